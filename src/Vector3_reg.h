@@ -50,6 +50,21 @@ public:
     typedef double elt_type;
 #endif
 
+    /*!
+     * \brief Result of coordinate-wise comparison of two vectors. Bit k is set if comparison holds for
+     * the k-th coordinate.
+     */
+    struct mask_type {
+        int value;
+
+        MUSTINLINE int bits() const { return value; }
+        MUSTINLINE bool any() const { return value != 0; }
+        MUSTINLINE bool all() const { return value == 7; }
+        MUSTINLINE mask_type operator& (const mask_type &other) const { return {value & other.value}; }
+        MUSTINLINE mask_type operator| (const mask_type &other) const { return {value | other.value}; }
+        MUSTINLINE mask_type operator~ () const { return {~value & 7}; }
+    };
+
     union
     {
         struct _ALIGN_SIZE { elt_type x, y, z; };
@@ -290,6 +305,27 @@ public:
         z = _z;
     }
 
+    /*!
+     * \brief Loads three packed coordinates from memory without alignment requirements. Exactly three
+     * values are read, so the pointer may point to the last element of a buffer.
+     * @param p Pointer to x, y and z coordinates
+     * @return Vector of \e this type
+     */
+    static MUSTINLINE vector3_reg load_packed(const elt_type *p) {
+        return {p[0], p[1], p[2]};
+    }
+
+    /*!
+     * \brief Stores three coordinates into memory without alignment requirements. Exactly three values
+     * are written.
+     * @param p Pointer to x, y and z coordinates
+     */
+    MUSTINLINE void store_packed(elt_type *p) const {
+        p[0] = x;
+        p[1] = y;
+        p[2] = z;
+    }
+
     /*!
      * \brief Cross product of two vectors
      * @param other Other vector
@@ -340,6 +376,94 @@ public:
         return v;
     }
 
+    /*!
+     * \brief Coordinate-wise comparison operators
+     * @param other Other vector
+     * @return Mask of coordinates for which the comparison holds
+     */
+    MUSTINLINE mask_type operator< (const vector3_reg &other) const {
+        return {(x < other.x) | ((y < other.y) << 1) | ((z < other.z) << 2)};
+    }
+    MUSTINLINE mask_type operator<= (const vector3_reg &other) const {
+        return {(x <= other.x) | ((y <= other.y) << 1) | ((z <= other.z) << 2)};
+    }
+    MUSTINLINE mask_type operator> (const vector3_reg &other) const {
+        return other < *this;
+    }
+    MUSTINLINE mask_type operator>= (const vector3_reg &other) const {
+        return other <= *this;
+    }
+    MUSTINLINE mask_type operator== (const vector3_reg &other) const {
+        return {(x == other.x) | ((y == other.y) << 1) | ((z == other.z) << 2)};
+    }
+    MUSTINLINE mask_type operator!= (const vector3_reg &other) const {
+        return ~(*this == other);
+    }
+
+    /*!
+     * \brief Coordinate-wise minimum of two vectors. As with the SSE/AVX instructions, \e other is returned where
+     * either coordinate is NaN or both are zeros.
+     * @param other Other vector
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3_reg min(const vector3_reg &other) const {
+        return {x < other.x ? x : other.x, y < other.y ? y : other.y, z < other.z ? z : other.z};
+    }
+
+    /*!
+     * \brief Coordinate-wise maximum of two vectors, returning \e other in the same cases as min()
+     * @param other Other vector
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3_reg max(const vector3_reg &other) const {
+        return {other.x < x ? x : other.x, other.y < y ? y : other.y, other.z < z ? z : other.z};
+    }
+
+    /*!
+     * \brief Absolute values of coordinates
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3_reg abs() const {
+        return {std::fabs(x), std::fabs(y), std::fabs(z)};
+    }
+
+    /*!
+     * \brief Coordinates rounded to the nearest integer
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3_reg round() const {
+        return {std::nearbyint(x), std::nearbyint(y), std::nearbyint(z)};
+    }
+
+    /*!
+     * \brief Coordinates rounded down
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3_reg floor() const {
+        return {std::floor(x), std::floor(y), std::floor(z)};
+    }
+
+    /*!
+     * \brief Clamps coordinates of \e this vector into the box [lo, hi]
+     * @param lo Lower bounds
+     * @param hi Upper bounds
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3_reg clamp(const vector3_reg &lo, const vector3_reg &hi) const {
+        return min(hi).max(lo);
+    }
+
+    /*!
+     * \brief Coordinate-wise selection
+     * @param m Mask
+     * @param a Vector used where mask is set
+     * @param b Vector used where mask is not set
+     * @return Result of \e this type
+     */
+    static MUSTINLINE vector3_reg select(const mask_type &m, const vector3_reg &a, const vector3_reg &b) {
+        return {(m.value & 1) ? a.x : b.x, (m.value & 2) ? a.y : b.y, (m.value & 4) ? a.z : b.z};
+    }
+
     /*!
      * \brief Prints coordinates of vector into the stream
      * @param os Reference to a stream
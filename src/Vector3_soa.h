@@ -0,0 +1,129 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTOR3SOA_H_
+#define VECTOR3SOA_H_
+
+#include <type_traits>
+#include <vector>
+#include "VectorsInternal.h"
+
+/*!
+ * \class vector3_soa
+ * \brief Non-owning view of an array of 3d vectors stored as structure of arrays, i.e. three separate arrays
+ * of x, y and z coordinates. Batch kernels operate on this layout since it maps directly onto SIMD registers.
+ * Use vector3_soa<const T> for read-only input arrays.
+ */
+template <typename T>
+struct vector3_soa {
+    typedef T elt_type;
+
+    T *x;           //!< Array of x coordinates
+    T *y;           //!< Array of y coordinates
+    T *z;           //!< Array of z coordinates
+    size_t size;    //!< Number of vectors
+
+    /*!
+     * \brief Default constructor. Creates an empty view.
+     */
+    MUSTINLINE vector3_soa() : x(0), y(0), z(0), size(0) { }
+
+    /*!
+     * \brief Constructor takes pointers to the coordinate arrays and their length
+     */
+    MUSTINLINE vector3_soa(T *_x, T *_y, T *_z, size_t _size) :
+        x(_x), y(_y), z(_z), size(_size) { }
+
+    /*!
+     * \brief Conversion from a mutable view to a read-only one
+     */
+    template <typename U, typename = typename std::enable_if<std::is_convertible<U *, T *>::value>::type>
+    MUSTINLINE vector3_soa(const vector3_soa<U> &other) :
+        x(other.x), y(other.y), z(other.z), size(other.size) { }
+
+    /*!
+     * \brief View of \e count vectors starting at \e offset
+     */
+    MUSTINLINE vector3_soa sub(size_t offset, size_t count) const {
+        return vector3_soa(x + offset, y + offset, z + offset, count);
+    }
+};
+
+/*!
+ * \brief Read-only view type used in signatures of batch kernels. Element type of a kernel is deduced from
+ * its mutable arguments only, so mutable views can be passed where read-only ones are expected.
+ */
+template <typename T>
+struct vector3_soa_in {
+    typedef vector3_soa<const T> type;
+};
+
+/*!
+ * \class vector3_soa_buffer
+ * \brief Owning storage for an array of 3d vectors in structure of arrays layout
+ */
+template <typename T>
+class vector3_soa_buffer {
+public:
+    typedef T elt_type;
+
+    std::vector<T> x;   //!< Array of x coordinates
+    std::vector<T> y;   //!< Array of y coordinates
+    std::vector<T> z;   //!< Array of z coordinates
+
+    /*!
+     * \brief Constructor allocates \e size zero-initialized vectors
+     */
+    explicit vector3_soa_buffer(size_t size = 0) : x(size), y(size), z(size) { }
+
+    /*!
+     * \brief Changes the number of stored vectors
+     */
+    void resize(size_t size) {
+        x.resize(size);
+        y.resize(size);
+        z.resize(size);
+    }
+
+    /*!
+     * \brief Number of stored vectors
+     */
+    MUSTINLINE size_t size() const { return x.size(); }
+
+    /*!
+     * \brief Mutable view of the whole buffer
+     */
+    MUSTINLINE vector3_soa<T> view() {
+        return vector3_soa<T>(x.data(), y.data(), z.data(), x.size());
+    }
+
+    /*!
+     * \brief Read-only view of the whole buffer
+     */
+    MUSTINLINE vector3_soa<const T> view() const {
+        return vector3_soa<const T>(x.data(), y.data(), z.data(), x.size());
+    }
+};
+
+#endif /* VECTOR3SOA_H_ */
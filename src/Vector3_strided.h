@@ -0,0 +1,199 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTOR3STRIDED_H_
+#define VECTOR3STRIDED_H_
+
+#include "VectorsInternal.h"
+#include "VectorsPack.h"
+#include "VectorsProfiler.h"
+#include "Vector3_soa.h"
+
+namespace vectors_internal {
+
+template <typename T>
+struct byte_type { typedef char type; };
+
+template <typename T>
+struct byte_type<const T> { typedef const char type; };
+
+} // namespace vectors_internal
+
+/*!
+ * \class vector3_strided
+ * \brief Non-owning view of 3d vectors stored in foreign memory: three consecutive coordinates per element
+ * and an arbitrary distance in bytes between elements (e.g. 12 bytes for packed float[3] triples or a vertex
+ * struct with further attributes). Elements are read directly into registers with load_packed() of the
+ * vector classes, so no intermediate copies are made. Use vector3_strided<const T> for read-only memory.
+ */
+template <typename T>
+class vector3_strided {
+public:
+    typedef T elt_type;
+
+    /*!
+     * \brief Constructor
+     * @param base Pointer to the x coordinate of the first element
+     * @param size Number of elements
+     * @param stride Distance between consecutive elements in bytes; packed triples by default
+     */
+    MUSTINLINE vector3_strided(T *base, size_t size, size_t stride = 3 * sizeof(T)) :
+        base(base), count(size), stride_bytes(stride) { }
+
+    /*!
+     * \brief Conversion from a mutable view to a read-only one
+     */
+    template <typename U, typename = typename std::enable_if<std::is_convertible<U *, T *>::value>::type>
+    MUSTINLINE vector3_strided(const vector3_strided<U> &other) :
+        base(other.data()), count(other.size()), stride_bytes(other.stride()) { }
+
+    MUSTINLINE T *data() const { return base; }
+    MUSTINLINE size_t size() const { return count; }
+    MUSTINLINE size_t stride() const { return stride_bytes; }
+
+    /*!
+     * \brief Pointer to coordinates of the i-th element
+     */
+    MUSTINLINE T *operator[] (size_t i) const {
+        typedef typename vectors_internal::byte_type<T>::type byte;
+        return reinterpret_cast<T *>(reinterpret_cast<byte *>(base) + i * stride_bytes);
+    }
+
+    /*!
+     * \brief Loads the i-th element into a vector class
+     */
+    template <typename V>
+    MUSTINLINE V load(size_t i) const {
+        return V::load_packed((*this)[i]);
+    }
+
+    /*!
+     * \brief Stores vector into the i-th element
+     */
+    template <typename V>
+    MUSTINLINE void store(size_t i, const V &v) const {
+        v.store_packed((*this)[i]);
+    }
+
+private:
+    T *base;                //!< Pointer to the first element
+    size_t count;           //!< Number of elements
+    size_t stride_bytes;    //!< Distance between elements in bytes
+};
+
+namespace vectors_internal {
+
+/*!
+ * \brief Reads \e W consecutive elements of a strided view into SoA registers
+ */
+template <typename P>
+struct strided_gather {
+    static MUSTINLINE void load(const vector3_strided<const typename P::elt_type> &src, size_t i,
+            typename P::reg *r) {
+        const typename P::elt_type *p = src[i];
+        r[0] = p[0];
+        r[1] = p[1];
+        r[2] = p[2];
+    }
+};
+
+#ifdef __AVX2__
+template <>
+struct strided_gather<simd_pack<float> > {
+    static MUSTINLINE void load(const vector3_strided<const float> &src, size_t i, __m256 *r) {
+        const int s = static_cast<int>(src.stride());
+        const __m256i offsets = _mm256_setr_epi32(0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s);
+        const __m256 all = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        const float *p = src[i];
+        r[0] = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), p, offsets, all, 1);
+        r[1] = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), p + 1, offsets, all, 1);
+        r[2] = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), p + 2, offsets, all, 1);
+    }
+};
+
+template <>
+struct strided_gather<simd_pack<double> > {
+    static MUSTINLINE void load(const vector3_strided<const double> &src, size_t i, __m256d *r) {
+        const int s = static_cast<int>(src.stride());
+        const __m128i offsets = _mm_setr_epi32(0, s, 2 * s, 3 * s);
+        const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        const double *p = src[i];
+        r[0] = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), p, offsets, all, 1);
+        r[1] = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), p + 1, offsets, all, 1);
+        r[2] = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), p + 2, offsets, all, 1);
+    }
+};
+#endif
+
+} // namespace vectors_internal
+
+/*!
+ * \brief Copies elements of a strided view into SoA arrays using hardware gathers
+ * @param view Source view, mutable or read-only
+ * @param dst Destination arrays, should have room for view.size() vectors
+ */
+template <typename T, typename U>
+void gather_soa(const vector3_strided<U> &view, vector3_soa<T> dst) {
+    VECTORS_PROFILE("gather_soa", view.size());
+    const vector3_strided<const T> src(view);
+    typedef vectors_internal::simd_pack<T> P;
+    const ptrdiff_t nregs = src.size() / P::width;
+
+    VECTORS_OMP(parallel for schedule(static) if(nregs > 4096))
+    for (ptrdiff_t r = 0; r < nregs; ++r) {
+        typename P::reg v[3];
+        vectors_internal::strided_gather<P>::load(src, r * P::width, v);
+        P::store(dst.x + r * P::width, v[0]);
+        P::store(dst.y + r * P::width, v[1]);
+        P::store(dst.z + r * P::width, v[2]);
+    }
+    for (size_t i = nregs * P::width; i < src.size(); ++i) {
+        const T *p = src[i];
+        dst.x[i] = p[0];
+        dst.y[i] = p[1];
+        dst.z[i] = p[2];
+    }
+}
+
+/*!
+ * \brief Copies SoA arrays into elements of a strided view. Other bytes of the destination elements
+ * (e.g. further vertex attributes) are left untouched.
+ * @param src Source arrays
+ * @param dst Destination view, should contain src.size vectors
+ */
+template <typename T>
+void scatter_soa(typename vector3_soa_in<T>::type src, const vector3_strided<T> &dst) {
+    VECTORS_PROFILE("scatter_soa", src.size);
+    const ptrdiff_t n = src.size;
+
+    VECTORS_OMP(parallel for schedule(static) if(n > 65536))
+    for (ptrdiff_t i = 0; i < n; ++i) {
+        T *p = dst[i];
+        p[0] = src.x[i];
+        p[1] = src.y[i];
+        p[2] = src.z[i];
+    }
+}
+
+#endif /* VECTOR3STRIDED_H_ */
@@ -32,11 +32,38 @@
  * \brief Optimized class of a 3d vector. Contains information of three coordinates (x, y, z) and main algebraic methods.
  * All coordinates are stored as double precision floating points. Class requires for AVX2 support. If machine has no AVX2
  * instructions a regular non-optimized class should be used.
+ *
+ * The fourth (padding) lane of the register is zero: constructors and loads clear it, scalar operands are
+ * broadcast with zero in that lane and divisors get 1 there, so operations stay in registers and horizontal
+ * operations may use the full register. The one exception is normalize() of a zero vector: it multiplies by
+ * an infinite reciprocal length and produces 0 * inf = NaN in every lane, the padding lane included. With
+ * VECTORS_DETERMINISTIC it divides instead, which gives NaN in the coordinates only.
  */
 class _MM_ALIGN32 vector3d_simd {
 public:
     typedef double elt_type;
 
+    /*!
+     * \brief Result of coordinate-wise comparison of two vectors. Lanes are all ones where comparison holds
+     * and zeros otherwise; the padding lane is ignored by bits(), any() and all().
+     */
+    struct mask_type {
+        __m256d mmvalue;
+
+        MUSTINLINE int bits() const { return _mm256_movemask_pd(mmvalue) & 7; }
+        MUSTINLINE bool any() const { return bits() != 0; }
+        MUSTINLINE bool all() const { return bits() == 7; }
+        MUSTINLINE mask_type operator& (const mask_type &other) const {
+            return {_mm256_and_pd(mmvalue, other.mmvalue)};
+        }
+        MUSTINLINE mask_type operator| (const mask_type &other) const {
+            return {_mm256_or_pd(mmvalue, other.mmvalue)};
+        }
+        MUSTINLINE mask_type operator~ () const {
+            return {_mm256_xor_pd(mmvalue, _mm256_castsi256_pd(_mm256_set1_epi64x(-1)))};
+        }
+    };
+
     /*!
      * Member variables
      */
@@ -48,6 +75,20 @@ public:
 private:
     uint8_t been_inserted;      //!< Used in comma initializer
 
+    /*!
+     * \brief Register with \e value in the coordinate lanes and zero in the padding lane
+     */
+    static MUSTINLINE __m256d splat(elt_type value) {
+        return _mm256_blend_pd(_mm256_set1_pd(value), _mm256_setzero_pd(), 8);
+    }
+
+    /*!
+     * \brief Copy of the register with 1 in the padding lane, so that division keeps the padding lane zero
+     */
+    static MUSTINLINE __m256d divisor(__m256d a) {
+        return _mm256_blend_pd(a, _mm256_set1_pd(1.0), 8);
+    }
+
 public:
 
     /*!
@@ -66,6 +107,11 @@ public:
      */
     MUSTINLINE vector3d_simd(__m256d other) : mmvalue(other), been_inserted(0) { }
 
+    /*!
+     * \brief Copy constructor
+     */
+    MUSTINLINE vector3d_simd(const vector3d_simd &other) : mmvalue(other.mmvalue), been_inserted(0) { }
+
     /*!
      * \brief Addition operator
      * @param other Other vector
@@ -99,12 +145,7 @@ public:
      * @return Result of \e this type
      */
     MUSTINLINE vector3d_simd operator/ (const vector3d_simd &other) const {
-        /*
-         * FIXME: optimize it! Be aware of division by 0 from the "dummy" variable of b vector!
-         */
-        __m256d r= other.mmvalue;
-        r[3] = 1.0;
-        return _mm256_div_pd(mmvalue, r);
+        return _mm256_div_pd(mmvalue, divisor(other.mmvalue));
     }
 
     /*!
@@ -143,12 +184,7 @@ public:
      * @return Result of \e this type
      */
     MUSTINLINE vector3d_simd& operator/= (const vector3d_simd &other) {
-        /*
-         * FIXME: optimize it! Be aware of division by 0 from the "dummy" variable of b vector!
-         */
-        __m256d r= other.mmvalue;
-        r[3] = 1.0;
-        mmvalue = _mm256_div_pd(mmvalue, r);
+        mmvalue = _mm256_div_pd(mmvalue, divisor(other.mmvalue));
         return *this;
     }
 
@@ -158,7 +194,7 @@ public:
      * @return Result of \e this type
      */
     MUSTINLINE vector3d_simd operator+ (elt_type value) const {
-        return _mm256_add_pd(mmvalue, _mm256_set_pd(0.0, value, value, value));
+        return _mm256_add_pd(mmvalue, splat(value));
     }
 
     /*!
@@ -167,7 +203,7 @@ public:
      * @return Result of \e this type
      */
     MUSTINLINE vector3d_simd operator- (elt_type value) const {
-        return _mm256_sub_pd(mmvalue, _mm256_set_pd(0.0, value, value, value));
+        return _mm256_sub_pd(mmvalue, splat(value));
     }
 
     /*!
@@ -176,7 +212,7 @@ public:
      * @return Result of \e this type
      */
     MUSTINLINE vector3d_simd operator* (elt_type value) const {
-        return _mm256_mul_pd(mmvalue, _mm256_set_pd(0.0, value, value, value));
+        return _mm256_mul_pd(mmvalue, splat(value));
     }
     friend MUSTINLINE vector3d_simd operator*(elt_type value, const vector3d_simd &rhs)  {
         return rhs * value;
@@ -188,7 +224,7 @@ public:
      * @return Result of \e this type
      */
     MUSTINLINE vector3d_simd operator/ (elt_type value) const {
-        return _mm256_div_pd(mmvalue, _mm256_set_pd(1.0, value, value, value));
+        return _mm256_div_pd(mmvalue, divisor(_mm256_set1_pd(value)));
     }
 
     /*!
@@ -198,7 +234,7 @@ public:
      * @return Reference to \e this vector
      */
     MUSTINLINE vector3d_simd& operator+= (elt_type value) {
-        mmvalue = _mm256_add_pd(mmvalue, _mm256_set_pd(0.0, value, value, value));
+        mmvalue = _mm256_add_pd(mmvalue, splat(value));
         return *this;
     }
 
@@ -209,7 +245,7 @@ public:
      * @return Reference to \e this vector
      */
     MUSTINLINE vector3d_simd& operator-= (elt_type value) {
-        mmvalue = _mm256_sub_pd(mmvalue, _mm256_set_pd(0.0, value, value, value));
+        mmvalue = _mm256_sub_pd(mmvalue, splat(value));
         return *this;
     }
 
@@ -220,7 +256,7 @@ public:
      * @return Reference to \e this vector
      */
     MUSTINLINE vector3d_simd& operator*= (elt_type value) {
-        mmvalue = _mm256_mul_pd(mmvalue, _mm256_set_pd(0.0, value, value, value));
+        mmvalue = _mm256_mul_pd(mmvalue, splat(value));
         return *this;
     }
 
@@ -231,7 +267,7 @@ public:
      * @return Reference to \e this vector
      */
     MUSTINLINE vector3d_simd& operator/= (elt_type value) {
-        mmvalue = _mm256_div_pd(mmvalue, _mm256_set_pd(1.0, value, value, value));
+        mmvalue = _mm256_div_pd(mmvalue, divisor(_mm256_set1_pd(value)));
         return *this;
     }
 
@@ -242,7 +278,7 @@ public:
      * @return Reference to \e this vector
      */
     MUSTINLINE vector3d_simd& operator= (elt_type value) {
-        mmvalue = _mm256_set_pd(0.0, value, value, value);
+        mmvalue = splat(value);
         return *this;
     }
 
@@ -268,6 +304,25 @@ public:
         mmvalue = _mm256_set_pd(0.0, z, y, x);
     }
 
+    /*!
+     * \brief Loads three packed coordinates from memory without alignment requirements. Exactly three
+     * values are read, so the pointer may point to the last element of a buffer.
+     * @param p Pointer to x, y and z coordinates
+     * @return Vector of \e this type
+     */
+    static MUSTINLINE vector3d_simd load_packed(const elt_type *p) {
+        return _mm256_maskload_pd(p, _mm256_setr_epi64x(-1, -1, -1, 0));
+    }
+
+    /*!
+     * \brief Stores three coordinates into memory without alignment requirements. Exactly three values
+     * are written.
+     * @param p Pointer to x, y and z coordinates
+     */
+    MUSTINLINE void store_packed(elt_type *p) const {
+        _mm256_maskstore_pd(p, _mm256_setr_epi64x(-1, -1, -1, 0), mmvalue);
+    }
+
     /*!
      * \brief Cross product of two vectors
      * @param other Other vector
@@ -290,10 +345,10 @@ public:
      * @return Result as a scalar
      */
     MUSTINLINE elt_type dot(const vector3d_simd &other) const {
-        __m256d r1 = _mm256_mul_pd(mmvalue, mmvalue);
-        __m256d r2 = _mm256_hadd_pd(r1, r1);
-        return _mm_cvtsd_f64(_mm_add_pd(_mm256_extractf128_pd(r2, 1),
-            _mm256_castpd256_pd128(r2)));
+        // (x + y) + z, as in scalar code
+        __m256d r = _mm256_mul_pd(mmvalue, other.mmvalue);
+        __m128d xy = _mm256_castpd256_pd128(r);
+        return _mm_cvtsd_f64(_mm_add_sd(_mm_add_sd(xy, _mm_unpackhi_pd(xy, xy)), _mm256_extractf128_pd(r, 1)));
     }
 
     /*!
@@ -301,10 +356,7 @@ public:
      * @return Result as a scalar
      */
     MUSTINLINE elt_type length() const {
-        __m256d r1 = _mm256_mul_pd(mmvalue, mmvalue);
-        __m256d r2 = _mm256_hadd_pd(r1, r1);
-        return _mm_cvtsd_f64(_mm_sqrt_pd(_mm_add_pd(_mm256_extractf128_pd(r2, 1),
-            _mm256_castpd256_pd128(r2))));
+        return _mm_cvtsd_f64(_mm_sqrt_pd(_mm_set_sd(dot(*this))));
     }
 
     /*!
@@ -316,12 +368,105 @@ public:
     }
 
     /*!
-     * \brief Normalization of \e this vector
+     * \brief Normalization of \e this vector. Coordinates are multiplied by the reciprocal length, or divided
+     * by the length if VECTORS_DETERMINISTIC is defined.
      * @return Vector scaled to unit length
      */
     MUSTINLINE vector3d_simd normalize() const {
+#ifdef VECTORS_DETERMINISTIC
+        const double l = length();
+        return _mm256_div_pd(mmvalue, divisor(_mm256_set1_pd(l)));
+#else
         __m256d r = _mm256_set1_pd(rlength());
         return _mm256_mul_pd(mmvalue, r);
+#endif
+    }
+
+    /*!
+     * \brief Coordinate-wise comparison operators
+     * @param other Other vector
+     * @return Mask of coordinates for which the comparison holds
+     */
+    MUSTINLINE mask_type operator< (const vector3d_simd &other) const {
+        return {_mm256_cmp_pd(mmvalue, other.mmvalue, _CMP_LT_OQ)};
+    }
+    MUSTINLINE mask_type operator<= (const vector3d_simd &other) const {
+        return {_mm256_cmp_pd(mmvalue, other.mmvalue, _CMP_LE_OQ)};
+    }
+    MUSTINLINE mask_type operator> (const vector3d_simd &other) const {
+        return {_mm256_cmp_pd(mmvalue, other.mmvalue, _CMP_GT_OQ)};
+    }
+    MUSTINLINE mask_type operator>= (const vector3d_simd &other) const {
+        return {_mm256_cmp_pd(mmvalue, other.mmvalue, _CMP_GE_OQ)};
+    }
+    MUSTINLINE mask_type operator== (const vector3d_simd &other) const {
+        return {_mm256_cmp_pd(mmvalue, other.mmvalue, _CMP_EQ_OQ)};
+    }
+    MUSTINLINE mask_type operator!= (const vector3d_simd &other) const {
+        return {_mm256_cmp_pd(mmvalue, other.mmvalue, _CMP_NEQ_UQ)};
+    }
+
+    /*!
+     * \brief Coordinate-wise minimum of two vectors
+     * @param other Other vector
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3d_simd min(const vector3d_simd &other) const {
+        return _mm256_min_pd(mmvalue, other.mmvalue);
+    }
+
+    /*!
+     * \brief Coordinate-wise maximum of two vectors
+     * @param other Other vector
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3d_simd max(const vector3d_simd &other) const {
+        return _mm256_max_pd(mmvalue, other.mmvalue);
+    }
+
+    /*!
+     * \brief Absolute values of coordinates
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3d_simd abs() const {
+        return _mm256_andnot_pd(_mm256_set1_pd(-0.0), mmvalue);
+    }
+
+    /*!
+     * \brief Coordinates rounded to the nearest integer
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3d_simd round() const {
+        return _mm256_round_pd(mmvalue, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    }
+
+    /*!
+     * \brief Coordinates rounded down
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3d_simd floor() const {
+        return _mm256_floor_pd(mmvalue);
+    }
+
+    /*!
+     * \brief Clamps coordinates of \e this vector into the box [lo, hi]
+     * @param lo Lower bounds
+     * @param hi Upper bounds
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3d_simd clamp(const vector3d_simd &lo, const vector3d_simd &hi) const {
+        return _mm256_max_pd(_mm256_min_pd(mmvalue, hi.mmvalue), lo.mmvalue);
+    }
+
+    /*!
+     * \brief Coordinate-wise selection
+     * @param m Mask
+     * @param a Vector used where mask is set
+     * @param b Vector used where mask is not set
+     * @return Result of \e this type
+     */
+    static MUSTINLINE vector3d_simd select(const mask_type &m, const vector3d_simd &a, const vector3d_simd &b) {
+        return _mm256_blendv_pd(b.mmvalue, a.mmvalue, m.mmvalue);
     }
 
     /*!
@@ -32,11 +32,38 @@
  * \brief Optimized class of a 3d vector. Contains information of three coordinates (x, y, z) and main algebraic methods.
  * All coordinates are stored as single precision floating points. Class asks for SSE4.2 support. If machine has no SSE4.2
  * instructions a regular non-optimized class should be used
+ *
+ * The fourth (padding) lane of the register is zero: constructors and loads clear it, scalar operands are
+ * broadcast with zero in that lane and divisors get 1 there, so operations stay in registers and horizontal
+ * operations may use the full register. The one exception is normalize() of a zero vector: it multiplies by
+ * an infinite reciprocal length and produces 0 * inf = NaN in every lane, the padding lane included. With
+ * VECTORS_DETERMINISTIC it divides instead, which gives NaN in the coordinates only.
  */
 class _MM_ALIGN16 vector3f_simd {
 public:
     typedef float elt_type;
 
+    /*!
+     * \brief Result of coordinate-wise comparison of two vectors. Lanes are all ones where comparison holds
+     * and zeros otherwise; the padding lane is ignored by bits(), any() and all().
+     */
+    struct mask_type {
+        __m128 mmvalue;
+
+        MUSTINLINE int bits() const { return _mm_movemask_ps(mmvalue) & 7; }
+        MUSTINLINE bool any() const { return bits() != 0; }
+        MUSTINLINE bool all() const { return bits() == 7; }
+        MUSTINLINE mask_type operator& (const mask_type &other) const {
+            return {_mm_and_ps(mmvalue, other.mmvalue)};
+        }
+        MUSTINLINE mask_type operator| (const mask_type &other) const {
+            return {_mm_or_ps(mmvalue, other.mmvalue)};
+        }
+        MUSTINLINE mask_type operator~ () const {
+            return {_mm_xor_ps(mmvalue, _mm_castsi128_ps(_mm_set1_epi32(-1)))};
+        }
+    };
+
     // Member variables
     union
     {
@@ -47,6 +74,24 @@ public:
 private:
     uint8_t been_inserted;      //!< Used in comma initializer
 
+    /*!
+     * \brief Register with \e value in the coordinate lanes and zero in the padding lane
+     */
+    static MUSTINLINE __m128 splat(elt_type value) {
+        return _mm_and_ps(_mm_set1_ps(value), _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0)));
+    }
+
+    /*!
+     * \brief Copy of the register with 1 in the padding lane, so that division keeps the padding lane zero
+     */
+    static MUSTINLINE __m128 divisor(__m128 a) {
+#ifdef __SSE4_1__
+        return _mm_blend_ps(a, _mm_set1_ps(1.0f), 8);
+#else
+        return _mm_or_ps(_mm_and_ps(a, _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0))), _mm_setr_ps(0, 0, 0, 1));
+#endif
+    }
+
 public:
     /*!
      * \brief Default constructor. All values will be assignet to zero.
@@ -64,6 +109,11 @@ public:
      */
     MUSTINLINE vector3f_simd(__m128 other) : mmvalue(other), been_inserted(0) { }
 
+    /*!
+     * \brief Copy constructor
+     */
+    MUSTINLINE vector3f_simd(const vector3f_simd &other) : mmvalue(other.mmvalue), been_inserted(0) { }
+
     /*!
      * \brief Addition operator
      * @param other Other vector
@@ -97,7 +147,7 @@ public:
      * @return Result of \e this type
      */
     MUSTINLINE vector3f_simd operator/(const vector3f_simd &other) const {
-        return _mm_div_ps(mmvalue, other.mmvalue);
+        return _mm_div_ps(mmvalue, divisor(other.mmvalue));
     }
 
     /*!
@@ -136,7 +186,7 @@ public:
      * @return Result of \e this type
      */
     MUSTINLINE vector3f_simd &operator/=(const vector3f_simd &other) {
-        mmvalue = _mm_div_ps(mmvalue, other.mmvalue);
+        mmvalue = _mm_div_ps(mmvalue, divisor(other.mmvalue));
         return *this;
     }
 
@@ -146,7 +196,7 @@ public:
      * @return Result of \e this type
      */
     MUSTINLINE vector3f_simd operator+(elt_type value) const {
-        return _mm_add_ps(mmvalue, _mm_set1_ps(value));
+        return _mm_add_ps(mmvalue, splat(value));
     }
 
     /*!
@@ -155,7 +205,7 @@ public:
      * @return Result of \e this type
      */
     MUSTINLINE vector3f_simd operator-(elt_type value) const {
-        return _mm_sub_ps(mmvalue, _mm_set1_ps(value));
+        return _mm_sub_ps(mmvalue, splat(value));
     }
 
     /*!
@@ -164,7 +214,7 @@ public:
      * @return Result of \e this type
      */
     MUSTINLINE vector3f_simd operator*(elt_type value) const {
-        return _mm_mul_ps(mmvalue, _mm_set1_ps(value));
+        return _mm_mul_ps(mmvalue, splat(value));
     }
     friend MUSTINLINE vector3f_simd operator*(elt_type value, const vector3f_simd &rhs)  {
         return rhs * value;
@@ -176,7 +226,7 @@ public:
      * @return Result of \e this type
      */
     MUSTINLINE vector3f_simd operator/(elt_type value) const {
-        return _mm_div_ps(mmvalue, _mm_set1_ps(value));
+        return _mm_div_ps(mmvalue, divisor(_mm_set1_ps(value)));
     }
 
     /*!
@@ -186,7 +236,7 @@ public:
      * @return Reference to \e this vector
      */
     MUSTINLINE vector3f_simd &operator+=(elt_type value) {
-        mmvalue = _mm_add_ps(mmvalue, _mm_set1_ps(value));
+        mmvalue = _mm_add_ps(mmvalue, splat(value));
         return *this;
     }
 
@@ -197,7 +247,7 @@ public:
      * @return Reference to \e this vector
      */
     MUSTINLINE vector3f_simd &operator-=(elt_type value) {
-        mmvalue = _mm_sub_ps(mmvalue, _mm_set1_ps(value));
+        mmvalue = _mm_sub_ps(mmvalue, splat(value));
         return *this;
     }
 
@@ -208,7 +258,7 @@ public:
      * @return Reference to \e this vector
      */
     MUSTINLINE vector3f_simd &operator*=(elt_type value) {
-        mmvalue = _mm_mul_ps(mmvalue, _mm_set1_ps(value));
+        mmvalue = _mm_mul_ps(mmvalue, splat(value));
         return *this;
     }
 
@@ -219,7 +269,7 @@ public:
      * @return Reference to \e this vector
      */
     MUSTINLINE vector3f_simd &operator/=(elt_type value) {
-        mmvalue = _mm_div_ps(mmvalue, _mm_set1_ps(value));
+        mmvalue = _mm_div_ps(mmvalue, divisor(_mm_set1_ps(value)));
         return *this;
     }
 
@@ -230,7 +280,7 @@ public:
      * @return Reference to \e this vector
      */
     MUSTINLINE vector3f_simd &operator=(elt_type value) {
-        mmvalue = _mm_set_ps(0, value, value, value);
+        mmvalue = splat(value);
         return *this;
     }
 
@@ -256,6 +306,36 @@ public:
         mmvalue = _mm_set_ps(0.0f, z, y, x);
     }
 
+    /*!
+     * \brief Loads three packed coordinates from memory without alignment requirements. Exactly three
+     * values are read, so the pointer may point to the last element of a buffer.
+     * @param p Pointer to x, y and z coordinates
+     * @return Vector of \e this type
+     */
+    static MUSTINLINE vector3f_simd load_packed(const elt_type *p) {
+#ifdef __AVX__
+        return _mm_maskload_ps(p, _mm_setr_epi32(-1, -1, -1, 0));
+#else
+        // The integer load goes through a may_alias type; a double load of float memory would break aliasing
+        return _mm_movelh_ps(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p))),
+            _mm_load_ss(p + 2));
+#endif
+    }
+
+    /*!
+     * \brief Stores three coordinates into memory without alignment requirements. Exactly three values
+     * are written.
+     * @param p Pointer to x, y and z coordinates
+     */
+    MUSTINLINE void store_packed(elt_type *p) const {
+#ifdef __AVX__
+        _mm_maskstore_ps(p, _mm_setr_epi32(-1, -1, -1, 0), mmvalue);
+#else
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(p), _mm_castps_si128(mmvalue));
+        _mm_store_ss(p + 2, _mm_movehl_ps(mmvalue, mmvalue));
+#endif
+    }
+
     /*!
      * \brief Cross product of two vectors
      * @param other Other vector
@@ -277,7 +357,13 @@ public:
      * @return Result as a scalar
      */
     MUSTINLINE elt_type dot(const vector3f_simd &other) const {
+#if defined(VECTORS_DETERMINISTIC) || !defined(__SSE4_1__)
+        // (x + y) + z, as in scalar code
+        const __m128 p = _mm_mul_ps(mmvalue, other.mmvalue);
+        return _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(p, _mm_shuffle_ps(p, p, 1)), _mm_movehl_ps(p, p)));
+#else
         return _mm_cvtss_f32(_mm_dp_ps(mmvalue, other.mmvalue, 0x71));
+#endif
     }
 
     /*!
@@ -285,23 +371,139 @@ public:
      * @return Result as a scalar
      */
     MUSTINLINE elt_type length() const {
-        return _mm_cvtss_f32(_mm_sqrt_ss(_mm_dp_ps(mmvalue, mmvalue, 0x71)));
+        return _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(dot(*this))));
     }
 
     /*!
-     * \brief Reciprocal length (absolute value) of \e this vector
+     * \brief Reciprocal length (absolute value) of \e this vector. Uses the hardware estimate unless
+     * VECTORS_DETERMINISTIC is defined.
      * @return Result as a scalar
      */
     MUSTINLINE elt_type rlength() const {
-        return _mm_cvtss_f32(_mm_rsqrt_ss(_mm_dp_ps(mmvalue, mmvalue, 0x71)));
+#ifdef VECTORS_DETERMINISTIC
+        return 1.f / length();
+#else
+        return _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(dot(*this))));
+#endif
     }
 
     /*!
-     * \brief Normalization of \e this vector
+     * \brief Normalization of \e this vector. Uses the hardware reciprocal square root estimate unless
+     * VECTORS_DETERMINISTIC is defined, in which case coordinates are divided by the length.
      * @return Vector scaled to unit length
      */
     MUSTINLINE vector3f_simd normalize() const {
-        return _mm_mul_ps(mmvalue, _mm_rsqrt_ps(_mm_dp_ps(mmvalue, mmvalue, 0x7F)));
+#ifdef VECTORS_DETERMINISTIC
+        const float l = length();
+        return _mm_div_ps(mmvalue, divisor(_mm_set1_ps(l)));
+#else
+        return _mm_mul_ps(mmvalue, _mm_rsqrt_ps(_mm_set1_ps(dot(*this))));
+#endif
+    }
+
+    /*!
+     * \brief Coordinate-wise comparison operators
+     * @param other Other vector
+     * @return Mask of coordinates for which the comparison holds
+     */
+    MUSTINLINE mask_type operator< (const vector3f_simd &other) const {
+        return {_mm_cmplt_ps(mmvalue, other.mmvalue)};
+    }
+    MUSTINLINE mask_type operator<= (const vector3f_simd &other) const {
+        return {_mm_cmple_ps(mmvalue, other.mmvalue)};
+    }
+    MUSTINLINE mask_type operator> (const vector3f_simd &other) const {
+        return {_mm_cmpgt_ps(mmvalue, other.mmvalue)};
+    }
+    MUSTINLINE mask_type operator>= (const vector3f_simd &other) const {
+        return {_mm_cmpge_ps(mmvalue, other.mmvalue)};
+    }
+    MUSTINLINE mask_type operator== (const vector3f_simd &other) const {
+        return {_mm_cmpeq_ps(mmvalue, other.mmvalue)};
+    }
+    MUSTINLINE mask_type operator!= (const vector3f_simd &other) const {
+        return {_mm_cmpneq_ps(mmvalue, other.mmvalue)};
+    }
+
+    /*!
+     * \brief Coordinate-wise minimum of two vectors
+     * @param other Other vector
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3f_simd min(const vector3f_simd &other) const {
+        return _mm_min_ps(mmvalue, other.mmvalue);
+    }
+
+    /*!
+     * \brief Coordinate-wise maximum of two vectors
+     * @param other Other vector
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3f_simd max(const vector3f_simd &other) const {
+        return _mm_max_ps(mmvalue, other.mmvalue);
+    }
+
+    /*!
+     * \brief Absolute values of coordinates
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3f_simd abs() const {
+        return _mm_andnot_ps(_mm_set1_ps(-0.0f), mmvalue);
+    }
+
+    /*!
+     * \brief Coordinates rounded to the nearest integer
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3f_simd round() const {
+#ifdef __SSE4_1__
+        return _mm_round_ps(mmvalue, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+#else
+        // Values of magnitude 2^23 and above are integers already and do not fit into int32; NaN compares
+        // unordered and passes through as well. The sign bit is restored so that -0.3 rounds to -0 as with SSE4.1.
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        const __m128 keep = _mm_cmpnlt_ps(_mm_andnot_ps(sign, mmvalue), _mm_set1_ps(8388608.0f));
+        const __m128 r = _mm_or_ps(_mm_cvtepi32_ps(_mm_cvtps_epi32(mmvalue)), _mm_and_ps(sign, mmvalue));
+        return _mm_or_ps(_mm_and_ps(keep, mmvalue), _mm_andnot_ps(keep, r));
+#endif
+    }
+
+    /*!
+     * \brief Coordinates rounded down
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3f_simd floor() const {
+#ifdef __SSE4_1__
+        return _mm_floor_ps(mmvalue);
+#else
+        const __m128 r = round().mmvalue;
+        return _mm_sub_ps(r, _mm_and_ps(_mm_cmpgt_ps(r, mmvalue), _mm_set1_ps(1.0f)));
+#endif
+    }
+
+    /*!
+     * \brief Clamps coordinates of \e this vector into the box [lo, hi]
+     * @param lo Lower bounds
+     * @param hi Upper bounds
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3f_simd clamp(const vector3f_simd &lo, const vector3f_simd &hi) const {
+        return _mm_max_ps(_mm_min_ps(mmvalue, hi.mmvalue), lo.mmvalue);
+    }
+
+    /*!
+     * \brief Coordinate-wise selection
+     * @param m Mask
+     * @param a Vector used where mask is set
+     * @param b Vector used where mask is not set
+     * @return Result of \e this type
+     */
+    static MUSTINLINE vector3f_simd select(const mask_type &m, const vector3f_simd &a, const vector3f_simd &b) {
+#ifdef __SSE4_1__
+        return _mm_blendv_ps(b.mmvalue, a.mmvalue, m.mmvalue);
+#else
+        return _mm_or_ps(_mm_and_ps(m.mmvalue, a.mmvalue), _mm_andnot_ps(m.mmvalue, b.mmvalue));
+#endif
     }
 
     /*!
@@ -0,0 +1,551 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTOR3I_H_
+#define VECTOR3I_H_
+
+#include <cstring>
+#include "VectorsInternal.h"
+#include "Vector3f_simd.h"
+#ifdef __AVX2__
+#include "Vector3d_simd.h"
+#endif
+
+/*!
+ * \class vector3i_simd
+ * \brief Optimized class of a 3d vector with integer coordinates, e.g. lattice points and voxel indices. All
+ * coordinates are stored as 32-bit signed integers and arithmetic wraps around on overflow. Class requires SSE4.1
+ * support. Coordinates can be kept in memory as packed int32_t or int16_t triples (load_packed() and
+ * store_packed()), the latter taking a quarter of the memory of vector3_reg.
+ *
+ * The fourth (padding) lane of the register is always zero, as in the floating point classes.
+ */
+class _MM_ALIGN16 vector3i_simd {
+public:
+    typedef int32_t elt_type;
+
+    /*!
+     * \brief Result of coordinate-wise comparison of two vectors. Lanes are all ones where comparison holds
+     * and zeros otherwise; the padding lane is ignored by bits(), any() and all().
+     */
+    struct mask_type {
+        __m128i mmvalue;
+
+        MUSTINLINE int bits() const { return _mm_movemask_ps(_mm_castsi128_ps(mmvalue)) & 7; }
+        MUSTINLINE bool any() const { return bits() != 0; }
+        MUSTINLINE bool all() const { return bits() == 7; }
+        MUSTINLINE mask_type operator& (const mask_type &other) const {
+            return {_mm_and_si128(mmvalue, other.mmvalue)};
+        }
+        MUSTINLINE mask_type operator| (const mask_type &other) const {
+            return {_mm_or_si128(mmvalue, other.mmvalue)};
+        }
+        MUSTINLINE mask_type operator~ () const {
+            return {_mm_xor_si128(mmvalue, _mm_set1_epi32(-1))};
+        }
+    };
+
+    // Member variables
+    union
+    {
+        struct _MM_ALIGN16 { elt_type x, y, z; };
+        __m128i mmvalue;
+    };
+
+private:
+    uint8_t been_inserted;      //!< Used in comma initializer
+
+    /*!
+     * \brief Register with \e value in the coordinate lanes and zero in the padding lane
+     */
+    static MUSTINLINE __m128i splat(elt_type value) {
+        return _mm_setr_epi32(value, value, value, 0);
+    }
+
+public:
+    /*!
+     * \brief Default constructor. All values will be assigned to zero.
+     */
+    MUSTINLINE vector3i_simd() : mmvalue(_mm_setzero_si128()), been_inserted(0) { }
+
+    /*!
+     * \brief Constructor takes three integer coordinates
+     */
+    MUSTINLINE vector3i_simd(elt_type x, elt_type y, elt_type z) :
+        mmvalue(_mm_setr_epi32(x, y, z, 0)), been_inserted(0) { }
+
+    /*!
+     * \brief Constructor copies data from another register
+     */
+    MUSTINLINE vector3i_simd(__m128i other) : mmvalue(other), been_inserted(0) { }
+
+    /*!
+     * \brief Copy constructor
+     */
+    MUSTINLINE vector3i_simd(const vector3i_simd &other) : mmvalue(other.mmvalue), been_inserted(0) { }
+
+    /*!
+     * \brief Lattice point containing the given point: coordinates rounded down. Coordinates outside of the
+     * int32_t range give INT32_MIN.
+     */
+    static MUSTINLINE vector3i_simd floor(const vector3f_simd &v) {
+        return _mm_cvttps_epi32(_mm_floor_ps(v.mmvalue));
+    }
+
+    /*!
+     * \brief Nearest lattice point: coordinates rounded to the nearest integer, ties to even
+     */
+    static MUSTINLINE vector3i_simd round(const vector3f_simd &v) {
+        return _mm_cvtps_epi32(v.mmvalue);
+    }
+
+    /*!
+     * \brief Conversion to single precision coordinates, exact for magnitudes up to 2^24
+     */
+    MUSTINLINE vector3f_simd to_float() const {
+        return _mm_cvtepi32_ps(mmvalue);
+    }
+
+#ifdef __AVX2__
+    /*!
+     * \brief Lattice point containing the given point: coordinates rounded down
+     */
+    static MUSTINLINE vector3i_simd floor(const vector3d_simd &v) {
+        return _mm256_cvttpd_epi32(_mm256_floor_pd(v.mmvalue));
+    }
+
+    /*!
+     * \brief Nearest lattice point: coordinates rounded to the nearest integer, ties to even
+     */
+    static MUSTINLINE vector3i_simd round(const vector3d_simd &v) {
+        return _mm256_cvtpd_epi32(v.mmvalue);
+    }
+
+    /*!
+     * \brief Conversion to double precision coordinates, always exact
+     */
+    MUSTINLINE vector3d_simd to_double() const {
+        return _mm256_cvtepi32_pd(mmvalue);
+    }
+#endif
+
+    /*!
+     * \brief Offset of the k-th point of the 3x3x3 neighbourhood of a lattice point, k in [0, 27); x varies
+     * fastest and k = 13 is the point itself
+     */
+    static MUSTINLINE vector3i_simd neighbor_offset(int k) {
+        return vector3i_simd(k % 3 - 1, k / 3 % 3 - 1, k / 9 - 1);
+    }
+
+    /*!
+     * \brief Addition operator
+     * @param other Other vector
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3i_simd operator+(const vector3i_simd &other) const {
+        return _mm_add_epi32(mmvalue, other.mmvalue);
+    }
+
+    /*!
+     * \brief Subtraction operator
+     * @param other Other vector
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3i_simd operator-(const vector3i_simd &other) const {
+        return _mm_sub_epi32(mmvalue, other.mmvalue);
+    }
+
+    /*!
+     * \brief Coordinate-wise multiplication operator
+     * @param other Other vector
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3i_simd operator*(const vector3i_simd &other) const {
+        return _mm_mullo_epi32(mmvalue, other.mmvalue);
+    }
+
+    /*!
+     * \brief Addition assignment operator
+     * @param other Other vector
+     * @return Reference to \e this vector
+     */
+    MUSTINLINE vector3i_simd &operator+=(const vector3i_simd &other) {
+        mmvalue = _mm_add_epi32(mmvalue, other.mmvalue);
+        return *this;
+    }
+
+    /*!
+     * \brief Subtraction assignment operator
+     * @param other Other vector
+     * @return Reference to \e this vector
+     */
+    MUSTINLINE vector3i_simd &operator-=(const vector3i_simd &other) {
+        mmvalue = _mm_sub_epi32(mmvalue, other.mmvalue);
+        return *this;
+    }
+
+    /*!
+     * \brief Coordinate-wise multiplication assignment operator
+     * @param other Other vector
+     * @return Reference to \e this vector
+     */
+    MUSTINLINE vector3i_simd &operator*=(const vector3i_simd &other) {
+        mmvalue = _mm_mullo_epi32(mmvalue, other.mmvalue);
+        return *this;
+    }
+
+    /*!
+     * \brief Addition of scalar value to all coordinates of \e this vector
+     * @param value value
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3i_simd operator+(elt_type value) const {
+        return _mm_add_epi32(mmvalue, splat(value));
+    }
+
+    /*!
+     * \brief Subtraction of scalar value from all coordinates of \e this vector
+     * @param value value
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3i_simd operator-(elt_type value) const {
+        return _mm_sub_epi32(mmvalue, splat(value));
+    }
+
+    /*!
+     * \brief Multiplication of all coordinates of \e this vector by scalar value
+     * @param value value
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3i_simd operator*(elt_type value) const {
+        return _mm_mullo_epi32(mmvalue, _mm_set1_epi32(value));
+    }
+    friend MUSTINLINE vector3i_simd operator*(elt_type value, const vector3i_simd &rhs)  {
+        return rhs * value;
+    }
+
+    /*!
+     * \brief Unary minus
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3i_simd operator-() const {
+        return _mm_sub_epi32(_mm_setzero_si128(), mmvalue);
+    }
+
+    /*!
+     * \brief Arithmetic shift of all coordinates to the left, i.e. multiplication by 2^bits
+     * @param bits Number of bits
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3i_simd shift_left(int bits) const {
+        return _mm_sll_epi32(mmvalue, _mm_cvtsi32_si128(bits));
+    }
+
+    /*!
+     * \brief Arithmetic shift of all coordinates to the right, i.e. division by 2^bits rounded down (index of
+     * the coarser lattice cell)
+     * @param bits Number of bits
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3i_simd shift_right(int bits) const {
+        return _mm_sra_epi32(mmvalue, _mm_cvtsi32_si128(bits));
+    }
+
+    /*!
+     * \brief Assignment operator for scalars
+     * Assigns given scalar to all coordinates
+     * @param value Scalar value
+     * @return Reference to \e this vector
+     */
+    MUSTINLINE vector3i_simd &operator=(elt_type value) {
+        mmvalue = splat(value);
+        return *this;
+    }
+
+    /*!
+     * \brief Assignment operator for vector
+     * @param other Other vector
+     * @return Reference to \e this vector
+     */
+    MUSTINLINE vector3i_simd &operator=(const vector3i_simd &other) {
+        mmvalue = other.mmvalue;
+        return *this;
+    }
+
+    /*!
+     * \brief Explicit set of three coordinates
+     * @param x Coordinate
+     * @param y Coordinate
+     * @param z Coordinate
+     */
+    MUSTINLINE void set(elt_type x, elt_type y, elt_type z) {
+        mmvalue = _mm_setr_epi32(x, y, z, 0);
+    }
+
+    /*!
+     * \brief Loads three packed coordinates from memory without alignment requirements. Exactly three
+     * values are read.
+     * @param p Pointer to x, y and z coordinates
+     * @return Vector of \e this type
+     */
+    static MUSTINLINE vector3i_simd load_packed(const int32_t *p) {
+#ifdef __AVX2__
+        return _mm_maskload_epi32(p, _mm_setr_epi32(-1, -1, -1, 0));
+#else
+        return _mm_insert_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)), p[2], 2);
+#endif
+    }
+
+    /*!
+     * \brief Loads three packed 16-bit coordinates from memory without alignment requirements. Exactly three
+     * values are read.
+     * @param p Pointer to x, y and z coordinates
+     * @return Vector of \e this type
+     */
+    static MUSTINLINE vector3i_simd load_packed(const int16_t *p) {
+        int32_t xy;
+        std::memcpy(&xy, p, sizeof(xy));
+        return _mm_cvtepi16_epi32(_mm_insert_epi16(_mm_cvtsi32_si128(xy), p[2], 2));
+    }
+
+    /*!
+     * \brief Stores three coordinates into memory without alignment requirements. Exactly three values
+     * are written.
+     * @param p Pointer to x, y and z coordinates
+     */
+    MUSTINLINE void store_packed(int32_t *p) const {
+#ifdef __AVX2__
+        _mm_maskstore_epi32(p, _mm_setr_epi32(-1, -1, -1, 0), mmvalue);
+#else
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(p), mmvalue);
+        p[2] = _mm_extract_epi32(mmvalue, 2);
+#endif
+    }
+
+    /*!
+     * \brief Stores three coordinates as 16-bit values into memory without alignment requirements. Coordinates
+     * outside of the int16_t range are saturated. Exactly three values are written.
+     * @param p Pointer to x, y and z coordinates
+     */
+    MUSTINLINE void store_packed(int16_t *p) const {
+        const __m128i packed = _mm_packs_epi32(mmvalue, mmvalue);
+        const int32_t xy = _mm_cvtsi128_si32(packed);
+        std::memcpy(p, &xy, sizeof(xy));
+        p[2] = static_cast<int16_t>(_mm_extract_epi16(packed, 2));
+    }
+
+    /*!
+     * \brief Cross product of two vectors
+     * @param other Other vector
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3i_simd cross(const vector3i_simd &other) const {
+        return _mm_sub_epi32(
+            _mm_mullo_epi32(_mm_shuffle_epi32(mmvalue, _MM_SHUFFLE(3, 0, 2, 1)),
+                _mm_shuffle_epi32(other.mmvalue, _MM_SHUFFLE(3, 1, 0, 2))),
+            _mm_mullo_epi32(_mm_shuffle_epi32(mmvalue, _MM_SHUFFLE(3, 1, 0, 2)),
+                _mm_shuffle_epi32(other.mmvalue, _MM_SHUFFLE(3, 0, 2, 1)))
+            );
+    }
+
+    /*!
+     * \brief Dot product of two vectors
+     * @param other Other vector
+     * @return Result as a scalar
+     */
+    MUSTINLINE elt_type dot(const vector3i_simd &other) const {
+        const __m128i p = _mm_mullo_epi32(mmvalue, other.mmvalue);
+        const __m128i s = _mm_add_epi32(p, _mm_shuffle_epi32(p, _MM_SHUFFLE(1, 0, 3, 2)));
+        return _mm_cvtsi128_si32(_mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1))));
+    }
+
+    /*!
+     * \brief Index of \e this point in a lattice of nx * ny * nz points stored with x varying fastest
+     * @param nx Number of points along x
+     * @param ny Number of points along y
+     * @return x + nx * (y + ny * z)
+     */
+    MUSTINLINE elt_type linear_index(elt_type nx, elt_type ny) const {
+        return dot(vector3i_simd(1, nx, nx * ny));
+    }
+
+    /*!
+     * \brief Hash of the coordinates for hash tables keyed by lattice points. Coordinates are multiplied by
+     * large primes and combined, then the bits are mixed so that low bits can index power of two tables.
+     * @return 32-bit hash value
+     */
+    MUSTINLINE uint32_t hash() const {
+        const __m128i p = _mm_mullo_epi32(mmvalue, _mm_setr_epi32(73856093, 19349663, 83492791, 0));
+        const __m128i s = _mm_xor_si128(p, _mm_shuffle_epi32(p, _MM_SHUFFLE(1, 0, 3, 2)));
+        uint32_t h = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_xor_si128(s, _mm_shuffle_epi32(s, 1))));
+        h ^= h >> 16;
+        h *= 0x85ebca6bu;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35u;
+        return h ^ (h >> 16);
+    }
+
+    /*!
+     * \brief Coordinate-wise comparison operators
+     * @param other Other vector
+     * @return Mask of coordinates for which the comparison holds
+     */
+    MUSTINLINE mask_type operator< (const vector3i_simd &other) const {
+        return {_mm_cmplt_epi32(mmvalue, other.mmvalue)};
+    }
+    MUSTINLINE mask_type operator<= (const vector3i_simd &other) const {
+        return ~(*this > other);
+    }
+    MUSTINLINE mask_type operator> (const vector3i_simd &other) const {
+        return {_mm_cmpgt_epi32(mmvalue, other.mmvalue)};
+    }
+    MUSTINLINE mask_type operator>= (const vector3i_simd &other) const {
+        return ~(*this < other);
+    }
+    MUSTINLINE mask_type operator== (const vector3i_simd &other) const {
+        return {_mm_cmpeq_epi32(mmvalue, other.mmvalue)};
+    }
+    MUSTINLINE mask_type operator!= (const vector3i_simd &other) const {
+        return ~(*this == other);
+    }
+
+    /*!
+     * \brief Coordinate-wise minimum of two vectors
+     * @param other Other vector
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3i_simd min(const vector3i_simd &other) const {
+        return _mm_min_epi32(mmvalue, other.mmvalue);
+    }
+
+    /*!
+     * \brief Coordinate-wise maximum of two vectors
+     * @param other Other vector
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3i_simd max(const vector3i_simd &other) const {
+        return _mm_max_epi32(mmvalue, other.mmvalue);
+    }
+
+    /*!
+     * \brief Absolute values of coordinates
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3i_simd abs() const {
+        return _mm_abs_epi32(mmvalue);
+    }
+
+    /*!
+     * \brief Clamps coordinates of \e this vector into the box [lo, hi]
+     * @param lo Lower bounds
+     * @param hi Upper bounds
+     * @return Result of \e this type
+     */
+    MUSTINLINE vector3i_simd clamp(const vector3i_simd &lo, const vector3i_simd &hi) const {
+        return _mm_max_epi32(_mm_min_epi32(mmvalue, hi.mmvalue), lo.mmvalue);
+    }
+
+    /*!
+     * \brief Coordinate-wise selection
+     * @param m Mask
+     * @param a Vector used where mask is set
+     * @param b Vector used where mask is not set
+     * @return Result of \e this type
+     */
+    static MUSTINLINE vector3i_simd select(const mask_type &m, const vector3i_simd &a, const vector3i_simd &b) {
+        return _mm_blendv_epi8(b.mmvalue, a.mmvalue, m.mmvalue);
+    }
+
+    /*!
+     * \brief Prints coordinates of vector into the stream
+     * @param os Reference to a stream
+     * @param v Vector to be printed
+     * @return Reference to the stream
+     */
+    friend MUSTINLINE std::ostream& operator<< (std::ostream& os, const vector3i_simd &v) {
+        os << v.x << ' ' << v.y << ' ' << v.z << ' ';
+        return os;
+    }
+
+    /*!
+     * \brief Set vector through the stream
+     * @param input Reference to a stream
+     * @param v Vector to be printed
+     * @return Reference to the stream
+     */
+    friend MUSTINLINE std::istream &operator>> (std::istream  &input, vector3i_simd &v) {
+        input >> v.x >> v.y >> v.z;
+        return input;
+    }
+
+    /*!
+     * \brief Allows to initialize vector in convenient way through operator<<
+     */
+    MUSTINLINE vector3i_simd& operator<< (const elt_type &value) {
+        x = value;
+        been_inserted = 1;
+        return *this;
+    }
+
+    /*!
+     * \brief Inserts \e value in the vector
+     * \warning There should be no more than 3 values passed into the vector using comma initializer. Otherwise
+     * an error will be printed out
+     */
+    MUSTINLINE vector3i_simd& operator, (const elt_type &value) {
+        if (been_inserted == 0) {
+            std::cerr << "Error! Bad use of comma initializer. Do not mess up the code! "
+                "Assign values to vector using operator<<..." << std::endl;
+            return *this;
+        }
+        if (been_inserted == 1) {
+            y = value;
+            ++been_inserted;
+        }
+        else if (been_inserted == 2) {
+            z = value;
+            ++been_inserted;
+        }
+        else
+            std::cerr << "Error! Too many arguments have been passed to comma initializer "
+                "(see operator<<, vector3i_simd)..." << std::endl;
+        return *this;
+    }
+};
+
+/*!
+ * \brief Hash functor for unordered containers keyed by lattice points
+ */
+struct vector3i_hash {
+    MUSTINLINE size_t operator() (const vector3i_simd &v) const { return v.hash(); }
+};
+
+/*!
+ * \brief Equality functor for unordered containers keyed by lattice points
+ */
+struct vector3i_equal {
+    MUSTINLINE bool operator() (const vector3i_simd &a, const vector3i_simd &b) const { return (a == b).all(); }
+};
+
+#endif /* VECTOR3I_H_ */
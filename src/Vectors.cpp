@@ -22,11 +22,3194 @@
  * SOFTWARE.                                                                      *
  * ****************************************************************************** */
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
 #include "Vectors.h"
 
 using namespace std;
 
+/*!
+ * \brief Linear congruential generator giving the same sequence on every platform
+ */
+struct test_random {
+    uint64_t state;
+
+    test_random() : state(42) { }
+
+    double next() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<double>(state >> 11) / 9007199254740992.0 * 2.0 - 1.0;
+    }
+};
+
+/*!
+ * \brief Set of points in SoA layout with coordinates in [-scale, scale)
+ */
+template <typename T>
+struct test_points {
+    vector<T> x, y, z;
+
+    test_points(size_t n, test_random &rnd, double scale = 1.0) : x(n), y(n), z(n) {
+        for (size_t i = 0; i < n; ++i) {
+            x[i] = static_cast<T>(scale * rnd.next());
+            y[i] = static_cast<T>(scale * rnd.next());
+            z[i] = static_cast<T>(scale * rnd.next());
+        }
+    }
+
+    vector3_soa<T> soa() { return vector3_soa<T>(&x[0], &y[0], &z[0], x.size()); }
+};
+
+/*
+ * Correctness checks of the vector classes. Every operation is compared with a long double reference computed
+ * from the same inputs. Errors are measured in machine epsilons of the element type relative to the magnitude
+ * of the operands, so that correctly rounded operations give at most 0.5. The padding lane of the SIMD classes
+ * has to stay zero after every operation. Failures are reported to std::cerr.
+ */
+
+#ifdef _MSC_VER
+#define TEST_NOINLINE __declspec(noinline)
+#else
+#define TEST_NOINLINE __attribute__((noinline))
+#endif
+
+/*!
+ * \brief Stores a vector over a coordinate written just before and reads the coordinate back. Kept out of line,
+ * where the compiler knows nothing about \e p, so packed accesses which break aliasing rules get reordered.
+ */
+template <typename V>
+TEST_NOINLINE typename V::elt_type store_over(typename V::elt_type *p, const V &v) {
+    p[0] = -5;
+    v.store_packed(p);
+    return p[0];
+}
+
+/*!
+ * \brief Loads a vector after writing \e value as its first coordinate and overwrites the coordinate afterwards
+ * @return First coordinate of the loaded vector
+ */
+template <typename V>
+TEST_NOINLINE typename V::elt_type load_overwritten(typename V::elt_type *p, typename V::elt_type value) {
+    p[0] = value;
+    const V v = V::load_packed(p);
+    p[0] = -9;
+    return v.x;
+}
+
+/*!
+ * \brief Value of the padding lane; classes without padding have none
+ */
+template <typename V>
+long double padding(const V &) {
+    return 0;
+}
+
+#ifdef __SSE3__
+inline long double padding(const vector3f_simd &v) {
+    return _mm_cvtss_f32(_mm_shuffle_ps(v.mmvalue, v.mmvalue, 3));
+}
+#endif
+
+#ifdef __AVX2__
+inline long double padding(const vector3d_simd &v) {
+    const __m128d hi = _mm256_extractf128_pd(v.mmvalue, 1);
+    return _mm_cvtsd_f64(_mm_unpackhi_pd(hi, hi));
+}
+#endif
+
+template <typename V>
+class vector_check {
+public:
+    typedef typename V::elt_type T;
+
+    /*!
+     * \brief Constructor
+     * @param name Name of the class used in reports
+     * @param approx_limit Allowed error of rlength() and normalize(), which may use hardware estimates
+     */
+    vector_check(const char *name, double approx_limit) : name(name), approx_limit(approx_limit), failures(0) { }
+
+    /*!
+     * \brief Checks all operations on random vectors and a few special cases
+     * @return Number of failed checks
+     */
+    int run() {
+        test_random rnd;
+        for (int i = 0; i < 2000; ++i) {
+            long double a[3], b[3];
+            for (int k = 0; k < 3; ++k) {
+                a[k] = static_cast<T>(4 * rnd.next());
+                // Divisors are kept away from zero
+                const double d = 1.5 + 0.5 * rnd.next();
+                b[k] = static_cast<T>(rnd.next() < 0 ? -d : d);
+            }
+            check(a, b, static_cast<T>(2 + rnd.next()));
+        }
+
+        // Rounding ties, negative values below one and values too large for 32-bit integers
+        const long double ties[3] = {0.5, -1.5, 2.5}, small[3] = {-0.25, 0.75, -0.0}, large[3] = {3e9, -1e10, 1e12};
+        const long double ones[3] = {1, -1, 1};
+        check(ties, ones, 2);
+        check(small, ones, 2);
+        check(large, ones, 2);
+
+        // NaN and infinities pass through rounding, and zero results keep the sign of the operand
+        const long double nan = std::numeric_limits<long double>::quiet_NaN();
+        const long double inf = std::numeric_limits<long double>::infinity();
+        const long double special[3][3] = {{nan, -0.3, inf}, {-0.0, -inf, -0.5}, {0.3, -0.7, 0.0}};
+        for (int i = 0; i < 3; ++i)
+            check_rounding(special[i]);
+        check_ordering();
+        check_boxes();
+        check_box_kernels();
+        return failures;
+    }
+
+private:
+    const char *name;
+    double approx_limit;
+    int failures;
+
+    void fail(const char *op, long double value, long double ref) {
+        if (++failures <= 20)
+            std::cerr << name << "::" << op << ": got " << value << ", expected " << ref << "\n";
+    }
+
+    /*!
+     * \brief Compares a scalar result with the reference
+     * @param scale Magnitude of the operands the error is measured against
+     * @param limit Allowed error in machine epsilons
+     */
+    void expect(const char *op, long double value, long double ref, long double scale, double limit) {
+        const long double eps = std::numeric_limits<T>::epsilon();
+        if (!(std::fabs(value - ref) <= limit * eps * scale))
+            fail(op, value, ref);
+    }
+
+    /*!
+     * \brief Compares coordinates of a vector result with the reference and checks the padding lane
+     */
+    void expect(const char *op, const V &v, const long double *ref, const long double *scale, double limit) {
+        expect(op, v.x, ref[0], scale[0], limit);
+        expect(op, v.y, ref[1], scale[1], limit);
+        expect(op, v.z, ref[2], scale[2], limit);
+        if (padding(v) != 0)
+            fail(op, padding(v), 0);
+    }
+
+    /*!
+     * \brief Correctly rounded coordinate-wise operation: error is measured relative to the result
+     */
+    void expect(const char *op, const V &v, const long double *ref) {
+        const long double scale[3] = {std::fabs(ref[0]), std::fabs(ref[1]), std::fabs(ref[2])};
+        expect(op, v, ref, scale, 0.5);
+    }
+
+    /*!
+     * \brief Whether a result equals the reference including the sign of zero; any NaN matches a NaN
+     */
+    static bool same_value(long double value, long double ref) {
+        return value != value ? ref != ref : value == ref && std::signbit(value) == std::signbit(ref);
+    }
+
+    /*!
+     * \brief Compares round() and floor() with the C library on operands the random checks do not reach
+     */
+    void check_rounding(const long double *a) {
+        const V va(a[0], a[1], a[2]), vr = va.round(), vf = va.floor();
+        const long double r[3] = {vr.x, vr.y, vr.z}, f[3] = {vf.x, vf.y, vf.z};
+        for (int k = 0; k < 3; ++k) {
+            if (!same_value(r[k], std::nearbyint(a[k])))
+                fail("round", r[k], std::nearbyint(a[k]));
+            if (!same_value(f[k], std::floor(a[k])))
+                fail("floor", f[k], std::floor(a[k]));
+        }
+        if (padding(vr) != 0 || padding(vf) != 0)
+            fail("round", padding(vr) + padding(vf), 0);
+    }
+
+    /*!
+     * \brief Compares coordinates of a vector result with the reference exactly, including the sign of zero
+     */
+    void expect_same(const char *op, const V &v, const long double *ref) {
+        const long double got[3] = {v.x, v.y, v.z};
+        for (int k = 0; k < 3; ++k)
+            if (!same_value(got[k], ref[k]))
+                fail(op, got[k], ref[k]);
+        if (padding(v) != 0)
+            fail(op, padding(v), 0);
+    }
+
+    /*!
+     * \brief min, max, clamp and select on NaN, signed zeros and infinities. As with the SSE/AVX instructions,
+     * min and max return the second operand unless the first one compares less or greater.
+     */
+    void check_ordering() {
+        const long double values[5] = {std::numeric_limits<long double>::quiet_NaN(), -0.0L, 0.0L, 1,
+            -std::numeric_limits<long double>::infinity()};
+        for (int i = 0; i < 5; ++i)
+            for (int j = 0; j < 5; ++j) {
+                const long double a[3] = {values[i], values[j], values[(i + j) % 5]};
+                const long double b[3] = {values[j], values[i], values[(i + 2 * j) % 5]};
+                const long double c[3] = {values[(i + 1) % 5], values[(j + 3) % 5], values[(2 * i + j) % 5]};
+                const V va(a[0], a[1], a[2]), vb(b[0], b[1], b[2]), vc(c[0], c[1], c[2]);
+                long double r[3];
+                for (int k = 0; k < 3; ++k) r[k] = a[k] < b[k] ? a[k] : b[k];
+                expect_same("min(special)", va.min(vb), r);
+                expect_same("select(special)", V::select(va < vb, va, vb), r);
+                for (int k = 0; k < 3; ++k) r[k] = b[k] < a[k] ? a[k] : b[k];
+                expect_same("max(special)", va.max(vb), r);
+                for (int k = 0; k < 3; ++k) {
+                    const long double m = a[k] < c[k] ? a[k] : c[k];
+                    r[k] = b[k] < m ? m : b[k];
+                }
+                expect_same("clamp(special)", va.clamp(vb, vc), r);
+            }
+    }
+
+    /*!
+     * \brief Compares corners of a box with the reference, including the padding lanes
+     */
+    void expect_box(const char *op, const aabb<V> &box, const long double *lo, const long double *hi) {
+        const long double got[6] = {box.lo.x, box.lo.y, box.lo.z, box.hi.x, box.hi.y, box.hi.z};
+        for (int k = 0; k < 3; ++k) {
+            if (!same_value(got[k], lo[k]))
+                fail(op, got[k], lo[k]);
+            if (!same_value(got[3 + k], hi[k]))
+                fail(op, got[3 + k], hi[k]);
+        }
+        if (padding(box.lo) != 0 || padding(box.hi) != 0)
+            fail(op, padding(box.lo) + padding(box.hi), 0);
+    }
+
+    /*!
+     * \brief Box methods on NaN coordinates and NaN slab distances, which have to agree on all backends
+     */
+    void check_boxes() {
+        const T inf = std::numeric_limits<T>::infinity(), nan = std::numeric_limits<T>::quiet_NaN();
+
+        // A ray along the x = 0 face gets 0 * inf = NaN in the x slab and enters through the z = 0 face
+        const aabb<V> unit(V(0, 0, 0), V(1, 1, 1));
+        T t = -1;
+        if (!unit.intersect_ray(V(0, T(0.5), -1), V(inf, inf, 1), 0, inf, t) || t != 1)
+            fail("aabb::intersect_ray", t, 1);
+
+        aabb<V> box;
+        box.expand(V(0, 0, 0)).expand(V(nan, 2, 2));
+        const long double lo[3] = {0, 0, 0}, hi[3] = {0, 2, 2};
+        expect_box("aabb::expand", box, lo, hi);
+        box.merge(aabb<V>(V(nan, -1, 0), V(nan, 1, 3)));
+        const long double merged_lo[3] = {0, -1, 0}, merged_hi[3] = {0, 2, 3};
+        expect_box("aabb::merge", box, merged_lo, merged_hi);
+    }
+
+    /*!
+     * \brief Box methods against intersect_ray_boxes() and build_aabbs() of the same element type, which
+     * evaluate the same slab test and bounds: results have to be identical, also on boxes with NaN corners
+     * and on rays along the faces of boxes, where the slab distances are 0 * inf = NaN
+     */
+    void check_box_kernels() {
+        const size_t n = 37;
+        const T inf = std::numeric_limits<T>::infinity(), nan = std::numeric_limits<T>::quiet_NaN();
+        test_random rnd;
+        test_points<T> lo(n, rnd), hi(n, rnd);
+        for (size_t i = 0; i < n; ++i) {
+            // Every third box has its lower y face on the plane y = 0 and every fourth its x face on x = 0.25
+            if (i % 3 == 0)
+                lo.y[i] = 0;
+            if (i % 4 == 0)
+                lo.x[i] = T(0.25);
+            hi.x[i] = lo.x[i] + std::fabs(hi.x[i]);
+            hi.y[i] = lo.y[i] + std::fabs(hi.y[i]);
+            hi.z[i] = lo.z[i] + std::fabs(hi.z[i]);
+        }
+        lo.x[5] = hi.z[11] = lo.y[18] = hi.y[18] = nan;
+
+        const T rays[4][6] = {{-2, 0, T(0.1), 1, 0, T(0.05)}, {T(0.25), -2, 0, 0, 1, 0},
+            {-2, -2, -2, 1, T(0.875), T(1.125)}, {T(0.25), 0, -2, 0, 0, 1}};
+        vector<T> t_entry(n);
+        for (int r = 0; r < 4; ++r) {
+            const T *o = rays[r], *d = rays[r] + 3;
+            const T tmin = T(0.125), tmax = 8;
+            intersect_ray_boxes<T>(o, d, tmin, tmax, lo.soa(), hi.soa(), &t_entry[0]);
+            const V origin(o[0], o[1], o[2]), inv_dir(T(1) / d[0], T(1) / d[1], T(1) / d[2]);
+            for (size_t i = 0; i < n; ++i) {
+                const aabb<V> box(V(lo.x[i], lo.y[i], lo.z[i]), V(hi.x[i], hi.y[i], hi.z[i]));
+                T t = -1;
+                const bool hit = box.intersect_ray(origin, inv_dir, tmin, tmax, t);
+                if (hit != (t_entry[i] != inf) || (hit && t != t_entry[i]))
+                    fail("aabb::intersect_ray(kernel)", hit ? t : inf, t_entry[i]);
+            }
+        }
+
+        const size_t offsets[2] = {0, n};
+        test_points<T> blo(1, rnd), bhi(1, rnd);
+        build_aabbs<T>(lo.soa(), offsets, 1, blo.soa(), bhi.soa());
+        aabb<V> box, merged;
+        for (size_t i = 0; i < n; ++i) {
+            box.expand(V(lo.x[i], lo.y[i], lo.z[i]));
+            merged.merge(aabb<V>(V(lo.x[i], lo.y[i], lo.z[i]), V(lo.x[i], lo.y[i], lo.z[i])));
+        }
+        const long double ref_lo[3] = {blo.x[0], blo.y[0], blo.z[0]}, ref_hi[3] = {bhi.x[0], bhi.y[0], bhi.z[0]};
+        expect_box("aabb::expand(kernel)", box, ref_lo, ref_hi);
+        expect_box("aabb::merge(kernel)", merged, ref_lo, ref_hi);
+    }
+
+    void check(const long double *a, const long double *b, T s) {
+        const V va(a[0], a[1], a[2]), vb(b[0], b[1], b[2]);
+        long double r[3], scale[3];
+        V v;
+
+        for (int k = 0; k < 3; ++k) r[k] = a[k] + b[k];
+        expect("operator+", va + vb, r);
+        v = va; v += vb;
+        expect("operator+=", v, r);
+        for (int k = 0; k < 3; ++k) r[k] = a[k] - b[k];
+        expect("operator-", va - vb, r);
+        v = va; v -= vb;
+        expect("operator-=", v, r);
+        for (int k = 0; k < 3; ++k) r[k] = a[k] * b[k];
+        expect("operator*", va * vb, r);
+        v = va; v *= vb;
+        expect("operator*=", v, r);
+        for (int k = 0; k < 3; ++k) r[k] = a[k] / b[k];
+        expect("operator/", va / vb, r);
+        v = va; v /= vb;
+        expect("operator/=", v, r);
+
+        for (int k = 0; k < 3; ++k) r[k] = a[k] + s;
+        expect("operator+(scalar)", va + s, r);
+        v = va; v += s;
+        expect("operator+=(scalar)", v, r);
+        for (int k = 0; k < 3; ++k) r[k] = a[k] - s;
+        expect("operator-(scalar)", va - s, r);
+        v = va; v -= s;
+        expect("operator-=(scalar)", v, r);
+        for (int k = 0; k < 3; ++k) r[k] = a[k] * s;
+        expect("operator*(scalar)", va * s, r);
+        expect("operator*(scalar, vector)", s * va, r);
+        v = va; v *= s;
+        expect("operator*=(scalar)", v, r);
+        for (int k = 0; k < 3; ++k) r[k] = a[k] / s;
+        expect("operator/(scalar)", va / s, r);
+        v = va; v /= s;
+        expect("operator/=(scalar)", v, r);
+        for (int k = 0; k < 3; ++k) r[k] = s;
+        v = s;
+        expect("operator=(scalar)", v, r);
+        v.set(a[0], a[1], a[2]);
+        expect("set", v, a);
+
+        T buffer[4] = {T(a[0]), T(a[1]), T(a[2]), T(-7)};
+        expect("load_packed", V::load_packed(buffer), a);
+        vb.store_packed(buffer);
+        expect("store_packed", V::load_packed(buffer), b);
+        const T stored = store_over(buffer, va), loaded = load_overwritten<V>(buffer, T(b[0]));
+        if (stored != T(a[0]))
+            fail("store_packed", stored, a[0]);
+        if (loaded != T(b[0]))
+            fail("load_packed", loaded, b[0]);
+        if (buffer[3] != T(-7))
+            fail("store_packed", buffer[3], -7);
+
+        // a_y b_z - a_z b_y etc.: two rounded products and a rounded difference
+        for (int k = 0; k < 3; ++k) {
+            const int i = (k + 1) % 3, j = (k + 2) % 3;
+            r[k] = a[i] * b[j] - a[j] * b[i];
+            scale[k] = std::fabs(a[i] * b[j]) + std::fabs(a[j] * b[i]);
+        }
+        expect("cross", va.cross(vb), r, scale, 2);
+
+        const long double dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+        const long double norm2 = a[0] * a[0] + a[1] * a[1] + a[2] * a[2];
+        const long double len = std::sqrt(norm2);
+        expect("dot", va.dot(vb), dot, std::fabs(a[0] * b[0]) + std::fabs(a[1] * b[1]) + std::fabs(a[2] * b[2]), 2);
+        expect("length", va.length(), len, len, 2);
+        if (norm2 > 0 && norm2 < 1e30) {
+            expect("rlength", va.rlength(), 1 / len, 1 / len, approx_limit);
+            const long double unit[3] = {1, 1, 1};
+            for (int k = 0; k < 3; ++k) r[k] = a[k] / len;
+            expect("normalize", va.normalize(), r, unit, approx_limit);
+        }
+
+        for (int k = 0; k < 3; ++k) r[k] = std::min(a[k], b[k]);
+        expect("min", va.min(vb), r);
+        expect("select", V::select(va < vb, va, vb), r);
+        for (int k = 0; k < 3; ++k) r[k] = std::max(a[k], b[k]);
+        expect("max", va.max(vb), r);
+        for (int k = 0; k < 3; ++k) r[k] = std::fabs(a[k]);
+        expect("abs", va.abs(), r);
+        for (int k = 0; k < 3; ++k) r[k] = std::nearbyint(a[k]);
+        expect("round", va.round(), r);
+        for (int k = 0; k < 3; ++k) r[k] = std::floor(a[k]);
+        expect("floor", va.floor(), r);
+        for (int k = 0; k < 3; ++k) r[k] = std::max(std::min(a[k], 1.0L), -1.0L);
+        expect("clamp", va.clamp(V(-1, -1, -1), V(1, 1, 1)), r);
+
+        int lt = 0, le = 0, gt = 0, ge = 0, eq = 0, ne = 0;
+        for (int k = 0; k < 3; ++k) {
+            lt |= (a[k] < b[k]) << k;
+            le |= (a[k] <= b[k]) << k;
+            gt |= (a[k] > b[k]) << k;
+            ge |= (a[k] >= b[k]) << k;
+            eq |= (a[k] == a[k]) << k;
+            ne |= (a[k] != b[k]) << k;
+        }
+        if ((va < vb).bits() != lt || (va <= vb).bits() != le || (va > vb).bits() != gt)
+            fail("comparison", (va < vb).bits(), lt);
+        if ((va >= vb).bits() != ge || (va == va).bits() != eq || (va != vb).bits() != ne)
+            fail("comparison", (va >= vb).bits(), ge);
+    }
+};
+
+#ifdef __SSE4_1__
+/*!
+ * \brief Exact checks of the integer vector class against scalar arithmetic
+ * @return Number of failed checks
+ */
+int check_vector3i() {
+    int failures = 0;
+    test_random rnd;
+    const auto expect = [&](const char *op, const vector3i_simd &v, int64_t x, int64_t y, int64_t z) {
+        if (v.x != x || v.y != y || v.z != z || _mm_extract_epi32(v.mmvalue, 3) != 0) {
+            if (++failures <= 20)
+                std::cerr << "vector3i_simd::" << op << ": got " << v << ", expected " << x << ' ' << y << ' ' << z
+                    << "\n";
+        }
+    };
+    for (int i = 0; i < 2000; ++i) {
+        int32_t a[3], b[3];
+        for (int k = 0; k < 3; ++k) {
+            a[k] = static_cast<int32_t>(std::floor(20000 * rnd.next()));
+            b[k] = static_cast<int32_t>(std::floor(20000 * rnd.next()));
+        }
+        const int32_t s = static_cast<int32_t>(std::floor(100 * rnd.next()));
+        const vector3i_simd va(a[0], a[1], a[2]), vb(b[0], b[1], b[2]);
+        expect("operator+", va + vb, a[0] + b[0], a[1] + b[1], a[2] + b[2]);
+        expect("operator-", va - vb, a[0] - b[0], a[1] - b[1], a[2] - b[2]);
+        expect("operator*", va * vb, a[0] * b[0], a[1] * b[1], a[2] * b[2]);
+        expect("operator*(scalar)", s * va, a[0] * s, a[1] * s, a[2] * s);
+        expect("operator-(scalar)", va - s, a[0] - s, a[1] - s, a[2] - s);
+        expect("unary minus", -va, -a[0], -a[1], -a[2]);
+        expect("shift_right", va.shift_right(3), a[0] >> 3, a[1] >> 3, a[2] >> 3);
+        expect("shift_left", va.shift_left(2), a[0] * 4, a[1] * 4, a[2] * 4);
+        expect("cross", va.cross(vb), a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]);
+        const int32_t dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+        if (va.dot(vb) != dot)
+            expect("dot", vector3i_simd(va.dot(vb), 0, 0), dot, 0, 0);
+        expect("min", va.min(vb), std::min(a[0], b[0]), std::min(a[1], b[1]), std::min(a[2], b[2]));
+        expect("select", vector3i_simd::select(va > vb, va, vb), std::max(a[0], b[0]), std::max(a[1], b[1]),
+            std::max(a[2], b[2]));
+        expect("abs", va.abs(), std::abs(a[0]), std::abs(a[1]), std::abs(a[2]));
+        expect("clamp", va.clamp(vector3i_simd(-5, -5, -5), vector3i_simd(5, 5, 5)), std::max(-5, std::min(a[0], 5)),
+            std::max(-5, std::min(a[1], 5)), std::max(-5, std::min(a[2], 5)));
+        if ((va <= vb).bits() != (~(va > vb)).bits() || (va == va).bits() != 7 || (va != va).any())
+            expect("comparison", vector3i_simd((va <= vb).bits(), 0, 0), (~(va > vb)).bits(), 0, 0);
+
+        int32_t packed[4] = {0, 0, 0, -7};
+        va.store_packed(packed);
+        expect("load_packed(int32_t)", vector3i_simd::load_packed(packed), a[0], a[1], a[2]);
+        int16_t compact[4] = {0, 0, 0, -7};
+        va.shift_left(1).store_packed(compact);      // saturates beyond 16 bits
+        const int32_t lo = -32768, hi = 32767;
+        expect("load_packed(int16_t)", vector3i_simd::load_packed(compact), std::max(lo, std::min(2 * a[0], hi)),
+            std::max(lo, std::min(2 * a[1], hi)), std::max(lo, std::min(2 * a[2], hi)));
+        if (packed[3] != -7 || compact[3] != -7)
+            expect("store_packed", vector3i_simd(packed[3], compact[3], 0), -7, -7, 0);
+
+        const vector3f_simd f(a[0] / 7.f, a[1] / 7.f, a[2] / 7.f);
+        expect("floor", vector3i_simd::floor(f), std::floor(f.x), std::floor(f.y), std::floor(f.z));
+        expect("round", vector3i_simd::round(f), std::nearbyint(f.x), std::nearbyint(f.y), std::nearbyint(f.z));
+        expect("to_float", vector3i_simd::round(va.to_float()), a[0], a[1], a[2]);
+#ifdef __AVX2__
+        const vector3d_simd d(a[0] / 7.0, a[1] / 7.0, a[2] / 7.0);
+        expect("floor(double)", vector3i_simd::floor(d), std::floor(d.x), std::floor(d.y), std::floor(d.z));
+        expect("to_double", vector3i_simd::floor(va.to_double()), a[0], a[1], a[2]);
+#endif
+        const int32_t index = a[0] + 7 * (a[1] + 5 * a[2]);
+        if (va.linear_index(7, 5) != index || va.hash() != vectors_internal::lattice_hash(a[0], a[1], a[2]))
+            expect("linear_index/hash", vector3i_simd(va.linear_index(7, 5), 0, 0), index, 0, 0);
+    }
+    return failures;
+}
+#endif
+
+/*!
+ * \brief Runs checks of all vector classes available for the instruction set
+ * @return Number of failed checks
+ */
+int check_vector_classes() {
+    // Hardware reciprocal square root estimates have relative error below 1.5 * 2^-12
+#ifdef VECTORS_DETERMINISTIC
+    const double approx_limit = 3;
+#else
+    const double approx_limit = 4096;
+#endif
+    int failures = vector_check<vector3_reg>("vector3_reg", 3).run();
+#ifdef __SSE3__
+    failures += vector_check<vector3f_simd>("vector3f_simd", approx_limit).run();
+#endif
+#ifdef __AVX2__
+    failures += vector_check<vector3d_simd>("vector3d_simd", 3).run();
+#endif
+#ifdef __SSE4_1__
+    failures += check_vector3i();
+#endif
+    (void)approx_limit;
+    return failures;
+}
+
+/*
+ * Checks of the batch kernels against long double references, with the same error measure as vector_check.
+ * Arrays have 1003 elements, which is not a multiple of any register width, so the tails are covered as well.
+ * Every kernel is run at unit scale and at tiny and huge coordinates; for double the squares of the latter lie
+ * outside of the range of float, so kernels may not route double arguments through single precision.
+ */
+
+/*!
+ * \brief Scales of test coordinates
+ */
+template <typename T>
+T test_scale(int k) {
+    const T tiny = T(sizeof(T) == 4 ? 1e-6 : 1e-25), huge = T(sizeof(T) == 4 ? 1e6 : 1e25);
+    return k == 0 ? T(1) : k == 1 ? tiny : huge;
+}
+
+enum { test_scales = 3 };
+
+/*!
+ * \brief Counts failed checks of one kernel and reports them
+ */
+struct batch_check {
+    const char *type;
+    int failures;
+
+    explicit batch_check(const char *type) : type(type), failures(0) { }
+
+    /*!
+     * \brief Records the result of a check
+     * @param kernel Name of the kernel
+     * @param scale Scale of the coordinates
+     * @param ok Result of the check
+     */
+    void expect(const char *kernel, double scale, bool ok) {
+        if (!ok && failures++ < 20)
+            std::cerr << kernel << "<" << type << "> failed at scale " << scale << "\n";
+    }
+};
+
+/*!
+ * \brief Element-wise kernels
+ */
+template <typename T>
+void check_elementwise(batch_check &check, T scale) {
+    typedef long double L;
+    const size_t n = 1003;
+    const L eps = std::numeric_limits<T>::epsilon();
+    test_random rnd;
+    test_points<T> a(n, rnd, 4.0 * scale), b(n, rnd, 4.0), c(n, rnd);
+    vector<T> s(n);
+    const T m[12] = {T(0.6), T(-0.8), T(0), T(1), T(0.8), T(0.6), T(0), T(-2), T(0), T(0), T(1), T(0.5)};
+
+    batch_dot<T>(a.soa(), b.soa(), &s[0]);
+    bool ok = true;
+    for (size_t i = 0; i < n; ++i) {
+        const L ref = L(a.x[i]) * b.x[i] + L(a.y[i]) * b.y[i] + L(a.z[i]) * b.z[i];
+        const L bound = std::fabs(L(a.x[i]) * b.x[i]) + std::fabs(L(a.y[i]) * b.y[i])
+            + std::fabs(L(a.z[i]) * b.z[i]);
+        ok &= std::fabs(s[i] - ref) <= 2 * eps * bound;
+    }
+    check.expect("batch_dot", scale, ok);
+
+    batch_length<T>(a.soa(), &s[0]);
+    ok = true;
+    for (size_t i = 0; i < n; ++i) {
+        const L len = std::sqrt(L(a.x[i]) * a.x[i] + L(a.y[i]) * a.y[i] + L(a.z[i]) * a.z[i]);
+        ok &= std::fabs(s[i] - len) <= 2 * eps * len;
+    }
+    check.expect("batch_length", scale, ok);
+
+    batch_cross<T>(a.soa(), b.soa(), c.soa());
+    ok = true;
+    for (size_t i = 0; i < n; ++i) {
+        const L ax[3] = {a.x[i], a.y[i], a.z[i]}, bx[3] = {b.x[i], b.y[i], b.z[i]};
+        const T got[3] = {c.x[i], c.y[i], c.z[i]};
+        for (int k = 0; k < 3; ++k) {
+            const int u = (k + 1) % 3, v = (k + 2) % 3;
+            const L ref = ax[u] * bx[v] - ax[v] * bx[u];
+            ok &= std::fabs(got[k] - ref) <= 2 * eps * (std::fabs(ax[u] * bx[v]) + std::fabs(ax[v] * bx[u]));
+        }
+    }
+    check.expect("batch_cross", scale, ok);
+
+    batch_normalize<T>(a.soa(), c.soa());
+    ok = true;
+    for (size_t i = 0; i < n; ++i) {
+        const L len = std::sqrt(L(a.x[i]) * a.x[i] + L(a.y[i]) * a.y[i] + L(a.z[i]) * a.z[i]);
+        ok &= std::fabs(c.x[i] - a.x[i] / len) <= 4 * eps;
+        ok &= std::fabs(c.y[i] - a.y[i] / len) <= 4 * eps;
+        ok &= std::fabs(c.z[i] - a.z[i] / len) <= 4 * eps;
+    }
+    check.expect("batch_normalize", scale, ok);
+
+    batch_transform<T>(a.soa(), m, c.soa());
+    ok = true;
+    for (size_t i = 0; i < n; ++i) {
+        const T *p[3] = {&c.x[i], &c.y[i], &c.z[i]};
+        for (int r = 0; r < 3; ++r) {
+            const L ref = m[4 * r] * L(a.x[i]) + m[4 * r + 1] * L(a.y[i])
+                + m[4 * r + 2] * L(a.z[i]) + m[4 * r + 3];
+            const L bound = std::fabs(m[4 * r] * L(a.x[i])) + std::fabs(m[4 * r + 1] * L(a.y[i]))
+                + std::fabs(m[4 * r + 2] * L(a.z[i])) + std::fabs(m[4 * r + 3]);
+            ok &= std::fabs(*p[r] - ref) <= 3 * eps * bound;
+        }
+    }
+    check.expect("batch_transform", scale, ok);
+}
+
+/*!
+ * \brief All-pairs and octree accelerations against a direct long double sum
+ */
+template <typename T>
+void check_nbody(batch_check &check, T scale) {
+    typedef long double L;
+    const size_t n = 203;
+    const L eps = std::numeric_limits<T>::epsilon();
+    test_random rnd;
+    test_points<T> p(n, rnd, scale), acc(n, rnd);
+    vector<T> w(n);
+    for (size_t i = 0; i < n; ++i)
+        w[i] = T(1 + 0.5 * rnd.next());
+    const T softening = T(0.01) * scale, coupling = T(0.5);
+    nbody_accelerations<T>(p.soa(), &w[0], acc.soa(), softening, coupling);
+    // With a zero opening angle no cell is approximated and the tree sums every pair
+    test_points<T> tree_acc(n, rnd);
+    nbody_octree<T> tree(4);
+    tree.build(p.soa(), &w[0]);
+    tree.accelerations(tree_acc.soa(), 0, softening, coupling);
+
+    bool ok = true, ok_tree = true;
+    for (size_t i = 0; i < n; ++i) {
+        L ref[3] = {0, 0, 0}, bound = 0;
+        for (size_t j = 0; j < n; ++j) {
+            const L d[3] = {L(p.x[j]) - p.x[i], L(p.y[j]) - p.y[i], L(p.z[j]) - p.z[i]};
+            const L r2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2] + L(softening) * softening;
+            const L f = coupling * w[j] / (r2 * std::sqrt(r2));
+            for (int k = 0; k < 3; ++k)
+                ref[k] += f * d[k];
+            bound += f * std::sqrt(r2);
+        }
+        ok &= std::fabs(acc.x[i] - ref[0]) <= 32 * eps * bound;
+        ok &= std::fabs(acc.y[i] - ref[1]) <= 32 * eps * bound;
+        ok &= std::fabs(acc.z[i] - ref[2]) <= 32 * eps * bound;
+        ok_tree &= std::fabs(tree_acc.x[i] - ref[0]) <= 32 * eps * bound;
+        ok_tree &= std::fabs(tree_acc.y[i] - ref[1]) <= 32 * eps * bound;
+        ok_tree &= std::fabs(tree_acc.z[i] - ref[2]) <= 32 * eps * bound;
+    }
+    check.expect("nbody_accelerations", scale, ok);
+    check.expect("nbody_octree::accelerations", scale, ok_tree);
+}
+
+/*!
+ * \brief Periodic kernels in a triclinic box against a search over neighbouring images
+ */
+template <typename T>
+void check_periodic(batch_check &check, T scale) {
+    typedef long double L;
+    const size_t n = 1003;
+    const L eps = std::numeric_limits<T>::epsilon();
+    test_random rnd;
+    test_points<T> a(n, rnd, 5 * scale), b(n, rnd, 5 * scale), c(n, rnd);
+    vector<T> s(n);
+    const T cell_a[3] = {T(1.2) * scale, 0, 0}, cell_b[3] = {T(-0.5) * scale, T(0.9) * scale, 0};
+    const T cell_c[3] = {T(0.4) * scale, T(0.45) * scale, T(0.7) * scale};
+    const periodic_box<T> box(cell_a, cell_b, cell_c);
+    const T *h = box.cell();
+
+    periodic_difference<T>(box, a.soa(), b.soa(), c.soa());
+    periodic_distance<T>(box, a.soa(), b.soa(), &s[0], true);
+    bool ok = true, ok_distance = true;
+    for (size_t i = 0; i < n; ++i) {
+        // Whole cell vectors are removed first, starting from c; the search covers the neighbouring images
+        L d[3] = {L(a.x[i]) - b.x[i], L(a.y[i]) - b.y[i], L(a.z[i]) - b.z[i]};
+        const L nz = std::nearbyint(d[2] / h[8]);
+        d[0] -= nz * h[6];
+        d[1] -= nz * h[7];
+        d[2] -= nz * h[8];
+        const L ny = std::nearbyint(d[1] / h[4]);
+        d[0] -= ny * h[3];
+        d[1] -= ny * h[4];
+        d[0] -= std::nearbyint(d[0] / h[0]) * h[0];
+        L best = std::numeric_limits<L>::max();
+        for (int u = -2; u <= 2; ++u)
+            for (int v = -2; v <= 2; ++v)
+                for (int w = -2; w <= 2; ++w) {
+                    const L x = d[0] + u * L(h[0]) + v * L(h[3]) + w * L(h[6]);
+                    const L y = d[1] + v * L(h[4]) + w * L(h[7]), z = d[2] + w * L(h[8]);
+                    best = std::min(best, x * x + y * y + z * z);
+                }
+        const L got = L(c.x[i]) * c.x[i] + L(c.y[i]) * c.y[i] + L(c.z[i]) * c.z[i];
+        const L bound = 64 * eps * scale * scale;
+        ok &= std::fabs(got - best) <= bound;
+        ok_distance &= std::fabs(s[i] - best) <= bound;
+    }
+    check.expect("periodic_difference", scale, ok);
+    check.expect("periodic_distance", scale, ok_distance);
+
+    periodic_wrap<T>(box, a.soa(), c.soa());
+    ok = true;
+    const T *u = box.reciprocal();
+    for (size_t i = 0; i < n; ++i) {
+        const L f[3] = {c.x[i] * L(u[0]) + c.y[i] * L(u[1]) + c.z[i] * L(u[2]), c.y[i] * L(u[4]) + c.z[i] * L(u[5]),
+            c.z[i] * L(u[8])};
+        const L g[3] = {a.x[i] * L(u[0]) + a.y[i] * L(u[1]) + a.z[i] * L(u[2]), a.y[i] * L(u[4]) + a.z[i] * L(u[5]),
+            a.z[i] * L(u[8])};
+        for (int k = 0; k < 3; ++k) {
+            const L shift = g[k] - f[k];
+            ok &= f[k] >= -16 * eps && f[k] <= 1 + 16 * eps && std::fabs(shift - std::nearbyint(shift)) <= 64 * eps;
+        }
+    }
+    check.expect("periodic_wrap", scale, ok);
+
+    // Coordinates just below a multiple of the box length, whose remainders round to the length or are tiny
+    // negative numbers, wrap into [0, L) exactly in orthorhombic boxes
+    const periodic_box<T> ortho(T(1.2) * scale, T(0.9) * scale, T(0.7) * scale);
+    const size_t ne = 11;
+    test_points<T> e(ne, rnd), we(ne, rnd);
+    const T len[3] = {ortho.cell()[0], ortho.cell()[4], ortho.cell()[8]};
+    for (size_t i = 0; i < ne; ++i) {
+        const T below = std::ldexp(T(1), -static_cast<int>(4 * i + 2)) * std::numeric_limits<T>::epsilon();
+        e.x[i] = -std::numeric_limits<T>::denorm_min() * T(i + 1);
+        e.y[i] = std::nextafter(T(3) * len[1], T(0)) - T(i) * below * len[1];
+        e.z[i] = -below * len[2];
+    }
+    periodic_wrap<T>(ortho, e.soa(), we.soa());
+    ok = true;
+    for (size_t i = 0; i < ne; ++i) {
+        const T got[3] = {we.x[i], we.y[i], we.z[i]};
+        // The vector class works in its own element type
+        typedef vector3_reg::elt_type E;
+        const vector3_reg r = ortho.wrap(vector3_reg(E(e.x[i]), E(e.y[i]), E(e.z[i])));
+        const E got_reg[3] = {r.x, r.y, r.z};
+        for (int k = 0; k < 3; ++k)
+            ok &= got[k] >= 0 && got[k] < len[k] && got_reg[k] >= 0 && got_reg[k] < E(len[k]);
+    }
+    check.expect("periodic_wrap(edges)", scale, ok);
+}
+
+/*!
+ * \brief Sum of weighted points and the magnitude of its terms
+ */
+template <typename T>
+void weighted_point(const test_points<T> &p, const size_t *idx, const long double *w, int count, long double *ref,
+        long double &bound) {
+    ref[0] = ref[1] = ref[2] = bound = 0;
+    for (int k = 0; k < count; ++k) {
+        const size_t j = idx[k];
+        ref[0] += w[k] * p.x[j];
+        ref[1] += w[k] * p.y[j];
+        ref[2] += w[k] * p.z[j];
+        bound += std::fabs(w[k]) * (std::fabs(p.x[j]) + std::fabs(p.y[j]) + std::fabs(p.z[j]));
+    }
+}
+
+/*!
+ * \brief Segment index and local parameter of a global spline parameter, clamped to the curve; NaN gives the start
+ */
+template <typename T>
+size_t spline_segment(T u, size_t nseg, long double &t) {
+    const long double c = u >= 0 ? std::min(static_cast<long double>(u), static_cast<long double>(nseg)) : 0;
+    const size_t s = std::min(static_cast<size_t>(c), nseg - 1);
+    t = c - s;
+    return s;
+}
+
+/*!
+ * \brief Interpolation and spline kernels against their defining formulas. Parameters extend past both ends
+ * of the curves to cover clamping, and one is NaN.
+ */
+template <typename T>
+void check_splines(batch_check &check, T scale) {
+    typedef long double L;
+    const size_t n = 1003, npoints = 16;
+    const L eps = std::numeric_limits<T>::epsilon();
+    test_random rnd;
+    test_points<T> a(n, rnd, 4 * scale), b(n, rnd, 4 * scale), c(n, rnd);
+    test_points<T> p(npoints, rnd, scale), m(npoints, rnd, scale);
+    vector<T> t(n), u(n);
+    for (size_t i = 0; i < n; ++i)
+        t[i] = static_cast<T>(0.5 + 0.75 * rnd.next());
+
+    batch_lerp<T>(a.soa(), b.soa(), &t[0], c.soa());
+    bool ok = true;
+    for (size_t i = 0; i < n; ++i) {
+        const T *pa[3] = {&a.x[i], &a.y[i], &a.z[i]}, *pb[3] = {&b.x[i], &b.y[i], &b.z[i]};
+        const T *pc[3] = {&c.x[i], &c.y[i], &c.z[i]};
+        for (int k = 0; k < 3; ++k) {
+            const L ref = *pa[k] + t[i] * (L(*pb[k]) - *pa[k]);
+            ok &= std::fabs(*pc[k] - ref) <= 4 * eps * (std::fabs(*pa[k]) + std::fabs(*pb[k]));
+        }
+    }
+    check.expect("batch_lerp", scale, ok);
+
+    // Slerp takes unit vectors; every tenth pair is exactly antiparallel and every tenth nearly parallel
+    if (scale == 1) {
+        for (size_t i = 0; i < n; ++i) {
+            const L la = std::sqrt(L(a.x[i]) * a.x[i] + L(a.y[i]) * a.y[i] + L(a.z[i]) * a.z[i]);
+            const L lb = std::sqrt(L(b.x[i]) * b.x[i] + L(b.y[i]) * b.y[i] + L(b.z[i]) * b.z[i]);
+            a.x[i] = T(a.x[i] / la), a.y[i] = T(a.y[i] / la), a.z[i] = T(a.z[i] / la);
+            b.x[i] = T(b.x[i] / lb), b.y[i] = T(b.y[i] / lb), b.z[i] = T(b.z[i] / lb);
+            if (i % 10 == 3)
+                b.x[i] = -a.x[i], b.y[i] = -a.y[i], b.z[i] = -a.z[i];
+            else if (i % 10 == 7)
+                b.x[i] = a.x[i], b.y[i] = a.y[i], b.z[i] = T(a.z[i] + 4 * eps);
+        }
+        batch_slerp<T>(a.soa(), b.soa(), &t[0], c.soa());
+        ok = true;
+        for (size_t i = 0; i < n; ++i) {
+            const L d = L(a.x[i]) * b.x[i] + L(a.y[i]) * b.y[i] + L(a.z[i]) * b.z[i];
+            const L cx = L(a.y[i]) * b.z[i] - L(a.z[i]) * b.y[i], cy = L(a.z[i]) * b.x[i] - L(a.x[i]) * b.z[i];
+            const L cz = L(a.x[i]) * b.y[i] - L(a.y[i]) * b.x[i], sn = std::sqrt(cx * cx + cy * cy + cz * cz);
+            const L angle = std::atan2(sn, d);
+            const L wa = sn > 0 ? std::sin((1 - t[i]) * angle) / sn : 1 - L(t[i]);
+            const L wb = sn > 0 ? std::sin(t[i] * angle) / sn : L(t[i]);
+            const L tol = 16 * eps * (std::fabs(wa) + std::fabs(wb));
+            ok &= std::fabs(c.x[i] - (wa * a.x[i] + wb * b.x[i])) <= tol;
+            ok &= std::fabs(c.y[i] - (wa * a.y[i] + wb * b.y[i])) <= tol;
+            ok &= std::fabs(c.z[i] - (wa * a.z[i] + wb * b.z[i])) <= tol;
+        }
+        check.expect("batch_slerp", scale, ok);
+    }
+
+    for (size_t i = 0; i < n; ++i)
+        u[i] = static_cast<T>(7.5 + 8.5 * rnd.next());
+    u[0] = 0;
+    u[1] = static_cast<T>(npoints - 1);
+    u[2] = 3;
+    u[3] = std::numeric_limits<T>::quiet_NaN();
+    spline_catmull_rom<T>(p.soa(), &u[0], n, c.soa());
+    test_points<T> bez(n, rnd), her(n, rnd);
+    vector<T> ub(n);
+    for (size_t i = 0; i < n; ++i)
+        ub[i] = static_cast<T>(u[i] / 3);
+    spline_bezier<T>(p.soa(), &ub[0], n, bez.soa());
+    spline_hermite<T>(p.soa(), m.soa(), &u[0], n, her.soa());
+    bool ok_bezier = true, ok_hermite = true;
+    ok = true;
+    for (size_t i = 0; i < n; ++i) {
+        L x, ref[3], bound;
+        size_t s = spline_segment(u[i], npoints - 1, x);
+        const size_t cr_idx[4] = {s > 0 ? s - 1 : 0, s, s + 1, std::min(s + 2, npoints - 1)};
+        const L cr_w[4] = {(-x * x * x + 2 * x * x - x) / 2, (3 * x * x * x - 5 * x * x + 2) / 2,
+            (-3 * x * x * x + 4 * x * x + x) / 2, (x * x * x - x * x) / 2};
+        weighted_point(p, cr_idx, cr_w, 4, ref, bound);
+        ok &= std::fabs(c.x[i] - ref[0]) <= 16 * eps * bound && std::fabs(c.y[i] - ref[1]) <= 16 * eps * bound
+            && std::fabs(c.z[i] - ref[2]) <= 16 * eps * bound;
+
+        // 16 points make five Bezier segments
+        s = spline_segment(ub[i], 5, x);
+        const size_t bez_idx[4] = {3 * s, 3 * s + 1, 3 * s + 2, 3 * s + 3};
+        const L bez_w[4] = {(1 - x) * (1 - x) * (1 - x), 3 * x * (1 - x) * (1 - x), 3 * x * x * (1 - x), x * x * x};
+        weighted_point(p, bez_idx, bez_w, 4, ref, bound);
+        ok_bezier &= std::fabs(bez.x[i] - ref[0]) <= 16 * eps * bound
+            && std::fabs(bez.y[i] - ref[1]) <= 16 * eps * bound && std::fabs(bez.z[i] - ref[2]) <= 16 * eps * bound;
+
+        s = spline_segment(u[i], npoints - 1, x);
+        const size_t her_idx[2] = {s, s + 1};
+        const L her_p[2] = {2 * x * x * x - 3 * x * x + 1, -2 * x * x * x + 3 * x * x};
+        const L her_m[2] = {x * x * x - 2 * x * x + x, x * x * x - x * x};
+        L ref_m[3], bound_m;
+        weighted_point(p, her_idx, her_p, 2, ref, bound);
+        weighted_point(m, her_idx, her_m, 2, ref_m, bound_m);
+        const L tol = 16 * eps * (bound + bound_m);
+        ok_hermite &= std::fabs(her.x[i] - ref[0] - ref_m[0]) <= tol
+            && std::fabs(her.y[i] - ref[1] - ref_m[1]) <= tol && std::fabs(her.z[i] - ref[2] - ref_m[2]) <= tol;
+    }
+    check.expect("spline_catmull_rom", scale, ok);
+    check.expect("spline_bezier", scale, ok_bezier);
+    check.expect("spline_hermite", scale, ok_hermite);
+
+    // Helix sampled at 101 parameters in [0.25, 2.25]; lengths are compared with the polyline through the samples
+    const size_t nsamples = 101;
+    const L u0 = 0.25, u1 = 2.25;
+    test_points<T> helix(nsamples, rnd);
+    for (size_t k = 0; k < nsamples; ++k) {
+        const L v = u0 + (u1 - u0) * k / (nsamples - 1);
+        helix.x[k] = T(scale * std::cos(3 * v));
+        helix.y[k] = T(scale * std::sin(3 * v));
+        helix.z[k] = T(scale * v / 2);
+    }
+    vector<L> cumulative(nsamples, 0);
+    for (size_t k = 1; k < nsamples; ++k) {
+        const L dx = L(helix.x[k]) - helix.x[k - 1], dy = L(helix.y[k]) - helix.y[k - 1];
+        const L dz = L(helix.z[k]) - helix.z[k - 1];
+        cumulative[k] = cumulative[k - 1] + std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+    const arc_length_table<T> table(helix.soa(), T(u0), T(u1));
+    const L total = cumulative.back();
+    // The table accumulates in double precision
+    const L sum_error = nsamples * std::numeric_limits<double>::epsilon();
+    ok = std::fabs(table.length() - total) <= (4 * eps + sum_error) * total;
+    for (size_t i = 0; i < n; ++i)
+        t[i] = static_cast<T>(total * (0.5 + 0.6 * rnd.next()));
+    table.parameters(&t[0], &u[0], n);
+    for (size_t i = 0; i < n; ++i) {
+        const L s = std::min(std::max(L(t[i]), 0.0L), total);
+        const size_t k = std::min<size_t>(std::upper_bound(cumulative.begin(), cumulative.end(), s)
+            - cumulative.begin() - 1, nsamples - 2);
+        const L ref = u0 + (u1 - u0) / (nsamples - 1) * (k + (s - cumulative[k]) / (cumulative[k + 1] - cumulative[k]));
+        ok &= std::fabs(u[i] - ref) <= (16 * eps + sum_error) * u1;
+    }
+    table.uniform_parameters(n, &u[0]);
+    ok &= u[0] == T(u0) && std::fabs(u[n - 1] - u1) <= 4 * eps * u1;
+    for (size_t i = 1; i < n; ++i)
+        ok &= u[i] >= u[i - 1];
+    check.expect("arc_length_table", scale, ok);
+}
+
+/*!
+ * \brief Vector field sampling against interpolation of the nodes in long double. Query points extend past the
+ * grid on every side to cover clamping, and some have a NaN coordinate, which maps to the first node of its axis.
+ */
+template <typename T>
+void check_field(batch_check &check, T scale) {
+    typedef long double L;
+    const size_t n = 1003, stride = 4;
+    const L eps = std::numeric_limits<T>::epsilon();
+    const size_t grids[2][3] = {{6, 5, 4}, {5, 1, 3}};
+    test_random rnd;
+    for (int g = 0; g < 2; ++g) {
+        const size_t *dims = grids[g], nodes = dims[0] * dims[1] * dims[2];
+        const T origin[3] = {T(-0.5) * scale, T(0.25) * scale, T(1) * scale};
+        const T spacing[3] = {T(0.5) * scale, T(0.75) * scale, T(0.3) * scale};
+        vector<T> data(stride * nodes);
+        L vmax = 0;
+        for (size_t i = 0; i < data.size(); ++i) {
+            data[i] = T(scale * rnd.next());
+            vmax = std::max(vmax, std::fabs(L(data[i])));
+        }
+        const vector_field_grid<T> field(&data[0], stride, dims, origin, spacing);
+
+        test_points<T> p(n, rnd), lin(n, rnd), cub(n, rnd);
+        T *coords[3] = {&p.x[0], &p.y[0], &p.z[0]};
+        for (size_t i = 0; i < n; ++i)
+            for (int d = 0; d < 3; ++d)
+                coords[d][i] = T(origin[d] + L(spacing[d]) * (dims[d] - 1) * (0.5 + 0.6 * rnd.next()));
+        for (size_t i = 0; i < n; i += 37)
+            coords[i % 3][i] = std::numeric_limits<T>::quiet_NaN();
+        sample_trilinear<T>(field, p.soa(), lin.soa());
+        sample_tricubic<T>(field, p.soa(), cub.soa());
+
+        bool ok_linear = true, ok_cubic = true;
+        for (size_t i = 0; i < n; ++i) {
+            // Cell, local coordinate, two linear and four cubic weights and their nodes along every axis
+            L wl[3][2], wc[3][4];
+            size_t nl[3][2], nc[3][4];
+            for (int d = 0; d < 3; ++d) {
+                const size_t last = dims[d] - 1;
+                const L q = (L(coords[d][i]) - origin[d]) / spacing[d];
+                const L c = q >= 0 ? std::min(q, L(last)) : 0;
+                const size_t cell = std::min(static_cast<size_t>(c), last > 0 ? last - 1 : 0);
+                const L t = c - cell;
+                wl[d][0] = 1 - t;
+                wl[d][1] = t;
+                wc[d][0] = (-t * t * t + 2 * t * t - t) / 2;
+                wc[d][1] = (3 * t * t * t - 5 * t * t + 2) / 2;
+                wc[d][2] = (-3 * t * t * t + 4 * t * t + t) / 2;
+                wc[d][3] = (t * t * t - t * t) / 2;
+                for (int k = 0; k < 2; ++k)
+                    nl[d][k] = std::min(cell + k, last);
+                for (int k = 0; k < 4; ++k)
+                    nc[d][k] = std::min(cell + k > 0 ? cell + k - 1 : 0, last);
+            }
+            L ref_linear[3] = {0, 0, 0}, ref_cubic[3] = {0, 0, 0};
+            for (int c = 0; c < 64; ++c) {
+                const int a = c & 3, b = (c >> 2) & 3, e = c >> 4;
+                const size_t node = nc[0][a] + dims[0] * (nc[1][b] + dims[1] * nc[2][e]);
+                const L w = wc[0][a] * wc[1][b] * wc[2][e];
+                for (int d = 0; d < 3; ++d)
+                    ref_cubic[d] += w * data[stride * node + d];
+                if (a < 2 && b < 2 && e < 2) {
+                    const size_t lnode = nl[0][a] + dims[0] * (nl[1][b] + dims[1] * nl[2][e]);
+                    const L lw = wl[0][a] * wl[1][b] * wl[2][e];
+                    for (int d = 0; d < 3; ++d)
+                        ref_linear[d] += lw * data[stride * lnode + d];
+                }
+            }
+            // The grid coordinates are rounded, and the interpolants change by at most a few vmax per cell
+            const L tol = 64 * eps * vmax;
+            ok_linear &= std::fabs(lin.x[i] - ref_linear[0]) <= tol && std::fabs(lin.y[i] - ref_linear[1]) <= tol
+                && std::fabs(lin.z[i] - ref_linear[2]) <= tol;
+            ok_cubic &= std::fabs(cub.x[i] - ref_cubic[0]) <= tol && std::fabs(cub.y[i] - ref_cubic[1]) <= tol
+                && std::fabs(cub.z[i] - ref_cubic[2]) <= tol;
+        }
+        check.expect("sample_trilinear", scale, ok_linear);
+        check.expect("sample_tricubic", scale, ok_cubic);
+    }
+
+    // Brick order on a grid of 3 x 2 x 3 bricks; points lie inside cells, away from brick boundaries
+    const size_t dims[3] = {20, 9, 17};
+    const T origin[3] = {T(-0.5) * scale, T(0.25) * scale, T(1) * scale};
+    const T spacing[3] = {T(0.5) * scale, T(0.75) * scale, T(0.3) * scale};
+    vector<T> data(3 * dims[0] * dims[1] * dims[2]);
+    const vector_field_grid<T> field(&data[0], 3, dims, origin, spacing);
+    test_points<T> p(n, rnd);
+    T *coords[3] = {&p.x[0], &p.y[0], &p.z[0]};
+    vector<uint32_t> brick(n), order(n);
+    for (size_t i = 0; i < n; ++i) {
+        size_t c[3];
+        for (int d = 0; d < 3; ++d) {
+            c[d] = static_cast<size_t>((dims[d] - 1) * (0.5 + 0.5 * rnd.next())) % (dims[d] - 1);
+            coords[d][i] = T(origin[d] + L(spacing[d]) * (c[d] + 0.5 + 0.25 * rnd.next()));
+        }
+        // Morton code of the brick
+        for (int b = 0; b < 3; ++b)
+            for (int d = 0; d < 3; ++d)
+                brick[i] |= ((c[d] / 8) >> b & 1) << (3 * b + d);
+    }
+    field_brick_order<T>(field, p.soa(), &order[0]);
+    vector<bool> seen(n, false);
+    bool ok_order = true;
+    for (size_t k = 0; k < n && ok_order; ++k) {
+        ok_order = order[k] < n && !seen[order[k]];
+        if (ok_order && k > 0) {
+            const uint32_t a = brick[order[k - 1]], b = brick[order[k]];
+            ok_order = a < b || (a == b && order[k - 1] < order[k]);
+        }
+        if (ok_order)
+            seen[order[k]] = true;
+    }
+    check.expect("field_brick_order", scale, ok_order);
+}
+
+/*!
+ * \brief Coordinates of point \e i as long doubles
+ */
+template <typename T>
+void test_point(const test_points<T> &p, size_t i, long double *v) {
+    v[0] = p.x[i];
+    v[1] = p.y[i];
+    v[2] = p.z[i];
+}
+
+/*!
+ * \brief Whether point \e i is within \e tol of \e ref in every coordinate
+ */
+template <typename T>
+bool near_point(const test_points<T> &p, size_t i, const long double *ref, long double tol) {
+    return std::fabs(p.x[i] - ref[0]) <= tol && std::fabs(p.y[i] - ref[1]) <= tol && std::fabs(p.z[i] - ref[2]) <= tol;
+}
+
+/*!
+ * \brief Accelerations of a harmonic oscillator, a = -x
+ */
+template <typename T>
+struct test_harmonic {
+    void operator()(vector3_soa<const T> pos, vector3_soa<T> acc) const {
+        for (size_t i = 0; i < pos.size; ++i) {
+            acc.x[i] = -pos.x[i];
+            acc.y[i] = -pos.y[i];
+            acc.z[i] = -pos.z[i];
+        }
+    }
+};
+
+/*!
+ * \brief Integrators against the update formulas; the complete steps integrate a harmonic oscillator
+ */
+template <typename T>
+void check_integrators(batch_check &check, T scale) {
+    typedef long double L;
+    const size_t n = 1003;
+    const L eps = std::numeric_limits<T>::epsilon();
+    const T dt = T(0.01);
+    test_random rnd;
+    test_points<T> x0(n, rnd, scale), v0(n, rnd, scale), a0(n, rnd, scale);
+    test_points<T> x = x0, v = v0, a = a0;
+
+    // Every coordinate of the results is bounded by the magnitudes of position, velocity and acceleration
+    velocity_verlet_kick_drift<T>(x.soa(), v.soa(), a0.soa(), dt);
+    bool ok = true;
+    for (size_t i = 0; i < n; ++i) {
+        L p[3], w[3], f[3], rv[3], rx[3];
+        test_point(x0, i, p);
+        test_point(v0, i, w);
+        test_point(a0, i, f);
+        for (int k = 0; k < 3; ++k) {
+            rv[k] = w[k] + L(0.5) * dt * f[k];
+            rx[k] = p[k] + dt * rv[k];
+        }
+        ok &= near_point(v, i, rv, 4 * eps * scale) && near_point(x, i, rx, 4 * eps * scale);
+    }
+    check.expect("velocity_verlet_kick_drift", scale, ok);
+
+    v = v0;
+    velocity_verlet_kick<T>(v.soa(), a0.soa(), dt);
+    ok = true;
+    for (size_t i = 0; i < n; ++i) {
+        L w[3], f[3];
+        test_point(v0, i, w);
+        test_point(a0, i, f);
+        for (int k = 0; k < 3; ++k)
+            w[k] += L(0.5) * dt * f[k];
+        ok &= near_point(v, i, w, 4 * eps * scale);
+    }
+    check.expect("velocity_verlet_kick", scale, ok);
+
+    x = x0;
+    v = v0;
+    leapfrog_step<T>(x.soa(), v.soa(), a0.soa(), dt);
+    ok = true;
+    for (size_t i = 0; i < n; ++i) {
+        L p[3], w[3], f[3];
+        test_point(x0, i, p);
+        test_point(v0, i, w);
+        test_point(a0, i, f);
+        for (int k = 0; k < 3; ++k) {
+            w[k] += dt * f[k];
+            p[k] += dt * w[k];
+        }
+        ok &= near_point(v, i, w, 4 * eps * scale) && near_point(x, i, p, 4 * eps * scale);
+    }
+    check.expect("leapfrog_step", scale, ok);
+
+    x = x0;
+    v = v0;
+    for (size_t i = 0; i < n; ++i) {
+        a.x[i] = -x0.x[i];
+        a.y[i] = -x0.y[i];
+        a.z[i] = -x0.z[i];
+    }
+    velocity_verlet_step<T>(x.soa(), v.soa(), a.soa(), dt, test_harmonic<T>());
+    ok = true;
+    for (size_t i = 0; i < n; ++i) {
+        L p[3], w[3];
+        test_point(x0, i, p);
+        test_point(v0, i, w);
+        for (int k = 0; k < 3; ++k) {
+            w[k] -= L(0.5) * dt * p[k];
+            p[k] += dt * w[k];
+            w[k] -= L(0.5) * dt * p[k];
+        }
+        ok &= near_point(v, i, w, 8 * eps * scale) && near_point(x, i, p, 8 * eps * scale);
+    }
+    check.expect("velocity_verlet_step", scale, ok);
+
+    x = x0;
+    v = v0;
+    rk4_integrator<T> rk4;
+    rk4.step(x.soa(), v.soa(), dt, test_harmonic<T>());
+    ok = true;
+    for (size_t i = 0; i < n; ++i) {
+        L p[3], w[3];
+        test_point(x0, i, p);
+        test_point(v0, i, w);
+        for (int k = 0; k < 3; ++k) {
+            const L k1x = w[k], k1v = -p[k];
+            const L k2x = w[k] + dt / 2 * k1v, k2v = -(p[k] + dt / 2 * k1x);
+            const L k3x = w[k] + dt / 2 * k2v, k3v = -(p[k] + dt / 2 * k2x);
+            const L k4x = w[k] + dt * k3v, k4v = -(p[k] + dt * k3x);
+            p[k] += dt / 6 * (k1x + 2 * k2x + 2 * k3x + k4x);
+            w[k] += dt / 6 * (k1v + 2 * k2v + 2 * k3v + k4v);
+        }
+        ok &= near_point(v, i, w, 8 * eps * scale) && near_point(x, i, p, 8 * eps * scale);
+    }
+    check.expect("rk4_integrator", scale, ok);
+}
+
+/*!
+ * \brief Filters against their predicates evaluated in long double. Points whose predicate value is within the
+ * rounding error of zero may go either way; the kept ones must be copied exactly and in order.
+ */
+template <typename T>
+void check_filters(batch_check &check, T scale) {
+    typedef long double L;
+    const size_t n = 1003;
+    const L eps = std::numeric_limits<T>::epsilon();
+    test_random rnd;
+    test_points<T> a(n, rnd, scale), c(n, rnd);
+    vector<uint32_t> index(n);
+    const T center[3] = {T(0.1) * scale, T(-0.2) * scale, T(0.05) * scale}, radius = T(0.8) * scale;
+
+    size_t kept = filter_sphere<T>(a.soa(), center[0], center[1], center[2], radius, c.soa(), &index[0]);
+    bool ok = kept > 0 && kept < n;
+    size_t k = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const L dx = L(a.x[i]) - center[0], dy = L(a.y[i]) - center[1], dz = L(a.z[i]) - center[2];
+        const L d2 = dx * dx + dy * dy + dz * dz, r2 = L(radius) * radius, tol = 8 * eps * (d2 + r2);
+        const bool in = k < kept && index[k] == i;
+        if (in) {
+            ok &= c.x[k] == a.x[i] && c.y[k] == a.y[i] && c.z[k] == a.z[i] && d2 <= r2 + tol;
+            ++k;
+        } else {
+            ok &= d2 >= r2 - tol;
+        }
+    }
+    ok &= k == kept;
+    check.expect("filter_sphere", scale, ok);
+
+    // Five planes of a box-like frustum
+    const T planes[20] = {1, 0, 0, T(0.6) * scale, -1, 0, 0, T(0.7) * scale, 0, T(0.6), T(0.8), T(0.5) * scale,
+        0, T(-0.8), T(0.6), T(0.4) * scale, T(0.48), T(0.6), T(-0.64), T(0.9) * scale};
+    kept = filter_halfspaces<T>(a.soa(), planes, 5, c.soa(), &index[0]);
+    ok = kept > 0 && kept < n;
+    k = 0;
+    for (size_t i = 0; i < n; ++i) {
+        bool inside = true, outside = false;
+        for (int p = 0; p < 5; ++p) {
+            const T *pl = planes + 4 * p;
+            const L d = pl[0] * L(a.x[i]) + pl[1] * L(a.y[i]) + pl[2] * L(a.z[i]) + pl[3];
+            const L tol = 4 * eps * (std::fabs(pl[0] * a.x[i]) + std::fabs(pl[1] * a.y[i])
+                + std::fabs(pl[2] * a.z[i]) + std::fabs(pl[3]));
+            inside &= d >= -tol;
+            outside |= d < tol;
+        }
+        const bool in = k < kept && index[k] == i;
+        if (in) {
+            ok &= c.x[k] == a.x[i] && c.y[k] == a.y[i] && c.z[k] == a.z[i] && inside;
+            ++k;
+        } else {
+            ok &= outside;
+        }
+    }
+    ok &= k == kept;
+    check.expect("filter_halfspaces", scale, ok);
+}
+
+/*!
+ * \brief Box kernels against brute force. Overlaps and bounds are exact; ray entry distances are compared with
+ * the slab test in long double, where rays grazing a box within the rounding error may go either way.
+ */
+template <typename T>
+void check_aabbs(batch_check &check, T scale) {
+    typedef long double L;
+    const size_t n = 1003;
+    const L eps = std::numeric_limits<T>::epsilon();
+    const T inf = std::numeric_limits<T>::infinity();
+    test_random rnd;
+    test_points<T> lo(n, rnd, scale), hi(n, rnd, scale);
+    for (size_t i = 0; i < n; ++i) {
+        hi.x[i] = T(lo.x[i] + std::fabs(hi.x[i]) / 4);
+        hi.y[i] = T(lo.y[i] + std::fabs(hi.y[i]) / 4);
+        hi.z[i] = T(lo.z[i] + std::fabs(hi.z[i]) / 4);
+    }
+    vector<T> t_entry(n);
+
+    // Rays from outside towards centers of some boxes; boxes behind t = 2 lie beyond tmax
+    bool ok = true;
+    for (size_t r = 0; r < 4; ++r) {
+        const size_t target = 97 * r + 5;
+        const T origin[3] = {T(-1.5) * scale, T(1.25) * scale, T(-1.375) * scale};
+        const T dir[3] = {T((lo.x[target] + hi.x[target]) / 2 - origin[0]),
+            T((lo.y[target] + hi.y[target]) / 2 - origin[1]), T((lo.z[target] + hi.z[target]) / 2 - origin[2])};
+        const T tmin = T(0.25), tmax = 2;
+        const size_t hits = intersect_ray_boxes<T>(origin, dir, tmin, tmax, lo.soa(), hi.soa(), &t_entry[0]);
+        size_t count = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const T *l[3] = {&lo.x[i], &lo.y[i], &lo.z[i]}, *h[3] = {&hi.x[i], &hi.y[i], &hi.z[i]};
+            L tn = tmin, tf = tmax, bound = tmax;
+            for (int d = 0; d < 3; ++d) {
+                const L t1 = (*l[d] - L(origin[d])) / dir[d], t2 = (*h[d] - L(origin[d])) / dir[d];
+                tn = std::max(tn, std::min(t1, t2));
+                tf = std::min(tf, std::max(t1, t2));
+                bound = std::max(bound, std::max(std::fabs(t1), std::fabs(t2)));
+            }
+            const L tol = 8 * eps * bound;
+            count += t_entry[i] != inf;
+            if (t_entry[i] != inf)
+                ok &= tn <= tf + tol && std::fabs(t_entry[i] - tn) <= tol;
+            else
+                ok &= tn >= tf - tol;
+        }
+        ok &= hits == count && t_entry[target] != inf && hits < n;
+    }
+    check.expect("intersect_ray_boxes", scale, ok);
+
+    const T qlo[3] = {T(-0.3) * scale, T(-0.2) * scale, T(-0.4) * scale};
+    const T qhi[3] = {T(0.2) * scale, T(0.35) * scale, T(0.1) * scale};
+    vector<uint32_t> index(n);
+    const size_t count = overlap_boxes<T>(qlo, qhi, lo.soa(), hi.soa(), &index[0]);
+    vector<uint32_t> ref;
+    for (size_t i = 0; i < n; ++i)
+        if (lo.x[i] <= qhi[0] && qlo[0] <= hi.x[i] && lo.y[i] <= qhi[1] && qlo[1] <= hi.y[i]
+                && lo.z[i] <= qhi[2] && qlo[2] <= hi.z[i])
+            ref.push_back(static_cast<uint32_t>(i));
+    check.expect("overlap_boxes", scale, count == ref.size() && std::equal(ref.begin(), ref.end(), index.begin()));
+
+    // Ranges of various lengths, one of them empty
+    const size_t offsets[8] = {0, 0, 1, 8, 9, 40, 203, n};
+    test_points<T> blo(7, rnd), bhi(7, rnd);
+    build_aabbs<T>(lo.soa(), offsets, 7, blo.soa(), bhi.soa());
+    ok = true;
+    for (size_t r = 0; r < 7; ++r) {
+        T rlo[3] = {inf, inf, inf}, rhi[3] = {-inf, -inf, -inf};
+        for (size_t i = offsets[r]; i < offsets[r + 1]; ++i) {
+            const T p[3] = {lo.x[i], lo.y[i], lo.z[i]};
+            for (int d = 0; d < 3; ++d) {
+                rlo[d] = std::min(rlo[d], p[d]);
+                rhi[d] = std::max(rhi[d], p[d]);
+            }
+        }
+        ok &= blo.x[r] == rlo[0] && blo.y[r] == rlo[1] && blo.z[r] == rlo[2];
+        ok &= bhi.x[r] == rhi[0] && bhi.y[r] == rhi[1] && bhi.z[r] == rhi[2];
+    }
+    check.expect("build_aabbs", scale, ok);
+
+    // NaN coordinates are skipped and keep the earlier points of their lane, here lane 0 in the vector body
+    // and the last point in the scalar tail
+    const size_t nn = 35, noffsets[2] = {0, nn};
+    test_points<T> q(nn, rnd), nlo(1, rnd), nhi(1, rnd);
+    for (size_t i = 0; i < nn; ++i) {
+        q.x[i] = scale;
+        q.y[i] = q.z[i] = 0;
+    }
+    q.x[0] = -100 * scale;
+    q.x[8] = q.y[9] = q.z[nn - 1] = std::numeric_limits<T>::quiet_NaN();
+    build_aabbs<T>(q.soa(), noffsets, 1, nlo.soa(), nhi.soa());
+    check.expect("build_aabbs(NaN)", scale, nlo.x[0] == -100 * scale && nhi.x[0] == scale && nlo.y[0] == 0
+        && nhi.y[0] == 0 && nlo.z[0] == 0 && nhi.z[0] == 0);
+
+    // A ray parallel to the x slabs and starting on the plane of the lower one gives 0 * inf = NaN there; it
+    // enters the boxes where it crosses the y slab, in the vector body and in the scalar tail alike
+    test_points<T> ulo(nn, rnd), uhi(nn, rnd);
+    for (size_t i = 0; i < nn; ++i) {
+        ulo.x[i] = ulo.y[i] = ulo.z[i] = 0;
+        uhi.x[i] = uhi.y[i] = uhi.z[i] = scale;
+    }
+    const T uorigin[3] = {0, -scale, T(0.5) * scale}, udir[3] = {0, 1, 0};
+    const size_t uhits = intersect_ray_boxes<T>(uorigin, udir, 0, inf, ulo.soa(), uhi.soa(), &t_entry[0]);
+    ok = uhits == nn;
+    for (size_t i = 0; i < nn; ++i)
+        ok &= t_entry[i] == scale;
+    check.expect("intersect_ray_boxes(NaN)", scale, ok);
+}
+
+/*!
+ * \brief Layout conversions, which have to copy every coordinate exactly. Strided views use a vertex-like record
+ * with further attributes, which scatter_soa() must not touch; the out-of-place transposes also run once above
+ * the streaming threshold from a misaligned destination.
+ */
+template <typename T>
+void check_layout(batch_check &check, T scale) {
+    const size_t n = 1003, record = 5;
+    test_random rnd;
+    test_points<T> a(n, rnd, scale), c(n, rnd);
+
+    vector<T> vertices(record * n);
+    for (size_t i = 0; i < vertices.size(); ++i)
+        vertices[i] = static_cast<T>(scale * rnd.next());
+    const vector<T> original = vertices;
+    const vector3_strided<T> view(&vertices[1], n, record * sizeof(T));
+    gather_soa(view, c.soa());
+    bool ok = true;
+    for (size_t i = 0; i < n; ++i)
+        ok &= c.x[i] == vertices[record * i + 1] && c.y[i] == vertices[record * i + 2]
+            && c.z[i] == vertices[record * i + 3];
+    check.expect("gather_soa", scale, ok);
+
+    scatter_soa<T>(a.soa(), view);
+    ok = true;
+    for (size_t i = 0; i < n; ++i) {
+        const T *v = &vertices[record * i];
+        ok &= v[0] == original[record * i] && v[1] == a.x[i] && v[2] == a.y[i] && v[3] == a.z[i]
+            && v[4] == original[record * i + 4];
+    }
+    check.expect("scatter_soa", scale, ok);
+
+    const size_t sizes[2] = {n, VECTORS_STREAM_BYTES / (3 * sizeof(T)) + 11};
+    for (int s = 0; s < (scale == 1 ? 2 : 1); ++s) {
+        const size_t m = sizes[s];
+        test_points<T> p(m, rnd, scale), q(m + 1, rnd);
+        vector<T> aos(3 * m + 1);
+        soa_to_aos<T>(p.soa(), &aos[1]);
+        ok = true;
+        for (size_t i = 0; i < m; ++i)
+            ok &= aos[3 * i + 1] == p.x[i] && aos[3 * i + 2] == p.y[i] && aos[3 * i + 3] == p.z[i];
+        check.expect("soa_to_aos", scale, ok);
+
+        aos_to_soa<T>(&aos[1], vector3_soa<T>(&q.x[1], &q.y[1], &q.z[1], m));
+        ok = true;
+        for (size_t i = 0; i < m; ++i)
+            ok &= q.x[i + 1] == p.x[i] && q.y[i + 1] == p.y[i] && q.z[i + 1] == p.z[i];
+        check.expect("aos_to_soa", scale, ok);
+    }
+
+    vector<T> data(3 * n);
+    for (size_t i = 0; i < n; ++i) {
+        data[3 * i] = a.x[i];
+        data[3 * i + 1] = a.y[i];
+        data[3 * i + 2] = a.z[i];
+    }
+    const vector3_soa<T> planes = aos_to_soa_inplace(&data[0], n);
+    ok = planes.size == n && planes.x == &data[0] && planes.y == &data[n] && planes.z == &data[2 * n];
+    for (size_t i = 0; i < n; ++i)
+        ok &= data[i] == a.x[i] && data[n + i] == a.y[i] && data[2 * n + i] == a.z[i];
+    check.expect("aos_to_soa_inplace", scale, ok);
+
+    soa_to_aos_inplace(&data[0], n);
+    ok = true;
+    for (size_t i = 0; i < n; ++i)
+        ok &= data[3 * i] == a.x[i] && data[3 * i + 1] == a.y[i] && data[3 * i + 2] == a.z[i];
+    check.expect("soa_to_aos_inplace", scale, ok);
+}
+
+/*!
+ * \brief Mean of points in long double
+ */
+template <typename T>
+void test_mean(const test_points<T> &p, size_t begin, size_t end, long double *c) {
+    c[0] = c[1] = c[2] = 0;
+    for (size_t i = begin; i < end; ++i) {
+        c[0] += p.x[i];
+        c[1] += p.y[i];
+        c[2] += p.z[i];
+    }
+    for (int k = 0; k < 3; ++k)
+        c[k] /= static_cast<long double>(end - begin);
+}
+
+/*!
+ * \brief Squared distance of two points in long double, and the sum of their squared distances from \e c
+ */
+template <typename T>
+long double test_distance2(const test_points<T> &a, size_t i, const test_points<T> &b, size_t j,
+        const long double *c, long double &norms) {
+    typedef long double L;
+    const L dx = L(a.x[i]) - b.x[j], dy = L(a.y[i]) - b.y[j], dz = L(a.z[i]) - b.z[j];
+    const L ax = a.x[i] - c[0], ay = a.y[i] - c[1], az = a.z[i] - c[2];
+    const L bx = b.x[j] - c[0], by = b.y[j] - c[1], bz = b.z[j] - c[2];
+    norms = ax * ax + ay * ay + az * az + bx * bx + by * by + bz * bz;
+    return dx * dx + dy * dy + dz * dz;
+}
+
+/*!
+ * \brief Whether a computed distance matches the long double one. The kernels use the Gram formula about the
+ * mean of the points, whose error is a few ulps of the squared norms \e norms, and refine distances below
+ * 1/64 of them, whose error is then a few ulps of |d| sqrt(norms); \e out_eps is the epsilon of the output type.
+ */
+template <typename U>
+bool near_distance(U out, long double d2, long double norms, long double eps, long double out_eps, bool squared) {
+    const long double tol = 16 * eps * std::min(norms, 8 * std::sqrt(d2 * norms)) + 4 * out_eps * d2;
+    return squared ? std::fabs(out - d2) <= tol : std::fabs(static_cast<long double>(out) * out - d2) <= tol;
+}
+
+/*!
+ * \brief Distance kernels against differences in long double. A third of the second set lies close to points of
+ * the first one to cover the refinement of short distances.
+ */
+template <typename T>
+void check_distances(batch_check &check, T scale) {
+    typedef long double L;
+    const size_t n = 1003, m = 37, nc = 203;
+    const L eps = std::numeric_limits<T>::epsilon();
+    test_random rnd;
+    test_points<T> a(n, rnd, scale), b(m, rnd, scale);
+    for (size_t j = 0; j < m; j += 3) {
+        b.x[j] = T(a.x[7 * j] + 1e-3 * scale * rnd.next());
+        b.y[j] = T(a.y[7 * j] + 1e-3 * scale * rnd.next());
+        b.z[j] = T(a.z[7 * j] + 1e-3 * scale * rnd.next());
+    }
+    a.x[nc - 1] = a.x[0];
+    a.y[nc - 1] = a.y[0];
+    a.z[nc - 1] = a.z[0];
+    L c[3], ca[3], cb[3], norms;
+    test_mean(a, 0, n, ca);
+    test_mean(b, 0, m, cb);
+    for (int k = 0; k < 3; ++k)
+        c[k] = (n * ca[k] + m * cb[k]) / (n + m);
+
+    // Condensed distances of the first points, the last of which duplicates the first one
+    const vector3_soa<T> sub = a.soa().sub(0, nc);
+    L cs[3];
+    test_mean(a, 0, nc, cs);
+
+    vector<T> out(n * m);
+    vector<float> out_float(n * m);
+    const L float_eps = std::numeric_limits<float>::epsilon();
+    // Squared distances at the extreme double scales are out of the range of single precision output
+    const bool float_squares = L(scale) * scale > std::numeric_limits<float>::min()
+        && L(scale) * scale < std::numeric_limits<float>::max();
+    for (int squared = 0; squared < 2; ++squared) {
+        distance_matrix<T>(a.soa(), b.soa(), &out[0], squared != 0);
+        bool ok = true;
+        for (size_t i = 0; i < n; ++i)
+            for (size_t j = 0; j < m; ++j) {
+                const L d2 = test_distance2(a, i, b, j, c, norms);
+                ok &= near_distance(out[i * m + j], d2, norms, eps, eps, squared != 0);
+            }
+        check.expect(squared ? "distance_matrix(squared)" : "distance_matrix", scale, ok);
+
+        if (!squared || float_squares) {
+            // Single precision output, which is the double to float overload for double points
+            distance_matrix(a.soa(), b.soa(), &out_float[0], squared != 0);
+            ok = true;
+            for (size_t i = 0; i < n; ++i)
+                for (size_t j = 0; j < m; ++j) {
+                    const L d2 = test_distance2(a, i, b, j, c, norms);
+                    ok &= near_distance(out_float[i * m + j], d2, norms, eps, float_eps, squared != 0);
+                }
+            check.expect(squared ? "distance_matrix(float, squared)" : "distance_matrix(float)", scale, ok);
+        }
+
+        condensed_distances<T>(sub, &out[0], squared != 0);
+        ok = true;
+        for (size_t i = 0; i < nc; ++i)
+            for (size_t j = i + 1; j < nc; ++j) {
+                const L d2 = test_distance2(a, i, a, j, cs, norms);
+                ok &= near_distance(out[condensed_index(nc, i, j)], d2, norms, eps, eps, squared != 0);
+            }
+        check.expect(squared ? "condensed_distances(squared)" : "condensed_distances", scale, ok);
+
+        if (!squared || float_squares) {
+            condensed_distances(sub, &out_float[0], squared != 0);
+            ok = true;
+            for (size_t i = 0; i < nc; ++i)
+                for (size_t j = i + 1; j < nc; ++j) {
+                    const L d2 = test_distance2(a, i, a, j, cs, norms);
+                    ok &= near_distance(out_float[condensed_index(nc, i, j)], d2, norms, eps, float_eps,
+                        squared != 0);
+                }
+            check.expect(squared ? "condensed_distances(float, squared)" : "condensed_distances(float)", scale,
+                ok);
+        }
+    }
+
+    // NaN and infinite coordinates spoil only the distances of their points, in the vector body and in the
+    // scalar tail; the origin is the mean of the finite coordinates
+    const size_t ne = 19;
+    test_points<T> e(ne, rnd);
+    for (size_t i = 0; i < ne; ++i) {
+        e.x[i] = a.x[i];
+        e.y[i] = a.y[i];
+        e.z[i] = a.z[i];
+    }
+    e.x[3] = e.z[17] = std::numeric_limits<T>::quiet_NaN();
+    e.y[12] = std::numeric_limits<T>::infinity();
+    distance_matrix<T>(e.soa(), e.soa(), &out[0]);
+    condensed_distances<T>(e.soa(), &out[ne * ne]);
+    bool ok = true;
+    for (size_t i = 0; i < ne; ++i)
+        for (size_t j = 0; j < ne; ++j) {
+            const T full = out[i * ne + j];
+            const T d[2] = {full, i < j ? out[ne * ne + condensed_index(ne, i, j)] : full};
+            const bool nan = i == 3 || i == 17 || j == 3 || j == 17, inf = i == 12 || j == 12;
+            for (int k = 0; k < 2; ++k) {
+                if (nan)
+                    ok &= d[k] != d[k];
+                else if (inf)
+                    ok &= !std::isfinite(d[k]);
+                else
+                    ok &= near_distance(d[k], test_distance2(e, i, e, j, cs, norms), norms, eps, eps, false);
+            }
+        }
+    check.expect("distance_matrix(NaN)", scale, ok);
+}
+
+/*!
+ * \brief Eigenvalues and eigenvectors of a symmetric matrix with cyclic Jacobi rotations in long double
+ * @param a Row-major n x n matrix, destroyed
+ * @param n Size of the matrix, at most 4
+ * @param values Output eigenvalues in decreasing order
+ * @param vectors Output row-major matrix; row k is the unit eigenvector of values[k]
+ */
+inline void test_jacobi(long double *a, int n, long double *values, long double *vectors) {
+    typedef long double L;
+    L v[16];
+    for (int i = 0; i < n * n; ++i)
+        v[i] = i % (n + 1) == 0;
+    for (int sweep = 0; sweep < 64; ++sweep)
+        for (int p = 0; p < n; ++p)
+            for (int q = p + 1; q < n; ++q) {
+                if (a[p * n + q] == 0)
+                    continue;
+                const L theta = (a[q * n + q] - a[p * n + p]) / (2 * a[p * n + q]);
+                const L t = (theta >= 0 ? 1 : -1) / (std::fabs(theta) + std::sqrt(theta * theta + 1));
+                const L c = 1 / std::sqrt(t * t + 1), s = t * c;
+                for (int k = 0; k < n; ++k) {
+                    const L akp = a[k * n + p], akq = a[k * n + q];
+                    a[k * n + p] = c * akp - s * akq;
+                    a[k * n + q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < n; ++k) {
+                    const L apk = a[p * n + k], aqk = a[q * n + k];
+                    a[p * n + k] = c * apk - s * aqk;
+                    a[q * n + k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < n; ++k) {
+                    const L vkp = v[k * n + p], vkq = v[k * n + q];
+                    v[k * n + p] = c * vkp - s * vkq;
+                    v[k * n + q] = s * vkp + c * vkq;
+                }
+            }
+    int order[4] = {0, 1, 2, 3};
+    for (int i = 0; i < n; ++i)
+        for (int j = i + 1; j < n; ++j)
+            if (a[order[j] * n + order[j]] > a[order[i] * n + order[i]])
+                std::swap(order[i], order[j]);
+    for (int i = 0; i < n; ++i) {
+        values[i] = a[order[i] * n + order[i]];
+        for (int k = 0; k < n; ++k)
+            vectors[i * n + k] = v[k * n + order[i]];
+    }
+}
+
+/*!
+ * \brief Optimal superposition of points [begin, end) of \e a onto those of \e b in long double with the
+ * quaternion method of Horn (1987)
+ * @param transform Output row-major 3x4 matrix [R | t]
+ * @return Minimal mean squared deviation
+ */
+template <typename T>
+long double test_superpose(const test_points<T> &a, const test_points<T> &b, size_t begin, size_t end,
+        long double *transform) {
+    typedef long double L;
+    L ca[3], cb[3], s[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0}, e = 0;
+    test_mean(a, begin, end, ca);
+    test_mean(b, begin, end, cb);
+    for (size_t i = begin; i < end; ++i) {
+        const L p[3] = {a.x[i] - ca[0], a.y[i] - ca[1], a.z[i] - ca[2]};
+        const L q[3] = {b.x[i] - cb[0], b.y[i] - cb[1], b.z[i] - cb[2]};
+        for (int j = 0; j < 3; ++j) {
+            for (int k = 0; k < 3; ++k)
+                s[3 * j + k] += p[j] * q[k];
+            e += p[j] * p[j] + q[j] * q[j];
+        }
+    }
+    const L &xx = s[0], &xy = s[1], &xz = s[2], &yx = s[3], &yy = s[4], &yz = s[5], &zx = s[6], &zy = s[7];
+    const L &zz = s[8];
+    L key[16] = {xx + yy + zz, yz - zy, zx - xz, xy - yx, yz - zy, xx - yy - zz, xy + yx, zx + xz,
+        zx - xz, xy + yx, -xx + yy - zz, yz + zy, xy - yx, zx + xz, yz + zy, -xx - yy + zz};
+    L values[4], vectors[16];
+    test_jacobi(key, 4, values, vectors);
+    const L w = vectors[0], x = vectors[1], y = vectors[2], z = vectors[3];
+    const L r[9] = {w * w + x * x - y * y - z * z, 2 * (x * y - w * z), 2 * (x * z + w * y),
+        2 * (x * y + w * z), w * w - x * x + y * y - z * z, 2 * (y * z - w * x),
+        2 * (x * z - w * y), 2 * (y * z + w * x), w * w - x * x - y * y + z * z};
+    for (int j = 0; j < 3; ++j) {
+        transform[4 * j] = r[3 * j];
+        transform[4 * j + 1] = r[3 * j + 1];
+        transform[4 * j + 2] = r[3 * j + 2];
+        transform[4 * j + 3] = cb[j] - (r[3 * j] * ca[0] + r[3 * j + 1] * ca[1] + r[3 * j + 2] * ca[2]);
+    }
+    return std::max(e - 2 * values[0], L(0)) / static_cast<L>(end - begin);
+}
+
+/*!
+ * \brief Superposition against the quaternion method in long double. Targets are rotated and shifted copies of
+ * the mobile points with some noise; the batch versions have to reproduce the single results exactly.
+ */
+template <typename T>
+void check_superposition(batch_check &check, T scale) {
+    typedef long double L;
+    const size_t n = 1003, size = 59, count = 17;
+    const L eps = std::numeric_limits<T>::epsilon();
+    test_random rnd;
+    test_points<T> a(n, rnd, scale), b(n, rnd, scale);
+    for (size_t s = 0; s < count; ++s) {
+        // Rotation about a random axis, every fourth structure without noise
+        const L axis[3] = {rnd.next(), rnd.next(), rnd.next() + 2}, angle = 3 * rnd.next();
+        const L len = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        const L u[3] = {axis[0] / len, axis[1] / len, axis[2] / len}, cs = std::cos(angle), sn = std::sin(angle);
+        const L noise = s % 4 ? 0.05 : 0, shift[3] = {rnd.next(), rnd.next(), rnd.next()};
+        for (size_t i = s * size; i < (s + 1) * size; ++i) {
+            const L p[3] = {a.x[i], a.y[i], a.z[i]}, d = u[0] * p[0] + u[1] * p[1] + u[2] * p[2];
+            const L c[3] = {u[1] * p[2] - u[2] * p[1], u[2] * p[0] - u[0] * p[2], u[0] * p[1] - u[1] * p[0]};
+            L q[3];
+            for (int k = 0; k < 3; ++k)
+                q[k] = cs * p[k] + sn * c[k] + (1 - cs) * d * u[k] + scale * (shift[k] + noise * rnd.next());
+            b.x[i] = T(q[0]);
+            b.y[i] = T(q[1]);
+            b.z[i] = T(q[2]);
+        }
+    }
+
+    vector<superposition<T> > batch(count);
+    vector<T> rmsd(count);
+    superpose_batch<T>(a.soa(), b.soa(), size, &batch[0]);
+    superposition_rmsd_batch<T>(a.soa(), b.soa(), size, &rmsd[0]);
+    bool ok = true, ok_rmsd = true, ok_batch = true, ok_rmsd_batch = true;
+    for (size_t s = 0; s < count; ++s) {
+        const vector3_soa<T> ma = a.soa().sub(s * size, size), mb = b.soa().sub(s * size, size);
+        const superposition<T> fit = superpose(ma, mb);
+        const T r = superposition_rmsd(ma, mb);
+        L ref[12], e = 0;
+        const L msd = test_superpose(a, b, s * size, (s + 1) * size, ref);
+        L ca[3];
+        test_mean(a, s * size, (s + 1) * size, ca);
+        for (size_t i = s * size; i < (s + 1) * size; ++i)
+            e += (a.x[i] - ca[0]) * (a.x[i] - ca[0]) + (a.y[i] - ca[1]) * (a.y[i] - ca[1])
+                + (a.z[i] - ca[2]) * (a.z[i] - ca[2]);
+        // Mean squared deviations are resolved to a few ulps of the mean squared norm
+        const L tol_msd = 64 * eps * e / size;
+        ok &= std::fabs(L(fit.rmsd) * fit.rmsd - msd) <= tol_msd;
+        ok_rmsd &= std::fabs(L(r) * r - msd) <= tol_msd;
+        for (int k = 0; k < 12; ++k)
+            ok &= std::fabs(fit.transform[k] - ref[k]) <= 64 * eps * (k % 4 == 3 ? 4 * scale : 1);
+        ok_batch &= batch[s].rmsd == fit.rmsd && std::equal(fit.transform, fit.transform + 12, batch[s].transform);
+        ok_rmsd_batch &= rmsd[s] == r;
+    }
+    check.expect("superpose", scale, ok);
+    check.expect("superposition_rmsd", scale, ok_rmsd);
+    check.expect("superpose_batch", scale, ok_batch);
+    check.expect("superposition_rmsd_batch", scale, ok_rmsd_batch);
+
+    // Collinear structures make the largest eigenvalue degenerate; the transform has to fit them all the same
+    const L u[3] = {2 / 7.0L, -3 / 7.0L, 6 / 7.0L}, w[3] = {0.6L, 0, -0.8L}, shift[3] = {0.5L, -1, 2};
+    for (size_t i = 0; i < size; ++i) {
+        const L t = scale * (L(i) / size - 0.3L);
+        a.x[i] = T(t * u[0]), a.y[i] = T(t * u[1]), a.z[i] = T(t * u[2]);
+        b.x[i] = T(t * w[0] + scale * shift[0]), b.y[i] = T(t * w[1] + scale * shift[1]);
+        b.z[i] = T(t * w[2] + scale * shift[2]);
+    }
+    const superposition<T> line = superpose(a.soa().sub(0, size), b.soa().sub(0, size));
+    L e = 0;
+    for (size_t i = 0; i < size; ++i) {
+        const L p[3] = {a.x[i], a.y[i], a.z[i]}, q[3] = {b.x[i], b.y[i], b.z[i]};
+        for (int r = 0; r < 3; ++r) {
+            const T *row = line.transform + 4 * r;
+            const L d = row[0] * p[0] + row[1] * p[1] + row[2] * p[2] + row[3] - q[r];
+            e += d * d;
+        }
+    }
+    // The coordinates are rounded to the element type, so the points lie on their lines only up to epsilon
+    check.expect("superpose(collinear)", scale, std::sqrt(e / size) <= 64 * eps * scale
+        && line.rmsd <= 8 * std::sqrt(eps) * scale
+        && superposition_rmsd(a.soa().sub(0, size), b.soa().sub(0, size)) == line.rmsd);
+}
+
+/*!
+ * \brief Length of a long double vector
+ */
+inline long double test_norm(const long double *a) {
+    return std::sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+}
+
+/*!
+ * \brief Edges of a triangle from its first corner in long double, the cross product of the edges, and an
+ * upper bound of its rounding error in units of epsilon
+ */
+template <typename T>
+void test_face(const test_points<T> &p, const uint32_t *tri, long double *n, long double &bound) {
+    long double a[3], b[3], c[3], u[3], w[3];
+    test_point(p, tri[0], a);
+    test_point(p, tri[1], b);
+    test_point(p, tri[2], c);
+    for (int k = 0; k < 3; ++k) {
+        u[k] = b[k] - a[k];
+        w[k] = c[k] - a[k];
+    }
+    n[0] = u[1] * w[2] - u[2] * w[1];
+    n[1] = u[2] * w[0] - u[0] * w[2];
+    n[2] = u[0] * w[1] - u[1] * w[0];
+    bound = 8 * (test_norm(a) + test_norm(b)) * (test_norm(a) + test_norm(c));
+}
+
+/*!
+ * \brief Mesh kernels against cross products of the edges in long double. Every 50th face is degenerate and
+ * the last vertex belongs to no face.
+ */
+template <typename T>
+void check_mesh(batch_check &check, T scale) {
+    typedef long double L;
+    const size_t nv = 1003, nf = 2011;
+    const L eps = std::numeric_limits<T>::epsilon();
+    test_random rnd;
+    test_points<T> p(nv, rnd, scale), fn(nf, rnd), vn(nv, rnd);
+    vector<uint32_t> tris(3 * nf);
+    for (size_t f = 0; f < nf; ++f)
+        for (int c = 0; c < 3; ++c)
+            tris[3 * f + c] = static_cast<uint32_t>((nv - 1) * (rnd.next() + 1) / 2);
+    for (size_t f = 0; f < nf; f += 50)
+        tris[3 * f + 1] = tris[3 * f];
+    vector<T> areas(nf), areas_only(nf);
+    mesh_face_normals<T>(p.soa(), &tris[0], nf, fn.soa(), &areas[0]);
+    mesh_face_areas<T>(p.soa(), &tris[0], nf, &areas_only[0]);
+    bool ok = true, ok_areas = true;
+    vector<L> nx(nf), ny(nf), nz(nf), bounds(nf);
+    for (size_t f = 0; f < nf; ++f) {
+        L n[3];
+        test_face(p, &tris[3 * f], n, bounds[f]);
+        nx[f] = n[0], ny[f] = n[1], nz[f] = n[2];
+        const L len = test_norm(n), err = eps * bounds[f];
+        ok_areas &= std::fabs(areas[f] - len / 2) <= err && areas_only[f] == areas[f];
+        if (len == 0) {
+            ok &= fn.x[f] == 0 && fn.y[f] == 0 && fn.z[f] == 0;
+        } else {
+            const L tol = err / len + 4 * eps;
+            ok &= std::fabs(fn.x[f] - n[0] / len) <= tol && std::fabs(fn.y[f] - n[1] / len) <= tol
+                && std::fabs(fn.z[f] - n[2] / len) <= tol;
+        }
+    }
+    check.expect("mesh_face_normals", scale, ok);
+    check.expect("mesh_face_areas", scale, ok_areas);
+
+    const mesh_adjacency adj(&tris[0], nf, nv);
+    mesh_vertex_normals<T>(p.soa(), &tris[0], adj, vn.soa());
+    vector<L> sx(nv, 0), sy(nv, 0), sz(nv, 0), err(nv, 0);
+    vector<size_t> degree(nv, 0);
+    for (size_t f = 0; f < nf; ++f)
+        for (int c = 0; c < 3; ++c) {
+            const uint32_t v = tris[3 * f + c];
+            sx[v] += nx[f], sy[v] += ny[f], sz[v] += nz[f];
+            err[v] += eps * bounds[f];
+            ++degree[v];
+        }
+    ok = degree[nv - 1] == 0 && adj.vertex_count() == nv;
+    for (size_t v = 0; v < nv; ++v) {
+        const L s[3] = {sx[v], sy[v], sz[v]}, len = test_norm(s);
+        // Sums in any order add the magnitudes of the terms times the number of terms
+        const L tol = degree[v] * err[v] / len + 4 * eps;
+        if (degree[v] == 0)
+            ok &= vn.x[v] == 0 && vn.y[v] == 0 && vn.z[v] == 0;
+        else if (tol < 1)
+            ok &= std::fabs(vn.x[v] - s[0] / len) <= tol && std::fabs(vn.y[v] - s[1] / len) <= tol
+                && std::fabs(vn.z[v] - s[2] / len) <= tol;
+    }
+    check.expect("mesh_vertex_normals", scale, ok);
+}
+
+/*!
+ * \brief Moller-Trumbore intersection in long double with error margins of the computed coordinates
+ */
+struct test_hit {
+    long double t, u, v, et, eu, ev;
+
+    /*!
+     * \brief Computes the intersection of a ray with triangle \e j
+     */
+    template <typename T>
+    test_hit(const long double *o, const long double *d, const test_points<T> &v0, const test_points<T> &v1,
+            const test_points<T> &v2, size_t j) {
+        typedef long double L;
+        L a[3], b[3], c[3], e1[3], e2[3], s[3], p[3], q[3];
+        test_point(v0, j, a);
+        test_point(v1, j, b);
+        test_point(v2, j, c);
+        for (int k = 0; k < 3; ++k) {
+            e1[k] = b[k] - a[k];
+            e2[k] = c[k] - a[k];
+            s[k] = o[k] - a[k];
+        }
+        p[0] = d[1] * e2[2] - d[2] * e2[1], p[1] = d[2] * e2[0] - d[0] * e2[2], p[2] = d[0] * e2[1] - d[1] * e2[0];
+        q[0] = s[1] * e1[2] - s[2] * e1[1], q[1] = s[2] * e1[0] - s[0] * e1[2], q[2] = s[0] * e1[1] - s[1] * e1[0];
+        const L det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+        u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) / det;
+        v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) / det;
+        t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) / det;
+        // Rounding of the differences is relative to the coordinates, not to the edges
+        const L na = test_norm(a), ns = test_norm(o) + na, n1 = test_norm(b) + na, n2 = test_norm(c) + na;
+        const L nd = test_norm(d), k = 16 / std::fabs(det);
+        eu = k * nd * n2 * (ns + std::fabs(u) * n1);
+        ev = k * n1 * nd * (ns + std::fabs(v) * n2);
+        et = k * n1 * n2 * (ns + std::fabs(t) * nd);
+    }
+
+    /*!
+     * \brief Whether the ray certainly hits the triangle within [tmin, tmax] for errors of \e eps
+     */
+    bool hit(long double tmin, long double tmax, long double eps) const {
+        return u >= eps * eu && v >= eps * ev && u + v <= 1 - eps * (eu + ev) && t >= tmin + eps * et
+            && t <= tmax - eps * et;
+    }
+
+    /*!
+     * \brief Whether the ray certainly misses the triangle or the interval [tmin, tmax]
+     */
+    bool miss(long double tmin, long double tmax, long double eps) const {
+        return !(u >= -eps * eu && v >= -eps * ev && u <= 1 + eps * eu && u + v <= 1 + eps * (eu + ev)
+            && t >= tmin - eps * et && t <= tmax + eps * et);
+    }
+
+    /*!
+     * \brief Whether computed coordinates of the hit match
+     */
+    template <typename T>
+    bool matches(T tc, T uc, T vc, long double eps) const {
+        return std::fabs(tc - t) <= eps * et && std::fabs(uc - u) <= eps * eu && std::fabs(vc - v) <= eps * ev;
+    }
+};
+
+/*!
+ * \brief Ray kernels against intersections in long double. Rays grazing an edge or an end of the interval within
+ * the rounding error may go either way; most rays aim at the center of some triangle.
+ */
+template <typename T>
+void check_rays(batch_check &check, T scale) {
+    typedef long double L;
+    const size_t n = 1003, nrays = 101;
+    const L eps = std::numeric_limits<T>::epsilon();
+    const T tmin = T(0.25), tmax = 2, inf = std::numeric_limits<T>::infinity();
+    test_random rnd;
+    test_points<T> v0(n, rnd, scale), v1(n, rnd, T(0.3) * scale), v2(n, rnd, T(0.3) * scale);
+    test_points<T> origins(nrays, rnd, 2 * scale), dirs(nrays, rnd, scale);
+    for (size_t j = 0; j < n; ++j) {
+        v1.x[j] += v0.x[j], v1.y[j] += v0.y[j], v1.z[j] += v0.z[j];
+        v2.x[j] += v0.x[j], v2.y[j] += v0.y[j], v2.z[j] += v0.z[j];
+    }
+    for (size_t i = 0; i < nrays; ++i)
+        if (i % 5) {
+            const size_t j = 7 * i + 3;
+            dirs.x[i] = T((L(v0.x[j]) + v1.x[j] + v2.x[j]) / 3 - origins.x[i]);
+            dirs.y[i] = T((L(v0.y[j]) + v1.y[j] + v2.y[j]) / 3 - origins.y[i]);
+            dirs.z[i] = T((L(v0.z[j]) + v1.z[j] + v2.z[j]) / 3 - origins.z[i]);
+        }
+
+    vector<T> t(n), u(n), v(n);
+    bool ok = true;
+    for (size_t i = 0; i < nrays; i += 10) {
+        const T origin[3] = {origins.x[i], origins.y[i], origins.z[i]}, dir[3] = {dirs.x[i], dirs.y[i], dirs.z[i]};
+        const L o[3] = {origin[0], origin[1], origin[2]}, d[3] = {dir[0], dir[1], dir[2]};
+        const size_t hits = intersect_ray_triangles<T>(origin, dir, tmin, tmax, v0.soa(), v1.soa(), v2.soa(), &t[0],
+            &u[0], &v[0]);
+        size_t count = 0;
+        for (size_t j = 0; j < n; ++j) {
+            const test_hit ref(o, d, v0, v1, v2, j);
+            count += t[j] != inf;
+            if (t[j] != inf)
+                ok &= !ref.miss(tmin, tmax, eps) && ref.matches(t[j], u[j], v[j], eps);
+            else
+                ok &= !ref.hit(tmin, tmax, eps) && u[j] == 0 && v[j] == 0;
+        }
+        ok &= hits == count && (i % 5 == 0 || hits > 0);
+    }
+    check.expect("intersect_ray_triangles", scale, ok);
+
+    vector<T> rt(nrays), ru(nrays), rv(nrays);
+    vector<int32_t> tri(nrays), occluder(nrays);
+    const size_t hits = closest_hits<T>(origins.soa(), dirs.soa(), tmin, tmax, v0.soa(), v1.soa(), v2.soa(), &rt[0],
+        &ru[0], &rv[0], &tri[0]);
+    const size_t occluded = occluded_rays<T>(origins.soa(), dirs.soa(), tmin, tmax, v0.soa(), v1.soa(), v2.soa(),
+        &occluder[0]);
+    bool ok_occluded = true;
+    ok = true;
+    size_t count = 0, count_occluded = 0;
+    for (size_t i = 0; i < nrays; ++i) {
+        const L o[3] = {origins.x[i], origins.y[i], origins.z[i]}, d[3] = {dirs.x[i], dirs.y[i], dirs.z[i]};
+        // Entry of the certain hit with the smallest upper bound of t
+        L closest = inf;
+        for (size_t j = 0; j < n; ++j) {
+            const test_hit ref(o, d, v0, v1, v2, j);
+            if (ref.hit(tmin, tmax, eps))
+                closest = std::min(closest, ref.t + eps * ref.et);
+        }
+        count += tri[i] >= 0;
+        count_occluded += occluder[i] >= 0;
+        if (tri[i] >= 0) {
+            const test_hit ref(o, d, v0, v1, v2, tri[i]);
+            ok &= !ref.miss(tmin, tmax, eps) && ref.matches(rt[i], ru[i], rv[i], eps)
+                && ref.t - eps * ref.et <= closest;
+        } else {
+            ok &= rt[i] == inf && closest == inf;
+        }
+        if (occluder[i] >= 0)
+            ok_occluded &= !test_hit(o, d, v0, v1, v2, occluder[i]).miss(tmin, tmax, eps);
+        else
+            ok_occluded &= closest == inf;
+    }
+    check.expect("closest_hits", scale, ok && hits == count && hits > nrays / 2);
+    check.expect("occluded_rays", scale, ok_occluded && occluded == count_occluded);
+}
+
+/*!
+ * \brief Welding against a brute-force search over all pairs in long double. Every fifth point is a copy of an
+ * earlier one moved by 0, 0.5, 0.9 or 1.5 times the tolerance, so groups and chains of welded points occur.
+ */
+template <typename T>
+void check_weld(batch_check &check, T scale) {
+    typedef long double L;
+    const size_t n = 1003;
+    const L eps = std::numeric_limits<T>::epsilon(), factors[4] = {0, 0.5, 0.9, 1.5};
+    test_random rnd;
+    test_points<T> p(n, rnd, scale), u(n, rnd);
+    for (size_t i = 5; i < n; i += 5) {
+        const size_t j = static_cast<size_t>(i * (rnd.next() + 1) / 2);
+        L d[3] = {rnd.next(), rnd.next(), rnd.next()};
+        const L f = factors[i / 5 % 4] * L(T(0.02) * scale) / test_norm(d);
+        p.x[i] = static_cast<T>(p.x[j] + f * d[0]);
+        p.y[i] = static_cast<T>(p.y[j] + f * d[1]);
+        p.z[i] = static_cast<T>(p.z[j] + f * d[2]);
+    }
+
+    vector<uint32_t> remap(n), ref(n);
+    for (int exact = 0; exact < 2; ++exact) {
+        const T tol = exact ? T(0) : T(0.02) * scale;
+        const L tol2 = L(tol) * tol;
+        const size_t count = weld_points<T>(p.soa(), tol, &remap[0], u.soa());
+        bool ok = true;
+        size_t ref_count = 0;
+        for (size_t i = 0; i < n; ++i) {
+            size_t first = i;
+            for (size_t j = 0; j < i && first == i; ++j) {
+                const L dx = L(p.x[i]) - p.x[j], dy = L(p.y[i]) - p.y[j], dz = L(p.z[i]) - p.z[j];
+                const L d2 = dx * dx + dy * dy + dz * dz;
+                // Distances within rounding of the tolerance could go either way
+                ok &= exact || std::fabs(d2 - tol2) > 8 * eps * tol2;
+                if (d2 <= tol2)
+                    first = j;
+            }
+            if (first != i) {
+                ref[i] = ref[first];
+                continue;
+            }
+            ok &= ref_count < n && u.x[ref_count] == p.x[i] && u.y[ref_count] == p.y[i] && u.z[ref_count] == p.z[i];
+            ref[i] = static_cast<uint32_t>(ref_count++);
+        }
+        ok &= count == ref_count && count < n && std::equal(ref.begin(), ref.end(), remap.begin());
+        check.expect(exact ? "weld_points(exact)" : "weld_points", scale, ok);
+    }
+
+    // Exact duplicates of infinite points are merged and NaN points never are, in the vector body and in the
+    // scalar tail
+    const T inf = std::numeric_limits<T>::infinity(), nan = std::numeric_limits<T>::quiet_NaN();
+    const size_t ns = 11;
+    const T special[ns][3] = {{inf, 0, 0}, {scale, 2 * scale, 3 * scale}, {nan, 0, 0}, {-inf, inf, 0}, {0, 0, 0},
+        {nan, 0, 0}, {0, -inf, scale}, {scale, 2 * scale, 3 * scale}, {0, -inf, scale}, {inf, 0, 0}, {-inf, inf, 0}};
+    test_points<T> sp(ns, rnd);
+    for (size_t i = 0; i < ns; ++i) {
+        sp.x[i] = special[i][0];
+        sp.y[i] = special[i][1];
+        sp.z[i] = special[i][2];
+    }
+    const size_t count = weld_points<T>(sp.soa(), T(0), &remap[0]);
+    size_t ref_count = 0;
+    for (size_t i = 0; i < ns; ++i) {
+        size_t first = i;
+        for (size_t j = 0; j < i && first == i; ++j)
+            if (sp.x[i] == sp.x[j] && sp.y[i] == sp.y[j] && sp.z[i] == sp.z[j])
+                first = j;
+        ref[i] = first != i ? ref[first] : static_cast<uint32_t>(ref_count++);
+    }
+    check.expect("weld_points(non-finite)", scale, count == ref_count && ref_count == 7
+        && std::equal(ref.begin(), ref.begin() + ns, remap.begin()));
+}
+
+/*!
+ * \brief Moments and oriented boxes against long double sums and projections. The points of an elongated,
+ * rotated and shifted box are added to one accumulator in two calls and to another one in a single call of
+ * several chunks, and the two are merged.
+ */
+template <typename T>
+void check_pca(batch_check &check, T scale) {
+    typedef long double L;
+    const size_t n1 = 1003, n = n1 + 2 * vectors_internal::moment_chunk + 819;
+    const L eps = std::numeric_limits<T>::epsilon(), half[3] = {3, 1.5, 0.5}, offset[3] = {0.5, -0.25, 0.75};
+    const L axis[3] = {2 / 7.0L, 3 / 7.0L, 6 / 7.0L}, cs = std::cos(0.6L), sn = std::sin(0.6L);
+    test_random rnd;
+    test_points<T> p(n, rnd, scale);
+    L rot[9], lim = 0;
+    for (int k = 0; k < 3; ++k)
+        for (int j = 0; j < 3; ++j)
+            rot[3 * k + j] = cs * (k == j) + (1 - cs) * axis[k] * axis[j]
+                + sn * (k == j ? 0 : (j - k + 3) % 3 == 1 ? -axis[3 - k - j] : axis[3 - k - j]);
+    for (size_t i = 0; i < n; ++i) {
+        L u[3], q[3];
+        test_point(p, i, u);
+        for (int k = 0; k < 3; ++k)
+            q[k] = scale * offset[k] + rot[3 * k] * half[0] * u[0] + rot[3 * k + 1] * half[1] * u[1]
+                + rot[3 * k + 2] * half[2] * u[2];
+        p.x[i] = static_cast<T>(q[0]);
+        p.y[i] = static_cast<T>(q[1]);
+        p.z[i] = static_cast<T>(q[2]);
+        test_point(p, i, q);
+        lim = std::max(lim, test_norm(q));
+    }
+
+    L mean[3] = {0, 0, 0}, cov[6] = {0, 0, 0, 0, 0, 0};
+    for (size_t i = 0; i < n; ++i) {
+        const L q[3] = {p.x[i], p.y[i], p.z[i]};
+        for (int k = 0; k < 3; ++k)
+            mean[k] += q[k] / n;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        const L d[3] = {p.x[i] - mean[0], p.y[i] - mean[1], p.z[i] - mean[2]};
+        for (int k = 0, j = 0; j < 3; ++j)
+            for (int l = j; l < 3; ++l)
+                cov[k++] += d[j] * d[l] / n;
+    }
+    const vector3_soa<T> all = p.soa();
+    point_moments<T> first, second;
+    first.add(all.sub(0, 500)).add(all.sub(500, n1 - 500));
+    second.add(all.sub(n1, n - n1));
+    first.merge(second);
+    T m[3], c[6];
+    first.mean(m);
+    first.covariance(c);
+    // Chunks are summed in the element type, in reduction_lanes partial sums
+    const L tol = (vectors_internal::moment_chunk / 8 + 16) * eps;
+    bool ok = first.count() == n;
+    for (int k = 0; k < 3; ++k)
+        ok &= std::fabs(m[k] - mean[k]) <= tol * lim;
+    for (int k = 0; k < 6; ++k)
+        ok &= std::fabs(c[k] - cov[k]) <= tol * lim * lim;
+    check.expect("point_moments", scale, ok);
+
+    // Eigen decomposition of the computed covariance against Jacobi rotations in long double
+    T values[3], vectors[9];
+    L a[9] = {c[0], c[1], c[2], c[1], c[3], c[4], c[2], c[4], c[5]}, ref_values[3], ref_vectors[9];
+    symmetric_eigen(c, values, vectors);
+    test_jacobi(a, 3, ref_values, ref_vectors);
+    ok = true;
+    for (int k = 0; k < 3; ++k) {
+        const L v[3] = {vectors[3 * k], vectors[3 * k + 1], vectors[3 * k + 2]};
+        const L sign = v[0] * ref_vectors[3 * k] + v[1] * ref_vectors[3 * k + 1] + v[2] * ref_vectors[3 * k + 2];
+        ok &= std::fabs(values[k] - ref_values[k]) <= 8 * eps * ref_values[0];
+        for (int d = 0; d < 3; ++d)
+            ok &= std::fabs(v[d] - (sign < 0 ? -1 : 1) * ref_vectors[3 * k + d]) <= 64 * eps;
+    }
+    const L det = vectors[0] * (L(vectors[4]) * vectors[8] - L(vectors[5]) * vectors[7])
+        - vectors[1] * (L(vectors[3]) * vectors[8] - L(vectors[5]) * vectors[6])
+        + vectors[2] * (L(vectors[3]) * vectors[7] - L(vectors[4]) * vectors[6]);
+    check.expect("symmetric_eigen", scale, ok && std::fabs(det - 1) <= 16 * eps);
+
+    // The box contains all points and touches them on every side, up to rounding of the projections
+    const oriented_box<T> box = fit_obb<T>(all);
+    const L slack = 32 * eps * lim;
+    L lo[3], hi[3];
+    ok = true;
+    for (int k = 0; k < 3; ++k) {
+        lo[k] = std::numeric_limits<L>::infinity();
+        hi[k] = -lo[k];
+        for (int j = 0; j < 3; ++j) {
+            const L dot = L(box.axes[3 * k]) * box.axes[3 * j] + L(box.axes[3 * k + 1]) * box.axes[3 * j + 1]
+                + L(box.axes[3 * k + 2]) * box.axes[3 * j + 2];
+            ok &= std::fabs(dot - (k == j)) <= 8 * eps;
+        }
+    }
+    for (size_t i = 0; i < n; ++i)
+        for (int k = 0; k < 3; ++k) {
+            const L t = (p.x[i] - L(box.center[0])) * box.axes[3 * k]
+                + (p.y[i] - L(box.center[1])) * box.axes[3 * k + 1] + (p.z[i] - L(box.center[2])) * box.axes[3 * k + 2];
+            lo[k] = std::min(lo[k], t);
+            hi[k] = std::max(hi[k], t);
+        }
+    for (int k = 0; k < 3; ++k)
+        ok &= std::fabs(hi[k] - box.half_extent[k]) <= slack && std::fabs(lo[k] + box.half_extent[k]) <= slack;
+    check.expect("fit_obb", scale, ok);
+
+    // Extents added in pieces along the axes of the box give the same box
+    obb_extents<T> ext(box.center, box.axes), rest(box.center, box.axes);
+    ext.add(all.sub(0, n1));
+    rest.add(all.sub(n1, n - n1));
+    const oriented_box<T> merged = ext.merge(rest).box();
+    ok = std::equal(box.axes, box.axes + 9, merged.axes);
+    for (int k = 0; k < 3; ++k)
+        ok &= std::fabs(merged.center[k] - L(box.center[k])) <= slack
+            && std::fabs(merged.half_extent[k] - L(box.half_extent[k])) <= slack;
+    check.expect("obb_extents", scale, ok);
+
+    // NaN points in the vector body and in the scalar tail are skipped; the reference repeats point 0 instead
+    const size_t nn = 43, bad[2] = {8, 41};
+    test_points<T> q(nn, rnd), qref(nn, rnd);
+    for (size_t i = 0; i < nn; ++i) {
+        q.x[i] = qref.x[i] = p.x[i];
+        q.y[i] = qref.y[i] = p.y[i];
+        q.z[i] = qref.z[i] = p.z[i];
+    }
+    for (int k = 0; k < 2; ++k) {
+        q.y[bad[k]] = std::numeric_limits<T>::quiet_NaN();
+        qref.x[bad[k]] = p.x[0];
+        qref.y[bad[k]] = p.y[0];
+        qref.z[bad[k]] = p.z[0];
+    }
+    obb_extents<T> with_nan(box.center, box.axes), without_nan(box.center, box.axes);
+    const oriented_box<T> skipped = with_nan.add(q.soa()).box(), expected = without_nan.add(qref.soa()).box();
+    check.expect("obb_extents(NaN)", scale, std::equal(expected.center, expected.center + 3, skipped.center)
+        && std::equal(expected.half_extent, expected.half_extent + 3, skipped.half_extent));
+
+    const size_t offsets[7] = {0, 1, 4, 9, n1, n1 + 4099, n};
+    oriented_box<T> boxes[6];
+    build_obbs<T>(all, offsets, 6, boxes);
+    ok = true;
+    for (int r = 0; r < 6; ++r) {
+        const oriented_box<T> single = fit_obb<T>(all.sub(offsets[r], offsets[r + 1] - offsets[r]));
+        ok &= std::equal(single.center, single.center + 3, boxes[r].center)
+            && std::equal(single.axes, single.axes + 9, boxes[r].axes)
+            && std::equal(single.half_extent, single.half_extent + 3, boxes[r].half_extent);
+    }
+    check.expect("build_obbs", scale, ok);
+}
+
+/*!
+ * \brief Convex hulls and support points against long double plane tests and brute-force maxima. A third of
+ * the points lies on a sphere, so that the hull has many vertices.
+ */
+template <typename T>
+void check_hull(batch_check &check, T scale) {
+    typedef long double L;
+    const size_t n = 1003, ndirs = 67;
+    const L eps = std::numeric_limits<T>::epsilon();
+    test_random rnd;
+    test_points<T> p(n, rnd, scale), dirs(ndirs, rnd);
+    L extent[3] = {0, 0, 0};
+    for (size_t i = 0; i < n; ++i) {
+        L q[3];
+        test_point(p, i, q);
+        const L f = i % 3 ? 1 : scale / test_norm(q);
+        p.x[i] = static_cast<T>(f * q[0]);
+        p.y[i] = static_cast<T>(f * q[1]);
+        p.z[i] = static_cast<T>(f * q[2]);
+        extent[0] = std::max(extent[0], L(std::fabs(p.x[i])));
+        extent[1] = std::max(extent[1], L(std::fabs(p.y[i])));
+        extent[2] = std::max(extent[2], L(std::fabs(p.z[i])));
+    }
+    const L size = extent[0] + extent[1] + extent[2];
+
+    // Closed triangulated surface: every directed edge once, its reverse once, and F = 2V - 4
+    const convex_hull<T> hull(p.soa());
+    const size_t nv = hull.vertex_count(), nf = hull.triangle_count();
+    const uint32_t *tri = hull.triangles(), *index = hull.indices();
+    const vector3_soa<const T> v = hull.vertices();
+    bool ok = nv > 3 && nf == 2 * nv - 4 && v.size == nv;
+    vector<uint64_t> edges, reversed;
+    for (size_t t = 0; ok && t < 3 * nf; ++t) {
+        const uint64_t a = tri[t], b = tri[t - t % 3 + (t + 1) % 3];
+        ok &= a < nv && b < nv && a != b;
+        edges.push_back(a << 32 | b);
+        reversed.push_back(b << 32 | a);
+    }
+    std::sort(edges.begin(), edges.end());
+    std::sort(reversed.begin(), reversed.end());
+    ok &= std::adjacent_find(edges.begin(), edges.end()) == edges.end() && edges == reversed;
+    for (size_t k = 0; ok && k < nv; ++k)
+        ok &= (k == 0 || index[k] > index[k - 1]) && index[k] < n && v.x[k] == p.x[index[k]]
+            && v.y[k] == p.y[index[k]] && v.z[k] == p.z[index[k]];
+    // All points lie behind the plane of every face, up to the tolerance of the hull
+    for (size_t f = 0; ok && f < nf; ++f) {
+        const uint32_t corners[3] = {index[tri[3 * f]], index[tri[3 * f + 1]], index[tri[3 * f + 2]]};
+        L normal[3], bound, a[3];
+        test_face(p, corners, normal, bound);
+        test_point(p, corners[0], a);
+        const L len = test_norm(normal);
+        for (size_t i = 0; i < n; ++i)
+            ok &= ((p.x[i] - a[0]) * normal[0] + (p.y[i] - a[1]) * normal[1] + (p.z[i] - a[2]) * normal[2])
+                <= 8 * eps * size * len;
+    }
+    check.expect("convex_hull", scale, ok);
+
+    // Support points against the largest dot product over all points
+    vector<uint32_t> index_all(ndirs);
+    support_points<T>(p.soa(), dirs.soa(), &index_all[0]);
+    bool ok_point = true, ok_points = true, ok_climb = nv > 3;
+    for (size_t k = 0, start = 0; k < ndirs && nv > 3; ++k) {
+        const T dir[3] = {dirs.x[k], dirs.y[k], dirs.z[k]};
+        L d[3], best = -std::numeric_limits<L>::infinity();
+        test_point(dirs, k, d);
+        for (size_t i = 0; i < n; ++i)
+            best = std::max(best, p.x[i] * d[0] + p.y[i] * d[1] + p.z[i] * d[2]);
+        const L tol = 4 * eps * test_norm(d) * size;
+        const size_t i = support_point<T>(p.soa(), dir);
+        ok_point &= i < n && p.x[i] * d[0] + p.y[i] * d[1] + p.z[i] * d[2] >= best - tol;
+        ok_points &= index_all[k] == i;
+        const size_t s = hull.support(dir, start);
+        ok_climb &= s < nv && v.x[s] * d[0] + v.y[s] * d[1] + v.z[s] * d[2] >= best - tol
+            && support_point_climb<T>(v, hull.offsets(), hull.neighbors(), dir, start) == s;
+        start = s;
+    }
+    check.expect("support_point", scale, ok_point);
+
+    // NaN dot products are skipped wherever they fall in a register
+    {
+        test_points<T> q(16, rnd, 0);
+        q.x[3] = 5 * scale;
+        q.x[15] = std::numeric_limits<T>::quiet_NaN();
+        const T dir[3] = {1, 0, 0};
+        bool ok_nan = support_point<T>(q.soa(), dir) == 3;
+        q.x[0] = std::numeric_limits<T>::quiet_NaN();
+        ok_nan &= support_point<T>(q.soa(), dir) == 3;
+        check.expect("support_point(NaN)", scale, ok_nan);
+
+        // Dot products of both signs of zero compare equal, so the first point is the support point
+        for (size_t i = 0; i < 16; ++i)
+            q.x[i] = i % 3 ? T(-0.0) : T(0);
+        const T zdir[3] = {-1, T(-0.0), 0};
+        check.expect("support_point(zeros)", scale, support_point<T>(q.soa(), zdir) == 0);
+    }
+    check.expect("support_points", scale, ok_points);
+    check.expect("support_point_climb", scale, ok_climb);
+
+    // Sets without volume give empty hulls
+    test_points<T> flat(n, rnd, scale);
+    std::fill(flat.z.begin(), flat.z.end(), T(0.5) * scale);
+    const convex_hull<T> planar(flat.soa()), three(p.soa().sub(0, 3));
+    check.expect("convex_hull(degenerate)", scale, planar.vertex_count() == 0 && planar.triangle_count() == 0
+        && three.vertex_count() == 0 && three.triangle_count() == 0);
+}
+
+/*!
+ * \brief Samplers against their ranges and moments. Means are compared with five standard deviations of the
+ * sample mean. The overloads taking a seed fill arrays below random_stream_points from stream 0 of the seed, so
+ * they give the same numbers as a generator constructed from it.
+ */
+template <typename T>
+void check_random(batch_check &check, T scale) {
+    typedef long double L;
+    const size_t n = 1003;
+    const L eps = std::numeric_limits<T>::epsilon(), sigma = 5 / std::sqrt(L(n));
+    const uint64_t seed = 7;
+    test_random rnd;
+    test_points<T> p(n, rnd), q(n, rnd);
+
+    vector<T> u(n);
+    random_stream rng(seed);
+    random_uniform(rng, &u[0], n);
+    L sum = 0;
+    bool ok = true;
+    for (size_t i = 0; i < n; ++i) {
+        ok &= u[i] >= 0 && u[i] < 1;
+        sum += u[i];
+    }
+    check.expect("random_uniform", scale, ok && std::fabs(sum / n - 0.5L) <= sigma / std::sqrt(12.0L));
+
+    // Box with corners which do not make its extent exact
+    const T lo[3] = {-scale, T(0.3) * scale, T(-0.7) * scale}, hi[3] = {T(0.1) * scale, T(2.2) * scale, T(0.7) * scale};
+    rng = random_stream(seed);
+    random_box(rng, lo, hi, p.soa());
+    random_box<T>(seed, lo, hi, q.soa());
+    L mean[3] = {0, 0, 0};
+    for (size_t i = 0; i < n; ++i) {
+        const T v[3] = {p.x[i], p.y[i], p.z[i]};
+        for (int k = 0; k < 3; ++k) {
+            const L slack = eps * (L(hi[k]) - lo[k]);
+            ok &= v[k] >= lo[k] - slack && v[k] <= hi[k] + slack;
+            mean[k] += v[k] / L(n);
+        }
+    }
+    for (int k = 0; k < 3; ++k)
+        ok &= std::fabs(mean[k] - (L(lo[k]) + hi[k]) / 2) <= sigma * (L(hi[k]) - lo[k]) / std::sqrt(12.0L);
+    ok &= p.x == q.x && p.y == q.y && p.z == q.z;
+    check.expect("random_box", scale, ok);
+
+    // Unit vectors with zero mean, the coordinates having variance 1 / 3
+    rng = random_stream(seed);
+    random_sphere(rng, p.soa());
+    random_sphere<T>(seed, q.soa());
+    ok = p.x == q.x && p.y == q.y && p.z == q.z;
+    std::fill(mean, mean + 3, 0);
+    for (size_t i = 0; i < n; ++i) {
+        L v[3];
+        test_point(p, i, v);
+        ok &= std::fabs(test_norm(v) - 1) <= 8 * eps;
+        for (int k = 0; k < 3; ++k)
+            mean[k] += v[k] / n;
+    }
+    for (int k = 0; k < 3; ++k)
+        ok &= std::fabs(mean[k]) <= sigma / std::sqrt(3.0L);
+    check.expect("random_sphere", scale, ok);
+
+    // Points of the unit ball have E|p|^2 = 3 / 5 with variance 3 / 7 - 9 / 25
+    rng = random_stream(seed);
+    random_ball(rng, p.soa());
+    random_ball<T>(seed, q.soa());
+    ok = p.x == q.x && p.y == q.y && p.z == q.z;
+    sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        L v[3];
+        test_point(p, i, v);
+        const L r = test_norm(v);
+        ok &= r <= 1 + 4 * eps;
+        sum += r * r;
+    }
+    check.expect("random_ball", scale, ok && std::fabs(sum / n - 0.6L) <= sigma * std::sqrt(3 / 7.0L - 0.36L));
+
+    // Cosine-weighted directions have E[cos] = 2 / 3 with variance 1 / 2 - 4 / 9, about the z axis by default
+    const T axis[3] = {T(1) / 3, T(2) / 3, T(-2) / 3}, up[3] = {0, 0, 1};
+    for (int k = 0; k < 2; ++k) {
+        const T *a = k ? axis : up;
+        rng = random_stream(seed);
+        random_hemisphere(rng, k ? axis : 0, p.soa());
+        random_hemisphere<T>(seed, k ? axis : 0, q.soa());
+        ok = p.x == q.x && p.y == q.y && p.z == q.z;
+        sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            L v[3];
+            test_point(p, i, v);
+            const L c = v[0] * a[0] + v[1] * a[1] + v[2] * a[2];
+            ok &= std::fabs(test_norm(v) - 1) <= 8 * eps && c >= -8 * eps;
+            sum += c;
+        }
+        ok &= std::fabs(sum / n - 2 / 3.0L) <= sigma * std::sqrt(0.5L - 4 / 9.0L);
+        check.expect(k ? "random_hemisphere(axis)" : "random_hemisphere", scale, ok);
+    }
+}
+
+/*!
+ * \brief Units in the last place of a value of type \e T near \e x
+ */
+template <typename T>
+long double test_ulp(long double x) {
+    int e;
+    std::frexp(x, &e);
+    return std::max(std::ldexp(1.0L, e - std::numeric_limits<T>::digits),
+        static_cast<long double>(std::numeric_limits<T>::denorm_min()));
+}
+
+/*!
+ * \brief Whether \e value is within \e ulps units in the last place of \e ref, or NaN like \e ref
+ */
+template <typename T>
+bool near_ulps(T value, long double ref, long double ulps) {
+    return ref != ref ? value != value : std::fabs(value - ref) <= ulps * test_ulp<T>(ref);
+}
+
+/*!
+ * \brief Trigonometric functions against the long double library within their documented ulp errors, and the
+ * coordinate conversions against long double formulas. The angles of sincos span a few radians at scale 1,
+ * tiny angles at the small scale and the range of exact reduction at the large one; acos is evaluated near
+ * zero and near +-1 at the small and the large scales.
+ */
+template <typename T>
+void check_trig(batch_check &check, T scale) {
+    typedef long double L;
+    const size_t n = 1003;
+    const L eps = std::numeric_limits<T>::epsilon();
+    const T limit = T(sizeof(T) == 4 ? 8192 : 1.6e6), range = std::min(T(8) * scale, limit);
+    test_random rnd;
+    test_points<T> p(n, rnd, scale), s(n, rnd), c(n, rnd);
+
+    vector<T> x(n), y(n), a(n), b(n);
+    for (size_t i = 0; i < n; ++i)
+        x[i] = static_cast<T>(range * rnd.next());
+    batch_sincos(&x[0], &a[0], &b[0], n);
+    bool ok = true;
+    for (size_t i = 0; i < n; ++i)
+        ok &= std::fabs(a[i] - std::sin(L(x[i]))) <= 2.5L * test_ulp<T>(std::sin(L(x[i])))
+            && std::fabs(b[i] - std::cos(L(x[i]))) <= 2.5L * test_ulp<T>(std::cos(L(x[i])));
+    check.expect("batch_sincos", scale, ok);
+
+    // Arguments beyond the exact reduction up to the largest finite one, mixed with smaller ones in registers
+    vector<T> big(n);
+    const L log_range = std::log(L(std::numeric_limits<T>::max()) / limit);
+    for (size_t i = 0; i < n; ++i)
+        big[i] = i % 3 ? static_cast<T>(limit * std::exp(log_range * (rnd.next() + 1) / 2)) * (i % 2 ? -1 : 1)
+            : x[i];
+    batch_sincos(&big[0], &a[0], &b[0], n);
+    ok = true;
+    for (size_t i = 0; i < n; ++i)
+        ok &= near_ulps(a[i], std::sin(L(big[i])), 2.5L) && near_ulps(b[i], std::cos(L(big[i])), 2.5L);
+    check.expect("batch_sincos(large)", scale, ok);
+
+    batch_atan2(&p.y[0], &p.x[0], &a[0], n);
+    ok = true;
+    for (size_t i = 0; i < n; ++i) {
+        const L ref = std::atan2(L(p.y[i]), L(p.x[i]));
+        ok &= std::fabs(a[i] - ref) <= 3 * test_ulp<T>(ref);
+    }
+    check.expect("batch_atan2", scale, ok);
+
+    for (size_t i = 0; i < n; ++i) {
+        const T t = static_cast<T>(rnd.next());
+        x[i] = scale < 1 ? t * scale : scale > 1 ? (t < 0 ? -1 : 1) * (1 - t * t * t * t) : t;
+    }
+    x[0] = 1;
+    x[1] = -1;
+    batch_acos(&x[0], &a[0], n);
+    ok = true;
+    for (size_t i = 0; i < n; ++i)
+        ok &= std::fabs(a[i] - std::acos(L(x[i]))) <= 4 * test_ulp<T>(std::acos(L(x[i])));
+    check.expect("batch_acos", scale, ok);
+
+    // Radii and heights within a few rounding errors, angles within the error of atan2 plus that of its inputs
+    cartesian_to_spherical<T>(p.soa(), s.soa());
+    cartesian_to_cylindrical<T>(p.soa(), c.soa());
+    bool ok_sph = true, ok_cyl = true;
+    for (size_t i = 0; i < n; ++i) {
+        L v[3];
+        test_point(p, i, v);
+        const L r = test_norm(v), rho = std::sqrt(v[0] * v[0] + v[1] * v[1]);
+        const L theta = std::atan2(rho, v[2]), phi = std::atan2(v[1], v[0]);
+        ok_sph &= std::fabs(s.x[i] - r) <= 3 * eps * r && std::fabs(s.y[i] - theta) <= 3 * test_ulp<T>(theta) + 2 * eps
+            && std::fabs(s.z[i] - phi) <= 3 * test_ulp<T>(phi);
+        ok_cyl &= std::fabs(c.x[i] - rho) <= 2 * eps * rho && c.y[i] == s.z[i] && c.z[i] == p.z[i];
+    }
+    check.expect("cartesian_to_spherical", scale, ok_sph);
+    check.expect("cartesian_to_cylindrical", scale, ok_cyl);
+
+    // Back to Cartesian coordinates against the formulas on the computed angles, and against the original points
+    test_points<T> ps(n, rnd), pc(n, rnd);
+    spherical_to_cartesian<T>(s.soa(), ps.soa());
+    cylindrical_to_cartesian<T>(c.soa(), pc.soa());
+    ok_sph = ok_cyl = true;
+    for (size_t i = 0; i < n; ++i) {
+        const L r = s.x[i], st = std::sin(L(s.y[i])), ct = std::cos(L(s.y[i]));
+        const L sp = std::sin(L(s.z[i])), cp = std::cos(L(s.z[i])), rho = c.x[i];
+        const L sph[3] = {r * st * cp, r * st * sp, r * ct};
+        const L cyl[3] = {rho * std::cos(L(c.y[i])), rho * std::sin(L(c.y[i])), c.z[i]};
+        L v[3];
+        test_point(p, i, v);
+        ok_sph &= near_point(ps, i, sph, 8 * eps * r) && near_point(ps, i, v, 32 * eps * r);
+        ok_cyl &= near_point(pc, i, cyl, 8 * eps * rho) && near_point(pc, i, v, 32 * eps * test_norm(v));
+    }
+    check.expect("spherical_to_cartesian", scale, ok_sph);
+    check.expect("cylindrical_to_cartesian", scale, ok_cyl);
+
+    // Special operands at every seventh element, in full registers and in the tail (element 1001): NaN, infinite
+    // and out-of-domain ones give the values of the long double library on every backend
+    const T inf = std::numeric_limits<T>::infinity(), nan = std::numeric_limits<T>::quiet_NaN();
+    const T special[8] = {nan, inf, -inf, 0, std::numeric_limits<T>::max(), std::numeric_limits<T>::denorm_min(),
+        T(-2), T(1) + std::numeric_limits<T>::epsilon()};
+    for (size_t i = 0; i < n; i += 7) {
+        x[i] = special[i / 7 % 8];
+        y[i] = special[i / 56 % 8];
+    }
+    batch_sincos(&x[0], &a[0], &b[0], n);
+    ok = true;
+    for (size_t i = 0; i < n; i += 7)
+        ok &= near_ulps(a[i], std::sin(L(x[i])), 2.5L) && near_ulps(b[i], std::cos(L(x[i])), 2.5L);
+    check.expect("batch_sincos(special)", scale, ok);
+    batch_atan2(&y[0], &x[0], &a[0], n);
+    ok = true;
+    for (size_t i = 0; i < n; i += 7)
+        ok &= near_ulps(a[i], std::atan2(L(y[i]), L(x[i])), 3);
+    check.expect("batch_atan2(special)", scale, ok);
+    batch_acos(&x[0], &a[0], n);
+    ok = true;
+    for (size_t i = 0; i < n; i += 7)
+        ok &= near_ulps(a[i], std::acos(L(x[i])), 4);
+    check.expect("batch_acos(special)", scale, ok);
+
+    // A NaN coordinate makes every spherical coordinate NaN, and the cylindrical ones depending on it
+    for (size_t i = 0; i < n; i += 7)
+        (i / 7 % 3 == 0 ? p.x : i / 7 % 3 == 1 ? p.y : p.z)[i] = nan;
+    cartesian_to_spherical<T>(p.soa(), s.soa());
+    cartesian_to_cylindrical<T>(p.soa(), c.soa());
+    ok_sph = ok_cyl = true;
+    for (size_t i = 0; i < n; i += 7) {
+        const bool planar = i / 7 % 3 < 2;
+        ok_sph &= s.x[i] != s.x[i] && s.y[i] != s.y[i] && s.z[i] != s.z[i];
+        ok_cyl &= (c.x[i] != c.x[i]) == planar && (c.y[i] != c.y[i]) == planar && (c.z[i] != c.z[i]) == !planar;
+    }
+    check.expect("cartesian_to_spherical(NaN)", scale, ok_sph);
+    check.expect("cartesian_to_cylindrical(NaN)", scale, ok_cyl);
+}
+
+/*!
+ * \brief Streaming pipeline: an identity stage passes the points through unchanged, stages and the sink see the
+ * chunks in order with the counts kept by the stages, and an exception of the source, a stage or the sink
+ * reaches the caller of run()
+ */
+template <typename T>
+void check_pipeline(batch_check &check, T scale) {
+    const size_t n = 1003, chunk = 64;
+    test_random rnd;
+    test_points<T> a(n, rnd, scale);
+    vector<T> packed(3 * n);
+    soa_to_aos<T>(a.soa(), &packed[0]);
+
+    // Every third read returns a short chunk; sizes records all reads including the final empty one
+    size_t next = 0, reads = 0;
+    vector<size_t> sizes;
+    const auto read = [&](T *buffer, size_t capacity) {
+        const size_t count = std::min(reads++ % 3 == 2 ? capacity / 4 : capacity, n - next);
+        std::copy(&packed[3 * next], &packed[3 * (next + count)], buffer);
+        next += count;
+        sizes.push_back(count);
+        return count;
+    };
+    vector<T> streamed;
+    vector<size_t> written;
+    const auto write = [&](const T *buffer, size_t count) {
+        streamed.insert(streamed.end(), buffer, buffer + 3 * count);
+        written.push_back(count);
+    };
+
+    point_pipeline<T> identity(chunk);
+    identity.then([](vector3_soa<T> part) { return part.size; });
+    size_t total = identity.run(read, write);
+    bool ok = !sizes.empty() && sizes.back() == 0;
+    if (ok)
+        sizes.pop_back();
+    check.expect("point_pipeline(identity)", scale, ok && total == n && streamed == packed && written == sizes);
+
+    // The first stage records the first point of every chunk, the second keeps a prefix whose length depends on
+    // the chunk number and drops some chunks completely, which are then not passed to the sink
+    next = reads = 0;
+    sizes.clear();
+    streamed.clear();
+    written.clear();
+    vector<T> firsts;
+    size_t calls = 0;
+    point_pipeline<T> prefix(chunk);
+    prefix.then([&](vector3_soa<T> part) { firsts.push_back(part.x[0]); return part.size; })
+        .then([&](vector3_soa<T> part) {
+            const size_t c = calls++;
+            return c % 5 == 3 ? 0 : part.size - std::min(part.size - 1, c % 4 * 5);
+        });
+    total = prefix.run(read, write);
+    vector<T> expected;
+    vector<size_t> expected_counts;
+    size_t expected_total = 0, offset = 0, c = 0;
+    ok = firsts.size() + 1 == sizes.size();
+    for (; ok && sizes[c]; offset += sizes[c++]) {
+        ok = firsts[c] == packed[3 * offset];
+        const size_t kept = c % 5 == 3 ? 0 : sizes[c] - std::min(sizes[c] - 1, c % 4 * 5);
+        if (kept) {
+            expected.insert(expected.end(), &packed[3 * offset], &packed[3 * (offset + kept)]);
+            expected_counts.push_back(kept);
+        }
+        expected_total += kept;
+    }
+    check.expect("point_pipeline(kept)", scale, ok && offset == n && total == expected_total
+        && streamed == expected && written == expected_counts);
+
+    // An exception stops the pipeline: the failing callback is not called again and run() rethrows it
+    const char *const callbacks[3] = {"source", "stage", "sink"};
+    for (int thrower = 0; thrower < 3; ++thrower) {
+        next = reads = 0;
+        size_t stage_calls = 0, sink_calls = 0;
+        point_pipeline<T> failing(chunk);
+        failing.then([&](vector3_soa<T> part) {
+            if (stage_calls++ == 2 && thrower == 1)
+                throw std::runtime_error(callbacks[1]);
+            return part.size;
+        });
+        bool thrown = false;
+        try {
+            failing.run([&](T *buffer, size_t capacity) {
+                if (reads == 4 && thrower == 0)
+                    throw std::runtime_error(callbacks[0]);
+                return read(buffer, capacity);
+            }, [&](const T *, size_t) {
+                if (sink_calls++ == 1 && thrower == 2)
+                    throw std::runtime_error(callbacks[2]);
+            });
+        } catch (const std::runtime_error &e) {
+            thrown = std::string(e.what()) == callbacks[thrower];
+        }
+        ok = thrown && (thrower != 0 || (reads == 4 && stage_calls <= 4));
+        ok &= thrower != 1 || stage_calls == 3;
+        ok &= thrower != 2 || sink_calls == 2;
+        check.expect(thrower == 0 ? "point_pipeline(source error)" : thrower == 1 ? "point_pipeline(stage error)"
+            : "point_pipeline(sink error)", scale, ok);
+    }
+}
+
+/*!
+ * \brief Runs the checks of all batch kernels at every test scale
+ * @return Number of failed checks
+ */
+template <typename T>
+int check_batch_kernels(const char *type) {
+    batch_check check(type);
+    for (int k = 0; k < test_scales; ++k) {
+        const T scale = test_scale<T>(k);
+        check_elementwise<T>(check, scale);
+        check_nbody<T>(check, scale);
+        check_periodic<T>(check, scale);
+        check_splines<T>(check, scale);
+        check_field<T>(check, scale);
+        check_integrators<T>(check, scale);
+        check_filters<T>(check, scale);
+        check_aabbs<T>(check, scale);
+        check_layout<T>(check, scale);
+        check_distances<T>(check, scale);
+        check_superposition<T>(check, scale);
+        check_mesh<T>(check, scale);
+        check_rays<T>(check, scale);
+        check_weld<T>(check, scale);
+        check_pca<T>(check, scale);
+        check_hull<T>(check, scale);
+        check_random<T>(check, scale);
+        check_trig<T>(check, scale);
+        check_pipeline<T>(check, scale);
+    }
+    if (check.failures)
+        std::cerr << "batch kernels<" << type << ">: " << check.failures << " failed checks\n";
+    return check.failures;
+}
+
+#ifdef VECTORS_ENABLE_PROFILING
+/*!
+ * \brief Checks the counters and the report of the profiler on the stages of the RK4 integrator, whose
+ * acceleration callback (all-pairs gravity) is profiled on its own and must not add to the stage times
+ * @return Number of failed checks
+ */
+int check_profiler() {
+    int failures = 0;
+    const auto expect = [&](const char *what, bool ok) {
+        if (!ok && ++failures <= 20)
+            std::cerr << "profiler: " << what << " failed\n";
+    };
+
+    // The batch checks ran every kernel, so the profiled names and the kernel variants must be the same set
+    const std::vector<vectors_profile_entry> ran = vectors_profile_snapshot();
+    const std::vector<vectors_kernel_variant> variants = vectors_kernel_variants();
+    std::set<std::string> profiled, listed;
+    for (size_t i = 0; i < ran.size(); ++i)
+        profiled.insert(ran[i].name);
+    for (size_t i = 0; i < variants.size(); ++i)
+        listed.insert(variants[i].name);
+    for (std::set<std::string>::const_iterator i = profiled.begin(); i != profiled.end(); ++i)
+        if (!listed.count(*i))
+            std::cerr << "profiler: kernel " << *i << " has no variant\n";
+    for (std::set<std::string>::const_iterator i = listed.begin(); i != listed.end(); ++i)
+        if (!profiled.count(*i))
+            std::cerr << "profiler: variant " << *i << " was never profiled\n";
+    expect("kernel variants", profiled == listed && listed.size() == variants.size());
+
+    const size_t n = 203;
+    test_random rnd;
+    test_points<double> pos(n, rnd), vel(n, rnd);
+    vector<double> w(n, 1.0);
+    rk4_integrator<double> rk4(n);
+    vectors_profile_reset();
+    rk4.step(pos.soa(), vel.soa(), 1e-3, [&](vector3_soa<const double> p, vector3_soa<double> a) {
+        nbody_accelerations<double>(p, &w[0], a, 0.01, 1.0);
+    });
+
+    const std::vector<vectors_profile_entry> entries = vectors_profile_snapshot();
+    const vectors_profile_entry *stage = 0, *final = 0, *accel = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].name == "rk4_integrator::stage")
+            stage = &entries[i];
+        else if (entries[i].name == "rk4_integrator::final")
+            final = &entries[i];
+        else if (entries[i].name == "nbody_accelerations")
+            accel = &entries[i];
+    }
+    expect("kernel registration", stage && final && accel);
+    if (failures)
+        return failures;
+    expect("stage counters", stage->calls == 3 && stage->elements == 3 * n);
+    expect("final counters", final->calls == 1 && final->elements == n);
+    expect("callback counters", accel->calls == 4 && accel->elements == 4 * n);
+    expect("callback excluded from stages", stage->cycles + final->cycles < accel->cycles);
+    // Seconds are cycles over one common frequency
+    expect("seconds", stage->seconds > 0 && std::fabs(stage->seconds * final->cycles - final->seconds * stage->cycles)
+        <= 1e-9 * stage->seconds * final->cycles);
+
+    std::ostringstream table, csv;
+    vectors_profile_report(table);
+    vectors_profile_report(csv, true);
+    std::ostringstream table_row, csv_row;
+    table_row << "\nrk4_integrator::stage 3 " << 3 * n << " " << stage->cycles << " ";
+    csv_row << "\nrk4_integrator::final,1," << n << "," << final->cycles << ",";
+    expect("table report", table.str().find("kernel calls elements cycles seconds cycles/element\n") == 0
+        && table.str().find(table_row.str()) != std::string::npos);
+    expect("csv report", csv.str().find("kernel,calls,elements,cycles,seconds\n") == 0
+        && csv.str().find(csv_row.str()) != std::string::npos);
+
+    vectors_profile_reset();
+    const std::vector<vectors_profile_entry> cleared = vectors_profile_snapshot();
+    bool zero = !cleared.empty();
+    for (size_t i = 0; i < cleared.size(); ++i)
+        zero &= cleared[i].calls == 0 && cleared[i].elements == 0 && cleared[i].cycles == 0;
+    expect("reset", zero);
+    return failures;
+}
+
+/*
+ * Timing of the padding lane handling of the SIMD classes, reported through the profiler. The operators are
+ * compared with the code they replaced, which built scalar operands with set intrinsics and wrote the padding
+ * lane of vector divisors through element access. Every element is updated in place in each round, so the
+ * loops measure throughput over independent chains.
+ */
+
+#ifdef __SSE3__
+/*!
+ * \brief Addition of a scalar to vector3f_simd as implemented before the padding lane invariant
+ */
+struct padding_old_float {
+    static MUSTINLINE vector3f_simd add(const vector3f_simd &a, float s) {
+        return _mm_add_ps(a.mmvalue, _mm_setr_ps(s, s, s, 0.0f));
+    }
+};
+#endif
+
+#ifdef __AVX2__
+/*!
+ * \brief Addition of a scalar to vector3d_simd and division as implemented before the padding lane invariant
+ */
+struct padding_old_double {
+    static MUSTINLINE vector3d_simd add(const vector3d_simd &a, double s) {
+        return _mm256_add_pd(a.mmvalue, _mm256_set_pd(0.0, s, s, s));
+    }
+
+    static MUSTINLINE vector3d_simd divide(const vector3d_simd &a, const vector3d_simd &b) {
+        __m256d r = b.mmvalue;
+        r[3] = 1.0;
+        return _mm256_div_pd(a.mmvalue, r);
+    }
+};
+#endif
+
+enum { timing_vectors = 256, timing_rounds = 1000, timing_repeats = 8 };
+
+/*!
+ * \brief Fills the vectors with values close to one, so that repeated operations stay in range
+ */
+template <typename V>
+void timing_fill(V *v, test_random &rnd) {
+    typedef typename V::elt_type T;
+    for (int i = 0; i < timing_vectors; ++i)
+        v[i] = V(T(1 + 0.1 * rnd.next()), T(1 + 0.1 * rnd.next()), T(1 + 0.1 * rnd.next()));
+}
+
+/*!
+ * \brief Times addition of a different scalar to every vector with the old and the current construction of
+ * the operand. The two variants alternate, so that clock changes affect both alike.
+ * @return Sum of the results, which keeps the loops from being optimized out
+ */
+template <typename V, typename Old>
+double time_scalar_paths(const char *old_name, const char *new_name) {
+    typedef typename V::elt_type T;
+    test_random rnd;
+    V a[timing_vectors], b[timing_vectors];
+    T s[2 * timing_vectors];
+    timing_fill(a, rnd);
+    timing_fill(b, rnd);
+    for (int i = 0; i < 2 * timing_vectors; ++i)
+        s[i] = T(1e-3 * rnd.next());
+    for (int k = 0; k < timing_repeats; ++k) {
+        {
+            VECTORS_PROFILE(old_name, timing_vectors * timing_rounds);
+            for (int r = 0; r < timing_rounds; ++r)
+                for (int i = 0; i < timing_vectors; ++i)
+                    a[i] = Old::add(a[i], s[i + (r & 255)]);
+        }
+        {
+            VECTORS_PROFILE(new_name, timing_vectors * timing_rounds);
+            for (int r = 0; r < timing_rounds; ++r)
+                for (int i = 0; i < timing_vectors; ++i)
+                    b[i] = b[i] + s[i + (r & 255)];
+        }
+    }
+    double sum = 0;
+    for (int i = 0; i < timing_vectors; ++i)
+        sum += a[i].x + b[i].x;
+    return sum;
+}
+
+#ifdef __AVX2__
+/*!
+ * \brief Times division of vector3d_simd with the old and the current divisor construction
+ * @return Sum of the results, which keeps the loops from being optimized out
+ */
+double time_divide_paths() {
+    test_random rnd;
+    vector3d_simd a[timing_vectors], b[timing_vectors], d[2 * timing_vectors];
+    timing_fill(a, rnd);
+    timing_fill(b, rnd);
+    timing_fill(d, rnd);
+    timing_fill(d + timing_vectors, rnd);
+    for (int k = 0; k < timing_repeats; ++k) {
+        {
+            VECTORS_PROFILE("vector3d_simd divide (element write)", timing_vectors * timing_rounds);
+            for (int r = 0; r < timing_rounds; ++r)
+                for (int i = 0; i < timing_vectors; ++i)
+                    a[i] = padding_old_double::divide(a[i], d[i + (r & 255)]);
+        }
+        {
+            VECTORS_PROFILE("vector3d_simd divide (blend)", timing_vectors * timing_rounds);
+            for (int r = 0; r < timing_rounds; ++r)
+                for (int i = 0; i < timing_vectors; ++i)
+                    b[i] = b[i] / d[i + (r & 255)];
+        }
+    }
+    double sum = 0;
+    for (int i = 0; i < timing_vectors; ++i)
+        sum += a[i].x + b[i].x;
+    return sum;
+}
+#endif
+
+/*!
+ * \brief Runs the timings of the padding lane handling and prints cycles per operation
+ */
+void time_padding_paths() {
+    vectors_profile_reset();
+    double sum = 0;
+#ifdef __SSE3__
+    sum += time_scalar_paths<vector3f_simd, padding_old_float>("vector3f_simd add scalar (set)",
+        "vector3f_simd add scalar (splat)");
+#endif
+#ifdef __AVX2__
+    sum += time_scalar_paths<vector3d_simd, padding_old_double>("vector3d_simd add scalar (set)",
+        "vector3d_simd add scalar (splat)");
+    sum += time_divide_paths();
+#endif
+    const std::vector<vectors_profile_entry> entries = vectors_profile_snapshot();
+    for (size_t i = 0; i < entries.size(); ++i)
+        if (entries[i].calls && entries[i].name.find("_simd ") != std::string::npos)
+            std::clog << entries[i].name << ": " << double(entries[i].cycles) / entries[i].elements << " cycles\n";
+    (void)sum;
+}
+#endif
+
+#ifdef VECTORS_DETERMINISTIC
+/*
+ * Reproducibility check. Prints a checksum of the results of every batch kernel, which should not depend on the
+ * instruction set or the number of threads, e.g. the output of "g++ -DVECTORS_DETERMINISTIC" and
+ * "g++ -DVECTORS_DETERMINISTIC -ffp-contract=off -mavx2 -mfma -fopenmp" builds should be the same.
+ */
+
+/*!
+ * \brief FNV-1a hash of the bytes of an array
+ */
+template <typename T>
+uint64_t checksum(const T *p, size_t n, uint64_t h = 14695981039346656037ULL) {
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(p);
+    for (size_t i = 0; i < n * sizeof(T); ++i)
+        h = (h ^ bytes[i]) * 1099511628211ULL;
+    return h;
+}
+
+template <typename T>
+uint64_t checksum(const vector<T> &v, uint64_t h = 14695981039346656037ULL) {
+    return checksum(&v[0], v.size(), h);
+}
+
+template <typename T>
+uint64_t checksum(const test_points<T> &p, uint64_t h = 14695981039346656037ULL) {
+    return checksum(&p.z[0], p.z.size(), checksum(&p.y[0], p.y.size(), checksum(&p.x[0], p.x.size(), h)));
+}
+
+template <typename T>
+void print_checksum(const char *kernel, uint64_t h) {
+    cout << kernel << "<" << (sizeof(T) == 4 ? "float" : "double") << "> " << hex << h << dec << "\n";
+}
+
+template <typename T>
+void check_kernels() {
+    const size_t n = 1003;      // not a multiple of any register width, so tails are covered as well
+    test_random rnd;
+    test_points<T> a(n, rnd), b(n, rnd, 2.0), c(n, rnd);
+    vector<T> s(n), w(n, T(1));
+
+    batch_dot<T>(a.soa(), b.soa(), &s[0]);
+    print_checksum<T>("batch_dot", checksum(s));
+    batch_length<T>(b.soa(), &s[0]);
+    print_checksum<T>("batch_length", checksum(s));
+    batch_cross<T>(a.soa(), b.soa(), c.soa());
+    print_checksum<T>("batch_cross", checksum(c));
+    batch_normalize<T>(b.soa(), c.soa());
+    print_checksum<T>("batch_normalize", checksum(c));
+    const T m[12] = {T(0.6), T(-0.8), T(0), T(1), T(0.8), T(0.6), T(0), T(-2), T(0), T(0), T(1), T(0.5)};
+    batch_transform<T>(a.soa(), m, c.soa());
+    print_checksum<T>("batch_transform", checksum(c));
+
+    vector<uint32_t> index(n);
+    size_t kept = filter_sphere<T>(b.soa(), T(0.2), T(-0.1), T(0.3), T(1.2), c.soa(), &index[0]);
+    uint64_t hk = checksum(&c.z[0], kept, checksum(&c.y[0], kept, checksum(&c.x[0], kept)));
+    print_checksum<T>("filter_sphere", checksum(&index[0], kept, hk));
+    const T planes[8] = {T(0.6), T(0.8), T(0), T(0.5), T(0), T(-0.6), T(0.8), T(0.7)};
+    kept = filter_halfspaces<T>(b.soa(), planes, 2, c.soa(), &index[0]);
+    hk = checksum(&c.z[0], kept, checksum(&c.y[0], kept, checksum(&c.x[0], kept)));
+    print_checksum<T>("filter_halfspaces", checksum(&index[0], kept, hk));
+    nbody_accelerations<T>(a.soa(), &w[0], c.soa(), T(0.01), T(1));
+    print_checksum<T>("nbody_accelerations", checksum(c));
+
+    // Integrators, with the n-body accelerations as the force callback
+    const auto accel = [&](vector3_soa<const T> x, vector3_soa<T> out) {
+        nbody_accelerations<T>(x, &w[0], out, T(0.01), T(1));
+    };
+    test_points<T> pos(a), vel(b), acc(c);
+    velocity_verlet_step<T>(pos.soa(), vel.soa(), acc.soa(), T(0.01), accel);
+    print_checksum<T>("velocity_verlet_step", checksum(acc, checksum(vel, checksum(pos))));
+    leapfrog_step<T>(pos.soa(), vel.soa(), acc.soa(), T(0.01));
+    print_checksum<T>("leapfrog_step", checksum(vel, checksum(pos)));
+    rk4_integrator<T> rk4(n);
+    rk4.step(pos.soa(), vel.soa(), T(0.01), accel);
+    print_checksum<T>("rk4_integrator", checksum(vel, checksum(pos)));
+
+    vector<T> d(n * n);
+    distance_matrix<T>(a.soa(), b.soa(), &d[0]);
+    print_checksum<T>("distance_matrix", checksum(d));
+    condensed_distances<T>(a.soa(), &d[0]);
+    print_checksum<T>("condensed_distances", checksum(&d[0], n * (n - 1) / 2));
+
+    const superposition<T> fit = superpose(a.soa(), b.soa());
+    print_checksum<T>("superpose", checksum(fit.transform, 12, checksum(&fit.rmsd, 1)));
+    const size_t structure = 17, nstructures = n / structure;
+    vector<superposition<T> > fits(nstructures);
+    superpose_batch<T>(a.soa().sub(0, nstructures * structure), b.soa().sub(0, nstructures * structure),
+        structure, &fits[0]);
+    superposition_rmsd_batch<T>(a.soa().sub(0, nstructures * structure), b.soa().sub(0, nstructures * structure),
+        structure, &s[0]);
+    print_checksum<T>("superpose_batch", checksum(&s[0], nstructures, checksum(&fits[0], nstructures)));
+
+    const T cell_a[3] = {T(2), T(0), T(0)}, cell_b[3] = {T(0.5), T(2), T(0)}, cell_c[3] = {T(0.3), T(-0.4), T(2)};
+    const periodic_box<T> box(cell_a, cell_b, cell_c);
+    periodic_distance<T>(box, a.soa(), b.soa(), &s[0]);
+    print_checksum<T>("periodic_distance", checksum(s));
+    periodic_wrap<T>(box, b.soa(), c.soa());
+    print_checksum<T>("periodic_wrap", checksum(c));
+    periodic_difference<T>(box, a.soa(), b.soa(), c.soa());
+    print_checksum<T>("periodic_difference", checksum(c));
+
+    for (size_t i = 0; i < n; ++i)
+        s[i] = static_cast<T>(i % 97) / T(8);
+    spline_catmull_rom<T>(b.soa().sub(0, 13), &s[0], n, c.soa());
+    print_checksum<T>("spline_catmull_rom", checksum(c));
+    spline_hermite<T>(b.soa().sub(0, 13), a.soa().sub(0, 13), &s[0], n, c.soa());
+    print_checksum<T>("spline_hermite", checksum(c));
+    spline_bezier<T>(b.soa().sub(0, 13), &s[0], n, c.soa());
+    print_checksum<T>("spline_bezier", checksum(c));
+    for (size_t i = 0; i < n; ++i)
+        s[i] = static_cast<T>(i % 89) / T(88);
+    batch_lerp<T>(a.soa(), b.soa(), &s[0], c.soa());
+    print_checksum<T>("batch_lerp", checksum(c));
+    batch_slerp<T>(a.soa(), b.soa(), &s[0], c.soa());
+    print_checksum<T>("batch_slerp", checksum(c));
+
+    vector<uint32_t> triangles(3 * n);
+    for (size_t k = 0; k < triangles.size(); ++k)
+        triangles[k] = static_cast<uint32_t>((k * 7919) % n);
+    const mesh_adjacency adj(&triangles[0], n, n);
+    mesh_face_normals<T>(a.soa(), &triangles[0], n, c.soa(), &s[0]);
+    print_checksum<T>("mesh_face_normals", checksum(s, checksum(c)));
+    mesh_face_areas<T>(b.soa(), &triangles[0], n, &s[0]);
+    print_checksum<T>("mesh_face_areas", checksum(s));
+    mesh_vertex_normals<T>(a.soa(), &triangles[0], adj, c.soa());
+    print_checksum<T>("mesh_vertex_normals", checksum(c));
+
+    vector<T> u(n), v(n);
+    vector<int32_t> hit(n);
+    closest_hits<T>(a.soa(), b.soa(), T(0), T(10), b.soa(), c.soa(), a.soa(), &s[0], &u[0], &v[0], &hit[0]);
+    const uint64_t h = checksum(&v[0], n, checksum(&u[0], n, checksum(s)));
+    print_checksum<T>("closest_hits", checksum(&hit[0], n, h));
+    const T ray_origin[3] = {T(0.1), T(-0.2), T(-3)}, ray_dir[3] = {T(0.05), T(0.1), T(1)};
+    intersect_ray_triangles<T>(ray_origin, ray_dir, T(0), T(10), b.soa(), c.soa(), a.soa(), &s[0], &u[0], &v[0]);
+    print_checksum<T>("intersect_ray_triangles", checksum(&v[0], n, checksum(&u[0], n, checksum(s))));
+    occluded_rays<T>(a.soa(), b.soa(), T(0), T(10), b.soa(), c.soa(), a.soa(), &hit[0]);
+    print_checksum<T>("occluded_rays", checksum(&hit[0], n));
+
+    test_points<T> box_hi(a);
+    for (size_t i = 0; i < n; ++i) {
+        box_hi.x[i] = a.x[i] + std::fabs(b.x[i]) / 4;
+        box_hi.y[i] = a.y[i] + std::fabs(b.y[i]) / 4;
+        box_hi.z[i] = a.z[i] + std::fabs(b.z[i]) / 4;
+    }
+    intersect_ray_boxes<T>(ray_origin, ray_dir, T(0), T(10), a.soa(), box_hi.soa(), &s[0]);
+    print_checksum<T>("intersect_ray_boxes", checksum(s));
+    const size_t box_offsets[4] = {0, 5, 100, n};
+    test_points<T> blo(c), bhi(c);
+    build_aabbs<T>(b.soa(), box_offsets, 3, blo.soa(), bhi.soa());
+    print_checksum<T>("build_aabbs", checksum(bhi, checksum(blo)));
+
+    vector<T> packed(3 * n), streamed;
+    soa_to_aos<T>(a.soa(), &packed[0]);
+    size_t next = 0;
+    point_pipeline<T> pipeline(64);
+    pipeline.then([&](vector3_soa<T> chunk) { batch_transform<T>(chunk, m, chunk); return chunk.size; })
+        .then([](vector3_soa<T> chunk) { return filter_sphere<T>(chunk, T(0), T(0), T(0), T(1.5), chunk); });
+    pipeline.run([&](T *buffer, size_t capacity) {
+        const size_t count = std::min(capacity, n - next);
+        std::copy(&packed[3 * next], &packed[3 * (next + count)], buffer);
+        next += count;
+        return count;
+    }, [&](const T *buffer, size_t count) { streamed.insert(streamed.end(), buffer, buffer + 3 * count); });
+    print_checksum<T>("point_pipeline", checksum(streamed));
+
+    vector<uint32_t> remap(n);
+    const size_t welded = weld_points<T>(a.soa(), T(0.1), &remap[0], c.soa());
+    print_checksum<T>("weld_points", checksum(&remap[0], n, checksum(&c.x[0], welded, welded)));
+
+    point_moments<T> moments;
+    moments.add(a.soa()).add(b.soa());
+    T cov[6];
+    moments.covariance(cov);
+    const oriented_box<T> obb = fit_obb<T>(a.soa());
+    const uint64_t hb = checksum(obb.axes, 9, checksum(obb.center, 3, checksum(cov, 6)));
+    print_checksum<T>("fit_obb", checksum(obb.half_extent, 3, hb));
+    const size_t obb_offsets[4] = {0, 5, 100, n};
+    oriented_box<T> obbs[3];
+    build_obbs<T>(b.soa(), obb_offsets, 3, obbs);
+    print_checksum<T>("build_obbs", checksum(obbs, 3));
+
+    const convex_hull<T> hull(a.soa());
+    vector<uint32_t> support(n);
+    support_points<T>(a.soa(), b.soa(), &support[0]);
+    size_t vertex = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const T dir[3] = {b.x[i], b.y[i], b.z[i]};
+        vertex = hull.support(dir, vertex);
+        remap[i] = hull.indices()[vertex];
+    }
+    const uint64_t hh = checksum(hull.triangles(), 3 * hull.triangle_count(), checksum(&support[0], n));
+    print_checksum<T>("convex_hull", checksum(&remap[0], n, hh));
+
+    random_stream rng(2018);
+    const T axis[3] = {T(0.6), T(0), T(-0.8)}, lo[3] = {-1, 0, 1}, hi[3] = {1, 2, 4};
+    random_sphere<T>(rng, c.soa());
+    print_checksum<T>("random_sphere", checksum(c));
+    random_ball<T>(rng, c.soa());
+    print_checksum<T>("random_ball", checksum(c));
+    random_hemisphere<T>(uint64_t(2018), axis, c.soa());
+    print_checksum<T>("random_hemisphere", checksum(c));
+    random_box<T>(uint64_t(2018), lo, hi, c.soa());
+    print_checksum<T>("random_box", checksum(c));
+    random_uniform<T>(rng, &s[0], n);
+    print_checksum<T>("random_uniform", checksum(s));
+
+    cartesian_to_spherical<T>(a.soa(), c.soa());
+    uint64_t ht = checksum(c);
+    spherical_to_cartesian<T>(c.soa(), c.soa());
+    ht = checksum(&c.y[0], n, checksum(&c.x[0], n, ht));
+    cartesian_to_cylindrical<T>(b.soa(), c.soa());
+    batch_sincos<T>(&b.x[0], &c.x[0], &c.y[0], n);
+    batch_acos<T>(&c.y[0], &c.z[0], n);
+    print_checksum<T>("cartesian_to_spherical", checksum(&c.z[0], n, checksum(&c.x[0], n, ht)));
+    cylindrical_to_cartesian<T>(b.soa(), c.soa());
+    batch_atan2<T>(&a.y[0], &a.x[0], &s[0], n);
+    print_checksum<T>("batch_atan2", checksum(s, checksum(c)));
+
+    const size_t dims[3] = {12, 10, 9};
+    const T origin[3] = {-1, -1, -1}, spacing[3] = {T(0.2), T(0.25), T(0.3)};
+    vector<T> nodes(3 * dims[0] * dims[1] * dims[2]);
+    for (size_t i = 0; i < nodes.size(); ++i)
+        nodes[i] = T(i % 17) * T(0.25) - 1;
+    const vector_field_grid<T> field(&nodes[0], 3, dims, origin, spacing);
+    sample_trilinear<T>(field, a.soa(), c.soa());
+    print_checksum<T>("sample_trilinear", checksum(c));
+    sample_tricubic<T>(field, a.soa(), c.soa());
+    print_checksum<T>("sample_tricubic", checksum(c));
+    field_brick_order<T>(field, a.soa(), &remap[0]);
+    print_checksum<T>("field_brick_order", checksum(&remap[0], n));
+}
+
+/*!
+ * \brief Compares results of the vector classes with scalar expressions bit by bit
+ * @return Number of mismatches
+ */
+int check_vectors() {
+    int mismatches = 0;
+    test_random rnd;
+    for (int i = 0; i < 1000; ++i) {
+        const double ax = rnd.next(), ay = rnd.next(), az = rnd.next();
+        const double bx = rnd.next(), by = rnd.next(), bz = rnd.next();
+        const vector3_reg ra(ax, ay, az), rb(bx, by, bz);
+        if (ra.dot(rb) != ax * bx + ay * by + az * bz)
+            ++mismatches;
+#ifdef __AVX2__
+        const vector3d_simd da(ax, ay, az), db(bx, by, bz);
+        const vector3d_simd dn = da.normalize();
+        const vector3_reg rn = ra.normalize();
+        if (da.dot(db) != ra.dot(rb) || da.length() != ra.length())
+            ++mismatches;
+        if (dn.x != rn.x || dn.y != rn.y || dn.z != rn.z)
+            ++mismatches;
+#endif
+#ifdef __SSE3__
+        const float fx = static_cast<float>(ax), fy = static_cast<float>(ay), fz = static_cast<float>(az);
+        const float fl = std::sqrt(fx * fx + fy * fy + fz * fz);
+        const vector3f_simd fa(fx, fy, fz);
+        const vector3f_simd fn = fa.normalize();
+        if (fa.length() != fl || fa.rlength() != 1.f / fl)
+            ++mismatches;
+        if (fn.x != fx / fl || fn.y != fy / fl || fn.z != fz / fl)
+            ++mismatches;
+#endif
+    }
+    return mismatches;
+}
+#endif
+
 int main() {
 
     typedef vector3_reg vector3;
@@ -39,5 +3222,29 @@ int main() {
 
     std::cout << a << "\n";
 
+    vectors_feature_report(std::clog);
+    if (!vectors_missing_features().empty()) {
+        std::cerr << "FAILED: compiled for instruction sets the CPU does not support\n";
+        return 1;
+    }
+
+    if (check_vector_classes() + check_batch_kernels<float>("float") + check_batch_kernels<double>("double"))
+        return 1;
+
+#ifdef VECTORS_ENABLE_PROFILING
+    if (check_profiler())
+        return 1;
+    time_padding_paths();
+#endif
+
+#ifdef VECTORS_DETERMINISTIC
+    check_kernels<float>();
+    check_kernels<double>();
+    const int mismatches = check_vectors();
+    std::cout << "vector class mismatches: " << mismatches << "\n";
+    if (mismatches)
+        return 1;
+#endif
+
 	return 0;
 }
@@ -33,7 +33,35 @@
 #include "Vector3d_simd.h"
 #endif
 
+#ifdef __SSE4_1__
+#include "Vector3i_simd.h"
+#endif
+
 #include "Vector3_reg.h"
+#include "Vector3_soa.h"
+#include "Vector3_strided.h"
+
+#include "VectorsNbody.h"
+#include "VectorsIntegrators.h"
+#include "VectorsBatch.h"
+#include "VectorsFilter.h"
+#include "VectorsAabb.h"
+#include "VectorsTranspose.h"
+#include "VectorsDistance.h"
+#include "VectorsSuperpose.h"
+#include "VectorsPeriodic.h"
+#include "VectorsSpline.h"
+#include "VectorsMesh.h"
+#include "VectorsRay.h"
+#include "VectorsStream.h"
+#include "VectorsWeld.h"
+#include "VectorsPca.h"
+#include "VectorsHull.h"
+#include "VectorsRandom.h"
+#include "VectorsTrig.h"
+#include "VectorsField.h"
+#include "VectorsFeatures.h"
+#include "VectorsProfiler.h"
 
 
 #endif /* VECTORS_H_ */
@@ -0,0 +1,354 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTORSAABB_H_
+#define VECTORSAABB_H_
+
+#include <limits>
+#include "VectorsInternal.h"
+#include "VectorsPack.h"
+#include "VectorsProfiler.h"
+#include "VectorsFilter.h"
+#include "Vector3_soa.h"
+
+/*!
+ * \class aabb
+ * \brief Axis-aligned bounding box. Template parameter is one of the vector classes (vector3_reg,
+ * vector3f_simd or vector3d_simd); all operations are built on coordinate-wise min/max and comparisons of
+ * that class, so they stay in registers for the SIMD versions.
+ */
+template <typename V>
+class aabb {
+public:
+    typedef V vector_type;
+    typedef typename V::elt_type elt_type;
+
+    V lo;   //!< Lower corner
+    V hi;   //!< Upper corner
+
+    /*!
+     * \brief Default constructor. Creates an empty box which can be expanded by points.
+     */
+    MUSTINLINE aabb() :
+        lo(std::numeric_limits<elt_type>::infinity(), std::numeric_limits<elt_type>::infinity(),
+            std::numeric_limits<elt_type>::infinity()),
+        hi(-std::numeric_limits<elt_type>::infinity(), -std::numeric_limits<elt_type>::infinity(),
+            -std::numeric_limits<elt_type>::infinity()) { }
+
+    /*!
+     * \brief Constructor takes two corners of the box
+     */
+    MUSTINLINE aabb(const V &_lo, const V &_hi) : lo(_lo), hi(_hi) { }
+
+    /*!
+     * \brief Checks whether the box contains no points
+     */
+    MUSTINLINE bool is_empty() const {
+        return (hi < lo).any();
+    }
+
+    /*!
+     * \brief Expands \e this box to contain the given point. NaN coordinates are skipped, as in build_aabbs().
+     * @param p Point
+     * @return Reference to \e this box
+     */
+    MUSTINLINE aabb &expand(const V &p) {
+        lo = V::select(p < lo, p, lo);
+        hi = V::select(hi < p, p, hi);
+        return *this;
+    }
+
+    /*!
+     * \brief Expands \e this box to contain the other one. NaN coordinates of the other box are skipped.
+     * @param other Other box
+     * @return Reference to \e this box
+     */
+    MUSTINLINE aabb &merge(const aabb &other) {
+        lo = V::select(other.lo < lo, other.lo, lo);
+        hi = V::select(hi < other.hi, other.hi, hi);
+        return *this;
+    }
+
+    /*!
+     * \brief Checks whether the point lies inside the box (boundary included)
+     */
+    MUSTINLINE bool contains(const V &p) const {
+        return ((lo <= p) & (p <= hi)).all();
+    }
+
+    /*!
+     * \brief Checks whether the other box lies inside \e this one
+     */
+    MUSTINLINE bool contains(const aabb &other) const {
+        return ((lo <= other.lo) & (other.hi <= hi)).all();
+    }
+
+    /*!
+     * \brief Checks whether two boxes overlap (touching boxes overlap)
+     */
+    MUSTINLINE bool overlaps(const aabb &other) const {
+        return ((lo <= other.hi) & (other.lo <= hi)).all();
+    }
+
+    /*!
+     * \brief Center of the box
+     */
+    MUSTINLINE V center() const {
+        return (lo + hi) * elt_type(0.5);
+    }
+
+    /*!
+     * \brief Edge lengths of the box
+     */
+    MUSTINLINE V extent() const {
+        return hi - lo;
+    }
+
+    /*!
+     * \brief Surface area of the box
+     */
+    MUSTINLINE elt_type surface_area() const {
+        const V e = extent();
+        return 2 * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    /*!
+     * \brief Volume of the box
+     */
+    MUSTINLINE elt_type volume() const {
+        const V e = extent();
+        return e.x * e.y * e.z;
+    }
+
+    /*!
+     * \brief Slab test of a ray against the box
+     * @param origin Origin of the ray
+     * @param inv_dir Reciprocal of the ray direction, coordinate-wise
+     * @param tmin Start of the ray interval
+     * @param tmax End of the ray interval
+     * @param t Output parameter of the entry point, valid if the ray hits the box
+     * @return True if the ray hits the box within [tmin, tmax]
+     */
+    MUSTINLINE bool intersect_ray(const V &origin, const V &inv_dir, elt_type tmin, elt_type tmax,
+            elt_type &t) const {
+        const V t1 = (lo - origin) * inv_dir;
+        const V t2 = (hi - origin) * inv_dir;
+        // Ordered comparisons skip slabs with NaN distances, as in intersect_ray_boxes()
+        const typename V::mask_type swap = t2 < t1;
+        const V tn = V::select(swap, t2, t1);
+        const V tf = V::select(swap, t1, t2);
+        elt_type tnear = tn.x > tmin ? tn.x : tmin;
+        tnear = tn.y > tnear ? tn.y : tnear;
+        tnear = tn.z > tnear ? tn.z : tnear;
+        elt_type tfar = tf.x < tmax ? tf.x : tmax;
+        tfar = tf.y < tfar ? tf.y : tfar;
+        tfar = tf.z < tfar ? tf.z : tfar;
+        t = tnear;
+        return tnear <= tfar;
+    }
+
+    /*!
+     * \brief Prints corners of the box into the stream
+     */
+    friend MUSTINLINE std::ostream &operator<< (std::ostream &os, const aabb &b) {
+        os << b.lo << "- " << b.hi;
+        return os;
+    }
+};
+
+namespace vectors_internal {
+
+template <typename P>
+MUSTINLINE typename P::mask ray_boxes_step(const vector3_soa<const typename P::elt_type> &lo,
+        const vector3_soa<const typename P::elt_type> &hi, const typename P::elt_type *origin,
+        const typename P::elt_type *inv_dir, typename P::elt_type tmin, typename P::elt_type tmax, size_t i,
+        typename P::reg &tnear) {
+    typedef typename P::reg reg;
+    const typename P::elt_type *l[3] = {lo.x, lo.y, lo.z};
+    const typename P::elt_type *h[3] = {hi.x, hi.y, hi.z};
+    reg tn = P::set1(tmin);
+    reg tf = P::set1(tmax);
+    for (int d = 0; d < 3; ++d) {
+        const reg o = P::set1(origin[d]);
+        const reg inv = P::set1(inv_dir[d]);
+        const reg t1 = P::mul(P::sub(P::load(l[d] + i), o), inv);
+        const reg t2 = P::mul(P::sub(P::load(h[d] + i), o), inv);
+        // A ray parallel to the slab and starting on its plane gives 0 * inf = NaN; ordered comparisons skip
+        // such a slab on every backend instead of letting NaN replace the interval built so far
+        const typename P::mask swap = P::cmp_lt(t2, t1);
+        const reg near = P::select(swap, t2, t1), far = P::select(swap, t1, t2);
+        tn = P::select(P::cmp_gt(near, tn), near, tn);
+        tf = P::select(P::cmp_lt(far, tf), far, tf);
+    }
+    tnear = tn;
+    return P::cmp_le(tn, tf);
+}
+
+template <typename P>
+MUSTINLINE typename P::mask overlap_step(const vector3_soa<const typename P::elt_type> &lo,
+        const vector3_soa<const typename P::elt_type> &hi, const typename P::elt_type *qlo,
+        const typename P::elt_type *qhi, size_t i) {
+    const typename P::elt_type *l[3] = {lo.x, lo.y, lo.z};
+    const typename P::elt_type *h[3] = {hi.x, hi.y, hi.z};
+    typename P::mask m = P::cmp_le(P::load(l[0] + i), P::set1(qhi[0]));
+    m = P::mask_and(m, P::cmp_le(P::set1(qlo[0]), P::load(h[0] + i)));
+    for (int d = 1; d < 3; ++d) {
+        m = P::mask_and(m, P::cmp_le(P::load(l[d] + i), P::set1(qhi[d])));
+        m = P::mask_and(m, P::cmp_le(P::set1(qlo[d]), P::load(h[d] + i)));
+    }
+    return m;
+}
+
+template <typename P>
+MUSTINLINE void bounds_step(const vector3_soa<const typename P::elt_type> &points, size_t i,
+        typename P::reg *lo, typename P::reg *hi) {
+    const typename P::elt_type *p[3] = {points.x, points.y, points.z};
+    for (int d = 0; d < 3; ++d) {
+        // Ordered comparisons skip NaN coordinates
+        const typename P::reg v = P::load(p[d] + i);
+        lo[d] = P::select(P::cmp_lt(v, lo[d]), v, lo[d]);
+        hi[d] = P::select(P::cmp_gt(v, hi[d]), v, hi[d]);
+    }
+}
+
+} // namespace vectors_internal
+
+/*!
+ * \brief Slab test of a single ray against an array of boxes stored as two SoA arrays of corners. Eight
+ * (single precision) or four (double precision) boxes are tested at once.
+ * @param origin Origin of the ray, three coordinates
+ * @param dir Direction of the ray, three coordinates
+ * @param tmin Start of the ray interval
+ * @param tmax End of the ray interval
+ * @param lo Lower corners of boxes
+ * @param hi Upper corners of boxes
+ * @param t_entry Output array of entry distances, infinity for missed boxes
+ * @return Number of boxes hit by the ray
+ */
+template <typename T>
+size_t intersect_ray_boxes(const T *origin, const T *dir, T tmin, T tmax, typename vector3_soa_in<T>::type lo,
+        typename vector3_soa_in<T>::type hi, T *t_entry) {
+    VECTORS_PROFILE("intersect_ray_boxes", lo.size);
+    typedef vectors_internal::simd_pack<T> P;
+    typedef vectors_internal::scalar_pack<T> S;
+
+    const T inv_dir[3] = {T(1) / dir[0], T(1) / dir[1], T(1) / dir[2]};
+    const T inf = std::numeric_limits<T>::infinity();
+    size_t hits = 0, i = 0;
+    for (; i + P::width <= lo.size; i += P::width) {
+        typename P::reg tn;
+        typename P::mask m = vectors_internal::ray_boxes_step<P>(lo, hi, origin, inv_dir, tmin, tmax, i, tn);
+        P::store(t_entry + i, P::select(m, tn, P::set1(inf)));
+        hits += vectors_internal::compaction_lut().count[P::movemask(m)];
+    }
+    for (; i < lo.size; ++i) {
+        T tn;
+        bool m = vectors_internal::ray_boxes_step<S>(lo, hi, origin, inv_dir, tmin, tmax, i, tn);
+        t_entry[i] = m ? tn : inf;
+        hits += m;
+    }
+    return hits;
+}
+
+/*!
+ * \brief Finds boxes overlapping the query box
+ * @param qlo Lower corner of the query box, three coordinates
+ * @param qhi Upper corner of the query box, three coordinates
+ * @param lo Lower corners of boxes
+ * @param hi Upper corners of boxes
+ * @param index Output array of indices of overlapping boxes, should have room for lo.size elements
+ * @return Number of overlapping boxes
+ */
+template <typename T>
+size_t overlap_boxes(const T *qlo, const T *qhi, typename vector3_soa_in<T>::type lo,
+        typename vector3_soa_in<T>::type hi, uint32_t *index) {
+    VECTORS_PROFILE("overlap_boxes", lo.size);
+    typedef vectors_internal::simd_pack<T> P;
+    typedef vectors_internal::scalar_pack<T> S;
+
+    size_t k = 0, i = 0;
+    for (; i + P::width <= lo.size; i += P::width) {
+        const int bits = P::movemask(vectors_internal::overlap_step<P>(lo, hi, qlo, qhi, i));
+        vectors_internal::compressor<T, P::width>(bits).store_index(index + k, i);
+        k += vectors_internal::compaction_lut().count[bits];
+    }
+    for (; i < lo.size; ++i)
+        if (vectors_internal::overlap_step<S>(lo, hi, qlo, qhi, i))
+            index[k++] = static_cast<uint32_t>(i);
+    return k;
+}
+
+/*!
+ * \brief Computes bounding boxes of ranges of points. Ranges are processed in parallel. Coordinates which are
+ * NaN are skipped.
+ * @param points Array of points
+ * @param offsets Array of \e nranges + 1 offsets; range r consists of points [offsets[r], offsets[r + 1])
+ * @param nranges Number of ranges
+ * @param lo Output lower corners, one per range
+ * @param hi Output upper corners, one per range
+ */
+template <typename T>
+void build_aabbs(typename vector3_soa_in<T>::type points, const size_t *offsets, size_t nranges,
+        vector3_soa<T> lo, vector3_soa<T> hi) {
+    VECTORS_PROFILE("build_aabbs", points.size);
+    typedef vectors_internal::simd_pack<T> P;
+    typedef vectors_internal::scalar_pack<T> S;
+    const T inf = std::numeric_limits<T>::infinity();
+
+    VECTORS_OMP(parallel for schedule(dynamic, 16))
+    for (ptrdiff_t r = 0; r < static_cast<ptrdiff_t>(nranges); ++r) {
+        const size_t end = offsets[r + 1];
+        size_t i = offsets[r];
+
+        typename P::reg vlo[3], vhi[3];
+        for (int d = 0; d < 3; ++d) {
+            vlo[d] = P::set1(inf);
+            vhi[d] = P::set1(-inf);
+        }
+        for (; i + P::width <= end; i += P::width)
+            vectors_internal::bounds_step<P>(points, i, vlo, vhi);
+
+        T slo[3] = {inf, inf, inf}, shi[3] = {-inf, -inf, -inf};
+        for (; i < end; ++i)
+            vectors_internal::bounds_step<S>(points, i, slo, shi);
+
+        T buf_lo[P::width], buf_hi[P::width];
+        for (int d = 0; d < 3; ++d) {
+            P::store(buf_lo, vlo[d]);
+            P::store(buf_hi, vhi[d]);
+            for (int k = 0; k < P::width; ++k) {
+                slo[d] = S::min(slo[d], buf_lo[k]);
+                shi[d] = S::max(shi[d], buf_hi[k]);
+            }
+        }
+        lo.x[r] = slo[0];
+        lo.y[r] = slo[1];
+        lo.z[r] = slo[2];
+        hi.x[r] = shi[0];
+        hi.y[r] = shi[1];
+        hi.z[r] = shi[2];
+    }
+}
+
+#endif /* VECTORSAABB_H_ */
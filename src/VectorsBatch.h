@@ -0,0 +1,187 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTORSBATCH_H_
+#define VECTORSBATCH_H_
+
+#include "VectorsInternal.h"
+#include "VectorsPack.h"
+#include "VectorsProfiler.h"
+#include "Vector3_soa.h"
+
+/*
+ * Element-wise batch versions of the basic vector operations. Output arrays may alias input arrays.
+ */
+
+namespace vectors_internal {
+
+template <typename T>
+struct dot_kernel {
+    const T *ax, *ay, *az, *bx, *by, *bz;
+    T *out;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        const typename P::reg a[3] = {P::load(ax + i), P::load(ay + i), P::load(az + i)};
+        const typename P::reg b[3] = {P::load(bx + i), P::load(by + i), P::load(bz + i)};
+        P::store(out + i, dot3<P>(a, b));
+    }
+};
+
+template <typename T>
+struct length_kernel {
+    const T *x, *y, *z;
+    T *out;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        typename P::reg vx = P::load(x + i), vy = P::load(y + i), vz = P::load(z + i);
+        P::store(out + i, P::sqrt(P::fmadd(vz, vz, P::fmadd(vy, vy, P::mul(vx, vx)))));
+    }
+};
+
+template <typename T>
+struct cross_kernel {
+    const T *ax, *ay, *az, *bx, *by, *bz;
+    T *ox, *oy, *oz;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        const typename P::reg a[3] = {P::load(ax + i), P::load(ay + i), P::load(az + i)};
+        const typename P::reg b[3] = {P::load(bx + i), P::load(by + i), P::load(bz + i)};
+        typename P::reg c[3];
+        cross3<P>(a, b, c);
+        P::store(ox + i, c[0]);
+        P::store(oy + i, c[1]);
+        P::store(oz + i, c[2]);
+    }
+};
+
+template <typename T>
+struct normalize_kernel {
+    const T *x, *y, *z;
+    T *ox, *oy, *oz;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        typename P::reg vx = P::load(x + i), vy = P::load(y + i), vz = P::load(z + i);
+        typename P::reg r = P::rsqrt(P::fmadd(vz, vz, P::fmadd(vy, vy, P::mul(vx, vx))));
+        P::store(ox + i, P::mul(vx, r));
+        P::store(oy + i, P::mul(vy, r));
+        P::store(oz + i, P::mul(vz, r));
+    }
+};
+
+template <typename T>
+struct transform_kernel {
+    const T *x, *y, *z;
+    T *ox, *oy, *oz;
+    T m[12];
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        typename P::reg vx = P::load(x + i), vy = P::load(y + i), vz = P::load(z + i);
+        T *out[3] = {ox, oy, oz};
+        for (int r = 0; r < 3; ++r) {
+            const T *row = m + 4 * r;
+            P::store(out[r] + i, P::fmadd(P::set1(row[2]), vz,
+                P::fmadd(P::set1(row[1]), vy, P::fmadd(P::set1(row[0]), vx, P::set1(row[3])))));
+        }
+    }
+};
+
+} // namespace vectors_internal
+
+/*!
+ * \brief Dot products of corresponding vectors
+ * @param a First array of vectors
+ * @param b Second array of vectors
+ * @param out Output array of scalars
+ */
+template <typename T>
+void batch_dot(typename vector3_soa_in<T>::type a, typename vector3_soa_in<T>::type b, T *out) {
+    VECTORS_PROFILE("batch_dot", a.size);
+    vectors_internal::dot_kernel<T> k = {a.x, a.y, a.z, b.x, b.y, b.z, out};
+    vectors_internal::pack_for<T>(a.size, k);
+}
+
+/*!
+ * \brief Lengths of vectors
+ * @param v Array of vectors
+ * @param out Output array of scalars
+ */
+template <typename T>
+void batch_length(typename vector3_soa_in<T>::type v, T *out) {
+    VECTORS_PROFILE("batch_length", v.size);
+    vectors_internal::length_kernel<T> k = {v.x, v.y, v.z, out};
+    vectors_internal::pack_for<T>(v.size, k);
+}
+
+/*!
+ * \brief Cross products of corresponding vectors
+ * @param a First array of vectors
+ * @param b Second array of vectors
+ * @param out Output array of vectors
+ */
+template <typename T>
+void batch_cross(typename vector3_soa_in<T>::type a, typename vector3_soa_in<T>::type b, vector3_soa<T> out) {
+    VECTORS_PROFILE("batch_cross", a.size);
+    vectors_internal::cross_kernel<T> k = {a.x, a.y, a.z, b.x, b.y, b.z, out.x, out.y, out.z};
+    vectors_internal::pack_for<T>(a.size, k);
+}
+
+/*!
+ * \brief Scales vectors to unit length
+ * @param v Array of vectors
+ * @param out Output array of vectors
+ */
+template <typename T>
+void batch_normalize(typename vector3_soa_in<T>::type v, vector3_soa<T> out) {
+    VECTORS_PROFILE("batch_normalize", v.size);
+    vectors_internal::normalize_kernel<T> k = {v.x, v.y, v.z, out.x, out.y, out.z};
+    vectors_internal::pack_for<T>(v.size, k);
+}
+
+/*!
+ * \brief Affine transformation of vectors: out = A v + t
+ * @param v Array of vectors
+ * @param m Row-major 3x4 matrix [A | t]
+ * @param out Output array of vectors
+ */
+template <typename T>
+void batch_transform(typename vector3_soa_in<T>::type v, const T *m, vector3_soa<T> out) {
+    VECTORS_PROFILE("batch_transform", v.size);
+    vectors_internal::transform_kernel<T> k;
+    k.x = v.x;
+    k.y = v.y;
+    k.z = v.z;
+    k.ox = out.x;
+    k.oy = out.y;
+    k.oz = out.z;
+    for (int i = 0; i < 12; ++i)
+        k.m[i] = m[i];
+    vectors_internal::pack_for<T>(v.size, k);
+}
+
+#endif /* VECTORSBATCH_H_ */
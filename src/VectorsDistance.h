@@ -0,0 +1,264 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTORSDISTANCE_H_
+#define VECTORSDISTANCE_H_
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <vector>
+#include "VectorsInternal.h"
+#include "VectorsPack.h"
+#include "VectorsProfiler.h"
+#include "Vector3_soa.h"
+
+/*
+ * Pairwise distance matrices. Squared distances are computed as ||a||^2 + ||b||^2 - 2 a.b, which needs a single
+ * fused dot product per pair. Points are first shifted to the centroid of their finite coordinates to keep the
+ * norms small, and pairs whose result is small compared to the norms (where the formula loses accuracy to
+ * cancellation) are recomputed as |a - b|^2. Work is tiled into blocks of rows and columns so that the column
+ * block stays in cache while it is reused by all rows of the block.
+ */
+
+/*!
+ * \brief Position of the distance between points \e i and \e j in the condensed distance array
+ * @param n Number of points
+ * @param i Index of the first point
+ * @param j Index of the second point, should be greater than \e i
+ */
+inline size_t condensed_index(size_t n, size_t i, size_t j) {
+    return i * n - i * (i + 1) / 2 + j - i - 1;
+}
+
+namespace vectors_internal {
+
+enum {
+    distance_block_rows = 32,       //!< Rows processed together against one block of columns
+    distance_block_cols = 1024      //!< Columns in a block; coordinates and norms of the block fit in L1/L2
+};
+
+/*!
+ * \brief Stores a register into an array of possibly different element type
+ */
+template <typename P, typename U, bool Same = std::is_same<typename P::elt_type, U>::value>
+struct pack_store {
+    static MUSTINLINE void store(U *p, typename P::reg a) {
+        typename P::elt_type tmp[P::width];
+        P::store(tmp, a);
+        for (int k = 0; k < P::width; ++k)
+            p[k] = static_cast<U>(tmp[k]);
+    }
+};
+
+template <typename P, typename U>
+struct pack_store<P, U, true> {
+    static MUSTINLINE void store(U *p, typename P::reg a) { P::store(p, a); }
+};
+
+#ifdef __AVX2__
+template <>
+struct pack_store<simd_pack<double>, float, false> {
+    static MUSTINLINE void store(float *p, __m256d a) { _mm_storeu_ps(p, _mm256_cvtpd_ps(a)); }
+};
+#endif
+
+/*!
+ * \brief Copy of a point set shifted by a common origin, together with squared norms of the points
+ */
+template <typename T>
+struct distance_points {
+    std::vector<T> x, y, z, norm;
+
+    distance_points(const vector3_soa<const T> &p, const T *origin) :
+        x(p.size), y(p.size), z(p.size), norm(p.size) {
+        for (size_t i = 0; i < p.size; ++i) {
+            x[i] = p.x[i] - origin[0];
+            y[i] = p.y[i] - origin[1];
+            z[i] = p.z[i] - origin[2];
+            norm[i] = x[i] * x[i] + y[i] * y[i] + z[i] * z[i];
+        }
+    }
+};
+
+/*!
+ * \brief Adds the finite coordinates of the points to \e sum and counts them in \e count, so that a NaN or
+ * infinite point spoils only its own distances and not the common origin
+ */
+template <typename T>
+void accumulate_sum(const vector3_soa<const T> &p, double *sum, size_t *count) {
+    const T *c[3] = {p.x, p.y, p.z};
+    for (int k = 0; k < 3; ++k)
+        for (size_t i = 0; i < p.size; ++i)
+            if (std::isfinite(c[k][i])) {
+                sum[k] += c[k][i];
+                ++count[k];
+            }
+}
+
+/*!
+ * \brief Mean of the accumulated coordinates, zero for an axis without finite coordinates
+ */
+template <typename T>
+void origin_from_sum(const double *sum, const size_t *count, T *origin) {
+    for (int k = 0; k < 3; ++k)
+        origin[k] = count[k] ? T(sum[k] / count[k]) : T(0);
+}
+
+/*!
+ * \brief Distances between point \e i of \e a and points [j0, j1) of \e b
+ */
+template <typename P, typename T, typename U>
+MUSTINLINE size_t distance_span(const distance_points<T> &a, size_t i, const distance_points<T> &b,
+        size_t j0, size_t j1, U *out, bool squared) {
+    typedef typename P::reg reg;
+    // Gram formula error is a few ulps of the norms; below 1/64 of them the difference form is used instead
+    const reg refine = P::set1(T(1) / T(64));
+    const reg minus_two = P::set1(T(-2));
+    const reg ax = P::set1(a.x[i]), ay = P::set1(a.y[i]), az = P::set1(a.z[i]), na = P::set1(a.norm[i]);
+
+    size_t j = j0;
+    for (; j + P::width <= j1; j += P::width) {
+        const reg bx = P::load(&b.x[j]), by = P::load(&b.y[j]), bz = P::load(&b.z[j]);
+        const reg nn = P::add(na, P::load(&b.norm[j]));
+        const reg dot = P::fmadd(az, bz, P::fmadd(ay, by, P::mul(ax, bx)));
+        reg d = P::fmadd(minus_two, dot, nn);
+        const typename P::mask near = P::cmp_lt(d, P::mul(nn, refine));
+        if (P::movemask(near)) {
+            const reg dx = P::sub(ax, bx), dy = P::sub(ay, by), dz = P::sub(az, bz);
+            d = P::select(near, P::fmadd(dz, dz, P::fmadd(dy, dy, P::mul(dx, dx))), d);
+        }
+        // Rounding may leave small negative squares; an ordered select keeps NaN on every backend
+        d = P::select(P::cmp_lt(d, P::zero()), P::zero(), d);
+        pack_store<P, U>::store(out + (j - j0), squared ? d : P::sqrt(d));
+    }
+    return j;
+}
+
+template <typename T, typename U>
+MUSTINLINE void distance_row(const distance_points<T> &a, size_t i, const distance_points<T> &b,
+        size_t j0, size_t j1, U *out, bool squared) {
+    const size_t j = distance_span<simd_pack<T> >(a, i, b, j0, j1, out, squared);
+    distance_span<scalar_pack<T> >(a, i, b, j, j1, out + (j - j0), squared);
+}
+
+template <typename T, typename U>
+void distance_matrix(const vector3_soa<const T> &a, const vector3_soa<const T> &b, U *out, bool squared) {
+    double sum[3] = {0, 0, 0};
+    size_t count[3] = {0, 0, 0};
+    accumulate_sum(a, sum, count);
+    accumulate_sum(b, sum, count);
+    T origin[3];
+    origin_from_sum(sum, count, origin);
+    const distance_points<T> pa(a, origin), pb(b, origin);
+
+    const ptrdiff_t nblocks = (a.size + distance_block_rows - 1) / distance_block_rows;
+    VECTORS_OMP(parallel for schedule(static) if(nblocks > 1 && a.size * b.size > 65536))
+    for (ptrdiff_t rb = 0; rb < nblocks; ++rb) {
+        const size_t i0 = rb * distance_block_rows;
+        const size_t i1 = std::min(i0 + distance_block_rows, a.size);
+        for (size_t j0 = 0; j0 < b.size; j0 += distance_block_cols) {
+            const size_t j1 = std::min(j0 + distance_block_cols, b.size);
+            for (size_t i = i0; i < i1; ++i)
+                distance_row(pa, i, pb, j0, j1, out + i * b.size + j0, squared);
+        }
+    }
+}
+
+template <typename T, typename U>
+void condensed_distances(const vector3_soa<const T> &a, U *out, bool squared) {
+    const size_t n = a.size;
+    if (n < 2)
+        return;
+    double sum[3] = {0, 0, 0};
+    size_t count[3] = {0, 0, 0};
+    accumulate_sum(a, sum, count);
+    T origin[3];
+    origin_from_sum(sum, count, origin);
+    const distance_points<T> pa(a, origin);
+
+    // Rows get shorter towards the end, so blocks are handed out dynamically
+    const ptrdiff_t nblocks = (n + distance_block_rows - 1) / distance_block_rows;
+    VECTORS_OMP(parallel for schedule(dynamic) if(nblocks > 1 && n * n > 131072))
+    for (ptrdiff_t rb = 0; rb < nblocks; ++rb) {
+        const size_t i0 = rb * distance_block_rows;
+        const size_t i1 = std::min(i0 + distance_block_rows, n);
+        for (size_t j0 = i0 + 1; j0 < n; j0 += distance_block_cols) {
+            const size_t j1 = std::min(j0 + distance_block_cols, n);
+            for (size_t i = i0; i < i1 && i + 1 < j1; ++i) {
+                const size_t js = std::max(j0, i + 1);
+                distance_row(pa, i, pa, js, j1, out + condensed_index(n, i, js), squared);
+            }
+        }
+    }
+}
+
+} // namespace vectors_internal
+
+/*!
+ * \brief Matrix of distances between all points of \e a and all points of \e b
+ * @param a First set of points
+ * @param b Second set of points, may be the same as \e a
+ * @param out Output row-major matrix of a.size x b.size elements; out[i * b.size + j] = |a_i - b_j|
+ * @param squared Store squared distances instead
+ */
+template <typename T>
+void distance_matrix(typename vector3_soa_in<T>::type a, typename vector3_soa_in<T>::type b, T *out,
+        bool squared = false) {
+    VECTORS_PROFILE("distance_matrix", a.size * b.size);
+    vectors_internal::distance_matrix(a, b, out, squared);
+}
+
+/*!
+ * \brief Matrix of distances between double precision points stored in single precision. Computations are
+ * done in double precision, only the output is rounded.
+ */
+inline void distance_matrix(vector3_soa_in<double>::type a, vector3_soa_in<double>::type b, float *out,
+        bool squared = false) {
+    VECTORS_PROFILE("distance_matrix", a.size * b.size);
+    vectors_internal::distance_matrix(a, b, out, squared);
+}
+
+/*!
+ * \brief Distances between all pairs of points of a single set, stored as the condensed upper triangle of the
+ * distance matrix: pairs (0, 1), (0, 2), ..., (0, n - 1), (1, 2), ... See condensed_index().
+ * @param a Set of points
+ * @param out Output array of a.size * (a.size - 1) / 2 elements
+ * @param squared Store squared distances instead
+ */
+template <typename T>
+void condensed_distances(typename vector3_soa_in<T>::type a, T *out, bool squared = false) {
+    VECTORS_PROFILE("condensed_distances", a.size > 1 ? a.size * (a.size - 1) / 2 : 0);
+    vectors_internal::condensed_distances(a, out, squared);
+}
+
+/*!
+ * \brief Condensed distances between double precision points stored in single precision
+ */
+inline void condensed_distances(vector3_soa_in<double>::type a, float *out, bool squared = false) {
+    VECTORS_PROFILE("condensed_distances", a.size > 1 ? a.size * (a.size - 1) / 2 : 0);
+    vectors_internal::condensed_distances(a, out, squared);
+}
+
+#endif /* VECTORSDISTANCE_H_ */
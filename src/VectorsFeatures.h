@@ -0,0 +1,404 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTORSFEATURES_H_
+#define VECTORSFEATURES_H_
+
+#include <string>
+#include <vector>
+#include "VectorsInternal.h"
+#include "VectorsPack.h"
+#include "VectorsTranspose.h"
+#include "Vector3_reg.h"
+#include "Vector3_soa.h"
+#ifdef __SSE3__
+#include "Vector3f_simd.h"
+#endif
+#ifdef __AVX2__
+#include "Vector3d_simd.h"
+#endif
+#ifdef __SSE4_1__
+#include "Vector3i_simd.h"
+#endif
+
+#ifdef __GNUG__
+#include <cpuid.h>
+#else
+#include <intrin.h>
+#endif
+
+/*
+ * Build and machine capabilities. The SIMD vector classes and the code paths of the batch kernels are chosen at
+ * compile time from the instruction set macros of the compiler (__SSE3__, __SSE4_1__, __AVX__, __AVX2__,
+ * __FMA__), so a build without -mavx2 silently lacks vector3d_simd and runs the kernels one element at a time.
+ * The functions below make this observable: vectors_build_features() lists the instruction sets the code was
+ * compiled for, vectors_cpu_features() those the running CPU and operating system support (cpuid and xgetbv),
+ * vectors_type_layouts() gives size, alignment and code path of every vector type and vectors_kernel_variants()
+ * the code path every batch kernel dispatches to. vectors_feature_report() prints all of it, e.g. into a log at
+ * startup.
+ *
+ * The VECTORS_HAS_* macros tell at compile time which vector classes exist. Define VECTORS_REQUIRE_AVX2 (or
+ * VECTORS_REQUIRE_SSE4_1) to turn a build without the instruction set into a compile error instead of a
+ * silent fallback.
+ */
+
+#ifdef __SSE3__
+#define VECTORS_HAS_VECTOR3F_SIMD 1
+#else
+#define VECTORS_HAS_VECTOR3F_SIMD 0
+#endif
+
+#ifdef __AVX2__
+#define VECTORS_HAS_VECTOR3D_SIMD 1
+#else
+#define VECTORS_HAS_VECTOR3D_SIMD 0
+#endif
+
+#ifdef __SSE4_1__
+#define VECTORS_HAS_VECTOR3I_SIMD 1
+#else
+#define VECTORS_HAS_VECTOR3I_SIMD 0
+#endif
+
+#if defined(VECTORS_REQUIRE_AVX2) && !defined(__AVX2__)
+#error "VECTORS_REQUIRE_AVX2 is defined but the code is compiled without AVX2 support (e.g. -mavx2)"
+#endif
+
+#if defined(VECTORS_REQUIRE_SSE4_1) && !defined(__SSE4_1__)
+#error "VECTORS_REQUIRE_SSE4_1 is defined but the code is compiled without SSE4.1 support (e.g. -msse4.1)"
+#endif
+
+/*!
+ * \brief Set of instruction set extensions used by the library
+ */
+struct vectors_feature_set {
+    bool sse3;
+    bool sse4_1;
+    bool avx;
+    bool avx2;
+    bool fma;
+};
+
+/*!
+ * \brief Size, alignment and code path of a type
+ */
+struct vectors_type_layout {
+    std::string name;       //!< Type name
+    size_t size;            //!< sizeof() of the type
+    size_t alignment;       //!< Required alignment in bytes
+    std::string backend;    //!< Instruction set of the operations: "scalar", "sse3", "sse4.1", "avx" or "avx2"
+};
+
+/*!
+ * \brief Code path of a batch kernel
+ */
+struct vectors_kernel_variant {
+    std::string name;       //!< Kernel name, as reported by the profiler
+    std::string backend;    //!< Instruction set of the code path: "scalar", "sse", "avx" or "avx2"
+    int float_width;        //!< Number of float elements processed by one instruction
+    int double_width;       //!< Number of double elements processed by one instruction
+    bool fused;             //!< Whether fused multiply-add instructions are used
+};
+
+namespace vectors_internal {
+
+inline const char *feature_name(int k) {
+    static const char *const names[] = { "sse3", "sse4.1", "avx", "avx2", "fma" };
+    return names[k];
+}
+
+inline bool feature_flag(const vectors_feature_set &f, int k) {
+    const bool flags[] = { f.sse3, f.sse4_1, f.avx, f.avx2, f.fma };
+    return flags[k];
+}
+
+enum { feature_count = 5 };
+
+/*!
+ * \brief Registers eax, ebx, ecx and edx of the cpuid instruction for the given leaf and subleaf
+ */
+inline void cpuid(unsigned leaf, unsigned subleaf, unsigned *r) {
+#ifdef __GNUG__
+    __cpuid_count(leaf, subleaf, r[0], r[1], r[2], r[3]);
+#else
+    int regs[4];
+    __cpuidex(regs, static_cast<int>(leaf), static_cast<int>(subleaf));
+    for (int k = 0; k < 4; ++k)
+        r[k] = static_cast<unsigned>(regs[k]);
+#endif
+}
+
+/*!
+ * \brief Lower half of the XCR0 register, i.e. the register states saved by the operating system. Requires
+ * OSXSAVE support.
+ */
+inline unsigned xcr0() {
+#ifdef __GNUG__
+    unsigned eax, edx;
+    __asm__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+    return eax;
+#else
+    return static_cast<unsigned>(_xgetbv(0));
+#endif
+}
+
+/*!
+ * \brief Name of the code path of batch kernels built on simd_pack
+ */
+inline const char *pack_backend() {
+    return simd_pack<float>::width > 1 ? "avx2" : "scalar";
+}
+
+/*!
+ * \brief Name of the code path of transposition kernels
+ */
+inline const char *transpose_backend() {
+#if defined(__AVX__)
+    return "avx";
+#elif defined(__SSE2__)
+    return "sse";
+#else
+    return "scalar";
+#endif
+}
+
+inline bool pack_fused() {
+#if defined(__FMA__) && !defined(VECTORS_DETERMINISTIC)
+    return simd_pack<float>::width > 1;
+#else
+    return false;
+#endif
+}
+
+template <typename V>
+inline vectors_type_layout type_layout(const char *name, const char *backend) {
+    vectors_type_layout t;
+    t.name = name;
+    t.size = sizeof(V);
+    t.alignment = alignof(V);
+    t.backend = backend;
+    return t;
+}
+
+} // namespace vectors_internal
+
+/*!
+ * \brief Instruction sets the code was compiled for
+ */
+inline vectors_feature_set vectors_build_features() {
+    vectors_feature_set f = { false, false, false, false, false };
+#ifdef __SSE3__
+    f.sse3 = true;
+#endif
+#ifdef __SSE4_1__
+    f.sse4_1 = true;
+#endif
+#ifdef __AVX__
+    f.avx = true;
+#endif
+#ifdef __AVX2__
+    f.avx2 = true;
+#endif
+#ifdef __FMA__
+    f.fma = true;
+#endif
+    return f;
+}
+
+/*!
+ * \brief Instruction sets supported by the running CPU. AVX, AVX2 and FMA are reported only if the operating
+ * system saves the AVX registers. The result is computed once.
+ */
+inline vectors_feature_set vectors_cpu_features() {
+    static const vectors_feature_set features = [] {
+        vectors_feature_set f = { false, false, false, false, false };
+        unsigned r[4];
+        vectors_internal::cpuid(0, 0, r);
+        const unsigned max_leaf = r[0];
+        if (max_leaf < 1)
+            return f;
+        vectors_internal::cpuid(1, 0, r);
+        f.sse3 = (r[2] >> 0) & 1;
+        f.sse4_1 = (r[2] >> 19) & 1;
+        const bool osxsave = (r[2] >> 27) & 1;
+        const bool ymm = osxsave && (vectors_internal::xcr0() & 6) == 6;
+        f.avx = ymm && ((r[2] >> 28) & 1);
+        f.fma = f.avx && ((r[2] >> 12) & 1);
+        if (max_leaf >= 7) {
+            vectors_internal::cpuid(7, 0, r);
+            f.avx2 = f.avx && ((r[1] >> 5) & 1);
+        }
+        return f;
+    }();
+    return features;
+}
+
+/*!
+ * \brief Names of instruction sets the code was compiled for but the running CPU does not support. Code
+ * executing such instructions terminates with an illegal instruction signal, so a non-empty result should be
+ * treated as a fatal configuration error.
+ */
+inline std::vector<std::string> vectors_missing_features() {
+    const vectors_feature_set build = vectors_build_features();
+    const vectors_feature_set cpu = vectors_cpu_features();
+    std::vector<std::string> missing;
+    for (int k = 0; k < vectors_internal::feature_count; ++k)
+        if (vectors_internal::feature_flag(build, k) && !vectors_internal::feature_flag(cpu, k))
+            missing.push_back(vectors_internal::feature_name(k));
+    return missing;
+}
+
+/*!
+ * \brief Size, alignment and code path of the vector classes and of the registers used by batch kernels. Only
+ * classes which were compiled in are listed.
+ */
+inline std::vector<vectors_type_layout> vectors_type_layouts() {
+    using vectors_internal::type_layout;
+    std::vector<vectors_type_layout> types;
+    types.push_back(type_layout<vector3_reg>("vector3_reg", "scalar"));
+#ifdef __SSE3__
+#ifdef __SSE4_1__
+    types.push_back(type_layout<vector3f_simd>("vector3f_simd", "sse4.1"));
+#else
+    types.push_back(type_layout<vector3f_simd>("vector3f_simd", "sse3"));
+#endif
+#endif
+#ifdef __AVX2__
+    types.push_back(type_layout<vector3d_simd>("vector3d_simd", "avx2"));
+#endif
+#ifdef __SSE4_1__
+#ifdef __AVX2__
+    types.push_back(type_layout<vector3i_simd>("vector3i_simd", "avx2"));
+#else
+    types.push_back(type_layout<vector3i_simd>("vector3i_simd", "sse4.1"));
+#endif
+#endif
+    const char *pack = vectors_internal::pack_backend();
+    types.push_back(type_layout<vectors_internal::simd_pack<float>::reg>("simd_pack<float>::reg", pack));
+    types.push_back(type_layout<vectors_internal::simd_pack<double>::reg>("simd_pack<double>::reg", pack));
+    return types;
+}
+
+/*!
+ * \brief Code paths the batch kernels dispatch to in this build, one entry per name the profiler reports.
+ * Kernels whose loops are plain C++ (tree walks, table lookups, sorting, quickhull) are listed as scalar
+ * whatever the instruction set flags; the harness in Vectors.cpp checks the names against the profiler.
+ */
+inline std::vector<vectors_kernel_variant> vectors_kernel_variants() {
+    enum path { pack, scalar, transpose };
+    static const struct { const char *name; path p; } table[] = {
+        {"nbody_accelerations", pack}, {"nbody_octree::build", scalar}, {"nbody_octree::accelerations", scalar},
+        {"velocity_verlet_kick", pack}, {"velocity_verlet_kick_drift", pack}, {"leapfrog_step", pack},
+        {"rk4_integrator::stage", pack}, {"rk4_integrator::final", pack}, {"batch_dot", pack},
+        {"batch_length", pack}, {"batch_cross", pack}, {"batch_normalize", pack}, {"batch_transform", pack},
+        {"filter_sphere", pack}, {"filter_halfspaces", pack}, {"intersect_ray_boxes", pack},
+        {"overlap_boxes", pack}, {"build_aabbs", pack}, {"gather_soa", pack}, {"scatter_soa", scalar},
+        {"aos_to_soa", transpose}, {"soa_to_aos", transpose}, {"aos_to_soa_inplace", transpose},
+        {"soa_to_aos_inplace", transpose}, {"distance_matrix", pack}, {"condensed_distances", pack},
+        {"superpose", pack}, {"superposition_rmsd", pack}, {"superpose_batch", pack},
+        {"superposition_rmsd_batch", pack}, {"periodic_wrap", pack}, {"periodic_difference", pack},
+        {"periodic_distance", pack}, {"batch_lerp", pack}, {"batch_slerp", pack}, {"spline_catmull_rom", pack},
+        {"spline_bezier", pack}, {"spline_hermite", pack}, {"arc_length_table::parameters", scalar},
+        {"arc_length_table::uniform_parameters", scalar}, {"mesh_face_normals", pack}, {"mesh_face_areas", pack},
+        {"mesh_vertex_normals", pack}, {"intersect_ray_triangles", pack}, {"closest_hits", pack},
+        {"occluded_rays", pack}, {"weld_points", pack}, {"point_moments", pack}, {"obb_extents", pack},
+        {"fit_obb", pack}, {"build_obbs", pack}, {"support_point", pack}, {"support_points", pack},
+        {"convex_hull", scalar}, {"random_uniform", pack}, {"random_box", pack}, {"random_sphere", pack},
+        {"random_ball", pack}, {"random_hemisphere", pack}, {"batch_sincos", pack}, {"batch_atan2", pack},
+        {"batch_acos", pack}, {"cartesian_to_spherical", pack}, {"spherical_to_cartesian", pack},
+        {"cartesian_to_cylindrical", pack}, {"cylindrical_to_cartesian", pack}, {"sample_trilinear", pack},
+        {"sample_tricubic", pack}, {"field_brick_order", scalar}
+    };
+    std::vector<vectors_kernel_variant> kernels;
+    for (size_t i = 0; i < sizeof(table) / sizeof(table[0]); ++i) {
+        vectors_kernel_variant k;
+        k.name = table[i].name;
+        if (table[i].p == pack) {
+            k.backend = vectors_internal::pack_backend();
+            k.float_width = vectors_internal::simd_pack<float>::width;
+            k.double_width = vectors_internal::simd_pack<double>::width;
+            k.fused = vectors_internal::pack_fused();
+        } else if (table[i].p == transpose) {
+            k.backend = vectors_internal::transpose_backend();
+            k.float_width = vectors_internal::transpose3<float>::width;
+            k.double_width = vectors_internal::transpose3<double>::width;
+            k.fused = false;
+        } else {
+            k.backend = "scalar";
+            k.float_width = 1;
+            k.double_width = 1;
+            k.fused = false;
+        }
+        kernels.push_back(k);
+    }
+    return kernels;
+}
+
+/*!
+ * \brief Prints instruction sets of the build and of the CPU, build options, type layouts and kernel code
+ * paths into the stream
+ * @param os Reference to a stream
+ */
+inline void vectors_feature_report(std::ostream &os) {
+    const vectors_feature_set build = vectors_build_features();
+    const vectors_feature_set cpu = vectors_cpu_features();
+    const std::vector<std::string> missing = vectors_missing_features();
+    os << "build:";
+    for (int k = 0; k < vectors_internal::feature_count; ++k)
+        if (vectors_internal::feature_flag(build, k))
+            os << ' ' << vectors_internal::feature_name(k);
+    os << "\ncpu:";
+    for (int k = 0; k < vectors_internal::feature_count; ++k)
+        if (vectors_internal::feature_flag(cpu, k))
+            os << ' ' << vectors_internal::feature_name(k);
+    os << "\nmissing:";
+    for (size_t i = 0; i < missing.size(); ++i)
+        os << ' ' << missing[i];
+    if (missing.empty())
+        os << " none";
+    os << "\noptions:";
+#ifdef _OPENMP
+    os << " openmp(" << omp_get_max_threads() << " threads)";
+#endif
+#ifdef VECTORS_DETERMINISTIC
+    os << " deterministic";
+#endif
+#ifdef VECTORS_ENABLE_PROFILING
+    os << " profiling";
+#endif
+#ifdef USE_FLOAT_VECTOR
+    os << " float_vector3_reg";
+#endif
+    os << "\ntype size alignment backend\n";
+    const std::vector<vectors_type_layout> types = vectors_type_layouts();
+    for (size_t i = 0; i < types.size(); ++i)
+        os << types[i].name << ' ' << types[i].size << ' ' << types[i].alignment << ' ' << types[i].backend << '\n';
+    os << "kernel backend float_width double_width fma\n";
+    const std::vector<vectors_kernel_variant> kernels = vectors_kernel_variants();
+    for (size_t i = 0; i < kernels.size(); ++i)
+        os << kernels[i].name << ' ' << kernels[i].backend << ' ' << kernels[i].float_width << ' '
+           << kernels[i].double_width << ' ' << (kernels[i].fused ? "yes" : "no") << '\n';
+}
+
+#endif /* VECTORSFEATURES_H_ */
@@ -0,0 +1,477 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTORSFIELD_H_
+#define VECTORSFIELD_H_
+
+#include <algorithm>
+#include <vector>
+#include "VectorsInternal.h"
+#include "VectorsPack.h"
+#include "VectorsProfiler.h"
+#include "VectorsSpline.h"
+#include "VectorsTrig.h"
+#include "Vector3_soa.h"
+
+/*
+ * Sampling of vector fields given on regular grids, e.g. velocity fields for particle advection. The field is a
+ * non-owning view of nodes stored x fastest, then y, then z, each node holding three consecutive coordinates
+ * followed by padding: an array of vector3f_simd or vector3d_simd can be sampled in place. A query point is
+ * mapped to grid coordinates (p - origin) / spacing; its cell index and the offsets of the neighbouring nodes
+ * are computed per lane and the node coordinates of all lanes are fetched with hardware gathers, so a node is
+ * read with one cache line access for all three coordinates.
+ *
+ * Points outside of the grid are clamped to its boundary; a NaN coordinate maps to the first node along its
+ * axis. Trilinear interpolation reads the eight nodes of the cell, tricubic interpolation the 4x4x4 nodes around
+ * it and applies uniform Catmull-Rom weights along every axis (interpolating and continuously differentiable;
+ * nodes beyond the boundary are replaced by the boundary nodes, as in spline_catmull_rom()). An axis with a
+ * single node is constant. Gather indices are 32-bit, so the number of nodes times the node stride must stay
+ * below 2^31.
+ *
+ * Particles are processed in registers of independent lanes and in parallel blocks, and results do not depend on
+ * the number of threads. Gathers hit the cache best when particles are stored roughly in spatial order, e.g.
+ * sorted by cell from time to time.
+ */
+
+/*!
+ * \class vector_field_grid
+ * \brief Non-owning view of a vector field sampled on a regular grid
+ */
+template <typename T>
+class vector_field_grid {
+public:
+    typedef T elt_type;
+
+    /*!
+     * \brief Constructor
+     * @param nodes Pointer to the x coordinate of the first node
+     * @param stride Distance between consecutive nodes in elements of \e T, at least 3
+     * @param dims Number of nodes along x, y and z, at least one each
+     * @param origin Position of the first node, three coordinates
+     * @param spacing Distance between nodes along x, y and z
+     */
+    vector_field_grid(const T *nodes, size_t stride, const size_t *dims, const T *origin, const T *spacing) {
+        init(nodes, stride, dims, origin, spacing);
+    }
+
+    /*!
+     * \brief Constructor of a view of an array of vector class objects, e.g. vector3f_simd
+     * @param nodes Array of nx * ny * nz nodes
+     * @param nx Number of nodes along x
+     * @param ny Number of nodes along y
+     * @param nz Number of nodes along z
+     * @param origin Position of the first node, three coordinates
+     * @param spacing Distance between nodes along x, y and z
+     */
+    template <typename V>
+    vector_field_grid(const V *nodes, size_t nx, size_t ny, size_t nz, const T *origin, const T *spacing) {
+        const size_t dims[3] = {nx, ny, nz};
+        init(&nodes->x, sizeof(V) / sizeof(T), dims, origin, spacing);
+    }
+
+    MUSTINLINE const T *data() const { return nodes; }
+    MUSTINLINE size_t stride() const { return node_stride; }
+
+    /*!
+     * \brief Number of nodes along axis \e d
+     */
+    MUSTINLINE int32_t dims(int d) const { return n[d]; }
+
+    /*!
+     * \brief Number of elements of \e T between neighbouring nodes along axis \e d
+     */
+    MUSTINLINE int32_t step(int d) const { return offset[d]; }
+
+    MUSTINLINE T origin(int d) const { return lower[d]; }
+    MUSTINLINE T spacing(int d) const { return h[d]; }
+    MUSTINLINE T inv_spacing(int d) const { return inv_h[d]; }
+
+    /*!
+     * \brief Node (i, j, k) as a vector class object
+     */
+    template <typename V>
+    MUSTINLINE V node(size_t i, size_t j, size_t k) const {
+        return V::load_packed(nodes + i * offset[0] + j * offset[1] + k * offset[2]);
+    }
+
+    /*!
+     * \brief Trilinear interpolation of the field at a single point
+     */
+    template <typename V>
+    V sample(const V &p) const;
+
+    /*!
+     * \brief Tricubic interpolation of the field at a single point
+     */
+    template <typename V>
+    V sample_cubic(const V &p) const;
+
+private:
+    void init(const T *first, size_t stride, const size_t *dims, const T *origin, const T *spacing) {
+        nodes = first;
+        node_stride = stride;
+        size_t elements = stride;
+        for (int d = 0; d < 3; ++d) {
+            n[d] = static_cast<int32_t>(dims[d]);
+            offset[d] = static_cast<int32_t>(elements);
+            elements *= dims[d];
+            lower[d] = origin[d];
+            h[d] = spacing[d];
+            inv_h[d] = T(1) / spacing[d];
+        }
+    }
+
+    const T *nodes;         //!< Coordinates of the first node
+    size_t node_stride;     //!< Elements between consecutive nodes
+    int32_t n[3];           //!< Number of nodes along every axis
+    int32_t offset[3];      //!< Elements between neighbouring nodes along every axis
+    T lower[3];             //!< Position of the first node
+    T h[3];                 //!< Distance between nodes
+    T inv_h[3];             //!< Inverse distance between nodes
+};
+
+namespace vectors_internal {
+
+/*!
+ * \class field_taps
+ * \brief Local coordinates of query points within their cells and offsets of the nodes around them. The
+ * generic version converts the cell indices lane by lane; the AVX2 versions stay in registers.
+ */
+template <typename P>
+struct field_taps {
+    typedef typename P::elt_type T;
+    typedef typename P::reg reg;
+
+    /*!
+     * \brief Computes local coordinates and node offsets along every axis
+     * @param f Grid of the field
+     * @param p Query points
+     * @param t Output local coordinates in [0, 1], zero along axes with a single node
+     * @param off Output offsets (in elements of \e T) of the K nodes around the cell along every axis, starting
+     * K / 2 - 1 nodes before the cell; nodes beyond the boundary are replaced by the boundary nodes
+     */
+    template <int K>
+    static MUSTINLINE void apply(const vector_field_grid<T> &f, const reg *p, reg *t, int32_t (*off)[K][P::width]) {
+        for (int d = 0; d < 3; ++d) {
+            const int32_t n = f.dims(d), last = std::max(n - 2, 0);
+            reg g = P::mul(P::sub(p[d], P::set1(f.origin(d))), P::set1(f.inv_spacing(d)));
+            // Ordered comparison fails for NaN, so NaN coordinates go to the first cell as in the AVX2 versions
+            g = P::min(P::select(P::cmp_ge(g, P::zero()), g, P::zero()), P::set1(static_cast<T>(n - 1)));
+            T s[P::width];
+            P::store(s, P::floor(g));
+            for (int l = 0; l < P::width; ++l) {
+                // The last node belongs to the last cell
+                const int32_t cell = s[l] > 0 ? std::min(static_cast<int32_t>(s[l]), last) : 0;
+                s[l] = static_cast<T>(cell);
+                for (int k = 0; k < K; ++k)
+                    off[d][k][l] = std::min(std::max(cell + k + 1 - K / 2, 0), n - 1) * f.step(d);
+            }
+            t[d] = P::sub(g, P::load(s));
+        }
+    }
+};
+
+#ifdef __AVX2__
+template <>
+struct field_taps<simd_pack<float> > {
+    template <int K>
+    static MUSTINLINE void apply(const vector_field_grid<float> &f, const __m256 *p, __m256 *t,
+            int32_t (*off)[K][8]) {
+        for (int d = 0; d < 3; ++d) {
+            const int32_t n = f.dims(d);
+            __m256 g = _mm256_mul_ps(_mm256_sub_ps(p[d], _mm256_set1_ps(f.origin(d))),
+                _mm256_set1_ps(f.inv_spacing(d)));
+            // max() returns the second operand for NaN, so NaN coordinates go to the first cell
+            g = _mm256_min_ps(_mm256_max_ps(g, _mm256_setzero_ps()), _mm256_set1_ps(static_cast<float>(n - 1)));
+            const __m256 c = _mm256_min_ps(_mm256_floor_ps(g), _mm256_set1_ps(static_cast<float>(std::max(n - 2, 0))));
+            t[d] = _mm256_sub_ps(g, c);
+            const __m256i cell = _mm256_cvttps_epi32(c);
+            for (int k = 0; k < K; ++k) {
+                __m256i i = _mm256_add_epi32(cell, _mm256_set1_epi32(k + 1 - K / 2));
+                i = _mm256_min_epi32(_mm256_max_epi32(i, _mm256_setzero_si256()), _mm256_set1_epi32(n - 1));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(off[d][k]),
+                    _mm256_mullo_epi32(i, _mm256_set1_epi32(f.step(d))));
+            }
+        }
+    }
+};
+
+template <>
+struct field_taps<simd_pack<double> > {
+    template <int K>
+    static MUSTINLINE void apply(const vector_field_grid<double> &f, const __m256d *p, __m256d *t,
+            int32_t (*off)[K][4]) {
+        for (int d = 0; d < 3; ++d) {
+            const int32_t n = f.dims(d);
+            __m256d g = _mm256_mul_pd(_mm256_sub_pd(p[d], _mm256_set1_pd(f.origin(d))),
+                _mm256_set1_pd(f.inv_spacing(d)));
+            g = _mm256_min_pd(_mm256_max_pd(g, _mm256_setzero_pd()), _mm256_set1_pd(n - 1));
+            const __m256d c = _mm256_min_pd(_mm256_floor_pd(g), _mm256_set1_pd(std::max(n - 2, 0)));
+            t[d] = _mm256_sub_pd(g, c);
+            const __m128i cell = _mm256_cvttpd_epi32(c);
+            for (int k = 0; k < K; ++k) {
+                __m128i i = _mm_add_epi32(cell, _mm_set1_epi32(k + 1 - K / 2));
+                i = _mm_min_epi32(_mm_max_epi32(i, _mm_setzero_si128()), _mm_set1_epi32(n - 1));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(off[d][k]), _mm_mullo_epi32(i, _mm_set1_epi32(f.step(d))));
+            }
+        }
+    }
+};
+#endif
+
+/*!
+ * \brief Adds w * node[idx] to the accumulated coordinates
+ */
+template <typename P>
+MUSTINLINE void field_accumulate(const typename P::elt_type *nodes, const int32_t *idx, typename P::reg w,
+        typename P::reg *acc) {
+    acc[0] = P::fmadd(w, P::gather(nodes, idx), acc[0]);
+    acc[1] = P::fmadd(w, P::gather(nodes + 1, idx), acc[1]);
+    acc[2] = P::fmadd(w, P::gather(nodes + 2, idx), acc[2]);
+}
+
+/*!
+ * \brief Trilinear interpolation of the field at points \e p
+ */
+template <typename P>
+MUSTINLINE void field_trilinear(const vector_field_grid<typename P::elt_type> &f, const typename P::reg *p,
+        typename P::reg *out) {
+    typedef typename P::reg reg;
+    reg t[3];
+    int32_t off[3][2][P::width], idx[8][P::width];
+    field_taps<P>::template apply<2>(f, p, t, off);
+    for (int c = 0; c < 8; ++c)
+        for (int l = 0; l < P::width; ++l)
+            idx[c][l] = off[0][c & 1][l] + off[1][(c >> 1) & 1][l] + off[2][c >> 2][l];
+    const typename P::elt_type *nodes = f.data();
+    for (int d = 0; d < 3; ++d) {
+        reg v[8];
+        for (int c = 0; c < 8; ++c)
+            v[c] = P::gather(nodes + d, idx[c]);
+        for (int c = 0; c < 4; ++c)
+            v[c] = P::fmadd(t[0], P::sub(v[2 * c + 1], v[2 * c]), v[2 * c]);
+        for (int c = 0; c < 2; ++c)
+            v[c] = P::fmadd(t[1], P::sub(v[2 * c + 1], v[2 * c]), v[2 * c]);
+        out[d] = P::fmadd(t[2], P::sub(v[1], v[0]), v[0]);
+    }
+}
+
+/*!
+ * \brief Tricubic (Catmull-Rom) interpolation of the field at points \e p
+ */
+template <typename P>
+MUSTINLINE void field_tricubic(const vector_field_grid<typename P::elt_type> &f, const typename P::reg *p,
+        typename P::reg *out) {
+    typedef typename P::reg reg;
+    reg t[3], w[3][4];
+    int32_t off[3][4][P::width], idx[P::width];
+    field_taps<P>::template apply<4>(f, p, t, off);
+    for (int d = 0; d < 3; ++d)
+        catmull_rom_weights<P>(t[d], w[d]);
+    const typename P::elt_type *nodes = f.data();
+    out[0] = out[1] = out[2] = P::zero();
+    for (int c = 0; c < 4; ++c) {
+        for (int b = 0; b < 4; ++b) {
+            reg row[3] = {P::zero(), P::zero(), P::zero()};
+            for (int a = 0; a < 4; ++a) {
+                for (int l = 0; l < P::width; ++l)
+                    idx[l] = off[0][a][l] + off[1][b][l] + off[2][c][l];
+                field_accumulate<P>(nodes, idx, w[0][a], row);
+            }
+            const reg wyz = P::mul(w[1][b], w[2][c]);
+            for (int d = 0; d < 3; ++d)
+                out[d] = P::fmadd(wyz, row[d], out[d]);
+        }
+    }
+}
+
+template <typename T, bool Cubic>
+struct field_sample_kernel {
+    vector_field_grid<T> field;
+    vector3_soa<const T> in;
+    vector3_soa<T> out;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        typename P::reg p[3] = {P::load(in.x + i), P::load(in.y + i), P::load(in.z + i)}, v[3];
+        if (Cubic)
+            field_tricubic<P>(field, p, v);
+        else
+            field_trilinear<P>(field, p, v);
+        P::store(out.x + i, v[0]);
+        P::store(out.y + i, v[1]);
+        P::store(out.z + i, v[2]);
+    }
+};
+
+enum { field_brick = 8 };  //!< Nodes per axis of the bricks grouping query points in field_brick_order()
+
+/*!
+ * \brief Spreads the ten low bits of \e v to every third bit
+ */
+MUSTINLINE uint32_t field_spread_bits(uint32_t v) {
+    v &= 0x3ff;
+    v = (v | v << 16) & 0x30000ff;
+    v = (v | v << 8) & 0x300f00f;
+    v = (v | v << 4) & 0x30c30c3;
+    v = (v | v << 2) & 0x9249249;
+    return v;
+}
+
+} // namespace vectors_internal
+
+template <typename T>
+template <typename V>
+V vector_field_grid<T>::sample(const V &p) const {
+    typedef vectors_internal::scalar_pack<T> S;
+    const T q[3] = {p.x, p.y, p.z};
+    T v[3];
+    vectors_internal::field_trilinear<S>(*this, q, v);
+    return V(v[0], v[1], v[2]);
+}
+
+template <typename T>
+template <typename V>
+V vector_field_grid<T>::sample_cubic(const V &p) const {
+    typedef vectors_internal::scalar_pack<T> S;
+    const T q[3] = {p.x, p.y, p.z};
+    T v[3];
+    vectors_internal::field_tricubic<S>(*this, q, v);
+    return V(v[0], v[1], v[2]);
+}
+
+/*!
+ * \brief Trilinear interpolation of a vector field at an array of points
+ * @param field Grid of the field
+ * @param points Query points
+ * @param out Output field values, may coincide with \e points
+ */
+template <typename T>
+void sample_trilinear(const vector_field_grid<T> &field, typename vector3_soa_in<T>::type points,
+        vector3_soa<T> out) {
+    VECTORS_PROFILE("sample_trilinear", points.size);
+    vectors_internal::field_sample_kernel<T, false> k = {field, points, out};
+    vectors_internal::pack_for<T>(points.size, k);
+}
+
+/*!
+ * \brief Tricubic (Catmull-Rom) interpolation of a vector field at an array of points
+ * @param field Grid of the field
+ * @param points Query points
+ * @param out Output field values, may coincide with \e points
+ */
+template <typename T>
+void sample_tricubic(const vector_field_grid<T> &field, typename vector3_soa_in<T>::type points,
+        vector3_soa<T> out) {
+    VECTORS_PROFILE("sample_tricubic", points.size);
+    vectors_internal::field_sample_kernel<T, true> k = {field, points, out};
+    vectors_internal::pack_for<T>(points.size, k);
+}
+
+/*!
+ * \brief Trilinear interpolation of a vector field at an array of vector class objects
+ * @param field Grid of the field
+ * @param points Query points
+ * @param out Output field values, may coincide with \e points
+ * @param n Number of points
+ */
+template <typename V>
+void sample_trilinear(const vector_field_grid<typename V::elt_type> &field, const V *points, V *out, size_t n) {
+    VECTORS_PROFILE("sample_trilinear", n);
+    typedef vectors_internal::field_sample_kernel<typename V::elt_type, false> kernel;
+    const kernel k = {field, vector3_soa<const typename V::elt_type>(), vector3_soa<typename V::elt_type>()};
+    vectors_internal::convert_vectors(points, out, n, k);
+}
+
+/*!
+ * \brief Tricubic (Catmull-Rom) interpolation of a vector field at an array of vector class objects
+ * @param field Grid of the field
+ * @param points Query points
+ * @param out Output field values, may coincide with \e points
+ * @param n Number of points
+ */
+template <typename V>
+void sample_tricubic(const vector_field_grid<typename V::elt_type> &field, const V *points, V *out, size_t n) {
+    VECTORS_PROFILE("sample_tricubic", n);
+    typedef vectors_internal::field_sample_kernel<typename V::elt_type, true> kernel;
+    const kernel k = {field, vector3_soa<const typename V::elt_type>(), vector3_soa<typename V::elt_type>()};
+    vectors_internal::convert_vectors(points, out, n, k);
+}
+
+/*!
+ * \brief Order of query points which makes their interpolation cache friendly: points are grouped by bricks of
+ * field_brick^3 nodes and the bricks are visited in Morton order. Points within a brick keep their relative
+ * order. Particle arrays sampled repeatedly should be permuted by this order from time to time.
+ * @param field Grid of the field
+ * @param points Query points, fewer than 2^32
+ * @param order Output indices of the points in traversal order
+ */
+template <typename T>
+void field_brick_order(const vector_field_grid<T> &field, typename vector3_soa_in<T>::type points,
+        uint32_t *order) {
+    VECTORS_PROFILE("field_brick_order", points.size);
+    using vectors_internal::field_brick;
+    int32_t nb[3];
+    for (int d = 0; d < 3; ++d)
+        nb[d] = (field.dims(d) + field_brick - 1) / field_brick;
+    const size_t bricks = size_t(nb[0]) * nb[1] * nb[2];
+
+    // Rank of every brick in Morton order
+    std::vector<uint64_t> code(bricks);
+    for (int32_t k = 0; k < nb[2]; ++k)
+        for (int32_t j = 0; j < nb[1]; ++j)
+            for (int32_t i = 0; i < nb[0]; ++i) {
+                const uint64_t b = i + size_t(nb[0]) * (j + size_t(nb[1]) * k);
+                code[b] = uint64_t(vectors_internal::field_spread_bits(i) | vectors_internal::field_spread_bits(j) << 1
+                    | vectors_internal::field_spread_bits(k) << 2) << 32 | b;
+            }
+    std::sort(code.begin(), code.end());
+    std::vector<uint32_t> rank(bricks), key(points.size);
+    for (size_t r = 0; r < bricks; ++r)
+        rank[static_cast<uint32_t>(code[r])] = static_cast<uint32_t>(r);
+
+    const ptrdiff_t n = static_cast<ptrdiff_t>(points.size);
+    VECTORS_OMP(parallel for schedule(static) if(n > 65536))
+    for (ptrdiff_t i = 0; i < n; ++i) {
+        const T p[3] = {points.x[i], points.y[i], points.z[i]};
+        size_t b = 0;
+        for (int d = 2; d >= 0; --d) {
+            const T g = (p[d] - field.origin(d)) * field.inv_spacing(d);
+            const int32_t c = g > 0 ? static_cast<int32_t>(std::min(g, static_cast<T>(field.dims(d) - 1))) : 0;
+            b = b * nb[d] + c / field_brick;
+        }
+        key[i] = rank[b];
+    }
+
+    // Stable counting sort by brick rank
+    std::vector<size_t> start(bricks + 1, 0);
+    for (ptrdiff_t i = 0; i < n; ++i)
+        ++start[key[i] + 1];
+    for (size_t r = 0; r < bricks; ++r)
+        start[r + 1] += start[r];
+    for (ptrdiff_t i = 0; i < n; ++i)
+        order[start[key[i]]++] = static_cast<uint32_t>(i);
+}
+
+#endif /* VECTORSFIELD_H_ */
@@ -0,0 +1,226 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTORSFILTER_H_
+#define VECTORSFILTER_H_
+
+#include "VectorsInternal.h"
+#include "VectorsPack.h"
+#include "VectorsProfiler.h"
+#include "Vector3_soa.h"
+
+/*
+ * Stream compaction of arrays of vectors. Points passing a test are packed to the front of the output array
+ * in their original order. Tests are evaluated for a whole register at once and selected lanes are moved
+ * together with a single permutation taken from a lookup table, so the loop has no data dependent branches.
+ * Output arrays must have room for in.size vectors and may coincide with the input ones.
+ */
+
+namespace vectors_internal {
+
+/*!
+ * \brief Lookup tables of lane permutations for all masks of an 8-lane register
+ */
+struct compaction_tables {
+    uint8_t lanes[256][8];      //!< Positions of set bits of the mask, padded with zeros
+    int32_t pairs[16][8];       //!< Same for 64-bit lanes of a 4-bit mask, as pairs of 32-bit lanes
+    uint8_t count[256];         //!< Number of set bits of the mask
+
+    compaction_tables() {
+        for (int m = 0; m < 256; ++m) {
+            int k = 0;
+            for (int b = 0; b < 8; ++b)
+                if (m & (1 << b))
+                    lanes[m][k++] = static_cast<uint8_t>(b);
+            count[m] = static_cast<uint8_t>(k);
+            for (; k < 8; ++k)
+                lanes[m][k] = 0;
+        }
+        for (int m = 0; m < 16; ++m)
+            for (int k = 0; k < 4; ++k) {
+                pairs[m][2 * k] = 2 * lanes[m][k];
+                pairs[m][2 * k + 1] = 2 * lanes[m][k] + 1;
+            }
+    }
+};
+
+inline const compaction_tables &compaction_lut() {
+    static const compaction_tables tables;
+    return tables;
+}
+
+/*!
+ * \class compressor
+ * \brief Packs selected lanes of a register to the front. Full register is always written, so the
+ * destination should have room for \e W elements.
+ */
+template <typename T, int W>
+struct compressor {
+    explicit MUSTINLINE compressor(int) { }
+    MUSTINLINE void store(T *p, T a) const { *p = a; }
+    MUSTINLINE void store_index(uint32_t *p, size_t i) const { *p = static_cast<uint32_t>(i); }
+};
+
+#ifdef __AVX2__
+template <>
+struct compressor<float, 8> {
+    __m256i perm;
+
+    explicit MUSTINLINE compressor(int bits) :
+        perm(_mm256_cvtepu8_epi32(_mm_loadl_epi64(
+            reinterpret_cast<const __m128i *>(compaction_lut().lanes[bits])))) { }
+
+    MUSTINLINE void store(float *p, __m256 a) const {
+        _mm256_storeu_ps(p, _mm256_permutevar8x32_ps(a, perm));
+    }
+
+    MUSTINLINE void store_index(uint32_t *p, size_t i) const {
+        __m256i idx = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(i)),
+            _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), _mm256_permutevar8x32_epi32(idx, perm));
+    }
+};
+
+template <>
+struct compressor<double, 4> {
+    __m256i perm;
+    __m128i iperm;
+
+    explicit MUSTINLINE compressor(int bits) :
+        perm(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(compaction_lut().pairs[bits]))),
+        iperm(_mm_cvtepu8_epi32(_mm_loadl_epi64(
+            reinterpret_cast<const __m128i *>(compaction_lut().lanes[bits])))) { }
+
+    MUSTINLINE void store(double *p, __m256d a) const {
+        _mm256_storeu_pd(p, _mm256_castps_pd(_mm256_permutevar8x32_ps(_mm256_castpd_ps(a), perm)));
+    }
+
+    MUSTINLINE void store_index(uint32_t *p, size_t i) const {
+        __m128i idx = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(i)), _mm_setr_epi32(0, 1, 2, 3));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p),
+            _mm_castps_si128(_mm_permutevar_ps(_mm_castsi128_ps(idx), iperm)));
+    }
+};
+#endif
+
+template <typename P, typename Pred>
+MUSTINLINE size_t filter_step(const vector3_soa<const typename P::elt_type> &in,
+        const vector3_soa<typename P::elt_type> &out, uint32_t *index, const Pred &pred, size_t i, size_t k) {
+    typedef typename P::reg reg;
+    const reg x = P::load(in.x + i);
+    const reg y = P::load(in.y + i);
+    const reg z = P::load(in.z + i);
+    const int bits = P::movemask(pred.template test<P>(x, y, z));
+    const compressor<typename P::elt_type, P::width> c(bits);
+    c.store(out.x + k, x);
+    c.store(out.y + k, y);
+    c.store(out.z + k, z);
+    if (index)
+        c.store_index(index + k, i);
+    return k + compaction_lut().count[bits];
+}
+
+template <typename T, typename Pred>
+size_t filter_soa(const vector3_soa<const T> &in, const vector3_soa<T> &out, uint32_t *index,
+        const Pred &pred) {
+    typedef simd_pack<T> P;
+    size_t i = 0, k = 0;
+    for (; i + P::width <= in.size; i += P::width)
+        k = filter_step<P>(in, out, index, pred, i, k);
+    for (; i < in.size; ++i)
+        k = filter_step<scalar_pack<T> >(in, out, index, pred, i, k);
+    return k;
+}
+
+template <typename T>
+struct sphere_predicate {
+    T cx, cy, cz, r2;
+
+    template <typename P>
+    MUSTINLINE typename P::mask test(typename P::reg x, typename P::reg y, typename P::reg z) const {
+        typename P::reg dx = P::sub(x, P::set1(cx));
+        typename P::reg dy = P::sub(y, P::set1(cy));
+        typename P::reg dz = P::sub(z, P::set1(cz));
+        return P::cmp_le(P::fmadd(dz, dz, P::fmadd(dy, dy, P::mul(dx, dx))), P::set1(r2));
+    }
+};
+
+template <typename T>
+struct halfspace_predicate {
+    const T *planes;
+    size_t nplanes;
+
+    template <typename P>
+    MUSTINLINE typename P::mask test(typename P::reg x, typename P::reg y, typename P::reg z) const {
+        typename P::mask m = P::cmp_ge(P::zero(), P::zero());
+        for (size_t k = 0; k < nplanes; ++k) {
+            const T *pl = planes + 4 * k;
+            typename P::reg d = P::fmadd(P::set1(pl[2]), z,
+                P::fmadd(P::set1(pl[1]), y, P::fmadd(P::set1(pl[0]), x, P::set1(pl[3]))));
+            m = P::mask_and(m, P::cmp_ge(d, P::zero()));
+        }
+        return m;
+    }
+};
+
+} // namespace vectors_internal
+
+/*!
+ * \brief Keeps points lying inside a sphere (distance culling)
+ * @param in Input points
+ * @param cx Coordinate of the center
+ * @param cy Coordinate of the center
+ * @param cz Coordinate of the center
+ * @param radius Radius of the sphere
+ * @param out Output points, may coincide with \e in
+ * @param index Optional output array of original indices of kept points
+ * @return Number of kept points
+ */
+template <typename T>
+size_t filter_sphere(typename vector3_soa_in<T>::type in, T cx, T cy, T cz, T radius, vector3_soa<T> out,
+        uint32_t *index = 0) {
+    VECTORS_PROFILE("filter_sphere", in.size);
+    vectors_internal::sphere_predicate<T> pred = {cx, cy, cz, radius * radius};
+    return vectors_internal::filter_soa(in, out, index, pred);
+}
+
+/*!
+ * \brief Keeps points lying on the positive side of all planes (frustum culling)
+ * @param in Input points
+ * @param planes Array of \e nplanes planes (a, b, c, d); point is kept if a x + b y + c z + d >= 0 for
+ * all of them
+ * @param nplanes Number of planes
+ * @param out Output points, may coincide with \e in
+ * @param index Optional output array of original indices of kept points
+ * @return Number of kept points
+ */
+template <typename T>
+size_t filter_halfspaces(typename vector3_soa_in<T>::type in, const T *planes, size_t nplanes,
+        vector3_soa<T> out, uint32_t *index = 0) {
+    VECTORS_PROFILE("filter_halfspaces", in.size);
+    vectors_internal::halfspace_predicate<T> pred = {planes, nplanes};
+    return vectors_internal::filter_soa(in, out, index, pred);
+}
+
+#endif /* VECTORSFILTER_H_ */
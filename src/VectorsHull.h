@@ -0,0 +1,751 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTORSHULL_H_
+#define VECTORSHULL_H_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "VectorsInternal.h"
+#include "VectorsPack.h"
+#include "VectorsProfiler.h"
+#include "Vector3_soa.h"
+
+/*
+ * Support mapping and convex hulls of point sets. The support point of a set in a direction is the point with
+ * the largest dot product with the direction, as evaluated by GJK and similar collision queries. It is found
+ * either by a SIMD scan of all points (the block maximum is found first and a block is scanned again for the
+ * index only when it improves the maximum) or by hill climbing on the vertex graph of a convex polytope, which
+ * visits only a few vertices when the previous support point is used as a start.
+ *
+ * Convex hulls are built with quickhull (Barber, Dobkin, Huhdanpaa 1996). Extreme points in 26 directions are
+ * hulled first; all points are then tested against the faces of this small hull with SIMD in parallel and
+ * only the points outside of it (usually a small fraction) enter the serial expansion. They are copied in
+ * Morton order, so the points moved between neighbouring faces are also close in memory, and their
+ * reassignments run in parallel again for large sets. Hull geometry is computed in double precision with
+ * the tolerance of Lloyd's Quickhull3D: points closer to a face than 3 * epsilon * (max |x| + max |y| +
+ * max |z|) are treated as lying on it.
+ */
+
+namespace vectors_internal {
+
+/*!
+ * \brief Number of points whose maximum is compared with the best one at once by support_point(), a multiple
+ * of every register width
+ */
+enum { support_block = 256 };
+
+/*!
+ * \brief Dot products of \e P::width points starting at \e i with a direction held in three registers
+ */
+template <typename P>
+MUSTINLINE typename P::reg support_dot(const vector3_soa<const typename P::elt_type> &p, size_t i,
+        const typename P::reg *d) {
+    const typename P::reg v[3] = {P::load(p.x + i), P::load(p.y + i), P::load(p.z + i)};
+    return dot3<P>(v, d);
+}
+
+/*!
+ * \brief Index of the first point with the largest dot product with \e dir, zero for an empty set or if no
+ * dot product is greater than -infinity; points with NaN dot products are skipped
+ */
+template <typename T>
+size_t support_point(const vector3_soa<const T> &p, const T *dir) {
+    typedef simd_pack<T> P;
+    typedef scalar_pack<T> S;
+    typedef typename P::reg reg;
+    const reg d[3] = {P::set1(dir[0]), P::set1(dir[1]), P::set1(dir[2])};
+    const size_t simd_end = p.size - p.size % P::width;
+
+    T best = -std::numeric_limits<T>::infinity();
+    size_t index = 0;
+    for (size_t i = 0; i < simd_end; i += support_block) {
+        const size_t end = std::min<size_t>(i + support_block, simd_end);
+        // Ordered comparisons skip NaN dot products as the scalar tail does
+        reg m = P::set1(-std::numeric_limits<T>::infinity());
+        for (size_t j = i; j < end; j += P::width) {
+            const reg v = support_dot<P>(p, j, d);
+            m = P::select(P::cmp_gt(v, m), v, m);
+        }
+        T buf[P::width];
+        P::store(buf, m);
+        T block_max = buf[0];
+        for (int l = 1; l < P::width; ++l)
+            if (buf[l] > block_max)
+                block_max = buf[l];
+        if (!(block_max > best))
+            continue;
+
+        // The block holds a new maximum; find its first occurrence
+        best = block_max;
+        const reg b = P::set1(best);
+        for (size_t j = i; j < end; j += P::width) {
+            const int bits = P::movemask(P::cmp_ge(support_dot<P>(p, j, d), b));
+            if (bits) {
+                int l = 0;
+                while (!(bits >> l & 1))
+                    ++l;
+                index = j + l;
+                break;
+            }
+        }
+    }
+    for (size_t i = simd_end; i < p.size; ++i) {
+        const T v = support_dot<S>(p, i, dir);
+        if (v > best) {
+            best = v;
+            index = i;
+        }
+    }
+    return index;
+}
+
+/*!
+ * \brief Index of the support point of a convex polytope found by steepest ascent on its vertex graph
+ */
+template <typename T>
+size_t support_point_climb(const vector3_soa<const T> &p, const uint32_t *offsets, const uint32_t *neighbors,
+        const T *dir, size_t start) {
+    typedef simd_pack<T> P;
+    typedef typename P::reg reg;
+    const reg d[3] = {P::set1(dir[0]), P::set1(dir[1]), P::set1(dir[2])};
+
+    size_t current = start;
+    T value = dir[0] * p.x[start] + dir[1] * p.y[start] + dir[2] * p.z[start];
+    for (;;) {
+        // Neighbours are evaluated a register at a time; unused lanes repeat the current vertex
+        size_t next = current;
+        for (uint32_t k = offsets[current]; k < offsets[current + 1]; k += P::width) {
+            int32_t idx[P::width];
+            for (int l = 0; l < P::width; ++l)
+                idx[l] = static_cast<int32_t>(k + l < offsets[current + 1] ? neighbors[k + l] : current);
+            const reg v[3] = {P::gather(p.x, idx), P::gather(p.y, idx), P::gather(p.z, idx)};
+            T buf[P::width];
+            P::store(buf, dot3<P>(v, d));
+            for (int l = 0; l < P::width; ++l) {
+                if (buf[l] > value) {
+                    value = buf[l];
+                    next = static_cast<size_t>(idx[l]);
+                }
+            }
+        }
+        if (next == current)
+            return current;
+        current = next;
+    }
+}
+
+/*!
+ * \brief Largest distance of points above the planes of a set of faces (negative inside of all of them)
+ */
+template <typename T>
+struct hull_filter_kernel {
+    vector3_soa<const T> p;
+    const T *plane;     //!< Unit normal and offset of every face
+    size_t nfaces;
+    T *dist;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        typedef typename P::reg reg;
+        const reg v[3] = {P::load(p.x + i), P::load(p.y + i), P::load(p.z + i)};
+        reg m = P::set1(-std::numeric_limits<T>::infinity());
+        for (size_t f = 0; f < nfaces; ++f) {
+            const T *q = plane + 4 * f;
+            const reg n[3] = {P::set1(q[0]), P::set1(q[1]), P::set1(q[2])};
+            m = P::max(m, P::sub(dot3<P>(n, v), P::set1(q[3])));
+        }
+        P::store(dist + i, m);
+    }
+};
+
+/*!
+ * \brief End of a list of outside points
+ */
+const uint32_t no_point = ~0u;
+
+/*!
+ * \brief Triangular face of a hull under construction
+ */
+struct hull_face {
+    uint32_t v[3];                  //!< Vertices, counter-clockwise seen from outside
+    int32_t n[3];                   //!< Neighbouring faces across the edges v[k] -> v[k + 1]
+    double normal[3];               //!< Outward unit normal
+    double offset;                  //!< Distance of the plane from the origin along the normal
+    uint32_t outside;               //!< First point of the list of points above the face, no_point if none
+    uint32_t furthest;              //!< Outside point furthest from the plane
+    double far_dist;                //!< Distance of the furthest point
+    bool alive;                     //!< Face belongs to the current hull
+    bool visible;                   //!< Face is seen from the point being added
+};
+
+/*!
+ * \class quickhull
+ * \brief Builder of the convex hull of a subset of points. The points are copied in the given order into
+ * interleaved double coordinates, so the random accesses of the expansion touch a single cache line per point;
+ * faces refer to the points by their position in the subset.
+ */
+class quickhull {
+public:
+    std::vector<hull_face> faces;   //!< All faces created; those alive form the hull
+    std::vector<uint32_t> ids;      //!< Input index of every point of the subset
+
+    quickhull() : eps(0) { }
+
+    /*!
+     * \brief Builds the hull
+     * @param points All points
+     * @param subset Indices of the points to hull
+     * @param tolerance Distance below which points are considered to lie on a plane
+     * @return False if the subset does not span a volume
+     */
+    template <typename T>
+    bool run(const vector3_soa<const T> &points, const std::vector<uint32_t> &subset, double tolerance) {
+        const size_t n = subset.size();
+        ids = subset;
+        eps = tolerance;
+        c.resize(3 * n);
+        for (size_t k = 0; k < n; ++k) {
+            c[3 * k] = points.x[ids[k]];
+            c[3 * k + 1] = points.y[ids[k]];
+            c[3 * k + 2] = points.z[ids[k]];
+        }
+        next.assign(n, no_point);
+        faces.clear();
+        if (n < 4 || !simplex())
+            return false;
+
+        std::vector<uint32_t> all(n);
+        for (size_t k = 0; k < n; ++k)
+            all[k] = static_cast<uint32_t>(k);
+        std::vector<int32_t> targets;
+        for (int32_t f = 0; f < 4; ++f)
+            targets.push_back(f);
+        assign(all, targets);
+        expand();
+        return true;
+    }
+
+private:
+    MUSTINLINE double distance(const hull_face &f, uint32_t i) const {
+        const double *q = &c[3 * i];
+        return f.normal[0] * q[0] + f.normal[1] * q[1] + f.normal[2] * q[2] - f.offset;
+    }
+
+    int32_t add_face(uint32_t a, uint32_t b, uint32_t v) {
+        hull_face f;
+        f.v[0] = a;
+        f.v[1] = b;
+        f.v[2] = v;
+        f.n[0] = f.n[1] = f.n[2] = -1;
+        const double *pa = &c[3 * a], *pb = &c[3 * b], *pv = &c[3 * v];
+        const double u[3] = {pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2]};
+        const double w[3] = {pv[0] - pa[0], pv[1] - pa[1], pv[2] - pa[2]};
+        const double n[3] = {u[1] * w[2] - u[2] * w[1], u[2] * w[0] - u[0] * w[2], u[0] * w[1] - u[1] * w[0]};
+        const double len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        const double inv = len > 0 ? 1 / len : 0;
+        for (int k = 0; k < 3; ++k)
+            f.normal[k] = n[k] * inv;
+        // The plane passes through the centroid, which balances the rounding of the three vertices
+        f.offset = (f.normal[0] * (pa[0] + pb[0] + pv[0]) + f.normal[1] * (pa[1] + pb[1] + pv[1])
+            + f.normal[2] * (pa[2] + pb[2] + pv[2])) / 3;
+        f.outside = no_point;
+        f.furthest = 0;
+        f.far_dist = 0;
+        f.alive = true;
+        f.visible = false;
+        faces.push_back(f);
+        return static_cast<int32_t>(faces.size() - 1);
+    }
+
+    /*!
+     * \brief Creates the initial tetrahedron: the two most distant of the extreme points along the axes, the
+     * point furthest from the line through them and the point furthest from the plane through all three
+     */
+    bool simplex() {
+        const uint32_t n = static_cast<uint32_t>(ids.size());
+        uint32_t extreme[6] = {0, 0, 0, 0, 0, 0};
+        for (uint32_t i = 1; i < n; ++i) {
+            for (int a = 0; a < 3; ++a) {
+                if (c[3 * i + a] < c[3 * extreme[2 * a] + a])
+                    extreme[2 * a] = i;
+                if (c[3 * i + a] > c[3 * extreme[2 * a + 1] + a])
+                    extreme[2 * a + 1] = i;
+            }
+        }
+        uint32_t i0 = 0, i1 = 0;
+        double best = 0;
+        for (int a = 0; a < 6; ++a) {
+            for (int b = a + 1; b < 6; ++b) {
+                const double d = squared_distance(extreme[a], extreme[b]);
+                if (d > best) {
+                    best = d;
+                    i0 = extreme[a];
+                    i1 = extreme[b];
+                }
+            }
+        }
+        if (!(best > eps * eps))
+            return false;
+
+        const double *p0 = &c[3 * i0], *p1 = &c[3 * i1];
+        const double u[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        const double uu = u[0] * u[0] + u[1] * u[1] + u[2] * u[2];
+        uint32_t i2 = i0;
+        best = 0;
+        for (uint32_t i = 0; i < n; ++i) {
+            const double w[3] = {c[3 * i] - p0[0], c[3 * i + 1] - p0[1], c[3 * i + 2] - p0[2]};
+            const double x[3] = {u[1] * w[2] - u[2] * w[1], u[2] * w[0] - u[0] * w[2], u[0] * w[1] - u[1] * w[0]};
+            const double d = (x[0] * x[0] + x[1] * x[1] + x[2] * x[2]) / uu;
+            if (d > best) {
+                best = d;
+                i2 = i;
+            }
+        }
+        if (!(best > eps * eps))
+            return false;
+
+        add_face(i0, i1, i2);
+        uint32_t i3 = i0;
+        best = 0;
+        for (uint32_t i = 0; i < n; ++i) {
+            const double d = distance(faces[0], i);
+            if (std::fabs(d) > std::fabs(best)) {
+                best = d;
+                i3 = i;
+            }
+        }
+        faces.clear();
+        if (!(std::fabs(best) > eps))
+            return false;
+        if (best > 0)
+            std::swap(i1, i2);
+
+        add_face(i0, i1, i2);
+        add_face(i0, i3, i1);
+        add_face(i1, i3, i2);
+        add_face(i2, i3, i0);
+        for (int32_t f = 0; f < 4; ++f) {
+            for (int e = 0; e < 3; ++e) {
+                const uint32_t a = faces[f].v[e], b = faces[f].v[(e + 1) % 3];
+                for (int32_t g = 0; g < 4; ++g)
+                    for (int k = 0; k < 3; ++k)
+                        if (faces[g].v[k] == b && faces[g].v[(k + 1) % 3] == a)
+                            faces[f].n[e] = g;
+            }
+        }
+        return true;
+    }
+
+    MUSTINLINE double squared_distance(uint32_t a, uint32_t b) const {
+        const double d[3] = {c[3 * a] - c[3 * b], c[3 * a + 1] - c[3 * b + 1], c[3 * a + 2] - c[3 * b + 2]};
+        return d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+    }
+
+    /*!
+     * \brief Adds points to the outside sets of the first target face they lie above; the others are dropped
+     */
+    void assign(const std::vector<uint32_t> &points, const std::vector<int32_t> &targets) {
+        const ptrdiff_t count = static_cast<ptrdiff_t>(points.size());
+        owner.resize(points.size());
+        height.resize(points.size());
+        VECTORS_OMP(parallel for schedule(static) if(count > 16384))
+        for (ptrdiff_t k = 0; k < count; ++k) {
+            owner[k] = -1;
+            for (size_t t = 0; t < targets.size(); ++t) {
+                const double d = distance(faces[targets[t]], points[k]);
+                if (d > eps) {
+                    owner[k] = targets[t];
+                    height[k] = d;
+                    break;
+                }
+            }
+        }
+        for (ptrdiff_t k = 0; k < count; ++k) {
+            if (owner[k] < 0)
+                continue;
+            hull_face &f = faces[owner[k]];
+            next[points[k]] = f.outside;
+            f.outside = points[k];
+            if (height[k] > f.far_dist) {
+                f.far_dist = height[k];
+                f.furthest = points[k];
+            }
+        }
+    }
+
+    /*!
+     * \brief Adds the furthest outside points of faces to the hull until no outside points are left. Faces
+     * are visited in the order of creation; only faces created later receive points, so one pass suffices.
+     */
+    void expand() {
+        struct frame {
+            int32_t face;
+            int edge;
+            int left;
+        };
+        std::vector<frame> stack;
+        std::vector<int32_t> visible, horizon_face, targets;
+        std::vector<int> horizon_edge;
+        std::vector<uint32_t> orphans;
+
+        for (size_t f = 0; f < faces.size(); ++f) {
+            if (!faces[f].alive || faces[f].outside == no_point)
+                continue;
+            const uint32_t eye = faces[f].furthest;
+
+            // Depth-first search of the faces seen from the eye point; the edges leading to hidden faces form
+            // the horizon, collected as a counter-clockwise loop
+            visible.assign(1, static_cast<int32_t>(f));
+            horizon_face.clear();
+            horizon_edge.clear();
+            faces[f].visible = true;
+            const frame root = {static_cast<int32_t>(f), 0, 3};
+            stack.assign(1, root);
+            while (!stack.empty()) {
+                frame &top = stack.back();
+                if (!top.left) {
+                    stack.pop_back();
+                    continue;
+                }
+                const int32_t face = top.face;
+                const int e = top.edge;
+                top.edge = (top.edge + 1) % 3;
+                --top.left;
+                const int32_t g = faces[face].n[e];
+                if (faces[g].visible)
+                    continue;
+                if (distance(faces[g], eye) > eps) {
+                    faces[g].visible = true;
+                    visible.push_back(g);
+                    const frame next = {g, (back_edge(g, face) + 1) % 3, 2};
+                    stack.push_back(next);
+                } else {
+                    horizon_face.push_back(face);
+                    horizon_edge.push_back(e);
+                }
+            }
+
+            // Cone of new faces from the horizon to the eye point
+            const int32_t first = static_cast<int32_t>(faces.size());
+            const int32_t count = static_cast<int32_t>(horizon_face.size());
+            for (int32_t k = 0; k < count; ++k) {
+                const int32_t h = horizon_face[k];
+                const int e = horizon_edge[k];
+                const int32_t across = faces[h].n[e];
+                const int32_t nf = add_face(faces[h].v[e], faces[h].v[(e + 1) % 3], eye);
+                faces[nf].n[0] = across;
+                faces[nf].n[1] = first + (k + 1) % count;
+                faces[nf].n[2] = first + (k + count - 1) % count;
+                faces[across].n[back_edge(across, h)] = nf;
+            }
+
+            orphans.clear();
+            for (size_t v = 0; v < visible.size(); ++v) {
+                hull_face &g = faces[visible[v]];
+                for (uint32_t i = g.outside; i != no_point; i = next[i])
+                    if (i != eye)
+                        orphans.push_back(i);
+                g.outside = no_point;
+                g.alive = false;
+            }
+            targets.clear();
+            for (int32_t k = 0; k < count; ++k)
+                targets.push_back(first + k);
+            assign(orphans, targets);
+        }
+    }
+
+    /*!
+     * \brief Edge of face \e g shared with face \e f
+     */
+    MUSTINLINE int back_edge(int32_t g, int32_t f) const {
+        return faces[g].n[0] == f ? 0 : faces[g].n[1] == f ? 1 : 2;
+    }
+
+    double eps;                     //!< Distance below which points are considered to lie on a plane
+    std::vector<double> c;          //!< Interleaved coordinates of the points of the subset
+    std::vector<uint32_t> next;     //!< Next point in the outside list of a face
+    std::vector<int32_t> owner;     //!< Face chosen for every point by assign()
+    std::vector<double> height;     //!< Distance of every point from its face
+};
+
+/*!
+ * \brief Spreads the ten low bits of \e v to every third bit, for the Morton order of candidate points
+ */
+MUSTINLINE uint64_t spread_bits(uint64_t v) {
+    v &= 0x3ff;
+    v = (v | v << 16) & 0x30000ff;
+    v = (v | v << 8) & 0x300f00f;
+    v = (v | v << 4) & 0x30c30c3;
+    v = (v | v << 2) & 0x9249249;
+    return v;
+}
+
+/*!
+ * \brief Builds the hull of a point set; see the description at the top of the file
+ * @return False if the points do not span a volume
+ */
+template <typename T>
+bool convex_hull_faces(const vector3_soa<const T> &p, quickhull &hull) {
+    if (p.size < 4)
+        return false;
+
+    // Extreme points in the directions towards the faces, edges and corners of a cube
+    std::vector<uint32_t> extreme(26);
+    VECTORS_OMP(parallel for schedule(dynamic) if(p.size > 65536))
+    for (int k = 0; k < 26; ++k) {
+        const int code = k < 13 ? k : k + 1;
+        const T dir[3] = {T(code % 3 - 1), T(code / 3 % 3 - 1), T(code / 9 - 1)};
+        extreme[k] = static_cast<uint32_t>(support_point(p, dir));
+    }
+    // Directions -z, -y, -x, x, y, z are codes 4, 10, 12, 14, 16, 22, i.e. k = 4, 10, 12, 13, 15, 21
+    const double lo[3] = {double(p.x[extreme[12]]), double(p.y[extreme[10]]), double(p.z[extreme[4]])};
+    const double hi[3] = {double(p.x[extreme[13]]), double(p.y[extreme[15]]), double(p.z[extreme[21]])};
+    double scale = 0;
+    for (int a = 0; a < 3; ++a)
+        scale += std::max(std::fabs(lo[a]), std::fabs(hi[a]));
+    const double eps = 3 * std::numeric_limits<double>::epsilon() * scale;
+    std::sort(extreme.begin(), extreme.end());
+    extreme.erase(std::unique(extreme.begin(), extreme.end()), extreme.end());
+
+    // Points inside the hull of the extreme points by a margin covering the rounding of T are dropped
+    std::vector<uint32_t> candidates;
+    quickhull coarse;
+    if (coarse.run(p, extreme, eps)) {
+        std::vector<T> plane;
+        for (size_t f = 0; f < coarse.faces.size(); ++f) {
+            if (!coarse.faces[f].alive)
+                continue;
+            for (int k = 0; k < 3; ++k)
+                plane.push_back(static_cast<T>(coarse.faces[f].normal[k]));
+            plane.push_back(static_cast<T>(coarse.faces[f].offset));
+        }
+        std::vector<T> dist(p.size);
+        hull_filter_kernel<T> k = {p, &plane[0], plane.size() / 4, &dist[0]};
+        pack_for<T>(p.size, k);
+        const T margin = T(16 * std::numeric_limits<T>::epsilon() * scale);
+        for (size_t i = 0; i < p.size; ++i)
+            if (dist[i] > -margin)
+                candidates.push_back(static_cast<uint32_t>(i));
+        candidates.insert(candidates.end(), extreme.begin(), extreme.end());
+    } else {
+        for (size_t i = 0; i < p.size; ++i)
+            candidates.push_back(static_cast<uint32_t>(i));
+    }
+
+    // Morton order of the candidates on a 1024^3 grid over the bounding box
+    std::vector<uint64_t> key(candidates.size());
+    double inv[3];
+    for (int a = 0; a < 3; ++a)
+        inv[a] = hi[a] > lo[a] ? 1023 / (hi[a] - lo[a]) : 0;
+    for (size_t k = 0; k < candidates.size(); ++k) {
+        const uint32_t i = candidates[k];
+        const uint64_t code = spread_bits(uint64_t((p.x[i] - lo[0]) * inv[0]))
+            | spread_bits(uint64_t((p.y[i] - lo[1]) * inv[1])) << 1
+            | spread_bits(uint64_t((p.z[i] - lo[2]) * inv[2])) << 2;
+        key[k] = code << 32 | i;
+    }
+    std::sort(key.begin(), key.end());
+    key.erase(std::unique(key.begin(), key.end()), key.end());
+    candidates.resize(key.size());
+    for (size_t k = 0; k < key.size(); ++k)
+        candidates[k] = static_cast<uint32_t>(key[k]);
+    return hull.run(p, candidates, eps);
+}
+
+} // namespace vectors_internal
+
+/*!
+ * \brief Support point of a set: the first point with the largest dot product with a direction
+ * @param points Points
+ * @param dir Direction, three coordinates; need not be normalized
+ * @return Index of the support point, zero for an empty set; points with NaN dot products are skipped
+ */
+template <typename T>
+size_t support_point(typename vector3_soa_in<T>::type points, const T *dir) {
+    VECTORS_PROFILE("support_point", points.size);
+    return vectors_internal::support_point(points, dir);
+}
+
+/*!
+ * \brief Support points of a set in many directions, processed in parallel
+ * @param points Points
+ * @param dirs Directions
+ * @param index Output array of dirs.size indices of support points
+ */
+template <typename T>
+void support_points(typename vector3_soa_in<T>::type points, typename vector3_soa_in<T>::type dirs,
+        uint32_t *index) {
+    VECTORS_PROFILE("support_points", points.size * dirs.size);
+    VECTORS_OMP(parallel for schedule(dynamic, 4) if(dirs.size > 1 && points.size * dirs.size > 65536))
+    for (ptrdiff_t k = 0; k < static_cast<ptrdiff_t>(dirs.size); ++k) {
+        const T dir[3] = {dirs.x[k], dirs.y[k], dirs.z[k]};
+        index[k] = static_cast<uint32_t>(vectors_internal::support_point(points, dir));
+    }
+}
+
+/*!
+ * \brief Support point of a convex polytope found by hill climbing on its vertex graph: the walk moves to the
+ * neighbour with the largest dot product until no neighbour improves it. On a convex polytope the local
+ * maximum is the global one; starting from the support point of a nearby direction (as in successive GJK
+ * iterations) takes only a few steps.
+ * @param points Vertices of the polytope
+ * @param offsets Neighbours of vertex v are neighbors[offsets[v]] ... neighbors[offsets[v + 1] - 1]
+ * @param neighbors Concatenated neighbour lists
+ * @param dir Direction, three coordinates
+ * @param start Vertex the walk starts from
+ * @return Index of the support point
+ */
+template <typename T>
+size_t support_point_climb(typename vector3_soa_in<T>::type points, const uint32_t *offsets,
+        const uint32_t *neighbors, const T *dir, size_t start) {
+    return vectors_internal::support_point_climb(points, offsets, neighbors, dir, start);
+}
+
+/*!
+ * \class convex_hull
+ * \brief Convex hull of a point set as a triangle mesh over its own copy of the hull vertices, with the
+ * vertex graph used by support(). Sets which do not span a volume (fewer than four points, or all points on a
+ * plane within the tolerance) give an empty hull.
+ */
+template <typename T>
+class convex_hull {
+public:
+    typedef T elt_type;
+
+    /*!
+     * \brief Builds the hull of points given as SoA arrays
+     */
+    explicit convex_hull(typename vector3_soa_in<T>::type points) {
+        VECTORS_PROFILE("convex_hull", points.size);
+        build(points);
+    }
+
+    /*!
+     * \brief Builds the hull of an array of vector class objects (vector3_reg, vector3f_simd, vector3d_simd)
+     * @param points Array of points
+     * @param n Number of points
+     */
+    template <typename V>
+    convex_hull(const V *points, size_t n) {
+        VECTORS_PROFILE("convex_hull", n);
+        std::vector<T> c(3 * n);
+        for (size_t i = 0; i < n; ++i) {
+            c[i] = static_cast<T>(points[i].x);
+            c[n + i] = static_cast<T>(points[i].y);
+            c[2 * n + i] = static_cast<T>(points[i].z);
+        }
+        build(vector3_soa<const T>(n ? &c[0] : 0, n ? &c[n] : 0, n ? &c[2 * n] : 0, n));
+    }
+
+    size_t vertex_count() const { return index.size(); }
+    size_t triangle_count() const { return tri.size() / 3; }
+
+    /*!
+     * \brief Coordinates of the hull vertices, in the order of the input points
+     */
+    vector3_soa<const T> vertices() const {
+        return index.empty() ? vector3_soa<const T>() : vector3_soa<const T>(&x[0], &y[0], &z[0], x.size());
+    }
+
+    /*!
+     * \brief Input point of every hull vertex
+     */
+    const uint32_t *indices() const { return index.empty() ? 0 : &index[0]; }
+
+    /*!
+     * \brief Hull vertex numbers of the triangles, three per face, counter-clockwise seen from outside
+     */
+    const uint32_t *triangles() const { return tri.empty() ? 0 : &tri[0]; }
+
+    /*!
+     * \brief Neighbours of hull vertex v are neighbors()[offsets()[v]] ... neighbors()[offsets()[v + 1] - 1]
+     */
+    const uint32_t *offsets() const { return &offset[0]; }
+    const uint32_t *neighbors() const { return neighbor.empty() ? 0 : &neighbor[0]; }
+
+    /*!
+     * \brief Support vertex of the hull by hill climbing
+     * @param dir Direction, three coordinates
+     * @param start Hull vertex the walk starts from, e.g. the result of the previous query
+     * @return Hull vertex number of the support point
+     */
+    size_t support(const T *dir, size_t start = 0) const {
+        return vectors_internal::support_point_climb(vertices(), offsets(), neighbors(), dir, start);
+    }
+
+private:
+    void build(const vector3_soa<const T> &points) {
+        offset.assign(1, 0);
+        vectors_internal::quickhull qh;
+        if (!vectors_internal::convex_hull_faces(points, qh))
+            return;
+
+        for (size_t f = 0; f < qh.faces.size(); ++f)
+            if (qh.faces[f].alive)
+                for (int k = 0; k < 3; ++k)
+                    tri.push_back(qh.ids[qh.faces[f].v[k]]);
+
+        // Vertices are numbered in the order of the input points
+        std::vector<uint32_t> vertex(points.size, vectors_internal::no_point);
+        for (size_t k = 0; k < tri.size(); ++k)
+            vertex[tri[k]] = 0;
+        for (size_t i = 0; i < points.size; ++i) {
+            if (!vertex[i]) {
+                vertex[i] = static_cast<uint32_t>(index.size());
+                index.push_back(static_cast<uint32_t>(i));
+            }
+        }
+        for (size_t k = 0; k < tri.size(); ++k)
+            tri[k] = vertex[tri[k]];
+        for (size_t v = 0; v < index.size(); ++v) {
+            x.push_back(points.x[index[v]]);
+            y.push_back(points.y[index[v]]);
+            z.push_back(points.z[index[v]]);
+        }
+
+        // Every edge a -> b of a triangle makes b a neighbour of a; the opposite face adds it the other way
+        offset.assign(index.size() + 1, 0);
+        for (size_t k = 0; k < tri.size(); ++k)
+            ++offset[tri[k] + 1];
+        for (size_t v = 0; v < index.size(); ++v)
+            offset[v + 1] += offset[v];
+        neighbor.resize(tri.size());
+        std::vector<uint32_t> fill(offset.begin(), offset.end() - 1);
+        for (size_t f = 0; f < tri.size(); f += 3)
+            for (int e = 0; e < 3; ++e)
+                neighbor[fill[tri[f + e]]++] = tri[f + (e + 1) % 3];
+    }
+
+    std::vector<T> x, y, z;             //!< Coordinates of hull vertices
+    std::vector<uint32_t> index;        //!< Input point of every hull vertex
+    std::vector<uint32_t> tri;          //!< Triangles
+    std::vector<uint32_t> offset;       //!< Start of the neighbour list of every vertex, plus the total length
+    std::vector<uint32_t> neighbor;     //!< Concatenated neighbour lists
+};
+
+#endif /* VECTORSHULL_H_ */
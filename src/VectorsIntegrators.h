@@ -0,0 +1,318 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTORSINTEGRATORS_H_
+#define VECTORSINTEGRATORS_H_
+
+#include "VectorsInternal.h"
+#include "VectorsPack.h"
+#include "VectorsProfiler.h"
+#include "Vector3_soa.h"
+
+/*
+ * Time integration kernels for the equation of motion x'' = a(x). Every kernel updates all arrays it touches
+ * in a single pass, so positions, velocities and accelerations are read from memory once per call.
+ * Acceleration callbacks have the signature
+ *
+ *      void accel(vector3_soa<const T> pos, vector3_soa<T> acc);
+ */
+
+namespace vectors_internal {
+
+/*!
+ * \brief v += 0.5 dt a; x += dt v
+ */
+template <typename T>
+struct verlet_kick_drift_kernel {
+    T *x[3], *v[3];
+    const T *a[3];
+    T dt;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        const typename P::reg half_dt = P::set1(T(0.5) * dt);
+        const typename P::reg full_dt = P::set1(dt);
+        for (int d = 0; d < 3; ++d) {
+            typename P::reg vh = P::fmadd(P::load(a[d] + i), half_dt, P::load(v[d] + i));
+            P::store(v[d] + i, vh);
+            P::store(x[d] + i, P::fmadd(vh, full_dt, P::load(x[d] + i)));
+        }
+    }
+};
+
+/*!
+ * \brief v += dt a; x += dt v
+ */
+template <typename T>
+struct leapfrog_kernel {
+    T *x[3], *v[3];
+    const T *a[3];
+    T dt;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        const typename P::reg step = P::set1(dt);
+        for (int d = 0; d < 3; ++d) {
+            typename P::reg vn = P::fmadd(P::load(a[d] + i), step, P::load(v[d] + i));
+            P::store(v[d] + i, vn);
+            P::store(x[d] + i, P::fmadd(vn, step, P::load(x[d] + i)));
+        }
+    }
+};
+
+/*!
+ * \brief v += c a
+ */
+template <typename T>
+struct kick_kernel {
+    T *v[3];
+    const T *a[3];
+    T c;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        const typename P::reg step = P::set1(c);
+        for (int d = 0; d < 3; ++d)
+            P::store(v[d] + i, P::fmadd(P::load(a[d] + i), step, P::load(v[d] + i)));
+    }
+};
+
+/*!
+ * \brief Intermediate stage of RK4. Accumulates weighted slopes (kx, kv) of the current stage and computes
+ * state of the next stage: xs = x + c kx, vs = v + c kv. Stage velocities may alias \e kx.
+ */
+template <typename T>
+struct rk4_stage_kernel {
+    const T *x[3], *v[3], *kx[3], *kv[3];
+    T *sx[3], *sv[3], *xs[3], *vs[3];
+    T c, w;
+    bool first;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        typedef typename P::reg reg;
+        const reg cc = P::set1(c);
+        const reg ww = P::set1(w);
+        for (int d = 0; d < 3; ++d) {
+            const reg kxi = P::load(kx[d] + i);
+            const reg kvi = P::load(kv[d] + i);
+            if (first) {
+                P::store(sx[d] + i, P::mul(kxi, ww));
+                P::store(sv[d] + i, P::mul(kvi, ww));
+            }
+            else {
+                P::store(sx[d] + i, P::fmadd(kxi, ww, P::load(sx[d] + i)));
+                P::store(sv[d] + i, P::fmadd(kvi, ww, P::load(sv[d] + i)));
+            }
+            P::store(xs[d] + i, P::fmadd(kxi, cc, P::load(x[d] + i)));
+            P::store(vs[d] + i, P::fmadd(kvi, cc, P::load(v[d] + i)));
+        }
+    }
+};
+
+/*!
+ * \brief Final stage of RK4: x += h (sx + kx), v += h (sv + kv)
+ */
+template <typename T>
+struct rk4_final_kernel {
+    T *x[3], *v[3];
+    const T *sx[3], *sv[3], *kx[3], *kv[3];
+    T h;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        const typename P::reg hh = P::set1(h);
+        for (int d = 0; d < 3; ++d) {
+            typename P::reg dx = P::add(P::load(sx[d] + i), P::load(kx[d] + i));
+            typename P::reg dv = P::add(P::load(sv[d] + i), P::load(kv[d] + i));
+            P::store(x[d] + i, P::fmadd(dx, hh, P::load(x[d] + i)));
+            P::store(v[d] + i, P::fmadd(dv, hh, P::load(v[d] + i)));
+        }
+    }
+};
+
+template <typename T, typename U>
+MUSTINLINE void soa_pointers(U **p, const vector3_soa<T> &v) {
+    p[0] = v.x;
+    p[1] = v.y;
+    p[2] = v.z;
+}
+
+} // namespace vectors_internal
+
+/*!
+ * \brief First half of the velocity Verlet step: half kick of velocities followed by a drift of positions.
+ * Accelerations should be recomputed for new positions and passed to velocity_verlet_kick() afterwards.
+ * @param pos Positions, updated
+ * @param vel Velocities, updated to the half step
+ * @param acc Accelerations at the current positions
+ * @param dt Time step
+ */
+template <typename T>
+void velocity_verlet_kick_drift(vector3_soa<T> pos, vector3_soa<T> vel, typename vector3_soa_in<T>::type acc,
+        T dt) {
+    VECTORS_PROFILE("velocity_verlet_kick_drift", pos.size);
+    vectors_internal::verlet_kick_drift_kernel<T> k;
+    vectors_internal::soa_pointers(k.x, pos);
+    vectors_internal::soa_pointers(k.v, vel);
+    vectors_internal::soa_pointers(k.a, acc);
+    k.dt = dt;
+    vectors_internal::pack_for<T>(pos.size, k);
+}
+
+/*!
+ * \brief Second half of the velocity Verlet step: half kick of velocities with accelerations at new positions
+ * @param vel Velocities, updated
+ * @param acc Accelerations at the new positions
+ * @param dt Time step
+ */
+template <typename T>
+void velocity_verlet_kick(vector3_soa<T> vel, typename vector3_soa_in<T>::type acc, T dt) {
+    VECTORS_PROFILE("velocity_verlet_kick", vel.size);
+    vectors_internal::kick_kernel<T> k;
+    vectors_internal::soa_pointers(k.v, vel);
+    vectors_internal::soa_pointers(k.a, acc);
+    k.c = T(0.5) * dt;
+    vectors_internal::pack_for<T>(vel.size, k);
+}
+
+/*!
+ * \brief Complete velocity Verlet step
+ * @param pos Positions, updated
+ * @param vel Velocities, updated
+ * @param acc Accelerations at the current positions on input and at the new positions on output
+ * @param dt Time step
+ * @param accel Callback computing accelerations
+ */
+template <typename T, typename Accel>
+void velocity_verlet_step(vector3_soa<T> pos, vector3_soa<T> vel, vector3_soa<T> acc, T dt, Accel accel) {
+    velocity_verlet_kick_drift<T>(pos, vel, acc, dt);
+    accel(vector3_soa<const T>(pos), acc);
+    velocity_verlet_kick<T>(vel, acc, dt);
+}
+
+/*!
+ * \brief Leapfrog (kick-drift) step with velocities defined at half steps: v += dt a; x += dt v
+ * @param pos Positions, updated
+ * @param vel Velocities, updated
+ * @param acc Accelerations at the current positions
+ * @param dt Time step
+ */
+template <typename T>
+void leapfrog_step(vector3_soa<T> pos, vector3_soa<T> vel, typename vector3_soa_in<T>::type acc,
+        T dt) {
+    VECTORS_PROFILE("leapfrog_step", pos.size);
+    vectors_internal::leapfrog_kernel<T> k;
+    vectors_internal::soa_pointers(k.x, pos);
+    vectors_internal::soa_pointers(k.v, vel);
+    vectors_internal::soa_pointers(k.a, acc);
+    k.dt = dt;
+    vectors_internal::pack_for<T>(pos.size, k);
+}
+
+/*!
+ * \class rk4_integrator
+ * \brief Classical fourth order Runge-Kutta scheme for x'' = a(x). Keeps stage buffers between steps; every
+ * stage is a single pass over the arrays.
+ */
+template <typename T>
+class rk4_integrator {
+public:
+    typedef T elt_type;
+
+    /*!
+     * \brief Constructor
+     * @param size Number of vectors, stage buffers are resized on demand anyway
+     */
+    explicit rk4_integrator(size_t size = 0) : xs(size), vs(size), a(size), sx(size), sv(size) { }
+
+    /*!
+     * \brief Advances positions and velocities by one time step
+     * @param pos Positions, updated
+     * @param vel Velocities, updated
+     * @param dt Time step
+     * @param accel Callback computing accelerations
+     */
+    template <typename Accel>
+    void step(vector3_soa<T> pos, vector3_soa<T> vel, T dt, Accel accel) {
+        const size_t n = pos.size;
+        if (xs.size() != n) {
+            xs.resize(n);
+            vs.resize(n);
+            a.resize(n);
+            sx.resize(n);
+            sv.resize(n);
+        }
+
+        accel(vector3_soa<const T>(pos), a.view());
+        stage(pos, vel, vel, T(0.5) * dt, T(1), true);
+        accel(xs.view(), a.view());
+        stage(pos, vel, vs.view(), T(0.5) * dt, T(2), false);
+        accel(xs.view(), a.view());
+        stage(pos, vel, vs.view(), dt, T(2), false);
+        accel(xs.view(), a.view());
+        finish(pos, vel, dt);
+    }
+
+private:
+    vector3_soa_buffer<T> xs;   //!< Stage positions
+    vector3_soa_buffer<T> vs;   //!< Stage velocities
+    vector3_soa_buffer<T> a;    //!< Stage accelerations
+    vector3_soa_buffer<T> sx;   //!< Weighted sum of position slopes
+    vector3_soa_buffer<T> sv;   //!< Weighted sum of velocity slopes
+
+    // The stages and the final update are profiled separately, so that the time of the acceleration
+    // callback is not attributed to them
+    void stage(vector3_soa<T> pos, vector3_soa<T> vel, vector3_soa<T> kx, T c, T w, bool first) {
+        VECTORS_PROFILE("rk4_integrator::stage", pos.size);
+        vectors_internal::rk4_stage_kernel<T> k;
+        vectors_internal::soa_pointers(k.x, pos);
+        vectors_internal::soa_pointers(k.v, vel);
+        vectors_internal::soa_pointers(k.kx, kx);
+        vectors_internal::soa_pointers(k.kv, a.view());
+        vectors_internal::soa_pointers(k.sx, sx.view());
+        vectors_internal::soa_pointers(k.sv, sv.view());
+        vectors_internal::soa_pointers(k.xs, xs.view());
+        vectors_internal::soa_pointers(k.vs, vs.view());
+        k.c = c;
+        k.w = w;
+        k.first = first;
+        vectors_internal::pack_for<T>(pos.size, k);
+    }
+
+    void finish(vector3_soa<T> pos, vector3_soa<T> vel, T dt) {
+        VECTORS_PROFILE("rk4_integrator::final", pos.size);
+        vectors_internal::rk4_final_kernel<T> k;
+        vectors_internal::soa_pointers(k.x, pos);
+        vectors_internal::soa_pointers(k.v, vel);
+        vectors_internal::soa_pointers(k.sx, sx.view());
+        vectors_internal::soa_pointers(k.sv, sv.view());
+        vectors_internal::soa_pointers(k.kx, vs.view());
+        vectors_internal::soa_pointers(k.kv, a.view());
+        k.h = dt / T(6);
+        vectors_internal::pack_for<T>(pos.size, k);
+    }
+};
+
+#endif /* VECTORSINTEGRATORS_H_ */
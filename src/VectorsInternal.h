@@ -30,6 +30,32 @@
 #include <x86intrin.h>
 #include <iostream>
 #include <cmath>
+#include <cstddef>
+#include <stdint.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*
+ * Batch kernels are parallelized with OpenMP when the code is compiled with -fopenmp. Otherwise
+ * the pragmas expand to nothing and kernels run on the calling thread.
+ */
+#ifdef _OPENMP
+#define VECTORS_PRAGMA(x) _Pragma(#x)
+#define VECTORS_OMP(x) VECTORS_PRAGMA(omp x)
+#else
+#define VECTORS_OMP(x)
+#endif
+
+/*
+ * Reproducible mode. When VECTORS_DETERMINISTIC is defined, batch kernels and the vector classes only use
+ * correctly rounded operations evaluated in a fixed order: fused multiply-add is split into a multiplication
+ * and an addition, reciprocal square root estimates are replaced by division and square root, and dot
+ * products of the vector classes are summed in the scalar order. Results are then bitwise identical with
+ * the scalar, SSE and AVX2 code paths and with any number of threads, provided that the compiler does not
+ * contract scalar expressions either (compile with -ffp-contract=off when FMA instructions are enabled).
+ */
 
 #ifdef __GNUG__
 #ifndef _MM_ALIGN32
@@ -0,0 +1,244 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTORSMESH_H_
+#define VECTORSMESH_H_
+
+#include <algorithm>
+#include <vector>
+#include "VectorsInternal.h"
+#include "VectorsPack.h"
+#include "VectorsProfiler.h"
+#include "Vector3_soa.h"
+
+/*
+ * Geometry of indexed triangle meshes. Triangles are given as triples of vertex indices, counter-clockwise
+ * when seen from the front side. Face kernels gather the corners of several triangles into registers; vertex
+ * normals are accumulated by gathering the normals of incident faces for every vertex (the incidence lists
+ * are stored in a mesh_adjacency), so vertices can be processed in parallel without atomics or write
+ * conflicts, and the result does not depend on the number of threads.
+ */
+
+/*!
+ * \class mesh_adjacency
+ * \brief Faces incident to every vertex of a triangle mesh in compressed sparse row format. Depends only on
+ * the connectivity, so it is built once and reused while the mesh deforms.
+ */
+class mesh_adjacency {
+public:
+    /*!
+     * \brief Constructor
+     * @param triangles Vertex indices, three per face
+     * @param nfaces Number of faces
+     * @param nvertices Number of vertices
+     */
+    mesh_adjacency(const uint32_t *triangles, size_t nfaces, size_t nvertices) :
+        offset(nvertices + 1, 0), face(3 * nfaces), nfaces(nfaces) {
+        for (size_t k = 0; k < 3 * nfaces; ++k)
+            ++offset[triangles[k] + 1];
+        for (size_t v = 0; v < nvertices; ++v)
+            offset[v + 1] += offset[v];
+        // Faces are listed in increasing order for every vertex
+        std::vector<uint32_t> fill(offset.begin(), offset.end() - 1);
+        for (size_t f = 0; f < nfaces; ++f)
+            for (int c = 0; c < 3; ++c)
+                face[fill[triangles[3 * f + c]]++] = static_cast<uint32_t>(f);
+    }
+
+    size_t vertex_count() const { return offset.size() - 1; }
+    size_t face_count() const { return nfaces; }
+
+    /*!
+     * \brief Faces of vertex v are faces()[offsets()[v]] ... faces()[offsets()[v + 1] - 1]
+     */
+    const uint32_t *offsets() const { return &offset[0]; }
+    const uint32_t *faces() const { return face.empty() ? 0 : &face[0]; }
+
+private:
+    std::vector<uint32_t> offset;   //!< Start of the face list of every vertex, plus the total length
+    std::vector<uint32_t> face;     //!< Concatenated face lists
+    size_t nfaces;                  //!< Number of faces of the mesh
+};
+
+namespace vectors_internal {
+
+/*!
+ * \brief a b - c d which is exactly zero whenever the products are equal, so that triangles with coinciding
+ * corners get zero normals. A plain fnmadd(c, d, a b) would leave the rounding error of a b instead; the
+ * rounding error of c d is recovered with a fused multiply-add and added back (Kahan).
+ */
+template <typename P>
+MUSTINLINE typename P::reg difference_of_products(typename P::reg a, typename P::reg b, typename P::reg c,
+        typename P::reg d) {
+    const typename P::reg w = P::mul(c, d);
+    return P::sub(P::fnmadd(c, d, w), P::fnmadd(a, b, w));
+}
+
+/*!
+ * \brief Normals and areas of triangles. Normals are scaled to unit length if \e unit is set and are equal to
+ * the cross product of the edges (twice the area) otherwise; either output may be null.
+ */
+template <typename T>
+struct face_normal_kernel {
+    vector3_soa<const T> v;
+    const uint32_t *triangles;
+    vector3_soa<T> normals;
+    T *areas;
+    bool unit;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        typedef typename P::reg reg;
+        int32_t corner[3][P::width];
+        for (int l = 0; l < P::width; ++l)
+            for (int c = 0; c < 3; ++c)
+                corner[c][l] = static_cast<int32_t>(triangles[3 * (i + l) + c]);
+
+        const reg ax = P::gather(v.x, corner[0]), ay = P::gather(v.y, corner[0]), az = P::gather(v.z, corner[0]);
+        const reg ux = P::sub(P::gather(v.x, corner[1]), ax);
+        const reg uy = P::sub(P::gather(v.y, corner[1]), ay);
+        const reg uz = P::sub(P::gather(v.z, corner[1]), az);
+        const reg wx = P::sub(P::gather(v.x, corner[2]), ax);
+        const reg wy = P::sub(P::gather(v.y, corner[2]), ay);
+        const reg wz = P::sub(P::gather(v.z, corner[2]), az);
+        reg nx = difference_of_products<P>(uy, wz, uz, wy);
+        reg ny = difference_of_products<P>(uz, wx, ux, wz);
+        reg nz = difference_of_products<P>(ux, wy, uy, wx);
+
+        if (areas || unit) {
+            const reg len = P::sqrt(P::fmadd(nz, nz, P::fmadd(ny, ny, P::mul(nx, nx))));
+            if (areas)
+                P::store(areas + i, P::mul(len, P::set1(T(0.5))));
+            if (unit) {
+                // Degenerate triangles get zero normals
+                const reg inv = P::select(P::cmp_gt(len, P::zero()), P::div(P::set1(T(1)), len), P::zero());
+                nx = P::mul(nx, inv);
+                ny = P::mul(ny, inv);
+                nz = P::mul(nz, inv);
+            }
+        }
+        if (normals.x) {
+            P::store(normals.x + i, nx);
+            P::store(normals.y + i, ny);
+            P::store(normals.z + i, nz);
+        }
+    }
+};
+
+/*!
+ * \brief Sums of face vectors over the faces incident to every vertex, scaled to unit length. Face vectors
+ * have an extra zero element at index face_count() which pads the shorter face lists of a register.
+ */
+template <typename T>
+struct vertex_normal_kernel {
+    const mesh_adjacency *adj;
+    vector3_soa<const T> face;
+    vector3_soa<T> normals;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        typedef typename P::reg reg;
+        const uint32_t *offset = adj->offsets() + i;
+        const uint32_t *list = adj->faces();
+        const int32_t pad = static_cast<int32_t>(adj->face_count());
+        uint32_t degree = 0;
+        for (int l = 0; l < P::width; ++l)
+            degree = std::max(degree, offset[l + 1] - offset[l]);
+
+        reg sx = P::zero(), sy = P::zero(), sz = P::zero();
+        int32_t idx[P::width];
+        for (uint32_t j = 0; j < degree; ++j) {
+            for (int l = 0; l < P::width; ++l)
+                idx[l] = offset[l] + j < offset[l + 1] ? static_cast<int32_t>(list[offset[l] + j]) : pad;
+            sx = P::add(sx, P::gather(face.x, idx));
+            sy = P::add(sy, P::gather(face.y, idx));
+            sz = P::add(sz, P::gather(face.z, idx));
+        }
+
+        const reg len = P::sqrt(P::fmadd(sz, sz, P::fmadd(sy, sy, P::mul(sx, sx))));
+        const reg inv = P::select(P::cmp_gt(len, P::zero()), P::div(P::set1(T(1)), len), P::zero());
+        P::store(normals.x + i, P::mul(sx, inv));
+        P::store(normals.y + i, P::mul(sy, inv));
+        P::store(normals.z + i, P::mul(sz, inv));
+    }
+};
+
+} // namespace vectors_internal
+
+/*!
+ * \brief Unit normals and, optionally, areas of triangles
+ * @param vertices Vertex positions
+ * @param triangles Vertex indices, three per face
+ * @param nfaces Number of faces
+ * @param normals Output unit normals, \e nfaces vectors; zero for degenerate triangles
+ * @param areas Output areas, \e nfaces values, or null
+ */
+template <typename T>
+void mesh_face_normals(typename vector3_soa_in<T>::type vertices, const uint32_t *triangles, size_t nfaces,
+        vector3_soa<T> normals, T *areas = 0) {
+    VECTORS_PROFILE("mesh_face_normals", nfaces);
+    vectors_internal::face_normal_kernel<T> k = {vertices, triangles, normals, areas, true};
+    vectors_internal::pack_for<T>(nfaces, k);
+}
+
+/*!
+ * \brief Areas of triangles
+ * @param vertices Vertex positions
+ * @param triangles Vertex indices, three per face
+ * @param nfaces Number of faces
+ * @param areas Output areas, \e nfaces values
+ */
+template <typename T>
+void mesh_face_areas(typename vector3_soa_in<T>::type vertices, const uint32_t *triangles, size_t nfaces,
+        T *areas) {
+    VECTORS_PROFILE("mesh_face_areas", nfaces);
+    vectors_internal::face_normal_kernel<T> k = {vertices, triangles, vector3_soa<T>(), areas, false};
+    vectors_internal::pack_for<T>(nfaces, k);
+}
+
+/*!
+ * \brief Area-weighted vertex normals: normalized sums of the normals of incident faces weighted by face
+ * areas. Vertices without faces get zero normals.
+ * @param vertices Vertex positions
+ * @param triangles Vertex indices, three per face
+ * @param adj Incidence lists built for the same triangles
+ * @param normals Output unit normals, adj.vertex_count() vectors
+ */
+template <typename T>
+void mesh_vertex_normals(typename vector3_soa_in<T>::type vertices, const uint32_t *triangles,
+        const mesh_adjacency &adj, vector3_soa<T> normals) {
+    VECTORS_PROFILE("mesh_vertex_normals", adj.vertex_count());
+    const size_t nfaces = adj.face_count();
+    std::vector<T> fx(nfaces + 1, T(0)), fy(nfaces + 1, T(0)), fz(nfaces + 1, T(0));
+    const vector3_soa<T> face(&fx[0], &fy[0], &fz[0], nfaces + 1);
+
+    // Cross products of the edges are normals scaled by twice the area
+    vectors_internal::face_normal_kernel<T> fk = {vertices, triangles, face, static_cast<T *>(0), false};
+    vectors_internal::pack_for<T>(nfaces, fk);
+
+    vectors_internal::vertex_normal_kernel<T> vk = {&adj, face, normals};
+    vectors_internal::pack_for<T>(adj.vertex_count(), vk);
+}
+
+#endif /* VECTORSMESH_H_ */
@@ -0,0 +1,403 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTORSNBODY_H_
+#define VECTORSNBODY_H_
+
+#include <vector>
+#include "VectorsInternal.h"
+#include "VectorsPack.h"
+#include "VectorsProfiler.h"
+#include "Vector3_soa.h"
+
+/*
+ * Pairwise force kernels. Both all-pairs and Barnes-Hut versions compute
+ *
+ *      a_i = coupling * sum_j w_j * (r_j - r_i) / (|r_j - r_i|^2 + softening^2)^(3/2)
+ *
+ * For gravity use masses as weights and the gravitational constant as coupling. For the electric field
+ * produced by point charges use charges as weights and -k_e as coupling (multiply by the charge of the
+ * target to get the force). Pairs with zero distance and zero softening (e.g. self-interaction) are skipped.
+ */
+
+namespace vectors_internal {
+
+/*!
+ * \brief Accumulates interactions of \e R registers of targets starting at \e i0 with all sources
+ */
+template <typename P, int R>
+MUSTINLINE void nbody_tile(const vector3_soa<const typename P::elt_type> &pos,
+        const typename P::elt_type *weight, size_t i0, const vector3_soa<typename P::elt_type> &acc,
+        typename P::elt_type eps2, typename P::elt_type coupling) {
+    typedef typename P::reg reg;
+
+    reg xi[R], yi[R], zi[R], ax[R], ay[R], az[R];
+    for (int r = 0; r < R; ++r) {
+        xi[r] = P::load(pos.x + i0 + r * P::width);
+        yi[r] = P::load(pos.y + i0 + r * P::width);
+        zi[r] = P::load(pos.z + i0 + r * P::width);
+        ax[r] = ay[r] = az[r] = P::zero();
+    }
+
+    const reg e2 = P::set1(eps2);
+    const reg zero = P::zero();
+    for (size_t j = 0; j < pos.size; ++j) {
+        const reg xj = P::set1(pos.x[j]);
+        const reg yj = P::set1(pos.y[j]);
+        const reg zj = P::set1(pos.z[j]);
+        const reg wj = P::set1(weight[j]);
+        for (int r = 0; r < R; ++r) {
+            reg dx = P::sub(xj, xi[r]);
+            reg dy = P::sub(yj, yi[r]);
+            reg dz = P::sub(zj, zi[r]);
+            reg r2 = P::fmadd(dx, dx, P::fmadd(dy, dy, P::fmadd(dz, dz, e2)));
+            reg inv = P::rsqrt(r2);
+            reg s = P::mul(P::mul(inv, inv), P::mul(inv, wj));
+            s = P::select(P::cmp_gt(r2, zero), s, zero);
+            ax[r] = P::fmadd(dx, s, ax[r]);
+            ay[r] = P::fmadd(dy, s, ay[r]);
+            az[r] = P::fmadd(dz, s, az[r]);
+        }
+    }
+
+    const reg c = P::set1(coupling);
+    for (int r = 0; r < R; ++r) {
+        P::store(acc.x + i0 + r * P::width, P::mul(ax[r], c));
+        P::store(acc.y + i0 + r * P::width, P::mul(ay[r], c));
+        P::store(acc.z + i0 + r * P::width, P::mul(az[r], c));
+    }
+}
+
+} // namespace vectors_internal
+
+/*!
+ * \brief All-pairs evaluation of accelerations. Targets are processed in tiles of two SIMD registers so that
+ * every broadcasted source is reused twice; tiles are distributed between threads.
+ * @param pos Positions of bodies
+ * @param weight Masses or charges of bodies
+ * @param acc Output accelerations, overwritten. Should have the same size as \e pos
+ * @param softening Softening length
+ * @param coupling Coupling constant
+ */
+template <typename T>
+void nbody_accelerations(typename vector3_soa_in<T>::type pos, const T *weight, vector3_soa<T> acc,
+        T softening, T coupling) {
+    VECTORS_PROFILE("nbody_accelerations", pos.size);
+    typedef vectors_internal::simd_pack<T> P;
+    typedef vectors_internal::scalar_pack<T> S;
+
+    const T eps2 = softening * softening;
+    const size_t tile = 2 * P::width;
+    const ptrdiff_t ntiles = pos.size / tile;
+
+    VECTORS_OMP(parallel for schedule(static))
+    for (ptrdiff_t t = 0; t < ntiles; ++t)
+        vectors_internal::nbody_tile<P, 2>(pos, weight, t * tile, acc, eps2, coupling);
+
+    for (size_t i = ntiles * tile; i < pos.size; ++i)
+        vectors_internal::nbody_tile<S, 1>(pos, weight, i, acc, eps2, coupling);
+}
+
+/*!
+ * \class nbody_octree
+ * \brief Barnes-Hut approximation of pairwise forces. Bodies are sorted into an octree and distant cells are
+ * replaced by their total weight placed at the weighted center. Approximation is meaningful for weights of
+ * the same sign (masses); for charges of mixed signs use nbody_accelerations().
+ */
+template <typename T>
+class nbody_octree {
+public:
+    typedef T elt_type;
+
+    /*!
+     * \brief Constructor
+     * @param leaf_size Maximal number of bodies in a leaf cell
+     */
+    explicit nbody_octree(size_t leaf_size = 8) : leaf_size(leaf_size ? leaf_size : 1) { }
+
+    /*!
+     * \brief Builds the tree. Positions and weights are copied, so input arrays may be modified afterwards.
+     * @param pos Positions of bodies
+     * @param weight Masses of bodies
+     */
+    void build(vector3_soa<const T> pos, const T *weight) {
+        VECTORS_PROFILE("nbody_octree::build", pos.size);
+        const size_t n = pos.size;
+        nodes.clear();
+        order.resize(n);
+        scratch.resize(n);
+        for (size_t i = 0; i < n; ++i)
+            order[i] = static_cast<uint32_t>(i);
+
+        bx.resize(n);
+        by.resize(n);
+        bz.resize(n);
+        bw.resize(n);
+        if (n == 0)
+            return;
+
+        T lo[3] = {pos.x[0], pos.y[0], pos.z[0]};
+        T hi[3] = {pos.x[0], pos.y[0], pos.z[0]};
+        for (size_t i = 1; i < n; ++i) {
+            const T p[3] = {pos.x[i], pos.y[i], pos.z[i]};
+            for (int d = 0; d < 3; ++d) {
+                lo[d] = p[d] < lo[d] ? p[d] : lo[d];
+                hi[d] = p[d] > hi[d] ? p[d] : hi[d];
+            }
+        }
+        T half = 0;
+        for (int d = 0; d < 3; ++d)
+            half = (hi[d] - lo[d]) > half ? (hi[d] - lo[d]) : half;
+        half = half * T(0.5) * T(1.0001) + T(1e-30);
+
+        node root;
+        root.cx = T(0.5) * (lo[0] + hi[0]);
+        root.cy = T(0.5) * (lo[1] + hi[1]);
+        root.cz = T(0.5) * (lo[2] + hi[2]);
+        root.half = half;
+        root.begin = 0;
+        root.end = static_cast<uint32_t>(n);
+        nodes.push_back(root);
+        build_node(0, pos, 0);
+
+        for (size_t k = 0; k < n; ++k) {
+            bx[k] = pos.x[order[k]];
+            by[k] = pos.y[order[k]];
+            bz[k] = pos.z[order[k]];
+            bw[k] = weight[order[k]];
+        }
+        for (size_t k = 0; k < nodes.size(); ++k)
+            if (nodes[k].nchild == 0)
+                accumulate_leaf(nodes[k]);
+        for (size_t k = nodes.size(); k-- > 0; )
+            if (nodes[k].nchild != 0)
+                accumulate_children(nodes[k]);
+    }
+
+    /*!
+     * \brief Accelerations of the bodies the tree was built from
+     * @param acc Output accelerations, in the original order of bodies
+     * @param theta Opening angle; cells seen under an angle smaller than theta are approximated
+     * @param softening Softening length
+     * @param coupling Coupling constant
+     */
+    void accelerations(vector3_soa<T> acc, T theta, T softening, T coupling) const {
+        VECTORS_PROFILE("nbody_octree::accelerations", bx.size());
+        const ptrdiff_t n = bx.size();
+        const T eps2 = softening * softening;
+
+        VECTORS_OMP(parallel for schedule(dynamic, 64))
+        for (ptrdiff_t k = 0; k < n; ++k) {
+            T a[3];
+            evaluate(bx[k], by[k], bz[k], theta * theta, eps2, a);
+            acc.x[order[k]] = coupling * a[0];
+            acc.y[order[k]] = coupling * a[1];
+            acc.z[order[k]] = coupling * a[2];
+        }
+    }
+
+    /*!
+     * \brief Accelerations at arbitrary target points
+     * @param targets Positions of targets
+     * @param acc Output accelerations
+     * @param theta Opening angle
+     * @param softening Softening length
+     * @param coupling Coupling constant
+     */
+    void accelerations(vector3_soa<const T> targets, vector3_soa<T> acc, T theta, T softening,
+            T coupling) const {
+        VECTORS_PROFILE("nbody_octree::accelerations", targets.size);
+        const ptrdiff_t n = targets.size;
+        const T eps2 = softening * softening;
+
+        VECTORS_OMP(parallel for schedule(dynamic, 64))
+        for (ptrdiff_t k = 0; k < n; ++k) {
+            T a[3];
+            evaluate(targets.x[k], targets.y[k], targets.z[k], theta * theta, eps2, a);
+            acc.x[k] = coupling * a[0];
+            acc.y[k] = coupling * a[1];
+            acc.z[k] = coupling * a[2];
+        }
+    }
+
+    /*!
+     * \brief Number of cells in the tree
+     */
+    size_t node_count() const { return nodes.size(); }
+
+private:
+    enum { max_depth = 48 };
+
+    struct node {
+        T cx, cy, cz;           //!< Geometric center of the cell
+        T half;                 //!< Half of the cell edge
+        T mx, my, mz;           //!< Weighted center of the cell
+        T mass;                 //!< Total weight of the cell
+        uint32_t begin, end;    //!< Range of bodies in the sorted arrays
+        uint32_t child;         //!< Index of the first child
+        uint32_t nchild;        //!< Number of children, zero for leaves
+
+        node() : cx(0), cy(0), cz(0), half(0), mx(0), my(0), mz(0), mass(0),
+            begin(0), end(0), child(0), nchild(0) { }
+    };
+
+    size_t leaf_size;                   //!< Maximal number of bodies in a leaf
+    std::vector<node> nodes;            //!< Cells; children of a cell are stored contiguously
+    std::vector<uint32_t> order;        //!< Original index of each sorted body
+    std::vector<uint32_t> scratch;      //!< Temporary storage used while sorting
+    std::vector<T> bx, by, bz, bw;      //!< Positions and weights in tree order
+
+    static MUSTINLINE int octant(T x, T y, T z, const node &nd) {
+        return (x >= nd.cx) | ((y >= nd.cy) << 1) | ((z >= nd.cz) << 2);
+    }
+
+    void build_node(size_t idx, const vector3_soa<const T> &pos, int depth) {
+        const node nd = nodes[idx];
+        if (nd.end - nd.begin <= leaf_size || depth >= max_depth)
+            return;
+
+        uint32_t count[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        for (uint32_t k = nd.begin; k < nd.end; ++k) {
+            const uint32_t i = order[k];
+            ++count[octant(pos.x[i], pos.y[i], pos.z[i], nd)];
+        }
+
+        uint32_t offset[8];
+        offset[0] = nd.begin;
+        for (int o = 1; o < 8; ++o)
+            offset[o] = offset[o - 1] + count[o - 1];
+        for (uint32_t k = nd.begin; k < nd.end; ++k) {
+            const uint32_t i = order[k];
+            scratch[offset[octant(pos.x[i], pos.y[i], pos.z[i], nd)]++] = i;
+        }
+        for (uint32_t k = nd.begin; k < nd.end; ++k)
+            order[k] = scratch[k];
+
+        const size_t first = nodes.size();
+        uint32_t begin = nd.begin;
+        const T h = T(0.5) * nd.half;
+        for (int o = 0; o < 8; ++o) {
+            if (count[o] == 0)
+                continue;
+            node c;
+            c.cx = nd.cx + ((o & 1) ? h : -h);
+            c.cy = nd.cy + ((o & 2) ? h : -h);
+            c.cz = nd.cz + ((o & 4) ? h : -h);
+            c.half = h;
+            c.begin = begin;
+            c.end = begin + count[o];
+            begin = c.end;
+            nodes.push_back(c);
+        }
+        nodes[idx].child = static_cast<uint32_t>(first);
+        nodes[idx].nchild = static_cast<uint32_t>(nodes.size() - first);
+
+        for (size_t c = first; c < nodes.size(); ++c)
+            build_node(c, pos, depth + 1);
+    }
+
+    void accumulate_leaf(node &nd) const {
+        T m = 0, x = 0, y = 0, z = 0;
+        for (uint32_t k = nd.begin; k < nd.end; ++k) {
+            m += bw[k];
+            x += bw[k] * bx[k];
+            y += bw[k] * by[k];
+            z += bw[k] * bz[k];
+        }
+        set_center(nd, m, x, y, z);
+    }
+
+    void accumulate_children(node &nd) const {
+        T m = 0, x = 0, y = 0, z = 0;
+        for (uint32_t c = nd.child; c < nd.child + nd.nchild; ++c) {
+            m += nodes[c].mass;
+            x += nodes[c].mass * nodes[c].mx;
+            y += nodes[c].mass * nodes[c].my;
+            z += nodes[c].mass * nodes[c].mz;
+        }
+        set_center(nd, m, x, y, z);
+    }
+
+    static void set_center(node &nd, T m, T x, T y, T z) {
+        nd.mass = m;
+        if (m != T(0)) {
+            nd.mx = x / m;
+            nd.my = y / m;
+            nd.mz = z / m;
+        }
+        else {
+            nd.mx = nd.cx;
+            nd.my = nd.cy;
+            nd.mz = nd.cz;
+        }
+    }
+
+    void evaluate(T px, T py, T pz, T theta2, T eps2, T *a) const {
+        a[0] = a[1] = a[2] = 0;
+        if (nodes.empty())
+            return;
+
+        uint32_t stack[8 * max_depth + 8];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const node &nd = nodes[stack[--top]];
+            const T dx = nd.mx - px;
+            const T dy = nd.my - py;
+            const T dz = nd.mz - pz;
+            const T d2 = dx * dx + dy * dy + dz * dz;
+            const T size = 2 * nd.half;
+
+            if (size * size < theta2 * d2) {
+                const T r2 = d2 + eps2;
+                const T inv = T(1) / std::sqrt(r2);
+                const T s = nd.mass * inv * inv * inv;
+                a[0] += dx * s;
+                a[1] += dy * s;
+                a[2] += dz * s;
+            }
+            else if (nd.nchild == 0) {
+                for (uint32_t k = nd.begin; k < nd.end; ++k) {
+                    const T ex = bx[k] - px;
+                    const T ey = by[k] - py;
+                    const T ez = bz[k] - pz;
+                    const T r2 = ex * ex + ey * ey + ez * ez + eps2;
+                    if (r2 > T(0)) {
+                        const T inv = T(1) / std::sqrt(r2);
+                        const T s = bw[k] * inv * inv * inv;
+                        a[0] += ex * s;
+                        a[1] += ey * s;
+                        a[2] += ez * s;
+                    }
+                }
+            }
+            else {
+                for (uint32_t c = nd.child; c < nd.child + nd.nchild; ++c)
+                    stack[top++] = c;
+            }
+        }
+    }
+};
+
+#endif /* VECTORSNBODY_H_ */
@@ -0,0 +1,355 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTORSPACK_H_
+#define VECTORSPACK_H_
+
+#include "VectorsInternal.h"
+
+namespace vectors_internal {
+
+/*!
+ * \class scalar_pack
+ * \brief Register abstraction used by batch kernels. Scalar version processes one element at a time and is
+ * used for array tails and on machines without AVX2 support.
+ */
+template <typename T>
+struct scalar_pack {
+    typedef T elt_type;
+    typedef T reg;
+    typedef bool mask;
+    enum { width = 1 };
+
+    static MUSTINLINE reg load(const T *p) { return *p; }
+    static MUSTINLINE void store(T *p, reg a) { *p = a; }
+
+    /*!
+     * \brief Loads base[idx[k]] into the k-th element
+     */
+    static MUSTINLINE reg gather(const T *base, const int32_t *idx) { return base[*idx]; }
+    static MUSTINLINE reg set1(T value) { return value; }
+    static MUSTINLINE reg zero() { return T(0); }
+
+    static MUSTINLINE reg add(reg a, reg b) { return a + b; }
+    static MUSTINLINE reg sub(reg a, reg b) { return a - b; }
+    static MUSTINLINE reg mul(reg a, reg b) { return a * b; }
+    static MUSTINLINE reg div(reg a, reg b) { return a / b; }
+
+    /*!
+     * \brief Computes a * b + c
+     */
+    static MUSTINLINE reg fmadd(reg a, reg b, reg c) { return a * b + c; }
+
+    /*!
+     * \brief Computes c - a * b
+     */
+    static MUSTINLINE reg fnmadd(reg a, reg b, reg c) { return c - a * b; }
+
+    static MUSTINLINE reg sqrt(reg a) { return std::sqrt(a); }
+    static MUSTINLINE reg round(reg a) { return std::nearbyint(a); }
+    static MUSTINLINE reg floor(reg a) { return std::floor(a); }
+
+    /*!
+     * \brief Reciprocal square root
+     */
+    static MUSTINLINE reg rsqrt(reg a) { return T(1) / std::sqrt(a); }
+
+    /*!
+     * \brief Smaller and larger of two values. As with the SSE/AVX instructions, the second operand is returned
+     * when either one is NaN, so the scalar and the vector bodies of a kernel agree. Reductions that have to skip
+     * NaN (or to propagate it) select on an ordered comparison instead.
+     */
+    static MUSTINLINE reg min(reg a, reg b) { return a < b ? a : b; }
+    static MUSTINLINE reg max(reg a, reg b) { return b < a ? a : b; }
+
+    static MUSTINLINE mask cmp_gt(reg a, reg b) { return a > b; }
+    static MUSTINLINE mask cmp_ge(reg a, reg b) { return a >= b; }
+    static MUSTINLINE mask cmp_lt(reg a, reg b) { return a < b; }
+    static MUSTINLINE mask cmp_le(reg a, reg b) { return a <= b; }
+    static MUSTINLINE mask mask_and(mask a, mask b) { return a && b; }
+    static MUSTINLINE mask mask_or(mask a, mask b) { return a || b; }
+
+    /*!
+     * \brief Bit k of the result is set if k-th element of the mask is set
+     */
+    static MUSTINLINE int movemask(mask m) { return m ? 1 : 0; }
+
+    /*!
+     * \brief Returns \e a where mask is set and \e b otherwise
+     */
+    static MUSTINLINE reg select(mask m, reg a, reg b) { return m ? a : b; }
+
+    /*!
+     * \brief Sum of all elements of the register
+     */
+    static MUSTINLINE T hsum(reg a) { return a; }
+};
+
+#ifdef __AVX2__
+/*!
+ * \class avx_pack_double
+ * \brief AVX2 register abstraction for four double precision values
+ */
+struct avx_pack_double {
+    typedef double elt_type;
+    typedef __m256d reg;
+    typedef __m256d mask;
+    enum { width = 4 };
+
+    static MUSTINLINE reg load(const double *p) { return _mm256_loadu_pd(p); }
+    static MUSTINLINE void store(double *p, reg a) { _mm256_storeu_pd(p, a); }
+    static MUSTINLINE reg gather(const double *base, const int32_t *idx) {
+        return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), base,
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(idx)), _mm256_castsi256_pd(_mm256_set1_epi64x(-1)), 8);
+    }
+    static MUSTINLINE reg set1(double value) { return _mm256_set1_pd(value); }
+    static MUSTINLINE reg zero() { return _mm256_setzero_pd(); }
+
+    static MUSTINLINE reg add(reg a, reg b) { return _mm256_add_pd(a, b); }
+    static MUSTINLINE reg sub(reg a, reg b) { return _mm256_sub_pd(a, b); }
+    static MUSTINLINE reg mul(reg a, reg b) { return _mm256_mul_pd(a, b); }
+    static MUSTINLINE reg div(reg a, reg b) { return _mm256_div_pd(a, b); }
+
+    static MUSTINLINE reg fmadd(reg a, reg b, reg c) {
+#if defined(__FMA__) && !defined(VECTORS_DETERMINISTIC)
+        return _mm256_fmadd_pd(a, b, c);
+#else
+        return _mm256_add_pd(_mm256_mul_pd(a, b), c);
+#endif
+    }
+
+    static MUSTINLINE reg fnmadd(reg a, reg b, reg c) {
+#if defined(__FMA__) && !defined(VECTORS_DETERMINISTIC)
+        return _mm256_fnmadd_pd(a, b, c);
+#else
+        return _mm256_sub_pd(c, _mm256_mul_pd(a, b));
+#endif
+    }
+
+    static MUSTINLINE reg sqrt(reg a) { return _mm256_sqrt_pd(a); }
+    static MUSTINLINE reg round(reg a) { return _mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static MUSTINLINE reg floor(reg a) { return _mm256_floor_pd(a); }
+
+    /*!
+     * \brief Reciprocal square root, computed as 1 / sqrt(a). The hardware estimate exists for single precision
+     * only, and converting the argument would lose the exponent range of doubles.
+     */
+    static MUSTINLINE reg rsqrt(reg a) { return _mm256_div_pd(_mm256_set1_pd(1.0), _mm256_sqrt_pd(a)); }
+
+    static MUSTINLINE reg min(reg a, reg b) { return _mm256_min_pd(a, b); }
+    static MUSTINLINE reg max(reg a, reg b) { return _mm256_max_pd(a, b); }
+
+    static MUSTINLINE mask cmp_gt(reg a, reg b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+    static MUSTINLINE mask cmp_ge(reg a, reg b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+    static MUSTINLINE mask cmp_lt(reg a, reg b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static MUSTINLINE mask cmp_le(reg a, reg b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+    static MUSTINLINE mask mask_and(mask a, mask b) { return _mm256_and_pd(a, b); }
+    static MUSTINLINE mask mask_or(mask a, mask b) { return _mm256_or_pd(a, b); }
+    static MUSTINLINE int movemask(mask m) { return _mm256_movemask_pd(m); }
+
+    static MUSTINLINE reg select(mask m, reg a, reg b) { return _mm256_blendv_pd(b, a, m); }
+
+    static MUSTINLINE double hsum(reg a) {
+        __m128d s = _mm_add_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+    }
+};
+
+/*!
+ * \class avx_pack_float
+ * \brief AVX2 register abstraction for eight single precision values
+ */
+struct avx_pack_float {
+    typedef float elt_type;
+    typedef __m256 reg;
+    typedef __m256 mask;
+    enum { width = 8 };
+
+    static MUSTINLINE reg load(const float *p) { return _mm256_loadu_ps(p); }
+    static MUSTINLINE void store(float *p, reg a) { _mm256_storeu_ps(p, a); }
+    static MUSTINLINE reg gather(const float *base, const int32_t *idx) {
+        return _mm256_mask_i32gather_ps(_mm256_setzero_ps(), base,
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(idx)), _mm256_castsi256_ps(_mm256_set1_epi32(-1)), 4);
+    }
+    static MUSTINLINE reg set1(float value) { return _mm256_set1_ps(value); }
+    static MUSTINLINE reg zero() { return _mm256_setzero_ps(); }
+
+    static MUSTINLINE reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+    static MUSTINLINE reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+    static MUSTINLINE reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+    static MUSTINLINE reg div(reg a, reg b) { return _mm256_div_ps(a, b); }
+
+    static MUSTINLINE reg fmadd(reg a, reg b, reg c) {
+#if defined(__FMA__) && !defined(VECTORS_DETERMINISTIC)
+        return _mm256_fmadd_ps(a, b, c);
+#else
+        return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+    }
+
+    static MUSTINLINE reg fnmadd(reg a, reg b, reg c) {
+#if defined(__FMA__) && !defined(VECTORS_DETERMINISTIC)
+        return _mm256_fnmadd_ps(a, b, c);
+#else
+        return _mm256_sub_ps(c, _mm256_mul_ps(a, b));
+#endif
+    }
+
+    static MUSTINLINE reg sqrt(reg a) { return _mm256_sqrt_ps(a); }
+    static MUSTINLINE reg round(reg a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    static MUSTINLINE reg floor(reg a) { return _mm256_floor_ps(a); }
+
+    /*!
+     * \brief Reciprocal square root. Hardware estimate is refined by one Newton-Raphson iteration, or replaced
+     * by the correctly rounded 1 / sqrt(a) in deterministic mode.
+     */
+    static MUSTINLINE reg rsqrt(reg a) {
+#ifdef VECTORS_DETERMINISTIC
+        return _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(a));
+#else
+        __m256 y = _mm256_rsqrt_ps(a);
+        __m256 hx = _mm256_mul_ps(a, _mm256_set1_ps(0.5f));
+        return _mm256_mul_ps(y, fnmadd(hx, _mm256_mul_ps(y, y), _mm256_set1_ps(1.5f)));
+#endif
+    }
+
+    static MUSTINLINE reg min(reg a, reg b) { return _mm256_min_ps(a, b); }
+    static MUSTINLINE reg max(reg a, reg b) { return _mm256_max_ps(a, b); }
+
+    static MUSTINLINE mask cmp_gt(reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static MUSTINLINE mask cmp_ge(reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static MUSTINLINE mask cmp_lt(reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static MUSTINLINE mask cmp_le(reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static MUSTINLINE mask mask_and(mask a, mask b) { return _mm256_and_ps(a, b); }
+    static MUSTINLINE mask mask_or(mask a, mask b) { return _mm256_or_ps(a, b); }
+    static MUSTINLINE int movemask(mask m) { return _mm256_movemask_ps(m); }
+
+    static MUSTINLINE reg select(mask m, reg a, reg b) { return _mm256_blendv_ps(b, a, m); }
+
+    static MUSTINLINE float hsum(reg a) {
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        return _mm_cvtss_f32(_mm_add_ss(s, _mm_movehdup_ps(s)));
+    }
+};
+#endif
+
+/*!
+ * \class simd_pack
+ * \brief Widest register abstraction available for the given element type
+ */
+template <typename T>
+struct simd_pack : scalar_pack<T> { };
+
+#ifdef __AVX2__
+template <>
+struct simd_pack<double> : avx_pack_double { };
+
+template <>
+struct simd_pack<float> : avx_pack_float { };
+#endif
+
+/*!
+ * \brief Number of partial sums kept by reductions, a multiple of every register width
+ */
+enum { reduction_lanes = 8 };
+
+/*!
+ * \class lane_sum
+ * \brief Sum accumulated in reduction_lanes partial sums. Element k of every block of reduction_lanes elements
+ * always goes to partial sum k and the partial sums are combined in a fixed order, so the result does not
+ * depend on the register width of \e P.
+ */
+template <typename P>
+struct lane_sum {
+    typedef typename P::elt_type elt_type;
+    typedef typename P::reg reg;
+    enum { regs = reduction_lanes / P::width };     //!< Registers holding one block
+
+    reg part[regs];
+
+    MUSTINLINE lane_sum() {
+        for (int r = 0; r < regs; ++r)
+            part[r] = P::zero();
+    }
+
+    /*!
+     * \brief Adds \e a to the partial sums of the r-th register of the block
+     */
+    MUSTINLINE void add(int r, reg a) { part[r] = P::add(part[r], a); }
+
+    /*!
+     * \brief Adds a * b to the partial sums of the r-th register of the block
+     */
+    MUSTINLINE void fmadd(int r, reg a, reg b) { part[r] = P::fmadd(a, b, part[r]); }
+
+    /*!
+     * \brief Combines the partial sums pairwise
+     */
+    MUSTINLINE elt_type total() const {
+        elt_type s[reduction_lanes];
+        for (int r = 0; r < regs; ++r)
+            P::store(s + r * P::width, part[r]);
+        return ((s[0] + s[1]) + (s[2] + s[3])) + ((s[4] + s[5]) + (s[6] + s[7]));
+    }
+};
+
+/*!
+ * \brief Dot product of vectors held as three registers of coordinates
+ */
+template <typename P>
+MUSTINLINE typename P::reg dot3(const typename P::reg *a, const typename P::reg *b) {
+    return P::fmadd(a[2], b[2], P::fmadd(a[1], b[1], P::mul(a[0], b[0])));
+}
+
+/*!
+ * \brief Cross product of vectors held as three registers of coordinates; \e out may not alias the inputs
+ */
+template <typename P>
+MUSTINLINE void cross3(const typename P::reg *a, const typename P::reg *b, typename P::reg *out) {
+    out[0] = P::fnmadd(a[2], b[1], P::mul(a[1], b[2]));
+    out[1] = P::fnmadd(a[0], b[2], P::mul(a[2], b[0]));
+    out[2] = P::fnmadd(a[1], b[0], P::mul(a[0], b[1]));
+}
+
+/*!
+ * \brief Runs element-wise kernel over an array of length \e n. Calls kernel.apply<P>(i) for every full
+ * register and kernel.apply<scalar_pack<T> >(i) for the remaining tail. Large arrays are split between threads.
+ */
+template <typename T, typename Kernel>
+void pack_for(size_t n, const Kernel &kernel) {
+    typedef simd_pack<T> P;
+    const ptrdiff_t nregs = n / P::width;
+
+    VECTORS_OMP(parallel for schedule(static) if(nregs > 4096))
+    for (ptrdiff_t r = 0; r < nregs; ++r)
+        kernel.template apply<P>(r * P::width);
+
+    for (size_t i = nregs * P::width; i < n; ++i)
+        kernel.template apply<scalar_pack<T> >(i);
+}
+
+} // namespace vectors_internal
+
+#endif /* VECTORSPACK_H_ */
@@ -0,0 +1,485 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTORSPCA_H_
+#define VECTORSPCA_H_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "VectorsInternal.h"
+#include "VectorsPack.h"
+#include "VectorsProfiler.h"
+#include "Vector3_soa.h"
+
+/*
+ * Principal component analysis and oriented bounding boxes of point sets. Moments are accumulated per chunk
+ * of moment_chunk points with SIMD registers (two passes over the cache-hot chunk: the mean, then the scatter
+ * about it), chunks are processed in parallel and merged in their order with the pairwise update of Chan,
+ * Golub and LeVeque, so the result does not depend on the number of threads and sets of any size can be
+ * streamed through a point_moments accumulator. Covariance matrices are decomposed with cyclic Jacobi
+ * rotations, which converge in a few sweeps for 3x3 matrices and stay accurate for (nearly) equal eigenvalues.
+ *
+ * Symmetric 3x3 matrices are stored as their six upper elements xx, xy, xz, yy, yz, zz.
+ */
+
+/*!
+ * \brief Box with arbitrary orientation
+ */
+template <typename T>
+struct oriented_box {
+    T center[3];        //!< Center of the box
+    T axes[9];          //!< Row-major rotation; rows are the unit axes of the box, forming a right-handed frame
+    T half_extent[3];   //!< Half edge lengths along the axes
+};
+
+namespace vectors_internal {
+
+/*!
+ * \brief Number of points of the chunks which are reduced independently, a multiple of reduction_lanes
+ */
+enum { moment_chunk = 4096 };
+
+/*!
+ * \brief Mean of a chunk of points and the scatter matrix (sum of outer products) of the points about it
+ */
+template <typename P, typename T>
+MUSTINLINE void chunk_moments(const vector3_soa<const T> &p, double *mean, double *scatter) {
+    typedef typename P::reg reg;
+    typedef lane_sum<P> L;
+    typedef scalar_pack<T> S;
+
+    L s[3];
+    size_t i = 0;
+    for (; i + reduction_lanes <= p.size; i += reduction_lanes) {
+        for (int r = 0; r < L::regs; ++r) {
+            const size_t j = i + r * P::width;
+            s[0].add(r, P::load(p.x + j));
+            s[1].add(r, P::load(p.y + j));
+            s[2].add(r, P::load(p.z + j));
+        }
+    }
+    T c[3] = {s[0].total(), s[1].total(), s[2].total()};
+    for (; i < p.size; ++i) {
+        c[0] += p.x[i];
+        c[1] += p.y[i];
+        c[2] += p.z[i];
+    }
+    for (int k = 0; k < 3; ++k)
+        c[k] /= static_cast<T>(p.size);
+
+    const reg cx = P::set1(c[0]), cy = P::set1(c[1]), cz = P::set1(c[2]);
+    L q[6];
+    for (i = 0; i + reduction_lanes <= p.size; i += reduction_lanes) {
+        for (int r = 0; r < L::regs; ++r) {
+            const size_t j = i + r * P::width;
+            const reg dx = P::sub(P::load(p.x + j), cx);
+            const reg dy = P::sub(P::load(p.y + j), cy);
+            const reg dz = P::sub(P::load(p.z + j), cz);
+            q[0].fmadd(r, dx, dx);
+            q[1].fmadd(r, dx, dy);
+            q[2].fmadd(r, dx, dz);
+            q[3].fmadd(r, dy, dy);
+            q[4].fmadd(r, dy, dz);
+            q[5].fmadd(r, dz, dz);
+        }
+    }
+    T m[6];
+    for (int k = 0; k < 6; ++k)
+        m[k] = q[k].total();
+    for (; i < p.size; ++i) {
+        const T dx = p.x[i] - c[0], dy = p.y[i] - c[1], dz = p.z[i] - c[2];
+        m[0] = S::fmadd(dx, dx, m[0]);
+        m[1] = S::fmadd(dx, dy, m[1]);
+        m[2] = S::fmadd(dx, dz, m[2]);
+        m[3] = S::fmadd(dy, dy, m[3]);
+        m[4] = S::fmadd(dy, dz, m[4]);
+        m[5] = S::fmadd(dz, dz, m[5]);
+    }
+    for (int k = 0; k < 3; ++k)
+        mean[k] = c[k];
+    for (int k = 0; k < 6; ++k)
+        scatter[k] = m[k];
+}
+
+/*!
+ * \brief Expands the ranges of projections of \e P::width points starting at \e i onto three axes. Points with
+ * NaN coordinates are skipped.
+ * @param p Points
+ * @param i Index of the first point
+ * @param o Origin of the projections, three registers
+ * @param a Axes, three registers per axis
+ * @param lo Minimal projections, three registers
+ * @param hi Maximal projections, three registers
+ */
+template <typename P>
+MUSTINLINE void extent_step(const vector3_soa<const typename P::elt_type> &p, size_t i, const typename P::reg *o,
+        const typename P::reg *a, typename P::reg *lo, typename P::reg *hi) {
+    typedef typename P::reg reg;
+    const reg d[3] = {P::sub(P::load(p.x + i), o[0]), P::sub(P::load(p.y + i), o[1]),
+        P::sub(P::load(p.z + i), o[2])};
+    for (int k = 0; k < 3; ++k) {
+        // Ordered comparisons leave the ranges unchanged by NaN projections
+        const reg t = dot3<P>(a + 3 * k, d);
+        lo[k] = P::select(P::cmp_lt(t, lo[k]), t, lo[k]);
+        hi[k] = P::select(P::cmp_gt(t, hi[k]), t, hi[k]);
+    }
+}
+
+/*!
+ * \brief Ranges of projections of a chunk of points onto three axes
+ */
+template <typename T>
+MUSTINLINE void chunk_extents(const vector3_soa<const T> &p, const T *origin, const T *axes, T *lo, T *hi) {
+    typedef simd_pack<T> P;
+    typedef scalar_pack<T> S;
+    const T inf = std::numeric_limits<T>::infinity();
+
+    typename P::reg o[3], a[9], vlo[3], vhi[3];
+    for (int k = 0; k < 3; ++k) {
+        o[k] = P::set1(origin[k]);
+        vlo[k] = P::set1(inf);
+        vhi[k] = P::set1(-inf);
+    }
+    for (int k = 0; k < 9; ++k)
+        a[k] = P::set1(axes[k]);
+    size_t i = 0;
+    for (; i + P::width <= p.size; i += P::width)
+        extent_step<P>(p, i, o, a, vlo, vhi);
+    for (; i < p.size; ++i)
+        extent_step<S>(p, i, origin, axes, lo, hi);
+
+    T buf_lo[P::width], buf_hi[P::width];
+    for (int k = 0; k < 3; ++k) {
+        P::store(buf_lo, vlo[k]);
+        P::store(buf_hi, vhi[k]);
+        for (int l = 0; l < P::width; ++l) {
+            lo[k] = S::min(lo[k], buf_lo[l]);
+            hi[k] = S::max(hi[k], buf_hi[l]);
+        }
+    }
+}
+
+} // namespace vectors_internal
+
+/*!
+ * \brief Eigenvalues and eigenvectors of a symmetric 3x3 matrix, computed in double precision with cyclic
+ * Jacobi rotations
+ * @param a Upper elements of the matrix: xx, xy, xz, yy, yz, zz
+ * @param values Output eigenvalues in decreasing order
+ * @param vectors Output row-major 3x3 matrix; row k is the unit eigenvector of values[k] and the rows form a
+ * right-handed frame
+ */
+template <typename T>
+void symmetric_eigen(const T *a, T *values, T *vectors) {
+    double m[3][3] = {{a[0], a[1], a[2]}, {a[1], a[3], a[4]}, {a[2], a[4], a[5]}};
+    double v[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+    const double scale = m[0][0] * m[0][0] + m[1][1] * m[1][1] + m[2][2] * m[2][2]
+        + 2 * (m[0][1] * m[0][1] + m[0][2] * m[0][2] + m[1][2] * m[1][2]);
+
+    for (int sweep = 0; sweep < 32; ++sweep) {
+        const double off = m[0][1] * m[0][1] + m[0][2] * m[0][2] + m[1][2] * m[1][2];
+        if (!(off > 1e-32 * scale))
+            break;
+        for (int p = 0; p < 2; ++p) {
+            for (int q = p + 1; q < 3; ++q) {
+                if (m[p][q] == 0)
+                    continue;
+                // Rotation in the (p, q) plane which zeroes m[p][q], with the smaller of the two angles
+                const double theta = (m[q][q] - m[p][p]) / (2 * m[p][q]);
+                const double t = (theta < 0 ? -1 : 1) / (std::fabs(theta) + std::sqrt(theta * theta + 1));
+                const double c = 1 / std::sqrt(t * t + 1), s = t * c;
+                for (int k = 0; k < 3; ++k) {
+                    const double mkp = m[k][p], mkq = m[k][q];
+                    m[k][p] = c * mkp - s * mkq;
+                    m[k][q] = s * mkp + c * mkq;
+                    const double vkp = v[k][p], vkq = v[k][q];
+                    v[k][p] = c * vkp - s * vkq;
+                    v[k][q] = s * vkp + c * vkq;
+                }
+                for (int k = 0; k < 3; ++k) {
+                    const double mpk = m[p][k], mqk = m[q][k];
+                    m[p][k] = c * mpk - s * mqk;
+                    m[q][k] = s * mpk + c * mqk;
+                }
+            }
+        }
+    }
+
+    int order[3] = {0, 1, 2};
+    for (int i = 0; i < 3; ++i)
+        for (int j = i + 1; j < 3; ++j)
+            if (m[order[j]][order[j]] > m[order[i]][order[i]])
+                std::swap(order[i], order[j]);
+    for (int k = 0; k < 3; ++k)
+        values[k] = static_cast<T>(m[order[k]][order[k]]);
+    for (int k = 0; k < 2; ++k)
+        for (int d = 0; d < 3; ++d)
+            vectors[3 * k + d] = static_cast<T>(v[d][order[k]]);
+    // The third axis completes a right-handed frame
+    const int i0 = order[0], i1 = order[1];
+    vectors[6] = static_cast<T>(v[1][i0] * v[2][i1] - v[2][i0] * v[1][i1]);
+    vectors[7] = static_cast<T>(v[2][i0] * v[0][i1] - v[0][i0] * v[2][i1]);
+    vectors[8] = static_cast<T>(v[0][i0] * v[1][i1] - v[1][i0] * v[0][i1]);
+}
+
+/*!
+ * \class point_moments
+ * \brief Accumulator of the number of points, their mean and their scatter matrix. Points may be added in
+ * any number of calls, e.g. chunk by chunk from a stream; every call processes its points in parallel. The
+ * result depends only on the sequence of calls, not on the number of threads.
+ */
+template <typename T>
+class point_moments {
+public:
+    typedef T elt_type;
+
+    point_moments() : n(0) {
+        std::fill(mu, mu + 3, 0.0);
+        std::fill(m2, m2 + 6, 0.0);
+    }
+
+    /*!
+     * \brief Adds points to the accumulator
+     * @return Reference to \e this accumulator
+     */
+    point_moments &add(typename vector3_soa_in<T>::type points) {
+        VECTORS_PROFILE("point_moments", points.size);
+        const size_t chunk = vectors_internal::moment_chunk;
+        const ptrdiff_t nchunks = (points.size + chunk - 1) / chunk;
+        if (nchunks <= 1) {
+            double part[9];
+            if (points.size) {
+                vectors_internal::chunk_moments<vectors_internal::simd_pack<T> >(points, part, part + 3);
+                merge(points.size, part, part + 3);
+            }
+            return *this;
+        }
+
+        std::vector<double> part(9 * nchunks);
+        VECTORS_OMP(parallel for schedule(static) if(nchunks > 4))
+        for (ptrdiff_t c = 0; c < nchunks; ++c)
+            vectors_internal::chunk_moments<vectors_internal::simd_pack<T> >(
+                points.sub(c * chunk, std::min(chunk, points.size - c * chunk)), &part[9 * c], &part[9 * c + 3]);
+        for (ptrdiff_t c = 0; c < nchunks; ++c)
+            merge(std::min(chunk, points.size - c * chunk), &part[9 * c], &part[9 * c + 3]);
+        return *this;
+    }
+
+    /*!
+     * \brief Adds the points of another accumulator
+     * @return Reference to \e this accumulator
+     */
+    point_moments &merge(const point_moments &other) {
+        return merge(other.n, other.mu, other.m2);
+    }
+
+    size_t count() const { return n; }
+
+    /*!
+     * \brief Mean of the points, three coordinates
+     */
+    void mean(T *c) const {
+        for (int k = 0; k < 3; ++k)
+            c[k] = static_cast<T>(mu[k]);
+    }
+
+    /*!
+     * \brief Covariance matrix of the points (scatter divided by the number of points), six upper elements
+     */
+    void covariance(T *cov) const {
+        for (int k = 0; k < 6; ++k)
+            cov[k] = n ? static_cast<T>(m2[k] / static_cast<double>(n)) : T(0);
+    }
+
+    /*!
+     * \brief Principal axes of the points
+     * @param variances Output variances along the axes in decreasing order
+     * @param axes Output row-major 3x3 matrix of unit axes, a right-handed frame
+     */
+    void principal_axes(T *variances, T *axes) const {
+        T cov[6];
+        covariance(cov);
+        symmetric_eigen(cov, variances, axes);
+    }
+
+private:
+    point_moments &merge(size_t count, const double *mean, const double *scatter) {
+        if (!count)
+            return *this;
+        const double nb = static_cast<double>(count), total = static_cast<double>(n) + nb;
+        const double d[3] = {mean[0] - mu[0], mean[1] - mu[1], mean[2] - mu[2]};
+        const double f = static_cast<double>(n) * nb / total;
+        m2[0] += scatter[0] + f * d[0] * d[0];
+        m2[1] += scatter[1] + f * d[0] * d[1];
+        m2[2] += scatter[2] + f * d[0] * d[2];
+        m2[3] += scatter[3] + f * d[1] * d[1];
+        m2[4] += scatter[4] + f * d[1] * d[2];
+        m2[5] += scatter[5] + f * d[2] * d[2];
+        for (int k = 0; k < 3; ++k)
+            mu[k] += d[k] * (nb / total);
+        n += count;
+        return *this;
+    }
+
+    size_t n;           //!< Number of points
+    double mu[3];       //!< Mean
+    double m2[6];       //!< Scatter matrix about the mean
+};
+
+/*!
+ * \class obb_extents
+ * \brief Accumulator of the extents of points along fixed axes, giving the smallest box with these axes
+ * which contains all points. Like point_moments, points may be added in any number of calls. A box fitted to
+ * a stream thus takes two passes, the first one for the axes (point_moments::principal_axes()); axes known in
+ * advance (e.g. from a subsample or from the previous frame) make it a single pass.
+ */
+template <typename T>
+class obb_extents {
+public:
+    typedef T elt_type;
+
+    /*!
+     * \brief Constructor
+     * @param origin Point the projections are taken relative to, e.g. the mean of the points; three coordinates
+     * @param axes Row-major 3x3 matrix of unit axes
+     */
+    obb_extents(const T *origin, const T *axes) {
+        std::copy(origin, origin + 3, o);
+        std::copy(axes, axes + 9, a);
+        std::fill(lo, lo + 3, std::numeric_limits<T>::infinity());
+        std::fill(hi, hi + 3, -std::numeric_limits<T>::infinity());
+    }
+
+    /*!
+     * \brief Expands the extents to contain the points
+     * @return Reference to \e this accumulator
+     */
+    obb_extents &add(typename vector3_soa_in<T>::type points) {
+        VECTORS_PROFILE("obb_extents", points.size);
+        const size_t chunk = vectors_internal::moment_chunk;
+        const ptrdiff_t nchunks = (points.size + chunk - 1) / chunk;
+        if (nchunks <= 1) {
+            vectors_internal::chunk_extents(points, o, a, lo, hi);
+            return *this;
+        }
+
+        std::vector<T> part(6 * nchunks);
+        VECTORS_OMP(parallel for schedule(static) if(nchunks > 4))
+        for (ptrdiff_t c = 0; c < nchunks; ++c) {
+            T *r = &part[6 * c];
+            std::fill(r, r + 3, std::numeric_limits<T>::infinity());
+            std::fill(r + 3, r + 6, -std::numeric_limits<T>::infinity());
+            vectors_internal::chunk_extents(points.sub(c * chunk, std::min(chunk, points.size - c * chunk)), o, a,
+                r, r + 3);
+        }
+        for (ptrdiff_t c = 0; c < nchunks; ++c)
+            for (int k = 0; k < 3; ++k) {
+                lo[k] = std::min(lo[k], part[6 * c + k]);
+                hi[k] = std::max(hi[k], part[6 * c + 3 + k]);
+            }
+        return *this;
+    }
+
+    /*!
+     * \brief Expands the extents to contain those of another accumulator with the same origin and axes
+     * @return Reference to \e this accumulator
+     */
+    obb_extents &merge(const obb_extents &other) {
+        for (int k = 0; k < 3; ++k) {
+            lo[k] = std::min(lo[k], other.lo[k]);
+            hi[k] = std::max(hi[k], other.hi[k]);
+        }
+        return *this;
+    }
+
+    /*!
+     * \brief Box containing all added points. No points give a box of zero size at the origin.
+     */
+    oriented_box<T> box() const {
+        oriented_box<T> b;
+        std::copy(a, a + 9, b.axes);
+        std::copy(o, o + 3, b.center);
+        for (int k = 0; k < 3; ++k) {
+            const bool empty = !(lo[k] <= hi[k]);
+            const T mid = empty ? T(0) : T(0.5) * (lo[k] + hi[k]);
+            b.half_extent[k] = empty ? T(0) : T(0.5) * (hi[k] - lo[k]);
+            for (int d = 0; d < 3; ++d)
+                b.center[d] += mid * a[3 * k + d];
+        }
+        return b;
+    }
+
+private:
+    T o[3];     //!< Origin of projections
+    T a[9];     //!< Axes
+    T lo[3];    //!< Minimal projections
+    T hi[3];    //!< Maximal projections
+};
+
+namespace vectors_internal {
+
+template <typename T>
+oriented_box<T> fit_obb(const vector3_soa<const T> &points) {
+    point_moments<T> m;
+    m.add(points);
+    T center[3], variances[3], axes[9];
+    m.mean(center);
+    m.principal_axes(variances, axes);
+    return obb_extents<T>(center, axes).add(points).box();
+}
+
+} // namespace vectors_internal
+
+/*!
+ * \brief Oriented bounding box of points with the principal axes as box axes. Both passes over the points
+ * run in parallel.
+ * @param points Points
+ * @return Box containing all points up to rounding errors; axes are sorted by decreasing variance of the points
+ */
+template <typename T>
+oriented_box<T> fit_obb(typename vector3_soa_in<T>::type points) {
+    VECTORS_PROFILE("fit_obb", points.size);
+    return vectors_internal::fit_obb(points);
+}
+
+/*!
+ * \brief Computes oriented bounding boxes of ranges of points. Ranges are processed in parallel.
+ * @param points Array of points
+ * @param offsets Array of \e nranges + 1 offsets; range r consists of points [offsets[r], offsets[r + 1])
+ * @param nranges Number of ranges
+ * @param boxes Output boxes, one per range
+ */
+template <typename T>
+void build_obbs(typename vector3_soa_in<T>::type points, const size_t *offsets, size_t nranges,
+        oriented_box<T> *boxes) {
+    VECTORS_PROFILE("build_obbs", points.size);
+
+    VECTORS_OMP(parallel for schedule(dynamic, 16))
+    for (ptrdiff_t r = 0; r < static_cast<ptrdiff_t>(nranges); ++r)
+        boxes[r] = vectors_internal::fit_obb(points.sub(offsets[r], offsets[r + 1] - offsets[r]));
+}
+
+#endif /* VECTORSPCA_H_ */
@@ -0,0 +1,414 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTORSPERIODIC_H_
+#define VECTORSPERIODIC_H_
+
+#include "VectorsInternal.h"
+#include "VectorsPack.h"
+#include "VectorsProfiler.h"
+#include "Vector3_soa.h"
+
+/*!
+ * \class periodic_box
+ * \brief Periodic simulation cell. Cell vectors a, b, c form a lower triangular matrix: a lies along x and b in
+ * the xy plane, as usual in molecular dynamics codes. Orthorhombic boxes have only the diagonal set.
+ *
+ * Minimum image is found by rounding the fractional coordinates of the difference (its dot products with the
+ * reciprocal cell vectors) and removing the whole cell vectors, which brings the difference into the cell
+ * centered at the origin. For triclinic cells a shorter image may still exist, so the result is compared with
+ * its neighbours shifted by the combinations of cell vectors which can be shorter for some point of the
+ * centered cell; the list is built once in the constructor. This is exact for cells in the usual reduced form
+ * (|b_x|, |c_x| <= a_x / 2, |c_y| <= b_y / 2).
+ *
+ * Member functions accept any of the vector classes and stay in registers: fractional coordinates are taken with
+ * dot(), rounded with round(), and the shortest candidate is picked with comparisons and select().
+ */
+template <typename T>
+class periodic_box {
+public:
+    typedef T elt_type;
+
+    /*!
+     * \brief Constructor of an orthorhombic box
+     * @param lx Length of the box along x
+     * @param ly Length of the box along y
+     * @param lz Length of the box along z
+     */
+    periodic_box(T lx, T ly, T lz) {
+        const T a[3] = {lx, 0, 0}, b[3] = {0, ly, 0}, c[3] = {0, 0, lz};
+        init(a, b, c);
+    }
+
+    /*!
+     * \brief Constructor of a triclinic box
+     * @param a First cell vector, only the x coordinate is used
+     * @param b Second cell vector, the z coordinate is ignored
+     * @param c Third cell vector
+     */
+    periodic_box(const T *a, const T *b, const T *c) {
+        init(a, b, c);
+    }
+
+    /*!
+     * \brief Cell matrix, row-major: rows are the cell vectors a, b and c
+     */
+    MUSTINLINE const T *cell() const { return h; }
+
+    /*!
+     * \brief Reciprocal of the diagonal of the cell matrix
+     */
+    MUSTINLINE const T *inverse_diagonal() const { return inv; }
+
+    /*!
+     * \brief Reciprocal cell vectors, row-major: fractional coordinates of a vector are its dot products with the
+     * rows
+     */
+    MUSTINLINE const T *reciprocal() const { return recip; }
+
+    /*!
+     * \brief Lattice vectors which may shorten a difference vector reduced into the centered cell, three
+     * coordinates each
+     */
+    MUSTINLINE const T *shifts() const { return shift; }
+    MUSTINLINE int shift_count() const { return nshifts; }
+
+    MUSTINLINE bool is_triclinic() const { return triclinic; }
+    MUSTINLINE T volume() const { return h[0] * h[4] * h[8]; }
+
+    /*!
+     * \brief Shortest periodic image of a difference vector
+     * @param d Difference vector
+     * @return Result of \e V type
+     */
+    template <typename V>
+    MUSTINLINE V min_image(const V &d) const {
+        typedef typename V::elt_type E;
+        if (!triclinic) {
+            const V len(static_cast<E>(h[0]), static_cast<E>(h[4]), static_cast<E>(h[8]));
+            const V rlen(static_cast<E>(inv[0]), static_cast<E>(inv[1]), static_cast<E>(inv[2]));
+            return d - len * (d * rlen).round();
+        }
+        const V r = d - lattice(fractional(d).round());
+        const E r2 = r.dot(r);
+        V best = r, best2(r2, r2, r2);
+        for (int k = 0; k < nshifts; ++k) {
+            const V c = r + V(static_cast<E>(shift[3 * k]), static_cast<E>(shift[3 * k + 1]),
+                static_cast<E>(shift[3 * k + 2]));
+            const E c2 = c.dot(c);
+            const V c2v(c2, c2, c2);
+            best = V::select(c2v < best2, c, best);
+            best2 = best2.min(c2v);
+        }
+        return best;
+    }
+
+    /*!
+     * \brief Periodic image of a point inside the cell, i.e. with fractional coordinates in [0, 1). Coordinates of
+     * orthorhombic boxes are in [0, L) exactly: images of tiny negative coordinates, which round to L, are
+     * moved to 0. In triclinic cells fractional coordinates may leave [0, 1] by the rounding error.
+     * @param p Position
+     * @return Result of \e V type
+     */
+    template <typename V>
+    MUSTINLINE V wrap(const V &p) const {
+        typedef typename V::elt_type E;
+        if (!triclinic) {
+            const V len(static_cast<E>(h[0]), static_cast<E>(h[4]), static_cast<E>(h[8]));
+            const V rlen(static_cast<E>(inv[0]), static_cast<E>(inv[1]), static_cast<E>(inv[2]));
+            const V zero(0, 0, 0);
+            V r = p - len * (p * rlen).floor();
+            // p / L may round up to an integer just above p, leaving a tiny negative remainder
+            r = V::select(r < zero, r + len, r);
+            return V::select(len <= r, zero, r);
+        }
+        return p - lattice(fractional(p).floor());
+    }
+
+    /*!
+     * \brief Minimum image of a - b
+     */
+    template <typename V>
+    MUSTINLINE V difference(const V &a, const V &b) const {
+        return min_image(a - b);
+    }
+
+    /*!
+     * \brief Squared distance between the closest periodic images of two points
+     */
+    template <typename V>
+    MUSTINLINE typename V::elt_type distance2(const V &a, const V &b) const {
+        const V d = difference(a, b);
+        return d.x * d.x + d.y * d.y + d.z * d.z;
+    }
+
+    /*!
+     * \brief Distance between the closest periodic images of two points
+     */
+    template <typename V>
+    MUSTINLINE typename V::elt_type distance(const V &a, const V &b) const {
+        return std::sqrt(distance2(a, b));
+    }
+
+private:
+    T h[9];             //!< Cell vectors
+    T inv[3];           //!< Reciprocal of the diagonal
+    T recip[9];         //!< Reciprocal cell vectors
+    T shift[3 * 26];    //!< Candidate lattice shifts for triclinic cells
+    int nshifts;        //!< Number of candidate shifts
+    bool triclinic;     //!< Some off-diagonal entry is not zero
+
+    void init(const T *a, const T *b, const T *c) {
+        const T cellv[9] = {a[0], 0, 0, b[0], b[1], 0, c[0], c[1], c[2]};
+        for (int k = 0; k < 9; ++k)
+            h[k] = cellv[k];
+        inv[0] = T(1) / h[0];
+        inv[1] = T(1) / h[4];
+        inv[2] = T(1) / h[8];
+        triclinic = h[3] != 0 || h[6] != 0 || h[7] != 0;
+        const T rc[9] = {inv[0], -h[3] * inv[0] * inv[1], (h[3] * h[7] - h[4] * h[6]) * inv[0] * inv[1] * inv[2],
+            0, inv[1], -h[7] * inv[1] * inv[2], 0, 0, inv[2]};
+        for (int k = 0; k < 9; ++k)
+            recip[k] = rc[k];
+
+        // Shift t can shorten some d = f_a a + f_b b + f_c c with |f| <= 1/2 iff the minimum of 2 d.t + |t|^2,
+        // |t|^2 - |a.t| - |b.t| - |c.t|, is negative
+        nshifts = 0;
+        for (int i = -1; i <= 1; ++i)
+            for (int j = -1; j <= 1; ++j)
+                for (int k = -1; k <= 1; ++k) {
+                    const T t[3] = {i * h[0] + j * h[3] + k * h[6], j * h[4] + k * h[7], k * h[8]};
+                    const T reach = std::fabs(h[0] * t[0]) + std::fabs(h[3] * t[0] + h[4] * t[1])
+                        + std::fabs(h[6] * t[0] + h[7] * t[1] + h[8] * t[2]);
+                    if ((i || j || k) && reach > t[0] * t[0] + t[1] * t[1] + t[2] * t[2]) {
+                        shift[3 * nshifts] = t[0];
+                        shift[3 * nshifts + 1] = t[1];
+                        shift[3 * nshifts + 2] = t[2];
+                        ++nshifts;
+                    }
+                }
+    }
+
+    /*!
+     * \brief Fractional coordinates of a vector
+     */
+    template <typename V>
+    MUSTINLINE V fractional(const V &d) const {
+        typedef typename V::elt_type E;
+        const V ra(static_cast<E>(recip[0]), static_cast<E>(recip[1]), static_cast<E>(recip[2]));
+        const V rb(0, static_cast<E>(recip[4]), static_cast<E>(recip[5]));
+        const V rc(0, 0, static_cast<E>(recip[8]));
+        return V(d.dot(ra), d.dot(rb), d.dot(rc));
+    }
+
+    /*!
+     * \brief Lattice vector with the given fractional coordinates
+     */
+    template <typename V>
+    MUSTINLINE V lattice(const V &f) const {
+        typedef typename V::elt_type E;
+        const V cx(static_cast<E>(h[0]), static_cast<E>(h[3]), static_cast<E>(h[6]));
+        const V cy(0, static_cast<E>(h[4]), static_cast<E>(h[7]));
+        const V cz(0, 0, static_cast<E>(h[8]));
+        return V(f.dot(cx), f.dot(cy), f.dot(cz));
+    }
+};
+
+namespace vectors_internal {
+
+/*!
+ * \brief Minimum image of difference vectors held in SoA registers
+ */
+template <typename P, typename T>
+MUSTINLINE void periodic_min_image(const periodic_box<T> &box, typename P::reg &x, typename P::reg &y,
+        typename P::reg &z) {
+    typedef typename P::reg reg;
+    const T *h = box.cell();
+    const T *inv = box.inverse_diagonal();
+    if (!box.is_triclinic()) {
+        x = P::fnmadd(P::round(P::mul(x, P::set1(inv[0]))), P::set1(h[0]), x);
+        y = P::fnmadd(P::round(P::mul(y, P::set1(inv[1]))), P::set1(h[4]), y);
+        z = P::fnmadd(P::round(P::mul(z, P::set1(inv[2]))), P::set1(h[8]), z);
+        return;
+    }
+    const T *u = box.reciprocal();
+    const reg nx = P::round(P::fmadd(z, P::set1(u[2]), P::fmadd(y, P::set1(u[1]), P::mul(x, P::set1(u[0])))));
+    const reg ny = P::round(P::fmadd(z, P::set1(u[5]), P::mul(y, P::set1(u[4]))));
+    const reg nz = P::round(P::mul(z, P::set1(u[8])));
+    x = P::fnmadd(nz, P::set1(h[6]), P::fnmadd(ny, P::set1(h[3]), P::fnmadd(nx, P::set1(h[0]), x)));
+    y = P::fnmadd(nz, P::set1(h[7]), P::fnmadd(ny, P::set1(h[4]), y));
+    z = P::fnmadd(nz, P::set1(h[8]), z);
+
+    if (box.shift_count() == 0)
+        return;
+    reg best2 = P::fmadd(z, z, P::fmadd(y, y, P::mul(x, x)));
+    const reg x0 = x, y0 = y, z0 = z;
+    for (int k = 0; k < box.shift_count(); ++k) {
+        const T *t = box.shifts() + 3 * k;
+        const reg cx = P::add(x0, P::set1(t[0]));
+        const reg cy = P::add(y0, P::set1(t[1]));
+        const reg cz = P::add(z0, P::set1(t[2]));
+        const reg c2 = P::fmadd(cz, cz, P::fmadd(cy, cy, P::mul(cx, cx)));
+        const typename P::mask m = P::cmp_lt(c2, best2);
+        best2 = P::select(m, c2, best2);
+        x = P::select(m, cx, x);
+        y = P::select(m, cy, y);
+        z = P::select(m, cz, z);
+    }
+}
+
+/*!
+ * \brief Remainder of \e x modulo the box length \e len, in [0, len) as in periodic_box::wrap()
+ */
+template <typename P, typename T>
+MUSTINLINE typename P::reg wrap_length(typename P::reg x, T len, T inv) {
+    const typename P::reg l = P::set1(len);
+    typename P::reg r = P::fnmadd(P::floor(P::mul(x, P::set1(inv))), l, x);
+    r = P::select(P::cmp_lt(r, P::zero()), P::add(r, l), r);
+    return P::select(P::cmp_le(l, r), P::zero(), r);
+}
+
+/*!
+ * \brief Wrapping of points held in SoA registers into the cell
+ */
+template <typename P, typename T>
+MUSTINLINE void periodic_wrap(const periodic_box<T> &box, typename P::reg &x, typename P::reg &y,
+        typename P::reg &z) {
+    typedef typename P::reg reg;
+    const T *h = box.cell();
+    const T *inv = box.inverse_diagonal();
+    if (!box.is_triclinic()) {
+        x = wrap_length<P>(x, h[0], inv[0]);
+        y = wrap_length<P>(y, h[4], inv[1]);
+        z = wrap_length<P>(z, h[8], inv[2]);
+        return;
+    }
+    const reg fz = P::mul(z, P::set1(inv[2]));
+    const reg fy = P::mul(P::fnmadd(fz, P::set1(h[7]), y), P::set1(inv[1]));
+    const reg fx = P::mul(P::fnmadd(fz, P::set1(h[6]), P::fnmadd(fy, P::set1(h[3]), x)), P::set1(inv[0]));
+    const reg nx = P::floor(fx), ny = P::floor(fy), nz = P::floor(fz);
+    x = P::fnmadd(nz, P::set1(h[6]), P::fnmadd(ny, P::set1(h[3]), P::fnmadd(nx, P::set1(h[0]), x)));
+    y = P::fnmadd(nz, P::set1(h[7]), P::fnmadd(ny, P::set1(h[4]), y));
+    z = P::fnmadd(nz, P::set1(h[8]), z);
+}
+
+template <typename T>
+struct periodic_wrap_kernel {
+    const periodic_box<T> *box;
+    const T *x, *y, *z;
+    T *ox, *oy, *oz;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        typename P::reg vx = P::load(x + i), vy = P::load(y + i), vz = P::load(z + i);
+        periodic_wrap<P>(*box, vx, vy, vz);
+        P::store(ox + i, vx);
+        P::store(oy + i, vy);
+        P::store(oz + i, vz);
+    }
+};
+
+template <typename T>
+struct periodic_difference_kernel {
+    const periodic_box<T> *box;
+    const T *ax, *ay, *az, *bx, *by, *bz;
+    T *ox, *oy, *oz;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        typename P::reg dx = P::sub(P::load(ax + i), P::load(bx + i));
+        typename P::reg dy = P::sub(P::load(ay + i), P::load(by + i));
+        typename P::reg dz = P::sub(P::load(az + i), P::load(bz + i));
+        periodic_min_image<P>(*box, dx, dy, dz);
+        P::store(ox + i, dx);
+        P::store(oy + i, dy);
+        P::store(oz + i, dz);
+    }
+};
+
+template <typename T>
+struct periodic_distance_kernel {
+    const periodic_box<T> *box;
+    const T *ax, *ay, *az, *bx, *by, *bz;
+    T *out;
+    bool squared;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        typename P::reg dx = P::sub(P::load(ax + i), P::load(bx + i));
+        typename P::reg dy = P::sub(P::load(ay + i), P::load(by + i));
+        typename P::reg dz = P::sub(P::load(az + i), P::load(bz + i));
+        periodic_min_image<P>(*box, dx, dy, dz);
+        const typename P::reg d2 = P::fmadd(dz, dz, P::fmadd(dy, dy, P::mul(dx, dx)));
+        P::store(out + i, squared ? d2 : P::sqrt(d2));
+    }
+};
+
+} // namespace vectors_internal
+
+/*!
+ * \brief Moves points into the periodic box
+ * @param box Periodic box
+ * @param in Input points
+ * @param out Output points, may coincide with \e in
+ */
+template <typename T>
+void periodic_wrap(const periodic_box<T> &box, typename vector3_soa_in<T>::type in, vector3_soa<T> out) {
+    VECTORS_PROFILE("periodic_wrap", in.size);
+    vectors_internal::periodic_wrap_kernel<T> k = {&box, in.x, in.y, in.z, out.x, out.y, out.z};
+    vectors_internal::pack_for<T>(in.size, k);
+}
+
+/*!
+ * \brief Minimum image differences of corresponding points, a - b
+ * @param box Periodic box
+ * @param a First array of points
+ * @param b Second array of points
+ * @param out Output array of difference vectors
+ */
+template <typename T>
+void periodic_difference(const periodic_box<T> &box, typename vector3_soa_in<T>::type a,
+        typename vector3_soa_in<T>::type b, vector3_soa<T> out) {
+    VECTORS_PROFILE("periodic_difference", a.size);
+    vectors_internal::periodic_difference_kernel<T> k = {&box, a.x, a.y, a.z, b.x, b.y, b.z, out.x, out.y, out.z};
+    vectors_internal::pack_for<T>(a.size, k);
+}
+
+/*!
+ * \brief Minimum image distances between corresponding points
+ * @param box Periodic box
+ * @param a First array of points
+ * @param b Second array of points
+ * @param out Output array of distances
+ * @param squared Store squared distances instead
+ */
+template <typename T>
+void periodic_distance(const periodic_box<T> &box, typename vector3_soa_in<T>::type a,
+        typename vector3_soa_in<T>::type b, T *out, bool squared = false) {
+    VECTORS_PROFILE("periodic_distance", a.size);
+    vectors_internal::periodic_distance_kernel<T> k = {&box, a.x, a.y, a.z, b.x, b.y, b.z, out, squared};
+    vectors_internal::pack_for<T>(a.size, k);
+}
+
+#endif /* VECTORSPERIODIC_H_ */
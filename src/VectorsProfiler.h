@@ -0,0 +1,202 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTORSPROFILER_H_
+#define VECTORSPROFILER_H_
+
+#include <string>
+#include <vector>
+#include "VectorsInternal.h"
+
+/*
+ * Instrumentation of batch kernels. Define VECTORS_ENABLE_PROFILING before including Vectors.h (or pass
+ * -DVECTORS_ENABLE_PROFILING to the compiler) to collect number of calls, number of processed elements and
+ * time stamp counter cycles spent in every kernel. When the macro is not defined VECTORS_PROFILE expands to
+ * nothing and the report functions return empty results.
+ */
+
+/*!
+ * \brief Accumulated statistics of a single kernel
+ */
+struct vectors_profile_entry {
+    std::string name;       //!< Kernel name
+    uint64_t calls;         //!< Number of calls
+    uint64_t elements;      //!< Total number of processed elements
+    uint64_t cycles;        //!< Total number of time stamp counter cycles
+    double seconds;         //!< Total time, estimated from cycles
+};
+
+#ifdef VECTORS_ENABLE_PROFILING
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+
+namespace vectors_internal {
+
+struct kernel_counters {
+    const char *name;
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> elements;
+    std::atomic<uint64_t> cycles;
+
+    explicit kernel_counters(const char *name) : name(name), calls(0), elements(0), cycles(0) { }
+};
+
+inline std::mutex &profile_mutex() {
+    static std::mutex m;
+    return m;
+}
+
+inline std::vector<kernel_counters*> &profile_registry() {
+    static std::vector<kernel_counters*> registry;
+    return registry;
+}
+
+/*!
+ * \brief Returns counters of the kernel with the given name, creating them on the first call. Counters are
+ * shared by all instantiations of a kernel template.
+ */
+inline kernel_counters &register_kernel(const char *name) {
+    std::lock_guard<std::mutex> lock(profile_mutex());
+    std::vector<kernel_counters*> &registry = profile_registry();
+    for (size_t i = 0; i < registry.size(); ++i)
+        if (std::strcmp(registry[i]->name, name) == 0)
+            return *registry[i];
+    registry.push_back(new kernel_counters(name));
+    return *registry.back();
+}
+
+/*!
+ * \class profile_scope
+ * \brief Adds one call and the elapsed cycles of the enclosing scope to the kernel counters
+ */
+class profile_scope {
+public:
+    MUSTINLINE profile_scope(kernel_counters &counters, size_t elements) :
+        counters(counters), start(__rdtsc()) {
+        counters.calls.fetch_add(1, std::memory_order_relaxed);
+        counters.elements.fetch_add(elements, std::memory_order_relaxed);
+    }
+
+    MUSTINLINE ~profile_scope() {
+        counters.cycles.fetch_add(__rdtsc() - start, std::memory_order_relaxed);
+    }
+
+private:
+    kernel_counters &counters;
+    uint64_t start;
+};
+
+/*!
+ * \brief Frequency of the time stamp counter, measured once against the steady clock
+ */
+inline double tsc_frequency() {
+    static const double frequency = [] {
+        typedef std::chrono::steady_clock clock;
+        const clock::time_point t0 = clock::now();
+        const uint64_t c0 = __rdtsc();
+        while (clock::now() - t0 < std::chrono::milliseconds(20)) { }
+        const uint64_t c1 = __rdtsc();
+        const double dt = std::chrono::duration<double>(clock::now() - t0).count();
+        return (c1 - c0) / dt;
+    }();
+    return frequency;
+}
+
+} // namespace vectors_internal
+
+#define VECTORS_PROFILE(name, elements) \
+    static vectors_internal::kernel_counters &vectors_profile_counters_ = \
+        vectors_internal::register_kernel(name); \
+    vectors_internal::profile_scope vectors_profile_scope_(vectors_profile_counters_, elements)
+
+/*!
+ * \brief Snapshot of statistics of all kernels called so far
+ */
+inline std::vector<vectors_profile_entry> vectors_profile_snapshot() {
+    std::vector<vectors_profile_entry> entries;
+    const double frequency = vectors_internal::tsc_frequency();
+    std::lock_guard<std::mutex> lock(vectors_internal::profile_mutex());
+    const std::vector<vectors_internal::kernel_counters*> &registry = vectors_internal::profile_registry();
+    for (size_t i = 0; i < registry.size(); ++i) {
+        vectors_profile_entry e;
+        e.name = registry[i]->name;
+        e.calls = registry[i]->calls.load(std::memory_order_relaxed);
+        e.elements = registry[i]->elements.load(std::memory_order_relaxed);
+        e.cycles = registry[i]->cycles.load(std::memory_order_relaxed);
+        e.seconds = e.cycles / frequency;
+        entries.push_back(e);
+    }
+    return entries;
+}
+
+/*!
+ * \brief Sets all counters to zero
+ */
+inline void vectors_profile_reset() {
+    std::lock_guard<std::mutex> lock(vectors_internal::profile_mutex());
+    const std::vector<vectors_internal::kernel_counters*> &registry = vectors_internal::profile_registry();
+    for (size_t i = 0; i < registry.size(); ++i) {
+        registry[i]->calls.store(0, std::memory_order_relaxed);
+        registry[i]->elements.store(0, std::memory_order_relaxed);
+        registry[i]->cycles.store(0, std::memory_order_relaxed);
+    }
+}
+
+#else
+
+#define VECTORS_PROFILE(name, elements) ((void)0)
+
+inline std::vector<vectors_profile_entry> vectors_profile_snapshot() {
+    return std::vector<vectors_profile_entry>();
+}
+
+inline void vectors_profile_reset() { }
+
+#endif
+
+/*!
+ * \brief Prints statistics of all kernels into the stream
+ * @param os Reference to a stream
+ * @param csv Print comma separated values instead of a table
+ */
+inline void vectors_profile_report(std::ostream &os, bool csv = false) {
+    const std::vector<vectors_profile_entry> entries = vectors_profile_snapshot();
+    if (csv)
+        os << "kernel,calls,elements,cycles,seconds\n";
+    else
+        os << "kernel calls elements cycles seconds cycles/element\n";
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const vectors_profile_entry &e = entries[i];
+        const char sep = csv ? ',' : ' ';
+        os << e.name << sep << e.calls << sep << e.elements << sep << e.cycles << sep << e.seconds;
+        if (!csv)
+            os << sep << (e.elements ? double(e.cycles) / e.elements : 0.);
+        os << '\n';
+    }
+}
+
+#endif /* VECTORSPROFILER_H_ */
@@ -0,0 +1,537 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTORSRANDOM_H_
+#define VECTORSRANDOM_H_
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "VectorsInternal.h"
+#include "VectorsPack.h"
+#include "VectorsFilter.h"
+#include "VectorsProfiler.h"
+#include "Vector3_soa.h"
+
+/*
+ * Random vectors for Monte Carlo sampling. random_stream runs four xoshiro256++ generators (Blackman, Vigna
+ * 2018) side by side, one per 64-bit lane of an AVX2 register; without AVX2 the lanes are stepped one after
+ * another and give the same numbers. Uniform numbers are made from the high bits of the outputs by setting the
+ * exponent of 1.0 (values in [1, 2), exact in every precision), so both paths agree bit by bit.
+ *
+ * Samplers draw blocks of candidates, transform them in SIMD registers and keep the accepted ones with the
+ * lane compaction of the filter kernels: unit sphere by Marsaglia's method, unit ball by rejection from the
+ * cube, cosine-weighted hemisphere by Malley's method (a uniform point of the disk lifted to the hemisphere),
+ * and boxes. None of them needs trigonometric or logarithmic functions.
+ *
+ * A random_stream must not be shared between threads; each thread should own one, created with its own
+ * stream number. The samplers taking a seed instead of a stream do this internally: the output is split into
+ * blocks of random_stream_points points, block b is generated by stream b in parallel, so the result does not
+ * depend on the number of threads.
+ */
+
+/*!
+ * \class random_stream
+ * \brief Four interleaved xoshiro256++ generators
+ */
+class random_stream {
+public:
+    enum { lanes = 4 };     //!< Number of generators
+
+    /*!
+     * \brief Constructor. The first generator is seeded by splitmix64 from the seed and the stream number, the
+     * others start 2^128, 2 * 2^128 and 3 * 2^128 steps further along the same sequence.
+     * @param seed Seed
+     * @param stream Number of the stream, e.g. of the thread using it
+     */
+    explicit random_stream(uint64_t seed = 0, uint64_t stream = 0) {
+        uint64_t x = mix(seed) ^ stream;
+        uint64_t w[4];
+        for (int k = 0; k < 4; ++k) {
+            x += 0x9e3779b97f4a7c15ULL;
+            w[k] = mix(x);
+        }
+        for (int l = 0; l < lanes; ++l) {
+            for (int k = 0; k < 4; ++k)
+                s[k][l] = w[k];
+            jump(w);
+        }
+    }
+
+    /*!
+     * \brief Advances every generator by one step
+     * @param out Output array of \e lanes random 64-bit numbers
+     */
+    void next(uint64_t *out) {
+        for (int l = 0; l < lanes; ++l)
+            out[l] = step(s[0][l], s[1][l], s[2][l], s[3][l]);
+    }
+
+    /*!
+     * \brief Fills an array with uniform numbers in [1, 2): 4 doubles (52 random bits each) or 8 floats (23
+     * random bits each) per step of the generators
+     * @param out Output array of 32 / sizeof(T) * steps numbers
+     * @param steps Number of steps
+     */
+    template <typename T>
+    void unit(T *out, size_t steps) {
+#ifdef __AVX2__
+        __m256i s0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s[0]));
+        __m256i s1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s[1]));
+        __m256i s2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s[2]));
+        __m256i s3 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s[3]));
+        for (size_t i = 0; i < steps; ++i) {
+            const __m256i r = _mm256_add_epi64(rotl(_mm256_add_epi64(s0, s3), 23), s0);
+            const __m256i t = _mm256_slli_epi64(s1, 17);
+            s2 = _mm256_xor_si256(s2, s0);
+            s3 = _mm256_xor_si256(s3, s1);
+            s1 = _mm256_xor_si256(s1, s2);
+            s0 = _mm256_xor_si256(s0, s3);
+            s2 = _mm256_xor_si256(s2, t);
+            s3 = rotl(s3, 45);
+            store_unit(out + i * (32 / sizeof(T)), r);
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(s[0]), s0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(s[1]), s1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(s[2]), s2);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(s[3]), s3);
+#else
+        uint64_t r[lanes];
+        for (size_t i = 0; i < steps; ++i) {
+            next(r);
+            store_unit(out + i * (32 / sizeof(T)), r);
+        }
+#endif
+    }
+
+private:
+    uint64_t s[4][lanes];   //!< Four words of state of every generator
+
+    static MUSTINLINE uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    static MUSTINLINE uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+    static MUSTINLINE uint64_t step(uint64_t &s0, uint64_t &s1, uint64_t &s2, uint64_t &s3) {
+        const uint64_t r = rotl(s0 + s3, 23) + s0;
+        const uint64_t t = s1 << 17;
+        s2 ^= s0;
+        s3 ^= s1;
+        s1 ^= s2;
+        s0 ^= s3;
+        s2 ^= t;
+        s3 = rotl(s3, 45);
+        return r;
+    }
+
+    /*!
+     * \brief Advances a state by 2^128 steps
+     */
+    static void jump(uint64_t *w) {
+        static const uint64_t poly[4] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL,
+            0x39abdc4529b1661cULL};
+        uint64_t j[4] = {0, 0, 0, 0};
+        for (int k = 0; k < 4; ++k) {
+            for (int b = 0; b < 64; ++b) {
+                if (poly[k] >> b & 1)
+                    for (int m = 0; m < 4; ++m)
+                        j[m] ^= w[m];
+                step(w[0], w[1], w[2], w[3]);
+            }
+        }
+        std::memcpy(w, j, sizeof j);
+    }
+
+    static MUSTINLINE void store_unit(double *out, const uint64_t *r) {
+        for (int l = 0; l < lanes; ++l) {
+            const uint64_t bits = r[l] >> 12 | 0x3ff0000000000000ULL;
+            std::memcpy(out + l, &bits, sizeof bits);
+        }
+    }
+
+    // The low and high halves of every number, as the 32-bit lanes of a register
+    static MUSTINLINE void store_unit(float *out, const uint64_t *r) {
+        for (int l = 0; l < lanes; ++l) {
+            const uint32_t bits[2] = {static_cast<uint32_t>(r[l]) >> 9 | 0x3f800000u,
+                static_cast<uint32_t>(r[l] >> 32) >> 9 | 0x3f800000u};
+            std::memcpy(out + 2 * l, bits, sizeof bits);
+        }
+    }
+
+#ifdef __AVX2__
+    static MUSTINLINE __m256i rotl(__m256i x, int k) {
+        return _mm256_or_si256(_mm256_slli_epi64(x, k), _mm256_srli_epi64(x, 64 - k));
+    }
+
+    static MUSTINLINE void store_unit(double *out, __m256i r) {
+        r = _mm256_or_si256(_mm256_srli_epi64(r, 12), _mm256_set1_epi64x(0x3ff0000000000000LL));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), r);
+    }
+
+    static MUSTINLINE void store_unit(float *out, __m256i r) {
+        r = _mm256_or_si256(_mm256_srli_epi32(r, 9), _mm256_set1_epi32(0x3f800000));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), r);
+    }
+#endif
+};
+
+namespace vectors_internal {
+
+/*!
+ * \brief Number of candidates drawn at once by the samplers, and the number of points generated by every
+ * stream of the samplers taking a seed
+ */
+enum { random_block = 256, random_stream_points = 16384 };
+
+/*!
+ * \brief Maps uniform numbers in [1, 2) to [-1, 1) exactly
+ */
+template <typename P>
+MUSTINLINE typename P::reg symmetric_unit(typename P::reg u) {
+    return P::sub(P::add(u, u), P::set1(3));
+}
+
+/*!
+ * \brief Uniform points of a box
+ */
+template <typename T>
+struct box_sampler {
+    enum { draws = 3 };     //!< Uniform numbers per candidate
+    T lo[3], extent[3];
+
+    template <typename P>
+    MUSTINLINE typename P::mask sample(const typename P::reg *u, typename P::reg *v) const {
+        for (int k = 0; k < 3; ++k)
+            v[k] = P::fmadd(P::sub(u[k], P::set1(1)), P::set1(extent[k]), P::set1(lo[k]));
+        return P::cmp_ge(P::zero(), P::zero());
+    }
+};
+
+/*!
+ * \brief Uniform points of the unit sphere (Marsaglia 1972)
+ */
+template <typename T>
+struct sphere_sampler {
+    enum { draws = 2 };
+
+    template <typename P>
+    MUSTINLINE typename P::mask sample(const typename P::reg *u, typename P::reg *v) const {
+        typedef typename P::reg reg;
+        const reg a = symmetric_unit<P>(u[0]), b = symmetric_unit<P>(u[1]);
+        const reg s = P::fmadd(b, b, P::mul(a, a));
+        const reg r = P::sqrt(P::sub(P::set1(1), s));
+        v[0] = P::mul(P::add(a, a), r);
+        v[1] = P::mul(P::add(b, b), r);
+        v[2] = P::sub(P::set1(1), P::add(s, s));
+        return P::cmp_lt(s, P::set1(1));
+    }
+};
+
+/*!
+ * \brief Uniform points of the unit ball
+ */
+template <typename T>
+struct ball_sampler {
+    enum { draws = 3 };
+
+    template <typename P>
+    MUSTINLINE typename P::mask sample(const typename P::reg *u, typename P::reg *v) const {
+        for (int k = 0; k < 3; ++k)
+            v[k] = symmetric_unit<P>(u[k]);
+        return P::cmp_lt(P::fmadd(v[2], v[2], P::fmadd(v[1], v[1], P::mul(v[0], v[0]))), P::set1(1));
+    }
+};
+
+/*!
+ * \brief Cosine-weighted directions of a hemisphere: uniform points of the unit disk lifted to the
+ * hemisphere (Malley's method) and rotated to the frame of its axis
+ */
+template <typename T>
+struct hemisphere_sampler {
+    enum { draws = 2 };
+    T frame[9];     //!< Tangent, bitangent and axis, as rows
+
+    /*!
+     * \brief Builds an orthonormal frame around a unit axis (Duff et al. 2017)
+     */
+    explicit hemisphere_sampler(const T *axis) {
+        static const T up[3] = {0, 0, 1};
+        const T *n = axis ? axis : up;
+        const T sign = n[2] < 0 ? T(-1) : T(1);
+        const T a = -1 / (sign + n[2]);
+        const T b = n[0] * n[1] * a;
+        const T f[9] = {1 + sign * n[0] * n[0] * a, sign * b, -sign * n[0], b, sign + n[1] * n[1] * a, -n[1],
+            n[0], n[1], n[2]};
+        std::copy(f, f + 9, frame);
+    }
+
+    template <typename P>
+    MUSTINLINE typename P::mask sample(const typename P::reg *u, typename P::reg *v) const {
+        typedef typename P::reg reg;
+        const reg a = symmetric_unit<P>(u[0]), b = symmetric_unit<P>(u[1]);
+        const reg s = P::fmadd(b, b, P::mul(a, a));
+        const reg c = P::sqrt(P::sub(P::set1(1), s));
+        for (int k = 0; k < 3; ++k)
+            v[k] = P::fmadd(c, P::set1(frame[6 + k]), P::fmadd(b, P::set1(frame[3 + k]),
+                P::mul(a, P::set1(frame[k]))));
+        return P::cmp_lt(s, P::set1(1));
+    }
+};
+
+/*!
+ * \brief Fills SoA arrays with samples: blocks of candidates are drawn and the accepted ones compacted
+ * to the output in the order of the candidates
+ */
+template <typename T, typename Sampler>
+void sample_soa(random_stream &rng, const Sampler &sampler, const vector3_soa<T> &out) {
+    typedef simd_pack<T> P;
+    typedef typename P::reg reg;
+    T u[Sampler::draws * random_block];
+    T v[3][random_block + P::width];
+    for (size_t k = 0; k < out.size;) {
+        rng.unit(u, Sampler::draws * random_block * sizeof(T) / 32);
+        size_t m = 0;
+        for (size_t i = 0; i < random_block; i += P::width) {
+            reg a[Sampler::draws], r[3];
+            for (int d = 0; d < Sampler::draws; ++d)
+                a[d] = P::load(u + d * random_block + i);
+            const int bits = P::movemask(sampler.template sample<P>(a, r));
+            const compressor<T, P::width> c(bits);
+            for (int d = 0; d < 3; ++d)
+                c.store(v[d] + m, r[d]);
+            m += compaction_lut().count[bits];
+        }
+        m = std::min(m, out.size - k);
+        std::copy(v[0], v[0] + m, out.x + k);
+        std::copy(v[1], v[1] + m, out.y + k);
+        std::copy(v[2], v[2] + m, out.z + k);
+        k += m;
+    }
+}
+
+/*!
+ * \brief Fills SoA arrays with samples in parallel, block b of random_stream_points points from stream b
+ */
+template <typename T, typename Sampler>
+void sample_soa(uint64_t seed, const Sampler &sampler, const vector3_soa<T> &out) {
+    const ptrdiff_t blocks = static_cast<ptrdiff_t>((out.size + random_stream_points - 1) / random_stream_points);
+    VECTORS_OMP(parallel for schedule(dynamic) if(blocks > 1))
+    for (ptrdiff_t b = 0; b < blocks; ++b) {
+        random_stream rng(seed, static_cast<uint64_t>(b));
+        const size_t first = b * static_cast<size_t>(random_stream_points);
+        sample_soa(rng, sampler, out.sub(first, std::min<size_t>(random_stream_points, out.size - first)));
+    }
+}
+
+/*!
+ * \brief Fills an array of vector class objects with samples, generated in SoA form in blocks
+ */
+template <typename V, typename Sampler>
+void sample_vectors(random_stream &rng, const Sampler &sampler, V *out, size_t n) {
+    typedef typename V::elt_type T;
+    T c[3 * random_block];
+    for (size_t i = 0; i < n; i += random_block) {
+        const size_t m = std::min<size_t>(random_block, n - i);
+        sample_soa(rng, sampler, vector3_soa<T>(c, c + random_block, c + 2 * random_block, m));
+        for (size_t j = 0; j < m; ++j)
+            out[i + j] = V(c[j], c[random_block + j], c[2 * random_block + j]);
+    }
+}
+
+} // namespace vectors_internal
+
+/*!
+ * \brief Fills an array with uniform random numbers in [0, 1)
+ * @param rng Generator
+ * @param out Output array
+ * @param n Number of values
+ */
+template <typename T>
+void random_uniform(random_stream &rng, T *out, size_t n) {
+    VECTORS_PROFILE("random_uniform", n);
+    const size_t per_step = 32 / sizeof(T);
+    T u[vectors_internal::random_block];
+    for (size_t i = 0; i < n; i += vectors_internal::random_block) {
+        const size_t m = std::min<size_t>(vectors_internal::random_block, n - i);
+        rng.unit(u, (m + per_step - 1) / per_step);
+        for (size_t j = 0; j < m; ++j)
+            out[i + j] = u[j] - 1;
+    }
+}
+
+/*!
+ * \brief Uniform random points of a box
+ * @param rng Generator
+ * @param lo Lower corner, three coordinates
+ * @param hi Upper corner, three coordinates
+ * @param out Output points
+ */
+template <typename T>
+void random_box(random_stream &rng, const T *lo, const T *hi, vector3_soa<T> out) {
+    VECTORS_PROFILE("random_box", out.size);
+    const vectors_internal::box_sampler<T> s = {{lo[0], lo[1], lo[2]}, {hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]}};
+    vectors_internal::sample_soa(rng, s, out);
+}
+
+/*!
+ * \brief Uniform random points of a box, generated in parallel from independent streams
+ * @param seed Seed
+ * @param lo Lower corner, three coordinates
+ * @param hi Upper corner, three coordinates
+ * @param out Output points
+ */
+template <typename T>
+void random_box(uint64_t seed, const T *lo, const T *hi, vector3_soa<T> out) {
+    VECTORS_PROFILE("random_box", out.size);
+    const vectors_internal::box_sampler<T> s = {{lo[0], lo[1], lo[2]}, {hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]}};
+    vectors_internal::sample_soa(seed, s, out);
+}
+
+/*!
+ * \brief Uniform random points of a box as vector class objects
+ * @param rng Generator
+ * @param lo Lower corner, three coordinates
+ * @param hi Upper corner, three coordinates
+ * @param out Output array
+ * @param n Number of points
+ */
+template <typename V>
+void random_box(random_stream &rng, const typename V::elt_type *lo, const typename V::elt_type *hi, V *out,
+        size_t n) {
+    typedef typename V::elt_type T;
+    VECTORS_PROFILE("random_box", n);
+    const vectors_internal::box_sampler<T> s = {{lo[0], lo[1], lo[2]}, {hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]}};
+    vectors_internal::sample_vectors(rng, s, out, n);
+}
+
+/*!
+ * \brief Uniform random unit vectors (points of the unit sphere)
+ * @param rng Generator
+ * @param out Output vectors
+ */
+template <typename T>
+void random_sphere(random_stream &rng, vector3_soa<T> out) {
+    VECTORS_PROFILE("random_sphere", out.size);
+    vectors_internal::sample_soa(rng, vectors_internal::sphere_sampler<T>(), out);
+}
+
+/*!
+ * \brief Uniform random unit vectors, generated in parallel from independent streams
+ * @param seed Seed
+ * @param out Output vectors
+ */
+template <typename T>
+void random_sphere(uint64_t seed, vector3_soa<T> out) {
+    VECTORS_PROFILE("random_sphere", out.size);
+    vectors_internal::sample_soa(seed, vectors_internal::sphere_sampler<T>(), out);
+}
+
+/*!
+ * \brief Uniform random unit vectors as vector class objects
+ * @param rng Generator
+ * @param out Output array
+ * @param n Number of vectors
+ */
+template <typename V>
+void random_sphere(random_stream &rng, V *out, size_t n) {
+    VECTORS_PROFILE("random_sphere", n);
+    vectors_internal::sample_vectors(rng, vectors_internal::sphere_sampler<typename V::elt_type>(), out, n);
+}
+
+/*!
+ * \brief Uniform random points of the unit ball
+ * @param rng Generator
+ * @param out Output points
+ */
+template <typename T>
+void random_ball(random_stream &rng, vector3_soa<T> out) {
+    VECTORS_PROFILE("random_ball", out.size);
+    vectors_internal::sample_soa(rng, vectors_internal::ball_sampler<T>(), out);
+}
+
+/*!
+ * \brief Uniform random points of the unit ball, generated in parallel from independent streams
+ * @param seed Seed
+ * @param out Output points
+ */
+template <typename T>
+void random_ball(uint64_t seed, vector3_soa<T> out) {
+    VECTORS_PROFILE("random_ball", out.size);
+    vectors_internal::sample_soa(seed, vectors_internal::ball_sampler<T>(), out);
+}
+
+/*!
+ * \brief Uniform random points of the unit ball as vector class objects
+ * @param rng Generator
+ * @param out Output array
+ * @param n Number of points
+ */
+template <typename V>
+void random_ball(random_stream &rng, V *out, size_t n) {
+    VECTORS_PROFILE("random_ball", n);
+    vectors_internal::sample_vectors(rng, vectors_internal::ball_sampler<typename V::elt_type>(), out, n);
+}
+
+/*!
+ * \brief Random unit vectors of a hemisphere with density proportional to the cosine of the angle to its
+ * axis, as used for diffuse reflection
+ * @param rng Generator
+ * @param axis Unit axis of the hemisphere, three coordinates; z axis if null
+ * @param out Output vectors
+ */
+template <typename T>
+void random_hemisphere(random_stream &rng, const T *axis, vector3_soa<T> out) {
+    VECTORS_PROFILE("random_hemisphere", out.size);
+    vectors_internal::sample_soa(rng, vectors_internal::hemisphere_sampler<T>(axis), out);
+}
+
+/*!
+ * \brief Cosine-weighted random unit vectors of a hemisphere, generated in parallel from independent streams
+ * @param seed Seed
+ * @param axis Unit axis of the hemisphere, three coordinates; z axis if null
+ * @param out Output vectors
+ */
+template <typename T>
+void random_hemisphere(uint64_t seed, const T *axis, vector3_soa<T> out) {
+    VECTORS_PROFILE("random_hemisphere", out.size);
+    vectors_internal::sample_soa(seed, vectors_internal::hemisphere_sampler<T>(axis), out);
+}
+
+/*!
+ * \brief Cosine-weighted random unit vectors of a hemisphere as vector class objects
+ * @param rng Generator
+ * @param axis Unit axis of the hemisphere, three coordinates; z axis if null
+ * @param out Output array
+ * @param n Number of vectors
+ */
+template <typename V>
+void random_hemisphere(random_stream &rng, const typename V::elt_type *axis, V *out, size_t n) {
+    VECTORS_PROFILE("random_hemisphere", n);
+    vectors_internal::sample_vectors(rng, vectors_internal::hemisphere_sampler<typename V::elt_type>(axis), out, n);
+}
+
+#endif /* VECTORSRANDOM_H_ */
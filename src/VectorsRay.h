@@ -0,0 +1,327 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTORSRAY_H_
+#define VECTORSRAY_H_
+
+#include <limits>
+#include "VectorsInternal.h"
+#include "VectorsPack.h"
+#include "VectorsProfiler.h"
+#include "VectorsFilter.h"
+#include "Vector3_soa.h"
+
+/*
+ * Ray-triangle intersection with the Moller-Trumbore algorithm. A hit is reported at o + t * d with barycentric
+ * coordinates (u, v) of the point p = (1 - u - v) * v0 + u * v1 + v * v2. Both sides of triangles are hit and
+ * rays parallel to the triangle plane miss it. Batch versions either test one ray against eight (single
+ * precision) or four (double precision) triangles at once, or trace a packet of that many rays against every
+ * triangle; lanes are retired with masks and a packet skips the rest of the test once all its lanes missed.
+ */
+
+/*!
+ * \brief Intersection of a single ray with a triangle using one of the vector classes
+ * @param origin Origin of the ray
+ * @param dir Direction of the ray, not necessarily normalized
+ * @param v0 First corner of the triangle
+ * @param v1 Second corner of the triangle
+ * @param v2 Third corner of the triangle
+ * @param tmin Start of the ray interval
+ * @param tmax End of the ray interval
+ * @param t Output ray parameter of the hit point, valid if the ray hits the triangle
+ * @param u Output barycentric coordinate of \e v1, valid if the ray hits the triangle
+ * @param v Output barycentric coordinate of \e v2, valid if the ray hits the triangle
+ * @return True if the ray hits the triangle within [tmin, tmax]
+ */
+template <typename V>
+MUSTINLINE bool intersect_ray_triangle(const V &origin, const V &dir, const V &v0, const V &v1, const V &v2,
+        typename V::elt_type tmin, typename V::elt_type tmax, typename V::elt_type &t, typename V::elt_type &u,
+        typename V::elt_type &v) {
+    typedef typename V::elt_type T;
+    const V e1 = v1 - v0;
+    const V e2 = v2 - v0;
+    const V p = dir.cross(e2);
+    const T det = e1.dot(p);
+    if (det == T(0))
+        return false;
+    const T inv = T(1) / det;
+    const V s = origin - v0;
+    u = s.dot(p) * inv;
+    if (!(u >= T(0) && u <= T(1)))
+        return false;
+    const V q = s.cross(e1);
+    v = dir.dot(q) * inv;
+    if (!(v >= T(0) && u + v <= T(1)))
+        return false;
+    t = e2.dot(q) * inv;
+    return t >= tmin && t <= tmax;
+}
+
+namespace vectors_internal {
+
+/*!
+ * \brief Moller-Trumbore test on registers. Returns the mask of lanes with hits within [tmin, tmax]; \e t, \e u
+ * and \e v are only meaningful in those lanes. Returns early with an empty mask once every lane has missed.
+ */
+template <typename P>
+MUSTINLINE typename P::mask moller_trumbore(const typename P::reg *o, const typename P::reg *d,
+        const typename P::reg *a, const typename P::reg *b, const typename P::reg *c, typename P::reg tmin,
+        typename P::reg tmax, typename P::reg &t, typename P::reg &u, typename P::reg &v) {
+    typedef typename P::reg reg;
+    const reg zero = P::zero(), one = P::set1(typename P::elt_type(1));
+    const reg e1[3] = {P::sub(b[0], a[0]), P::sub(b[1], a[1]), P::sub(b[2], a[2])};
+    const reg e2[3] = {P::sub(c[0], a[0]), P::sub(c[1], a[1]), P::sub(c[2], a[2])};
+    reg p[3], q[3];
+    cross3<P>(d, e2, p);
+    const reg det = dot3<P>(e1, p);
+    const reg inv = P::div(one, det);
+    const reg s[3] = {P::sub(o[0], a[0]), P::sub(o[1], a[1]), P::sub(o[2], a[2])};
+
+    // Zero determinants give infinite or NaN coordinates, which fail the comparisons
+    u = P::mul(dot3<P>(s, p), inv);
+    typename P::mask m = P::mask_and(P::cmp_ge(u, zero), P::cmp_le(u, one));
+    if (!P::movemask(m))
+        return m;
+    cross3<P>(s, e1, q);
+    v = P::mul(dot3<P>(d, q), inv);
+    m = P::mask_and(m, P::mask_and(P::cmp_ge(v, zero), P::cmp_le(P::add(u, v), one)));
+    if (!P::movemask(m))
+        return m;
+    t = P::mul(dot3<P>(e2, q), inv);
+    return P::mask_and(m, P::mask_and(P::cmp_ge(t, tmin), P::cmp_le(t, tmax)));
+}
+
+/*!
+ * \brief Loads the i-th vector of an SoA array into three registers, broadcasting it if \e broadcast is set
+ */
+template <typename P>
+MUSTINLINE void load3(const vector3_soa<const typename P::elt_type> &a, size_t i, bool broadcast,
+        typename P::reg *r) {
+    if (broadcast) {
+        r[0] = P::set1(a.x[i]);
+        r[1] = P::set1(a.y[i]);
+        r[2] = P::set1(a.z[i]);
+    } else {
+        r[0] = P::load(a.x + i);
+        r[1] = P::load(a.y + i);
+        r[2] = P::load(a.z + i);
+    }
+}
+
+/*!
+ * \brief Traces a packet of rays starting at ray \e i against all triangles. With \e closest unset stops at
+ * the first hit of every lane and only fills \e triangle.
+ */
+template <typename P>
+MUSTINLINE void ray_packet(const vector3_soa<const typename P::elt_type> &origins,
+        const vector3_soa<const typename P::elt_type> &dirs, const vector3_soa<const typename P::elt_type> &v0,
+        const vector3_soa<const typename P::elt_type> &v1, const vector3_soa<const typename P::elt_type> &v2,
+        typename P::elt_type tmin, typename P::elt_type tmax, bool closest, size_t i, typename P::elt_type *t,
+        typename P::elt_type *u, typename P::elt_type *v, int32_t *triangle) {
+    typedef typename P::reg reg;
+    const int all = (1 << P::width) - 1;
+    reg o[3], d[3];
+    load3<P>(origins, i, false, o);
+    load3<P>(dirs, i, false, d);
+    const reg lo = P::set1(tmin);
+    reg best = P::set1(tmax), bu = P::zero(), bv = P::zero();
+    int32_t index[P::width];
+    int found = 0;
+    for (int l = 0; l < P::width; ++l)
+        index[l] = -1;
+
+    for (size_t j = 0; j < v0.size; ++j) {
+        reg a[3], b[3], c[3], tj, uj, vj;
+        load3<P>(v0, j, true, a);
+        load3<P>(v1, j, true, b);
+        load3<P>(v2, j, true, c);
+        const typename P::mask m = moller_trumbore<P>(o, d, a, b, c, lo, best, tj, uj, vj);
+        int bits = P::movemask(m);
+        if (!closest)
+            bits &= ~found;     // occluded lanes keep their first hit
+        if (!bits)
+            continue;
+        for (int l = 0; l < P::width; ++l)
+            if (bits & (1 << l))
+                index[l] = static_cast<int32_t>(j);
+        if (closest) {
+            best = P::select(m, tj, best);
+            bu = P::select(m, uj, bu);
+            bv = P::select(m, vj, bv);
+        } else {
+            found |= bits;
+            if (found == all)
+                break;
+        }
+    }
+
+    if (!closest) {
+        for (int l = 0; l < P::width; ++l)
+            triangle[i + l] = index[l];
+        return;
+    }
+    typename P::elt_type buf[P::width];
+    P::store(buf, best);
+    P::store(u + i, bu);
+    P::store(v + i, bv);
+    for (int l = 0; l < P::width; ++l) {
+        t[i + l] = index[l] < 0 ? std::numeric_limits<typename P::elt_type>::infinity() : buf[l];
+        triangle[i + l] = index[l];
+    }
+}
+
+} // namespace vectors_internal
+
+/*!
+ * \brief Intersections of a single ray with an array of triangles. Eight (single precision) or four (double
+ * precision) triangles are tested at once.
+ * @param origin Origin of the ray, three coordinates
+ * @param dir Direction of the ray, three coordinates
+ * @param tmin Start of the ray interval
+ * @param tmax End of the ray interval
+ * @param v0 First corners of triangles
+ * @param v1 Second corners of triangles
+ * @param v2 Third corners of triangles
+ * @param t Output ray parameters of hit points, infinity for missed triangles
+ * @param u Output barycentric coordinates of \e v1, zero for missed triangles
+ * @param v Output barycentric coordinates of \e v2, zero for missed triangles
+ * @return Number of triangles hit by the ray
+ */
+template <typename T>
+size_t intersect_ray_triangles(const T *origin, const T *dir, T tmin, T tmax, typename vector3_soa_in<T>::type v0,
+        typename vector3_soa_in<T>::type v1, typename vector3_soa_in<T>::type v2, T *t, T *u, T *v) {
+    VECTORS_PROFILE("intersect_ray_triangles", v0.size);
+    typedef vectors_internal::simd_pack<T> P;
+    typedef vectors_internal::scalar_pack<T> S;
+    const typename P::reg o[3] = {P::set1(origin[0]), P::set1(origin[1]), P::set1(origin[2])};
+    const typename P::reg d[3] = {P::set1(dir[0]), P::set1(dir[1]), P::set1(dir[2])};
+    const typename P::reg lo = P::set1(tmin), hi = P::set1(tmax), inf = P::set1(std::numeric_limits<T>::infinity());
+    size_t hits = 0, i = 0;
+    for (; i + P::width <= v0.size; i += P::width) {
+        typename P::reg a[3], b[3], c[3], ti, ui, vi;
+        vectors_internal::load3<P>(v0, i, false, a);
+        vectors_internal::load3<P>(v1, i, false, b);
+        vectors_internal::load3<P>(v2, i, false, c);
+        const typename P::mask m = vectors_internal::moller_trumbore<P>(o, d, a, b, c, lo, hi, ti, ui, vi);
+        const int bits = P::movemask(m);
+        if (!bits) {
+            P::store(t + i, inf);
+            P::store(u + i, P::zero());
+            P::store(v + i, P::zero());
+            continue;
+        }
+        P::store(t + i, P::select(m, ti, inf));
+        P::store(u + i, P::select(m, ui, P::zero()));
+        P::store(v + i, P::select(m, vi, P::zero()));
+        hits += vectors_internal::compaction_lut().count[bits];
+    }
+    for (; i < v0.size; ++i) {
+        T a[3], b[3], c[3], ti = 0, ui = 0, vi = 0;
+        vectors_internal::load3<S>(v0, i, true, a);
+        vectors_internal::load3<S>(v1, i, true, b);
+        vectors_internal::load3<S>(v2, i, true, c);
+        const bool m = vectors_internal::moller_trumbore<S>(origin, dir, a, b, c, tmin, tmax, ti, ui, vi);
+        t[i] = m ? ti : std::numeric_limits<T>::infinity();
+        u[i] = m ? ui : T(0);
+        v[i] = m ? vi : T(0);
+        hits += m;
+    }
+    return hits;
+}
+
+/*!
+ * \brief Closest hits of rays with an array of triangles. Rays are traced in packets of eight (single
+ * precision) or four (double precision) against every triangle; packets are distributed between threads.
+ * @param origins Origins of rays
+ * @param dirs Directions of rays
+ * @param tmin Start of the ray intervals
+ * @param tmax End of the ray intervals
+ * @param v0 First corners of triangles
+ * @param v1 Second corners of triangles
+ * @param v2 Third corners of triangles
+ * @param t Output ray parameters of the closest hits, infinity for rays which miss all triangles
+ * @param u Output barycentric coordinates of the second corners at the closest hits
+ * @param v Output barycentric coordinates of the third corners at the closest hits
+ * @param triangle Output indices of the closest triangles, -1 for rays which miss all triangles
+ * @return Number of rays which hit a triangle
+ */
+template <typename T>
+size_t closest_hits(typename vector3_soa_in<T>::type origins, typename vector3_soa_in<T>::type dirs, T tmin,
+        T tmax, typename vector3_soa_in<T>::type v0, typename vector3_soa_in<T>::type v1,
+        typename vector3_soa_in<T>::type v2, T *t, T *u, T *v, int32_t *triangle) {
+    VECTORS_PROFILE("closest_hits", origins.size);
+    typedef vectors_internal::simd_pack<T> P;
+    typedef vectors_internal::scalar_pack<T> S;
+    const ptrdiff_t nregs = origins.size / P::width;
+
+    VECTORS_OMP(parallel for schedule(dynamic, 16) if(nregs > 1 && origins.size * v0.size > 65536))
+    for (ptrdiff_t r = 0; r < nregs; ++r)
+        vectors_internal::ray_packet<P>(origins, dirs, v0, v1, v2, tmin, tmax, true, r * P::width, t, u, v,
+            triangle);
+    for (size_t i = nregs * P::width; i < origins.size; ++i)
+        vectors_internal::ray_packet<S>(origins, dirs, v0, v1, v2, tmin, tmax, true, i, t, u, v, triangle);
+
+    size_t hits = 0;
+    for (size_t i = 0; i < origins.size; ++i)
+        hits += triangle[i] >= 0;
+    return hits;
+}
+
+/*!
+ * \brief Visibility test of rays: finds any triangle hit within the ray interval. A packet of rays stops
+ * testing triangles as soon as all its rays are occluded.
+ * @param origins Origins of rays
+ * @param dirs Directions of rays
+ * @param tmin Start of the ray intervals
+ * @param tmax End of the ray intervals, e.g. 1 for rays from a point to a light with dir = light - point
+ * @param v0 First corners of triangles
+ * @param v1 Second corners of triangles
+ * @param v2 Third corners of triangles
+ * @param triangle Output indices of occluding triangles (not necessarily the closest ones), -1 for visible rays
+ * @return Number of occluded rays
+ */
+template <typename T>
+size_t occluded_rays(typename vector3_soa_in<T>::type origins, typename vector3_soa_in<T>::type dirs, T tmin,
+        T tmax, typename vector3_soa_in<T>::type v0, typename vector3_soa_in<T>::type v1,
+        typename vector3_soa_in<T>::type v2, int32_t *triangle) {
+    VECTORS_PROFILE("occluded_rays", origins.size);
+    typedef vectors_internal::simd_pack<T> P;
+    typedef vectors_internal::scalar_pack<T> S;
+    const ptrdiff_t nregs = origins.size / P::width;
+
+    VECTORS_OMP(parallel for schedule(dynamic, 16) if(nregs > 1 && origins.size * v0.size > 65536))
+    for (ptrdiff_t r = 0; r < nregs; ++r)
+        vectors_internal::ray_packet<P>(origins, dirs, v0, v1, v2, tmin, tmax, false, r * P::width,
+            static_cast<T *>(0), static_cast<T *>(0), static_cast<T *>(0), triangle);
+    for (size_t i = nregs * P::width; i < origins.size; ++i)
+        vectors_internal::ray_packet<S>(origins, dirs, v0, v1, v2, tmin, tmax, false, i, static_cast<T *>(0),
+            static_cast<T *>(0), static_cast<T *>(0), triangle);
+
+    size_t hits = 0;
+    for (size_t i = 0; i < origins.size; ++i)
+        hits += triangle[i] >= 0;
+    return hits;
+}
+
+#endif /* VECTORSRAY_H_ */
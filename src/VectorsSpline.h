@@ -0,0 +1,412 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTORSSPLINE_H_
+#define VECTORSSPLINE_H_
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include "VectorsInternal.h"
+#include "VectorsPack.h"
+#include "VectorsProfiler.h"
+#include "VectorsTrig.h"
+#include "Vector3_soa.h"
+
+/*
+ * Interpolation and spline evaluation over SoA arrays. Piecewise cubic splines are evaluated at arrays of
+ * global parameters u: the integer part selects the segment and the fractional part is the local parameter
+ * t in [0, 1]. Parameters outside of [0, number of segments] are clamped to the ends of the curve, and NaN
+ * parameters give its start. Control points of all lanes are fetched with hardware gathers, and the basis
+ * polynomials are evaluated with FMA.
+ */
+
+namespace vectors_internal {
+
+/*!
+ * \brief Splits global parameters into segment indices and local parameters
+ * @param u Global parameters
+ * @param nseg Number of segments, at least one
+ * @param seg Output segment indices
+ * @return Local parameters in [0, 1]
+ */
+template <typename P>
+MUSTINLINE typename P::reg spline_locate(typename P::reg u, int32_t nseg, int32_t *seg) {
+    typedef typename P::elt_type T;
+    // Ordered comparison fails for NaN, so NaN parameters go to the start of the curve on every backend
+    u = P::min(P::select(P::cmp_ge(u, P::zero()), u, P::zero()), P::set1(static_cast<T>(nseg)));
+    T s[P::width];
+    P::store(s, P::floor(u));
+    for (int l = 0; l < P::width; ++l) {
+        // The end of the curve belongs to the last segment
+        seg[l] = s[l] > 0 ? std::min(static_cast<int32_t>(s[l]), nseg - 1) : 0;
+        s[l] = static_cast<T>(seg[l]);
+    }
+    return P::sub(u, P::load(s));
+}
+
+/*!
+ * \brief Adds w * p[idx] to the accumulated coordinates
+ */
+template <typename P>
+MUSTINLINE void spline_accumulate(const vector3_soa<const typename P::elt_type> &p, const int32_t *idx,
+        typename P::reg w, typename P::reg *acc) {
+    acc[0] = P::fmadd(w, P::gather(p.x, idx), acc[0]);
+    acc[1] = P::fmadd(w, P::gather(p.y, idx), acc[1]);
+    acc[2] = P::fmadd(w, P::gather(p.z, idx), acc[2]);
+}
+
+template <typename P>
+MUSTINLINE void spline_store(const vector3_soa<typename P::elt_type> &out, size_t i, const typename P::reg *acc) {
+    P::store(out.x + i, acc[0]);
+    P::store(out.y + i, acc[1]);
+    P::store(out.z + i, acc[2]);
+}
+
+/*!
+ * \brief Weights of the four control points of a uniform Catmull-Rom segment at local parameters \e t
+ */
+template <typename P>
+MUSTINLINE void catmull_rom_weights(typename P::reg t, typename P::reg *w) {
+    typedef typename P::elt_type T;
+    const typename P::reg half = P::set1(T(0.5));
+    w[0] = P::mul(P::fmadd(P::fnmadd(half, t, P::set1(T(1))), t, P::set1(T(-0.5))), t);
+    w[1] = P::fmadd(P::mul(P::fmadd(P::set1(T(1.5)), t, P::set1(T(-2.5))), t), t, P::set1(T(1)));
+    w[2] = P::mul(P::fmadd(P::fmadd(P::set1(T(-1.5)), t, P::set1(T(2))), t, half), t);
+    w[3] = P::mul(P::mul(P::fmadd(half, t, P::set1(T(-0.5))), t), t);
+}
+
+template <typename T>
+struct lerp_kernel {
+    vector3_soa<const T> a, b;
+    const T *t;
+    vector3_soa<T> out;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        const typename P::reg tt = P::load(t + i);
+        const typename P::reg ax = P::load(a.x + i), ay = P::load(a.y + i), az = P::load(a.z + i);
+        P::store(out.x + i, P::fmadd(tt, P::sub(P::load(b.x + i), ax), ax));
+        P::store(out.y + i, P::fmadd(tt, P::sub(P::load(b.y + i), ay), ay));
+        P::store(out.z + i, P::fmadd(tt, P::sub(P::load(b.z + i), az), az));
+    }
+};
+
+template <typename T>
+struct slerp_kernel {
+    vector3_soa<const T> a, b;
+    const T *t;
+    vector3_soa<T> out;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        typedef typename P::reg reg;
+        const reg tt = P::load(t + i);
+        const reg ax = P::load(a.x + i), ay = P::load(a.y + i), az = P::load(a.z + i);
+        const reg bx = P::load(b.x + i), by = P::load(b.y + i), bz = P::load(b.z + i);
+        const reg d = P::fmadd(az, bz, P::fmadd(ay, by, P::mul(ax, bx)));
+        const reg cx = P::fnmadd(az, by, P::mul(ay, bz));
+        const reg cy = P::fnmadd(ax, bz, P::mul(az, bx));
+        const reg cz = P::fnmadd(ay, bx, P::mul(ax, by));
+        const reg sn = P::sqrt(P::fmadd(cz, cz, P::fmadd(cy, cy, P::mul(cx, cx))));
+
+        // Weights sin((1 - t) w) / sin(w) and sin(t w) / sin(w). The angle is taken from both its sine and
+        // cosine, which is accurate for small angles as well.
+        const reg one = P::set1(T(1)), w = atan2<P>(sn, d);
+        reg sa, sb, unused;
+        sincos<P>(P::mul(P::sub(one, tt), w), sa, unused);
+        sincos<P>(P::mul(tt, w), sb, unused);
+        const reg inv = P::div(one, sn);
+
+        // Nearly parallel and nearly antiparallel vectors, whose sine is lost in rounding, are interpolated
+        // linearly; an antiparallel pair spans no unique plane, so the path passes through the origin there
+        const typename P::mask arc = P::cmp_gt(sn,
+            P::mul(P::set1(std::numeric_limits<T>::epsilon()), P::sqrt(P::fmadd(d, d, P::mul(sn, sn)))));
+        const reg va = P::select(arc, P::mul(sa, inv), P::sub(one, tt));
+        const reg vb = P::select(arc, P::mul(sb, inv), tt);
+        P::store(out.x + i, P::fmadd(vb, bx, P::mul(va, ax)));
+        P::store(out.y + i, P::fmadd(vb, by, P::mul(va, ay)));
+        P::store(out.z + i, P::fmadd(vb, bz, P::mul(va, az)));
+    }
+};
+
+/*!
+ * \brief Uniform Catmull-Rom spline through all points; end segments reuse the end points as outer controls
+ */
+template <typename T>
+struct catmull_rom_kernel {
+    vector3_soa<const T> p;
+    const T *u;
+    vector3_soa<T> out;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        typedef typename P::reg reg;
+        const int32_t last = static_cast<int32_t>(p.size - 1);
+        int32_t seg[P::width], idx[P::width];
+        const reg t = spline_locate<P>(P::load(u + i), last, seg);
+        reg w[4];
+        catmull_rom_weights<P>(t, w);
+
+        reg acc[3] = {P::zero(), P::zero(), P::zero()};
+        for (int k = 0; k < 4; ++k) {
+            for (int l = 0; l < P::width; ++l)
+                idx[l] = std::min(std::max(seg[l] + k - 1, 0), last);
+            spline_accumulate<P>(p, idx, w[k], acc);
+        }
+        spline_store<P>(out, i, acc);
+    }
+};
+
+/*!
+ * \brief Piecewise cubic Bezier curve; segment s uses control points 3s ... 3s + 3
+ */
+template <typename T>
+struct bezier_kernel {
+    vector3_soa<const T> p;
+    const T *u;
+    vector3_soa<T> out;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        typedef typename P::reg reg;
+        int32_t seg[P::width], idx[P::width];
+        const reg t = spline_locate<P>(P::load(u + i), static_cast<int32_t>((p.size - 1) / 3), seg);
+        const reg s = P::sub(P::set1(T(1)), t), three = P::set1(T(3));
+        const reg t2 = P::mul(t, t), s2 = P::mul(s, s);
+        reg w[4];
+        w[0] = P::mul(s2, s);
+        w[1] = P::mul(P::mul(three, t), s2);
+        w[2] = P::mul(P::mul(three, t2), s);
+        w[3] = P::mul(t2, t);
+
+        reg acc[3] = {P::zero(), P::zero(), P::zero()};
+        for (int k = 0; k < 4; ++k) {
+            for (int l = 0; l < P::width; ++l)
+                idx[l] = 3 * seg[l] + k;
+            spline_accumulate<P>(p, idx, w[k], acc);
+        }
+        spline_store<P>(out, i, acc);
+    }
+};
+
+/*!
+ * \brief Cubic Hermite spline through points with given tangents
+ */
+template <typename T>
+struct hermite_kernel {
+    vector3_soa<const T> p, m;
+    const T *u;
+    vector3_soa<T> out;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        typedef typename P::reg reg;
+        int32_t seg[P::width], next[P::width];
+        const reg t = spline_locate<P>(P::load(u + i), static_cast<int32_t>(p.size - 1), seg);
+        const reg one = P::set1(T(1)), t2 = P::mul(t, t);
+        const reg h00 = P::fmadd(P::fmadd(P::set1(T(2)), t, P::set1(T(-3))), t2, one);
+        const reg h10 = P::mul(P::fmadd(P::add(t, P::set1(T(-2))), t, one), t);
+        const reg h01 = P::mul(P::fnmadd(P::set1(T(2)), t, P::set1(T(3))), t2);
+        const reg h11 = P::mul(P::sub(t, one), t2);
+        for (int l = 0; l < P::width; ++l)
+            next[l] = seg[l] + 1;
+
+        reg acc[3] = {P::zero(), P::zero(), P::zero()};
+        spline_accumulate<P>(p, seg, h00, acc);
+        spline_accumulate<P>(m, seg, h10, acc);
+        spline_accumulate<P>(p, next, h01, acc);
+        spline_accumulate<P>(m, next, h11, acc);
+        spline_store<P>(out, i, acc);
+    }
+};
+
+} // namespace vectors_internal
+
+/*!
+ * \brief Linear interpolation a + t (b - a) of corresponding vectors
+ * @param a Vectors at t = 0
+ * @param b Vectors at t = 1
+ * @param t Interpolation parameters, one per vector
+ * @param out Output vectors, may alias \e a or \e b
+ */
+template <typename T>
+void batch_lerp(typename vector3_soa_in<T>::type a, typename vector3_soa_in<T>::type b, const T *t,
+        vector3_soa<T> out) {
+    VECTORS_PROFILE("batch_lerp", a.size);
+    vectors_internal::lerp_kernel<T> k = {a, b, t, out};
+    vectors_internal::pack_for<T>(a.size, k);
+}
+
+/*!
+ * \brief Spherical linear interpolation of corresponding unit vectors with constant angular velocity.
+ * Nearly parallel vectors are interpolated linearly. Antiparallel vectors span no unique plane of rotation:
+ * when their cross product vanishes in rounding they are interpolated linearly as well, through the origin,
+ * and near that limit the result loses accuracy in proportion to 1 / sin(w).
+ * @param a Unit vectors at t = 0
+ * @param b Unit vectors at t = 1
+ * @param t Interpolation parameters, one per vector
+ * @param out Output vectors, may alias \e a or \e b
+ */
+template <typename T>
+void batch_slerp(typename vector3_soa_in<T>::type a, typename vector3_soa_in<T>::type b, const T *t,
+        vector3_soa<T> out) {
+    VECTORS_PROFILE("batch_slerp", a.size);
+    vectors_internal::slerp_kernel<T> k = {a, b, t, out};
+    vectors_internal::pack_for<T>(a.size, k);
+}
+
+/*!
+ * \brief Evaluates the uniform Catmull-Rom spline passing through all points. Segment s runs from point s
+ * to point s + 1 for u in [s, s + 1].
+ * @param points Points of the curve, at least two
+ * @param u Parameters in [0, points.size - 1]
+ * @param count Number of parameters
+ * @param out Output positions, \e count vectors
+ */
+template <typename T>
+void spline_catmull_rom(typename vector3_soa_in<T>::type points, const T *u, size_t count, vector3_soa<T> out) {
+    VECTORS_PROFILE("spline_catmull_rom", count);
+    if (points.size < 2)
+        return;
+    vectors_internal::catmull_rom_kernel<T> k = {points, u, out};
+    vectors_internal::pack_for<T>(count, k);
+}
+
+/*!
+ * \brief Evaluates a piecewise cubic Bezier curve. Segment s uses control points 3s ... 3s + 3 and is
+ * traversed for u in [s, s + 1].
+ * @param points Control points, 3 * (number of segments) + 1 of them
+ * @param u Parameters in [0, (points.size - 1) / 3]
+ * @param count Number of parameters
+ * @param out Output positions, \e count vectors
+ */
+template <typename T>
+void spline_bezier(typename vector3_soa_in<T>::type points, const T *u, size_t count, vector3_soa<T> out) {
+    VECTORS_PROFILE("spline_bezier", count);
+    if (points.size < 4)
+        return;
+    vectors_internal::bezier_kernel<T> k = {points, u, out};
+    vectors_internal::pack_for<T>(count, k);
+}
+
+/*!
+ * \brief Evaluates the cubic Hermite spline through points with given tangents (derivatives with respect
+ * to u). Segment s runs from point s to point s + 1 for u in [s, s + 1].
+ * @param points Points of the curve, at least two
+ * @param tangents Tangents at the points
+ * @param u Parameters in [0, points.size - 1]
+ * @param count Number of parameters
+ * @param out Output positions, \e count vectors
+ */
+template <typename T>
+void spline_hermite(typename vector3_soa_in<T>::type points, typename vector3_soa_in<T>::type tangents,
+        const T *u, size_t count, vector3_soa<T> out) {
+    VECTORS_PROFILE("spline_hermite", count);
+    if (points.size < 2)
+        return;
+    vectors_internal::hermite_kernel<T> k = {points, tangents, u, out};
+    vectors_internal::pack_for<T>(count, k);
+}
+
+/*!
+ * \class arc_length_table
+ * \brief Mapping between the arc length of a curve and its parameter, used to move along a spline with
+ * constant speed. Built from positions sampled at uniformly spaced parameters (e.g. with spline_catmull_rom());
+ * the curve is approximated by the polyline through the samples.
+ */
+template <typename T>
+class arc_length_table {
+public:
+    /*!
+     * \brief Constructor
+     * @param samples Curve positions at parameters u0 + k (u1 - u0) / (samples.size - 1), at least two
+     * @param u0 Parameter of the first sample
+     * @param u1 Parameter of the last sample
+     */
+    arc_length_table(typename vector3_soa_in<T>::type samples, T u0, T u1) :
+        cumulative(samples.size > 1 ? samples.size : 2, T(0)), u0(u0),
+        step((u1 - u0) / static_cast<T>(cumulative.size() - 1)) {
+        double sum = 0;
+        for (size_t k = 1; k < samples.size; ++k) {
+            const double dx = samples.x[k] - samples.x[k - 1];
+            const double dy = samples.y[k] - samples.y[k - 1];
+            const double dz = samples.z[k] - samples.z[k - 1];
+            sum += std::sqrt(dx * dx + dy * dy + dz * dz);
+            cumulative[k] = static_cast<T>(sum);
+        }
+    }
+
+    /*!
+     * \brief Total length of the curve
+     */
+    T length() const { return cumulative.back(); }
+
+    /*!
+     * \brief Parameters at given arc lengths from the start of the curve
+     * @param s Arc lengths, clamped to [0, length()]
+     * @param u Output parameters
+     * @param count Number of values
+     */
+    void parameters(const T *s, T *u, size_t count) const {
+        VECTORS_PROFILE("arc_length_table::parameters", count);
+        const ptrdiff_t n = count;
+        VECTORS_OMP(parallel for schedule(static) if(n > 65536))
+        for (ptrdiff_t i = 0; i < n; ++i)
+            u[i] = parameter(s[i]);
+    }
+
+    /*!
+     * \brief Parameters of \e count points spaced uniformly along the curve, including both ends
+     * @param count Number of points, at least two
+     * @param u Output parameters
+     */
+    void uniform_parameters(size_t count, T *u) const {
+        VECTORS_PROFILE("arc_length_table::uniform_parameters", count);
+        const ptrdiff_t n = count;
+        const T ds = count > 1 ? length() / static_cast<T>(count - 1) : T(0);
+        VECTORS_OMP(parallel for schedule(static) if(n > 65536))
+        for (ptrdiff_t i = 0; i < n; ++i)
+            u[i] = parameter(ds * static_cast<T>(i));
+    }
+
+private:
+    std::vector<T> cumulative;  //!< Arc length at every sample
+    T u0;                       //!< Parameter of the first sample
+    T step;                     //!< Parameter increment between samples
+
+    T parameter(T s) const {
+        const size_t last = cumulative.size() - 1;
+        if (!(s > 0))
+            return u0;
+        if (s >= cumulative[last])
+            return u0 + step * static_cast<T>(last);
+        const size_t k = std::upper_bound(cumulative.begin(), cumulative.end(), s) - cumulative.begin() - 1;
+        const T len = cumulative[k + 1] - cumulative[k];
+        const T f = len > 0 ? (s - cumulative[k]) / len : T(0);
+        return u0 + step * (static_cast<T>(k) + f);
+    }
+};
+
+#endif /* VECTORSSPLINE_H_ */
@@ -0,0 +1,216 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTORSSTREAM_H_
+#define VECTORSSTREAM_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "VectorsInternal.h"
+#include "VectorsTranspose.h"
+#include "Vector3_soa.h"
+
+namespace vectors_internal {
+
+/*!
+ * \class buffer_queue
+ * \brief Blocking FIFO of buffer numbers passed between the threads of a pipeline
+ */
+class buffer_queue {
+public:
+    void push(int buffer) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(buffer);
+        }
+        ready.notify_one();
+    }
+
+    int pop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (queue.empty())
+            ready.wait(lock);
+        const int buffer = queue.front();
+        queue.pop_front();
+        return buffer;
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<int> queue;
+};
+
+} // namespace vectors_internal
+
+/*!
+ * \class point_pipeline
+ * \brief Streaming processing of point sets which do not fit into memory. Points are read in chunks of packed
+ * xyz triples, converted to SoA, passed through a chain of stages and converted back for writing. Reading and
+ * writing run in two background threads on double buffers, so I/O of the neighbouring chunks overlaps with the
+ * computation; all stages of a chunk run one after another while the chunk is still in cache. Stages are
+ * called from the thread calling run(), in the order of chunks, so they may accumulate reductions without
+ * locking and may use the OpenMP parallel batch kernels. Chunks should fit into the L2 cache together with
+ * their SoA copy; larger ones are still processed correctly but lose the benefit of a single pass.
+ */
+template <typename T>
+class point_pipeline {
+public:
+    typedef T elt_type;
+
+    /*!
+     * \brief Reads up to \e capacity points as packed triples into the buffer and returns their number;
+     * zero ends the stream
+     */
+    typedef std::function<size_t(T *, size_t)> source;
+
+    /*!
+     * \brief Receives \e count processed points as packed triples
+     */
+    typedef std::function<void(const T *, size_t)> sink;
+
+    /*!
+     * \brief Processes a chunk in place and returns the number of points kept; kept points should be moved to
+     * the front of the chunk (as the filter kernels do)
+     */
+    typedef std::function<size_t(vector3_soa<T>)> stage;
+
+    /*!
+     * \brief Constructor
+     * @param chunk_size Number of points in a chunk
+     */
+    explicit point_pipeline(size_t chunk_size = 65536) : chunk(chunk_size ? chunk_size : 1) { }
+
+    /*!
+     * \brief Appends a stage to the chain
+     * @return Reference to \e this pipeline
+     */
+    point_pipeline &then(const stage &s) {
+        stages.push_back(s);
+        return *this;
+    }
+
+    /*!
+     * \brief Runs the pipeline until the source is exhausted. An exception thrown by the source, a stage or the
+     * sink stops the pipeline and is rethrown here once both background threads have finished.
+     * @param read Source of points
+     * @param write Sink of processed points; may be empty if the stages only compute reductions
+     * @return Number of points which passed all stages
+     */
+    size_t run(const source &read, const sink &write = sink()) {
+        std::vector<T> input[2], output[2];
+        size_t count[2] = {0, 0}, kept[2] = {0, 0};
+        std::vector<T> soa(3 * chunk);
+        const vector3_soa<T> points(&soa[0], &soa[chunk], &soa[2 * chunk], chunk);
+        vectors_internal::buffer_queue in_free, in_full, out_free, out_full;
+        std::exception_ptr read_error, write_error, stage_error;
+        std::atomic<bool> stop(false);
+        for (int b = 0; b < 2; ++b) {
+            input[b].resize(3 * chunk);
+            in_free.push(b);
+            if (write) {
+                output[b].resize(3 * chunk);
+                out_free.push(b);
+            }
+        }
+
+        // Empty chunk marks the end of the input, buffer -1 the end of the output
+        std::thread reader([&]() {
+            for (;;) {
+                const int b = in_free.pop();
+                size_t n = 0;
+                if (!stop) {
+                    try {
+                        n = std::min(read(&input[b][0], chunk), chunk);
+                    } catch (...) {
+                        read_error = std::current_exception();
+                    }
+                }
+                count[b] = n;
+                in_full.push(b);
+                if (!n)
+                    return;
+            }
+        });
+        std::thread writer([&]() {
+            for (int b; (b = out_full.pop()) >= 0; out_free.push(b)) {
+                if (write_error)
+                    continue;
+                try {
+                    write(&output[b][0], kept[b]);
+                } catch (...) {
+                    write_error = std::current_exception();
+                    stop = true;
+                }
+            }
+        });
+
+        size_t total = 0;
+        for (int b; count[b = in_full.pop()]; in_free.push(b)) {
+            if (stop)
+                continue;
+            vector3_soa<T> part = points.sub(0, count[b]);
+            aos_to_soa<T>(&input[b][0], part);
+            try {
+                for (size_t s = 0; s < stages.size() && part.size; ++s)
+                    part.size = std::min(stages[s](part), part.size);
+            } catch (...) {
+                stage_error = std::current_exception();
+                stop = true;
+                continue;
+            }
+            total += part.size;
+            if (write && part.size) {
+                const int o = out_free.pop();
+                kept[o] = part.size;
+                soa_to_aos<T>(part, &output[o][0]);
+                out_full.push(o);
+            }
+        }
+        out_full.push(-1);
+        reader.join();
+        writer.join();
+
+        if (read_error)
+            std::rethrow_exception(read_error);
+        if (stage_error)
+            std::rethrow_exception(stage_error);
+        if (write_error)
+            std::rethrow_exception(write_error);
+        return total;
+    }
+
+private:
+    size_t chunk;                   //!< Number of points in a chunk
+    std::vector<stage> stages;      //!< Chain of stages
+};
+
+#endif /* VECTORSSTREAM_H_ */
@@ -0,0 +1,436 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTORSSUPERPOSE_H_
+#define VECTORSSUPERPOSE_H_
+
+#include <type_traits>
+#include "VectorsInternal.h"
+#include "VectorsPack.h"
+#include "VectorsProfiler.h"
+#include "Vector3_soa.h"
+
+/*
+ * Optimal superposition of two point sets (Kabsch problem). The covariance matrix of the centered sets is
+ * accumulated with SIMD registers, then the optimal rotation and the RMSD are obtained with the quaternion
+ * characteristic polynomial (QCP) method of Theobald (2005) and Liu, Agrafiotis, Theobald (2010): the largest
+ * eigenvalue of the 4x4 key matrix is found with a few Newton iterations and the rotation quaternion is
+ * taken from the adjoint of the shifted matrix, which avoids a general eigen-decomposition or SVD. Only when
+ * the largest eigenvalue is degenerate (collinear structures, for instance), so that the adjoint vanishes, the
+ * eigenvector is found by Jacobi rotations of the key matrix instead.
+ *
+ * RMSD is derived from the eigenvalue, so values smaller than about sqrt(epsilon) times the size of the
+ * structures are not resolved (e.g. identical structures give ~1e-8 in double precision).
+ */
+
+/*!
+ * \brief Result of superposition of a mobile point set onto a target one
+ */
+template <typename T>
+struct superposition {
+    T transform[12];    //!< Row-major 3x4 matrix [R | t]: R * mobile + t is the best fit of target
+    T rmsd;             //!< Root mean square deviation after the fit
+};
+
+namespace vectors_internal {
+
+/*!
+ * \brief Sums of coordinates of both point sets. Partial sums are independent of the register width, so all
+ * backends give the same result.
+ */
+template <typename P, typename T>
+MUSTINLINE void superposition_centroid(const vector3_soa<const T> &a, const vector3_soa<const T> &b, T *sum) {
+    typedef lane_sum<P> L;
+    L s[6];
+    size_t i = 0;
+    for (; i + reduction_lanes <= a.size; i += reduction_lanes) {
+        for (int r = 0; r < L::regs; ++r) {
+            const size_t j = i + r * P::width;
+            s[0].add(r, P::load(a.x + j));
+            s[1].add(r, P::load(a.y + j));
+            s[2].add(r, P::load(a.z + j));
+            s[3].add(r, P::load(b.x + j));
+            s[4].add(r, P::load(b.y + j));
+            s[5].add(r, P::load(b.z + j));
+        }
+    }
+    for (int k = 0; k < 6; ++k)
+        sum[k] = s[k].total();
+    for (; i < a.size; ++i) {
+        sum[0] += a.x[i];
+        sum[1] += a.y[i];
+        sum[2] += a.z[i];
+        sum[3] += b.x[i];
+        sum[4] += b.y[i];
+        sum[5] += b.z[i];
+    }
+}
+
+/*!
+ * \brief Covariance matrix M[3 * j + k] = sum b_j a_k of centered point sets followed by the sums of squared
+ * norms of \e a and \e b
+ */
+template <typename P, typename T>
+MUSTINLINE void superposition_covariance(const vector3_soa<const T> &a, const vector3_soa<const T> &b,
+        const T *center, T *sum) {
+    typedef typename P::reg reg;
+    typedef lane_sum<P> L;
+    const reg cax = P::set1(center[0]), cay = P::set1(center[1]), caz = P::set1(center[2]);
+    const reg cbx = P::set1(center[3]), cby = P::set1(center[4]), cbz = P::set1(center[5]);
+    L s[11];
+    size_t i = 0;
+    for (; i + reduction_lanes <= a.size; i += reduction_lanes) {
+        for (int r = 0; r < L::regs; ++r) {
+            const size_t j = i + r * P::width;
+            const reg ax = P::sub(P::load(a.x + j), cax);
+            const reg ay = P::sub(P::load(a.y + j), cay);
+            const reg az = P::sub(P::load(a.z + j), caz);
+            const reg bx = P::sub(P::load(b.x + j), cbx);
+            const reg by = P::sub(P::load(b.y + j), cby);
+            const reg bz = P::sub(P::load(b.z + j), cbz);
+            s[0].fmadd(r, bx, ax);
+            s[1].fmadd(r, bx, ay);
+            s[2].fmadd(r, bx, az);
+            s[3].fmadd(r, by, ax);
+            s[4].fmadd(r, by, ay);
+            s[5].fmadd(r, by, az);
+            s[6].fmadd(r, bz, ax);
+            s[7].fmadd(r, bz, ay);
+            s[8].fmadd(r, bz, az);
+            s[9].fmadd(r, ax, ax);
+            s[9].fmadd(r, ay, ay);
+            s[9].fmadd(r, az, az);
+            s[10].fmadd(r, bx, bx);
+            s[10].fmadd(r, by, by);
+            s[10].fmadd(r, bz, bz);
+        }
+    }
+    for (int k = 0; k < 11; ++k)
+        sum[k] = s[k].total();
+
+    // The tail goes through the same pack operations with a single element
+    typedef scalar_pack<T> S;
+    for (; i < a.size; ++i) {
+        const T ax = a.x[i] - center[0], ay = a.y[i] - center[1], az = a.z[i] - center[2];
+        const T bx = b.x[i] - center[3], by = b.y[i] - center[4], bz = b.z[i] - center[5];
+        sum[0] = S::fmadd(bx, ax, sum[0]);
+        sum[1] = S::fmadd(bx, ay, sum[1]);
+        sum[2] = S::fmadd(bx, az, sum[2]);
+        sum[3] = S::fmadd(by, ax, sum[3]);
+        sum[4] = S::fmadd(by, ay, sum[4]);
+        sum[5] = S::fmadd(by, az, sum[5]);
+        sum[6] = S::fmadd(bz, ax, sum[6]);
+        sum[7] = S::fmadd(bz, ay, sum[7]);
+        sum[8] = S::fmadd(bz, az, sum[8]);
+        sum[9] = S::fmadd(az, az, S::fmadd(ay, ay, S::fmadd(ax, ax, sum[9])));
+        sum[10] = S::fmadd(bz, bz, S::fmadd(by, by, S::fmadd(bx, bx, sum[10])));
+    }
+}
+
+/*!
+ * \brief Largest eigenvalue of a symmetric 4x4 matrix and its unit eigenvector by cyclic Jacobi rotations, for
+ * key matrices whose largest eigenvalue is degenerate, where every column of the adjoint vanishes
+ * @param k Row-major matrix
+ * @param q Output eigenvector
+ * @return Largest eigenvalue
+ */
+inline double key_eigenvector(const double *k, double *q) {
+    double m[4][4], v[4][4];
+    double scale = 0;
+    for (int i = 0; i < 4; ++i)
+        for (int j = 0; j < 4; ++j) {
+            m[i][j] = k[4 * i + j];
+            v[i][j] = i == j;
+            scale += m[i][j] * m[i][j];
+        }
+
+    for (int sweep = 0; sweep < 32; ++sweep) {
+        double off = 0;
+        for (int p = 0; p < 3; ++p)
+            for (int r = p + 1; r < 4; ++r)
+                off += m[p][r] * m[p][r];
+        if (!(off > 1e-32 * scale))
+            break;
+        for (int p = 0; p < 3; ++p) {
+            for (int r = p + 1; r < 4; ++r) {
+                if (m[p][r] == 0)
+                    continue;
+                // Rotation in the (p, r) plane which zeroes m[p][r], with the smaller of the two angles
+                const double theta = (m[r][r] - m[p][p]) / (2 * m[p][r]);
+                const double t = (theta < 0 ? -1 : 1) / (std::fabs(theta) + std::sqrt(theta * theta + 1));
+                const double c = 1 / std::sqrt(t * t + 1), s = t * c;
+                for (int i = 0; i < 4; ++i) {
+                    const double mip = m[i][p], mir = m[i][r];
+                    m[i][p] = c * mip - s * mir;
+                    m[i][r] = s * mip + c * mir;
+                    const double vip = v[i][p], vir = v[i][r];
+                    v[i][p] = c * vip - s * vir;
+                    v[i][r] = s * vip + c * vir;
+                }
+                for (int i = 0; i < 4; ++i) {
+                    const double mpi = m[p][i], mri = m[r][i];
+                    m[p][i] = c * mpi - s * mri;
+                    m[r][i] = s * mpi + c * mri;
+                }
+            }
+        }
+    }
+
+    int top = 0;
+    for (int i = 1; i < 4; ++i)
+        if (m[i][i] > m[top][top])
+            top = i;
+    for (int i = 0; i < 4; ++i)
+        q[i] = v[i][top];
+    return m[top][top];
+}
+
+/*!
+ * \brief Largest eigenvalue of the QCP key matrix and, optionally, the corresponding rotation
+ * @param m Covariance matrix sum b_j a_k
+ * @param e0 Half of the sum of squared norms of both centered sets
+ * @param rot Output row-major rotation applied to \e a, or null
+ * @return Largest eigenvalue
+ */
+inline double qcp_solve(const double *m, double e0, double *rot) {
+    // The key matrix is normalized by e0, so that the polynomial and the adjoint below neither overflow nor
+    // underflow and the threshold of the eigenvector is relative to the size of the structures
+    const double norm = e0 > 0.0 ? e0 : 1.0, inv_norm = 1.0 / norm;
+    const double sxx = m[0] * inv_norm, sxy = m[1] * inv_norm, sxz = m[2] * inv_norm;
+    const double syx = m[3] * inv_norm, syy = m[4] * inv_norm, syz = m[5] * inv_norm;
+    const double szx = m[6] * inv_norm, szy = m[7] * inv_norm, szz = m[8] * inv_norm;
+
+    const double sxx2 = sxx * sxx, syy2 = syy * syy, szz2 = szz * szz;
+    const double sxy2 = sxy * sxy, syz2 = syz * syz, sxz2 = sxz * sxz;
+    const double syx2 = syx * syx, szy2 = szy * szy, szx2 = szx * szx;
+
+    const double syzszymsyyszz2 = 2.0 * (syz * szy - syy * szz);
+    const double sxx2syy2szz2syz2szy2 = syy2 + szz2 - sxx2 + syz2 + szy2;
+    const double sxy2sxz2syx2szx2 = sxy2 + sxz2 - syx2 - szx2;
+
+    const double sxzpszx = sxz + szx, syzpszy = syz + szy, sxypsyx = sxy + syx;
+    const double syzmszy = syz - szy, sxzmszx = sxz - szx, sxymsyx = sxy - syx;
+    const double sxxpsyy = sxx + syy, sxxmsyy = sxx - syy;
+
+    // Coefficients of the characteristic polynomial x^4 + c2 x^2 + c1 x + c0
+    const double c2 = -2.0 * (sxx2 + syy2 + szz2 + sxy2 + syx2 + sxz2 + szx2 + syz2 + szy2);
+    const double c1 = 8.0 * (sxx * syz * szy + syy * szx * sxz + szz * sxy * syx
+        - sxx * syy * szz - syz * szx * sxy - szy * syx * sxz);
+    const double c0 = sxy2sxz2syx2szx2 * sxy2sxz2syx2szx2
+        + (sxx2syy2szz2syz2szy2 + syzszymsyyszz2) * (sxx2syy2szz2syz2szy2 - syzszymsyyszz2)
+        + (-sxzpszx * syzmszy + sxymsyx * (sxxmsyy - szz)) * (-sxzmszx * syzpszy + sxymsyx * (sxxmsyy + szz))
+        + (-sxzpszx * syzpszy - sxypsyx * (sxxpsyy - szz)) * (-sxzmszx * syzmszy - sxypsyx * (sxxpsyy + szz))
+        + (sxypsyx * syzpszy + sxzpszx * (sxxmsyy + szz)) * (-sxymsyx * syzmszy + sxzpszx * (sxxpsyy + szz))
+        + (sxypsyx * syzmszy + sxzmszx * (sxxmsyy - szz)) * (-sxymsyx * syzpszy + sxzmszx * (sxxpsyy - szz));
+
+    // Newton iterations starting from the upper bound of the eigenvalue
+    double lambda = e0 * inv_norm;
+    for (int it = 0; it < 50; ++it) {
+        const double old = lambda;
+        const double x2 = lambda * lambda;
+        const double b = (x2 + c2) * lambda;
+        const double a = b + c1;
+        const double denom = 2.0 * x2 * lambda + b + a;
+        if (denom == 0.0)
+            break;
+        lambda -= (a * lambda + c0) / denom;
+        if (std::fabs(lambda - old) < std::fabs(1e-11 * lambda))
+            break;
+    }
+
+    // Eigenvector is any non-vanishing column of the adjoint of (K - lambda I)
+    const double a11 = sxxpsyy + szz - lambda, a12 = syzmszy, a13 = -sxzmszx, a14 = sxymsyx;
+    const double a21 = syzmszy, a22 = sxxmsyy - szz - lambda, a23 = sxypsyx, a24 = sxzpszx;
+    const double a31 = a13, a32 = a23, a33 = syy - sxx - szz - lambda, a34 = syzpszy;
+    const double a41 = a14, a42 = a24, a43 = a34, a44 = szz - sxxpsyy - lambda;
+
+    const double a3344_4334 = a33 * a44 - a43 * a34, a3244_4234 = a32 * a44 - a42 * a34;
+    const double a3243_4233 = a32 * a43 - a42 * a33, a3143_4133 = a31 * a43 - a41 * a33;
+    const double a3144_4134 = a31 * a44 - a41 * a34, a3142_4132 = a31 * a42 - a41 * a32;
+    const double a1324_1423 = a13 * a24 - a14 * a23, a1224_1422 = a12 * a24 - a14 * a22;
+    const double a1223_1322 = a12 * a23 - a13 * a22, a1124_1421 = a11 * a24 - a14 * a21;
+    const double a1123_1321 = a11 * a23 - a13 * a21, a1122_1221 = a11 * a22 - a12 * a21;
+
+    const double columns[4][4] = {
+        {a22 * a3344_4334 - a23 * a3244_4234 + a24 * a3243_4233,
+            -a21 * a3344_4334 + a23 * a3144_4134 - a24 * a3143_4133,
+            a21 * a3244_4234 - a22 * a3144_4134 + a24 * a3142_4132,
+            -a21 * a3243_4233 + a22 * a3143_4133 - a23 * a3142_4132},
+        {a12 * a3344_4334 - a13 * a3244_4234 + a14 * a3243_4233,
+            -a11 * a3344_4334 + a13 * a3144_4134 - a14 * a3143_4133,
+            a11 * a3244_4234 - a12 * a3144_4134 + a14 * a3142_4132,
+            -a11 * a3243_4233 + a12 * a3143_4133 - a13 * a3142_4132},
+        {a42 * a1324_1423 - a43 * a1224_1422 + a44 * a1223_1322,
+            -a41 * a1324_1423 + a43 * a1124_1421 - a44 * a1123_1321,
+            a41 * a1224_1422 - a42 * a1124_1421 + a44 * a1122_1221,
+            -a41 * a1223_1322 + a42 * a1123_1321 - a43 * a1122_1221},
+        {a32 * a1324_1423 - a33 * a1224_1422 + a34 * a1223_1322,
+            -a31 * a1324_1423 + a33 * a1124_1421 - a34 * a1123_1321,
+            a31 * a1224_1422 - a32 * a1124_1421 + a34 * a1122_1221,
+            -a31 * a1223_1322 + a32 * a1123_1321 - a33 * a1122_1221}
+    };
+
+    double q[4];
+    int c = 0;
+    for (; c < 4; ++c) {
+        const double *v = columns[c];
+        const double qsqr = v[0] * v[0] + v[1] * v[1] + v[2] * v[2] + v[3] * v[3];
+        if (qsqr >= 1e-6) {
+            const double inv = 1.0 / std::sqrt(qsqr);
+            for (int k = 0; k < 4; ++k)
+                q[k] = v[k] * inv;
+            break;
+        }
+    }
+    if (c == 4) {
+        // Degenerate largest eigenvalue (e.g. collinear structures): any vector of its eigenspace is optimal.
+        // Newton's iterations converge slowly to a multiple root, so the eigenvalue is taken from here as well.
+        const double key[16] = {a11 + lambda, a12, a13, a14, a21, a22 + lambda, a23, a24,
+            a31, a32, a33 + lambda, a34, a41, a42, a43, a44 + lambda};
+        lambda = key_eigenvector(key, q);
+    }
+    if (!rot)
+        return lambda * norm;
+
+    const double a2 = q[0] * q[0], x2 = q[1] * q[1], y2 = q[2] * q[2], z2 = q[3] * q[3];
+    const double xy = q[1] * q[2], az = q[0] * q[3], zx = q[3] * q[1];
+    const double ay = q[0] * q[2], yz = q[2] * q[3], ax = q[0] * q[1];
+    rot[0] = a2 + x2 - y2 - z2;
+    rot[1] = 2.0 * (xy + az);
+    rot[2] = 2.0 * (zx - ay);
+    rot[3] = 2.0 * (xy - az);
+    rot[4] = a2 - x2 + y2 - z2;
+    rot[5] = 2.0 * (yz + ax);
+    rot[6] = 2.0 * (zx + ay);
+    rot[7] = 2.0 * (yz - ax);
+    rot[8] = a2 - x2 - y2 + z2;
+    return lambda * norm;
+}
+
+/*!
+ * \brief Superposition of \e a onto \e b. Rotation and translation are stored only if \e transform is not null.
+ * @return RMSD after the fit
+ */
+template <typename T>
+T superpose(const vector3_soa<const T> &a, const vector3_soa<const T> &b, T *transform) {
+    const size_t n = a.size;
+    T center[6];
+    superposition_centroid<simd_pack<T> >(a, b, center);
+    for (int k = 0; k < 6; ++k)
+        center[k] = n ? center[k] / static_cast<T>(n) : T(0);
+
+    T sum[11];
+    superposition_covariance<simd_pack<T> >(a, b, center, sum);
+
+    double m[9];
+    for (int k = 0; k < 9; ++k)
+        m[k] = sum[k];
+    const double e0 = 0.5 * (static_cast<double>(sum[9]) + sum[10]);
+    double rot[9];
+    const double lambda = qcp_solve(m, e0, transform ? rot : 0);
+
+    if (transform) {
+        for (int r = 0; r < 3; ++r) {
+            T *row = transform + 4 * r;
+            row[0] = static_cast<T>(rot[3 * r]);
+            row[1] = static_cast<T>(rot[3 * r + 1]);
+            row[2] = static_cast<T>(rot[3 * r + 2]);
+            row[3] = static_cast<T>(center[3 + r]
+                - (rot[3 * r] * center[0] + rot[3 * r + 1] * center[1] + rot[3 * r + 2] * center[2]));
+        }
+    }
+    return n ? static_cast<T>(std::sqrt(std::fabs(2.0 * (e0 - lambda) / n))) : T(0);
+}
+
+} // namespace vectors_internal
+
+/*!
+ * \brief Finds rotation and translation which minimize RMSD between corresponding points of two sets
+ * @param mobile Points to be moved
+ * @param target Reference points, same number as \e mobile
+ * @return Transform [R | t] (directly usable with batch_transform()) and the minimal RMSD
+ */
+template <typename U, typename V>
+superposition<typename std::remove_const<U>::type> superpose(const vector3_soa<U> &mobile,
+        const vector3_soa<V> &target) {
+    typedef typename std::remove_const<U>::type T;
+    VECTORS_PROFILE("superpose", mobile.size);
+    superposition<T> result;
+    result.rmsd = vectors_internal::superpose(vector3_soa<const T>(mobile), vector3_soa<const T>(target),
+        result.transform);
+    return result;
+}
+
+/*!
+ * \brief Minimal RMSD between corresponding points of two sets after optimal superposition. Cheaper than
+ * superpose() since the rotation is not constructed.
+ * @param a First set of points
+ * @param b Second set of points, same number as \e a
+ */
+template <typename U, typename V>
+typename std::remove_const<U>::type superposition_rmsd(const vector3_soa<U> &a, const vector3_soa<V> &b) {
+    typedef typename std::remove_const<U>::type T;
+    VECTORS_PROFILE("superposition_rmsd", a.size);
+    return vectors_internal::superpose(vector3_soa<const T>(a), vector3_soa<const T>(b), static_cast<T *>(0));
+}
+
+/*!
+ * \brief Superposition of many structures of equal size, processed in parallel
+ * @param mobile Points of all mobile structures, one after another
+ * @param target Points of all target structures, one after another
+ * @param structure_size Number of points in every structure
+ * @param out Output array of mobile.size / structure_size results
+ */
+template <typename T>
+void superpose_batch(typename vector3_soa_in<T>::type mobile, typename vector3_soa_in<T>::type target,
+        size_t structure_size, superposition<T> *out) {
+    VECTORS_PROFILE("superpose_batch", mobile.size);
+    const ptrdiff_t count = structure_size ? mobile.size / structure_size : 0;
+
+    VECTORS_OMP(parallel for schedule(static) if(count > 64))
+    for (ptrdiff_t s = 0; s < count; ++s)
+        out[s].rmsd = vectors_internal::superpose(mobile.sub(s * structure_size, structure_size),
+            target.sub(s * structure_size, structure_size), out[s].transform);
+}
+
+/*!
+ * \brief RMSD after optimal superposition for many structures of equal size, processed in parallel
+ * @param a Points of all first structures, one after another
+ * @param b Points of all second structures, one after another
+ * @param structure_size Number of points in every structure
+ * @param rmsd Output array of a.size / structure_size values
+ */
+template <typename T>
+void superposition_rmsd_batch(typename vector3_soa_in<T>::type a, typename vector3_soa_in<T>::type b,
+        size_t structure_size, T *rmsd) {
+    VECTORS_PROFILE("superposition_rmsd_batch", a.size);
+    const ptrdiff_t count = structure_size ? a.size / structure_size : 0;
+
+    VECTORS_OMP(parallel for schedule(static) if(count > 64))
+    for (ptrdiff_t s = 0; s < count; ++s)
+        rmsd[s] = vectors_internal::superpose(a.sub(s * structure_size, structure_size),
+            b.sub(s * structure_size, structure_size), static_cast<T *>(0));
+}
+
+#endif /* VECTORSSUPERPOSE_H_ */
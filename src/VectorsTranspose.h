@@ -0,0 +1,474 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTORSTRANSPOSE_H_
+#define VECTORSTRANSPOSE_H_
+
+#include <vector>
+#include "VectorsInternal.h"
+#include "VectorsProfiler.h"
+#include "Vector3_soa.h"
+
+/*
+ * Conversion between packed xyz triples (array of structures, e.g. float[3] or double[3] elements) and
+ * structure of arrays. A block of vectors is read with three full-width loads and transposed in registers
+ * with shuffles, so every byte is loaded and stored exactly once. When the output is larger than
+ * VECTORS_STREAM_BYTES it is written with non-temporal stores to avoid evicting the input from cache.
+ *
+ * Note that vector3_reg objects are padded and aligned, so arrays of vector3_reg are not packed triples;
+ * use gather_soa() with a stride of sizeof(vector3_reg) for them.
+ */
+
+#ifndef VECTORS_STREAM_BYTES
+#define VECTORS_STREAM_BYTES (8u << 20)
+#endif
+
+namespace vectors_internal {
+
+/*!
+ * \class scalar_transpose3
+ * \brief Transposition of a single vector, used for tails and as a fallback
+ */
+template <typename T>
+struct scalar_transpose3 {
+    typedef T reg;
+    enum { width = 1, alignment = sizeof(T) };
+
+    static MUSTINLINE reg load(const T *p) { return *p; }
+    static MUSTINLINE void store(T *p, reg a) { *p = a; }
+    static MUSTINLINE void stream(T *p, reg a) { *p = a; }
+
+    static MUSTINLINE void load_aos(const T *p, reg *v) {
+        v[0] = p[0];
+        v[1] = p[1];
+        v[2] = p[2];
+    }
+
+    static MUSTINLINE void store_aos(T *p, const reg *v) {
+        p[0] = v[0];
+        p[1] = v[1];
+        p[2] = v[2];
+    }
+
+    static MUSTINLINE void stream_aos(T *p, const reg *v) { store_aos(p, v); }
+    static MUSTINLINE void fence() { }
+};
+
+/*!
+ * \class transpose3
+ * \brief Widest in-register transposition of \e width packed vectors into three coordinate registers and back.
+ * Stream functions require pointers aligned to \e alignment bytes.
+ */
+template <typename T>
+struct transpose3 : scalar_transpose3<T> { };
+
+#if defined(__AVX__)
+template <>
+struct transpose3<float> {
+    typedef __m256 reg;
+    enum { width = 8, alignment = 32 };
+
+    static MUSTINLINE reg load(const float *p) { return _mm256_loadu_ps(p); }
+    static MUSTINLINE void store(float *p, reg a) { _mm256_storeu_ps(p, a); }
+    static MUSTINLINE void stream(float *p, reg a) { _mm256_stream_ps(p, a); }
+
+    /*
+     * Lanes 0-3 of every register hold vectors 0-3 and lanes 4-7 hold vectors 4-7, so the 128-bit halves
+     * are transposed with the same shuffles as in the SSE version.
+     */
+    static MUSTINLINE void load_aos(const float *p, reg *v) {
+        const __m256 m0 = _mm256_loadu_ps(p);
+        const __m256 m1 = _mm256_loadu_ps(p + 8);
+        const __m256 m2 = _mm256_loadu_ps(p + 16);
+        const __m256 a = _mm256_permute2f128_ps(m0, m1, 0x30);      // x0 y0 z0 x1 | x4 y4 z4 x5
+        const __m256 b = _mm256_permute2f128_ps(m0, m2, 0x21);      // y1 z1 x2 y2 | y5 z5 x6 y6
+        const __m256 c = _mm256_permute2f128_ps(m1, m2, 0x30);      // z2 x3 y3 z3 | z6 x7 y7 z7
+        const __m256 t0 = _mm256_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2));
+        const __m256 t1 = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 2, 1));
+        v[0] = _mm256_shuffle_ps(a, t0, _MM_SHUFFLE(2, 0, 3, 0));
+        v[1] = _mm256_shuffle_ps(t1, t0, _MM_SHUFFLE(3, 1, 2, 0));
+        v[2] = _mm256_shuffle_ps(t1, c, _MM_SHUFFLE(3, 0, 3, 1));
+    }
+
+    static MUSTINLINE void shuffle_aos(const reg *v, reg *m) {
+        const __m256 xy = _mm256_shuffle_ps(v[0], v[1], _MM_SHUFFLE(2, 0, 2, 0));
+        const __m256 yz = _mm256_shuffle_ps(v[1], v[2], _MM_SHUFFLE(3, 1, 3, 1));
+        const __m256 zx = _mm256_shuffle_ps(v[2], v[0], _MM_SHUFFLE(3, 1, 2, 0));
+        const __m256 a = _mm256_shuffle_ps(xy, zx, _MM_SHUFFLE(2, 0, 2, 0));
+        const __m256 b = _mm256_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0));
+        const __m256 c = _mm256_shuffle_ps(zx, yz, _MM_SHUFFLE(3, 1, 3, 1));
+        m[0] = _mm256_permute2f128_ps(a, b, 0x20);
+        m[1] = _mm256_permute2f128_ps(c, a, 0x30);
+        m[2] = _mm256_permute2f128_ps(b, c, 0x31);
+    }
+
+    static MUSTINLINE void store_aos(float *p, const reg *v) {
+        reg m[3];
+        shuffle_aos(v, m);
+        _mm256_storeu_ps(p, m[0]);
+        _mm256_storeu_ps(p + 8, m[1]);
+        _mm256_storeu_ps(p + 16, m[2]);
+    }
+
+    static MUSTINLINE void stream_aos(float *p, const reg *v) {
+        reg m[3];
+        shuffle_aos(v, m);
+        _mm256_stream_ps(p, m[0]);
+        _mm256_stream_ps(p + 8, m[1]);
+        _mm256_stream_ps(p + 16, m[2]);
+    }
+
+    static MUSTINLINE void fence() { _mm_sfence(); }
+};
+#elif defined(__SSE__)
+template <>
+struct transpose3<float> {
+    typedef __m128 reg;
+    enum { width = 4, alignment = 16 };
+
+    static MUSTINLINE reg load(const float *p) { return _mm_loadu_ps(p); }
+    static MUSTINLINE void store(float *p, reg a) { _mm_storeu_ps(p, a); }
+    static MUSTINLINE void stream(float *p, reg a) { _mm_stream_ps(p, a); }
+
+    static MUSTINLINE void load_aos(const float *p, reg *v) {
+        const __m128 a = _mm_loadu_ps(p);                           // x0 y0 z0 x1
+        const __m128 b = _mm_loadu_ps(p + 4);                       // y1 z1 x2 y2
+        const __m128 c = _mm_loadu_ps(p + 8);                       // z2 x3 y3 z3
+        const __m128 t0 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2));    // x2 y2 x3 y3
+        const __m128 t1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 2, 1));    // y0 z0 y1 z1
+        v[0] = _mm_shuffle_ps(a, t0, _MM_SHUFFLE(2, 0, 3, 0));
+        v[1] = _mm_shuffle_ps(t1, t0, _MM_SHUFFLE(3, 1, 2, 0));
+        v[2] = _mm_shuffle_ps(t1, c, _MM_SHUFFLE(3, 0, 3, 1));
+    }
+
+    static MUSTINLINE void shuffle_aos(const reg *v, reg *m) {
+        const __m128 xy = _mm_shuffle_ps(v[0], v[1], _MM_SHUFFLE(2, 0, 2, 0));     // x0 x2 y0 y2
+        const __m128 yz = _mm_shuffle_ps(v[1], v[2], _MM_SHUFFLE(3, 1, 3, 1));     // y1 y3 z1 z3
+        const __m128 zx = _mm_shuffle_ps(v[2], v[0], _MM_SHUFFLE(3, 1, 2, 0));     // z0 z2 x1 x3
+        m[0] = _mm_shuffle_ps(xy, zx, _MM_SHUFFLE(2, 0, 2, 0));
+        m[1] = _mm_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0));
+        m[2] = _mm_shuffle_ps(zx, yz, _MM_SHUFFLE(3, 1, 3, 1));
+    }
+
+    static MUSTINLINE void store_aos(float *p, const reg *v) {
+        reg m[3];
+        shuffle_aos(v, m);
+        _mm_storeu_ps(p, m[0]);
+        _mm_storeu_ps(p + 4, m[1]);
+        _mm_storeu_ps(p + 8, m[2]);
+    }
+
+    static MUSTINLINE void stream_aos(float *p, const reg *v) {
+        reg m[3];
+        shuffle_aos(v, m);
+        _mm_stream_ps(p, m[0]);
+        _mm_stream_ps(p + 4, m[1]);
+        _mm_stream_ps(p + 8, m[2]);
+    }
+
+    static MUSTINLINE void fence() { _mm_sfence(); }
+};
+#endif
+
+#if defined(__AVX__)
+template <>
+struct transpose3<double> {
+    typedef __m256d reg;
+    enum { width = 4, alignment = 32 };
+
+    static MUSTINLINE reg load(const double *p) { return _mm256_loadu_pd(p); }
+    static MUSTINLINE void store(double *p, reg a) { _mm256_storeu_pd(p, a); }
+    static MUSTINLINE void stream(double *p, reg a) { _mm256_stream_pd(p, a); }
+
+    static MUSTINLINE void load_aos(const double *p, reg *v) {
+        const __m256d a = _mm256_loadu_pd(p);                       // x0 y0 z0 x1
+        const __m256d b = _mm256_loadu_pd(p + 4);                   // y1 z1 x2 y2
+        const __m256d c = _mm256_loadu_pd(p + 8);                   // z2 x3 y3 z3
+        const __m256d r0 = _mm256_permute2f128_pd(a, b, 0x30);      // x0 y0 x2 y2
+        const __m256d r1 = _mm256_permute2f128_pd(a, c, 0x21);      // z0 x1 z2 x3
+        const __m256d r2 = _mm256_permute2f128_pd(b, c, 0x30);      // y1 z1 y3 z3
+        v[0] = _mm256_shuffle_pd(r0, r1, 0xA);
+        v[1] = _mm256_shuffle_pd(r0, r2, 0x5);
+        v[2] = _mm256_shuffle_pd(r1, r2, 0xA);
+    }
+
+    static MUSTINLINE void shuffle_aos(const reg *v, reg *m) {
+        const __m256d r0 = _mm256_shuffle_pd(v[0], v[1], 0x0);     // x0 y0 x2 y2
+        const __m256d r1 = _mm256_shuffle_pd(v[2], v[0], 0xA);     // z0 x1 z2 x3
+        const __m256d r2 = _mm256_shuffle_pd(v[1], v[2], 0xF);     // y1 z1 y3 z3
+        m[0] = _mm256_permute2f128_pd(r0, r1, 0x20);
+        m[1] = _mm256_permute2f128_pd(r2, r0, 0x30);
+        m[2] = _mm256_permute2f128_pd(r1, r2, 0x31);
+    }
+
+    static MUSTINLINE void store_aos(double *p, const reg *v) {
+        reg m[3];
+        shuffle_aos(v, m);
+        _mm256_storeu_pd(p, m[0]);
+        _mm256_storeu_pd(p + 4, m[1]);
+        _mm256_storeu_pd(p + 8, m[2]);
+    }
+
+    static MUSTINLINE void stream_aos(double *p, const reg *v) {
+        reg m[3];
+        shuffle_aos(v, m);
+        _mm256_stream_pd(p, m[0]);
+        _mm256_stream_pd(p + 4, m[1]);
+        _mm256_stream_pd(p + 8, m[2]);
+    }
+
+    static MUSTINLINE void fence() { _mm_sfence(); }
+};
+#elif defined(__SSE2__)
+template <>
+struct transpose3<double> {
+    typedef __m128d reg;
+    enum { width = 2, alignment = 16 };
+
+    static MUSTINLINE reg load(const double *p) { return _mm_loadu_pd(p); }
+    static MUSTINLINE void store(double *p, reg a) { _mm_storeu_pd(p, a); }
+    static MUSTINLINE void stream(double *p, reg a) { _mm_stream_pd(p, a); }
+
+    static MUSTINLINE void load_aos(const double *p, reg *v) {
+        const __m128d a = _mm_loadu_pd(p);                          // x0 y0
+        const __m128d b = _mm_loadu_pd(p + 2);                      // z0 x1
+        const __m128d c = _mm_loadu_pd(p + 4);                      // y1 z1
+        v[0] = _mm_shuffle_pd(a, b, 0x2);
+        v[1] = _mm_shuffle_pd(a, c, 0x1);
+        v[2] = _mm_shuffle_pd(b, c, 0x2);
+    }
+
+    static MUSTINLINE void shuffle_aos(const reg *v, reg *m) {
+        m[0] = _mm_shuffle_pd(v[0], v[1], 0x0);
+        m[1] = _mm_shuffle_pd(v[2], v[0], 0x2);
+        m[2] = _mm_shuffle_pd(v[1], v[2], 0x3);
+    }
+
+    static MUSTINLINE void store_aos(double *p, const reg *v) {
+        reg m[3];
+        shuffle_aos(v, m);
+        _mm_storeu_pd(p, m[0]);
+        _mm_storeu_pd(p + 2, m[1]);
+        _mm_storeu_pd(p + 4, m[2]);
+    }
+
+    static MUSTINLINE void stream_aos(double *p, const reg *v) {
+        reg m[3];
+        shuffle_aos(v, m);
+        _mm_stream_pd(p, m[0]);
+        _mm_stream_pd(p + 2, m[1]);
+        _mm_stream_pd(p + 4, m[2]);
+    }
+
+    static MUSTINLINE void fence() { _mm_sfence(); }
+};
+#endif
+
+template <typename T>
+MUSTINLINE bool is_aligned(const T *p, size_t alignment) {
+    return reinterpret_cast<uintptr_t>(p) % alignment == 0;
+}
+
+template <typename T, bool Stream>
+struct aos_to_soa_kernel {
+    const T *aos;
+    T *x, *y, *z;
+
+    template <typename B>
+    MUSTINLINE void apply(size_t i) const {
+        typename B::reg v[3];
+        B::load_aos(aos + 3 * i, v);
+        if (Stream) {
+            B::stream(x + i, v[0]);
+            B::stream(y + i, v[1]);
+            B::stream(z + i, v[2]);
+        } else {
+            B::store(x + i, v[0]);
+            B::store(y + i, v[1]);
+            B::store(z + i, v[2]);
+        }
+    }
+};
+
+template <typename T, bool Stream>
+struct soa_to_aos_kernel {
+    const T *x, *y, *z;
+    T *aos;
+
+    template <typename B>
+    MUSTINLINE void apply(size_t i) const {
+        typename B::reg v[3] = {B::load(x + i), B::load(y + i), B::load(z + i)};
+        if (Stream)
+            B::stream_aos(aos + 3 * i, v);
+        else
+            B::store_aos(aos + 3 * i, v);
+    }
+};
+
+/*!
+ * \brief Runs transposition kernel over vectors [head, n). Every thread issues a store fence after its
+ * part, so non-temporal stores are globally visible when the function returns.
+ */
+template <typename T, typename Kernel>
+void transpose_for(size_t head, size_t n, const Kernel &kernel) {
+    typedef transpose3<T> B;
+    for (size_t i = 0; i < head; ++i)
+        kernel.template apply<scalar_transpose3<T> >(i);
+
+    const ptrdiff_t nregs = (n - head) / B::width;
+    VECTORS_OMP(parallel if(nregs > 4096))
+    {
+        VECTORS_OMP(for schedule(static))
+        for (ptrdiff_t r = 0; r < nregs; ++r)
+            kernel.template apply<B>(head + r * B::width);
+        B::fence();
+    }
+
+    for (size_t i = head + nregs * B::width; i < n; ++i)
+        kernel.template apply<scalar_transpose3<T> >(i);
+}
+
+/*!
+ * \brief Number of leading vectors to process with scalar code so that all destination pointers become
+ * aligned for non-temporal stores. Returns \e n if streaming should not be used.
+ * @param n Number of vectors
+ * @param planes Destination arrays advancing by one element per vector
+ * @param nplanes Number of destination arrays advancing by one element per vector
+ * @param packed Destination array advancing by three elements per vector, or null
+ */
+template <typename T>
+size_t stream_head(size_t n, T *const *planes, int nplanes, const T *packed) {
+    typedef transpose3<T> B;
+    if (B::width == 1 || 3 * n * sizeof(T) < VECTORS_STREAM_BYTES)
+        return n;
+    for (size_t head = 0; head < B::alignment / sizeof(T); ++head) {
+        bool aligned = !packed || is_aligned(packed + 3 * head, B::alignment);
+        for (int k = 0; k < nplanes; ++k)
+            aligned = aligned && is_aligned(planes[k] + head, B::alignment);
+        if (aligned)
+            return head;
+    }
+    return n;
+}
+
+/*!
+ * \brief In-place permutation of \e n elements: element k moves to position dest(k). Cycles are followed
+ * starting from every element which has not been moved yet.
+ */
+template <typename T, typename Dest>
+void permute_inplace(T *data, size_t n, const Dest &dest) {
+    std::vector<bool> moved(n, false);
+    for (size_t start = 0; start < n; ++start) {
+        if (moved[start])
+            continue;
+        T value = data[start];
+        size_t k = start;
+        do {
+            k = dest(k);
+            const T next = data[k];
+            data[k] = value;
+            value = next;
+            moved[k] = true;
+        } while (k != start);
+    }
+}
+
+struct aos_to_soa_index {
+    size_t n;
+    MUSTINLINE size_t operator() (size_t k) const { return (k % 3) * n + k / 3; }
+};
+
+struct soa_to_aos_index {
+    size_t n;
+    MUSTINLINE size_t operator() (size_t k) const { return 3 * (k % n) + k / n; }
+};
+
+} // namespace vectors_internal
+
+/*!
+ * \brief Converts packed xyz triples into separate coordinate arrays
+ * @param aos Array of 3 * out.size coordinates: x0 y0 z0 x1 y1 z1 ...
+ * @param out Output arrays, should not overlap \e aos
+ */
+template <typename T>
+void aos_to_soa(const T *aos, vector3_soa<T> out) {
+    VECTORS_PROFILE("aos_to_soa", out.size);
+    T *const planes[3] = {out.x, out.y, out.z};
+    const size_t head = vectors_internal::stream_head<T>(out.size, planes, 3, 0);
+    if (head < out.size) {
+        vectors_internal::aos_to_soa_kernel<T, true> k = {aos, out.x, out.y, out.z};
+        vectors_internal::transpose_for<T>(head, out.size, k);
+    } else {
+        vectors_internal::aos_to_soa_kernel<T, false> k = {aos, out.x, out.y, out.z};
+        vectors_internal::transpose_for<T>(0, out.size, k);
+    }
+}
+
+/*!
+ * \brief Converts separate coordinate arrays into packed xyz triples
+ * @param in Input arrays
+ * @param aos Output array of 3 * in.size coordinates, should not overlap \e in
+ */
+template <typename T>
+void soa_to_aos(typename vector3_soa_in<T>::type in, T *aos) {
+    VECTORS_PROFILE("soa_to_aos", in.size);
+    const size_t head = vectors_internal::stream_head<T>(in.size, 0, 0, aos);
+    if (head < in.size) {
+        vectors_internal::soa_to_aos_kernel<T, true> k = {in.x, in.y, in.z, aos};
+        vectors_internal::transpose_for<T>(head, in.size, k);
+    } else {
+        vectors_internal::soa_to_aos_kernel<T, false> k = {in.x, in.y, in.z, aos};
+        vectors_internal::transpose_for<T>(0, in.size, k);
+    }
+}
+
+/*!
+ * \brief Converts packed xyz triples into coordinate arrays in place. Needs only one bit of extra memory per
+ * coordinate but is considerably slower than the out-of-place version.
+ * @param data Array of 3 * n coordinates
+ * @param n Number of vectors
+ * @return View of the result: x, y and z arrays are stored one after another in \e data
+ */
+template <typename T>
+vector3_soa<T> aos_to_soa_inplace(T *data, size_t n) {
+    VECTORS_PROFILE("aos_to_soa_inplace", n);
+    const vectors_internal::aos_to_soa_index dest = {n};
+    vectors_internal::permute_inplace(data, 3 * n, dest);
+    return vector3_soa<T>(data, data + n, data + 2 * n, n);
+}
+
+/*!
+ * \brief Converts coordinate arrays stored one after another (x0 ... xn-1 y0 ... z0 ...) into packed xyz
+ * triples in place
+ * @param data Array of 3 * n coordinates
+ * @param n Number of vectors
+ */
+template <typename T>
+void soa_to_aos_inplace(T *data, size_t n) {
+    VECTORS_PROFILE("soa_to_aos_inplace", n);
+    const vectors_internal::soa_to_aos_index dest = {n};
+    vectors_internal::permute_inplace(data, 3 * n, dest);
+}
+
+#endif /* VECTORSTRANSPOSE_H_ */
@@ -0,0 +1,538 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTORSTRIG_H_
+#define VECTORSTRIG_H_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "VectorsInternal.h"
+#include "VectorsPack.h"
+#include "VectorsProfiler.h"
+#include "Vector3_soa.h"
+
+/*
+ * Vectorized trigonometric functions and conversions between Cartesian, spherical and cylindrical
+ * coordinates. Functions are written once for any register abstraction, so the SIMD and the scalar tail
+ * paths evaluate the same polynomials and agree in reproducible mode.
+ *
+ * sin and cos reduce the argument by multiples of pi / 2 with a four-part Cody-Waite constant and evaluate
+ * the Cephes minimax polynomials on [-pi / 4, pi / 4]. The reduction is exact for |x| < 2^20 pi / 2 in double
+ * and |x| < 2^12 pi / 2 in float; larger finite arguments (rare in practice) are passed to the C library in
+ * double precision element by element, which is slow but identical on every backend. Results are within
+ * 2.5 ulp of the correctly rounded values for all finite arguments and NaN for infinite ones. atan2 reduces
+ * min(|x|, |y|) / max(|x|, |y|) to [-tan(pi / 8), tan(pi / 8)], evaluates the Cephes rational (double) or
+ * polynomial (float) approximation and adds the octant angles in two parts; its error is within 3 ulp, except
+ * that signed zeros are not distinguished. Two infinite operands give odd multiples of pi / 4 and NaN operands
+ * give NaN on every backend. acos(x) is computed as atan2(sqrt((1 - x)(1 + x)), x), within 4 ulp and accurate
+ * near x = +-1 as well, and NaN outside of [-1, 1].
+ */
+
+namespace vectors_internal {
+
+/*!
+ * \brief Polynomial a[0] z^(n - 1) + ... + a[n - 1] by Horner's scheme
+ */
+template <typename P, int N>
+MUSTINLINE typename P::reg horner(typename P::reg z, const typename P::elt_type (&a)[N]) {
+    typename P::reg p = P::set1(a[0]);
+    for (int k = 1; k < N; ++k)
+        p = P::fmadd(p, z, P::set1(a[k]));
+    return p;
+}
+
+template <typename P>
+MUSTINLINE typename P::reg abs_reg(typename P::reg a) {
+    return P::max(a, P::sub(P::zero(), a));
+}
+
+/*!
+ * \brief Constants and kernel polynomials of the trigonometric functions
+ */
+template <typename T>
+struct trig_kernels;
+
+template <>
+struct trig_kernels<double> {
+    /*!
+     * \brief pi / 2 split into parts of 33 bits, so multiples by integers below 2^20 are exact, and a fourth
+     * part of 53 bits
+     */
+    static MUSTINLINE const double *pio2() {
+        static const double c[4] = {1.57079632673412561417e+00, 6.07710050630396597660e-11,
+            2.02226624871116645580e-21, 8.47842766036889956997e-32};
+        return c;
+    }
+
+    /*!
+     * \brief Largest argument reduced with pio2(), below 2^20 pi / 2
+     */
+    static MUSTINLINE double reduction_limit() { return 1.6e6; }
+
+    /*!
+     * \brief pi / 4, pi / 2 and pi as sums of a double and a small correction
+     */
+    static MUSTINLINE const double *angles() {
+        static const double c[6] = {7.85398163397448278999e-1, 3.061616997868383e-17, 1.57079632679489655800,
+            6.123233995736766e-17, 3.14159265358979311600, 1.2246467991473532e-16};
+        return c;
+    }
+
+    template <typename P>
+    static MUSTINLINE typename P::reg sin(typename P::reg r, typename P::reg z) {
+        static const double c[6] = {1.58962301576546568060e-10, -2.50507477628578072866e-8,
+            2.75573136213857245213e-6, -1.98412698295895385996e-4, 8.33333333332211858878e-3,
+            -1.66666666666666307295e-1};
+        return P::fmadd(P::mul(r, z), horner<P>(z, c), r);
+    }
+
+    template <typename P>
+    static MUSTINLINE typename P::reg cos(typename P::reg z) {
+        static const double c[6] = {-1.13585365213876817300e-11, 2.08757008419747316778e-9,
+            -2.75573141792967388112e-7, 2.48015872888517045348e-5, -1.38888888888730564116e-3,
+            4.16666666666665929218e-2};
+        return P::fmadd(P::mul(z, z), horner<P>(z, c), P::fnmadd(P::set1(0.5), z, P::set1(1)));
+    }
+
+    /*!
+     * \brief Arc tangent for |t| <= tan(pi / 8)
+     */
+    template <typename P>
+    static MUSTINLINE typename P::reg atan(typename P::reg t, typename P::reg z) {
+        static const double p[5] = {-8.750608600031904122785e-1, -1.615753718733365076637e1,
+            -7.500855792314704667340e1, -1.228866684490136173410e2, -6.485021904942025371773e1};
+        static const double q[6] = {1, 2.485846490142306297962e1, 1.650270098316988542046e2,
+            4.328810604912902668951e2, 4.853903996359136964868e2, 1.945506571482613964425e2};
+        return P::fmadd(P::mul(t, z), P::div(horner<P>(z, p), horner<P>(z, q)), t);
+    }
+};
+
+template <>
+struct trig_kernels<float> {
+    /*!
+     * \brief pi / 2 split into three parts of at most 12 bits, so multiples by integers below 2^12 are exact,
+     * and a fourth part of 24 bits
+     */
+    static MUSTINLINE const float *pio2() {
+        static const float c[4] = {1.5703125f, 4.837512969970703125e-4f, 7.549533620476723e-8f,
+            2.5633440682570896e-12f};
+        return c;
+    }
+
+    /*!
+     * \brief Largest argument reduced with pio2(), below 2^12 pi / 2
+     */
+    static MUSTINLINE float reduction_limit() { return 6400; }
+
+    /*!
+     * \brief pi / 4, pi / 2 and pi as sums of a float and a small correction
+     */
+    static MUSTINLINE const float *angles() {
+        static const float c[6] = {0.7853981852531433f, -2.1855694143368964e-8f, 1.5707963705062866f,
+            -4.371138828673793e-8f, 3.1415927410125732f, -8.742277657347586e-8f};
+        return c;
+    }
+
+    template <typename P>
+    static MUSTINLINE typename P::reg sin(typename P::reg r, typename P::reg z) {
+        static const float c[3] = {-1.9515295891e-4f, 8.3321608736e-3f, -1.6666654611e-1f};
+        return P::fmadd(P::mul(r, z), horner<P>(z, c), r);
+    }
+
+    template <typename P>
+    static MUSTINLINE typename P::reg cos(typename P::reg z) {
+        static const float c[3] = {2.443315711809948e-5f, -1.388731625493765e-3f, 4.166664568298827e-2f};
+        return P::fmadd(P::mul(z, z), horner<P>(z, c), P::fnmadd(P::set1(0.5f), z, P::set1(1)));
+    }
+
+    template <typename P>
+    static MUSTINLINE typename P::reg atan(typename P::reg t, typename P::reg z) {
+        static const float c[4] = {8.05374449538e-2f, -1.38776856032e-1f, 1.99777106478e-1f,
+            -3.33329491539e-1f};
+        return P::fmadd(P::mul(t, z), horner<P>(z, c), t);
+    }
+};
+
+/*!
+ * \brief Replaces the sine and cosine of the elements beyond trig_kernels::reduction_limit() with those of
+ * the C library
+ */
+template <typename P>
+void sincos_large(typename P::reg x, typename P::reg &s, typename P::reg &c) {
+    typedef typename P::elt_type T;
+    const T limit = trig_kernels<T>::reduction_limit();
+    T bx[P::width], bs[P::width], bc[P::width];
+    P::store(bx, x);
+    P::store(bs, s);
+    P::store(bc, c);
+    for (int l = 0; l < P::width; ++l)
+        if (std::fabs(bx[l]) > limit) {
+            bs[l] = static_cast<T>(std::sin(static_cast<double>(bx[l])));
+            bc[l] = static_cast<T>(std::cos(static_cast<double>(bx[l])));
+        }
+    s = P::load(bs);
+    c = P::load(bc);
+}
+
+/*!
+ * \brief Sine and cosine of every element
+ */
+template <typename P>
+MUSTINLINE void sincos(typename P::reg x, typename P::reg &s, typename P::reg &c) {
+    typedef typename P::elt_type T;
+    typedef typename P::reg reg;
+    typedef trig_kernels<T> K;
+    const T *pio2 = K::pio2();
+
+    // x = k pi / 2 + r with |r| <= pi / 4; q = k mod 4 selects the quadrant
+    const reg k = P::round(P::mul(x, P::set1(T(0.636619772367581343076))));
+    reg r = P::fnmadd(k, P::set1(pio2[0]), x);
+    r = P::fnmadd(k, P::set1(pio2[1]), r);
+    r = P::fnmadd(k, P::set1(pio2[2]), r);
+    r = P::fnmadd(k, P::set1(pio2[3]), r);
+    const reg q = P::fnmadd(P::set1(T(4)), P::floor(P::mul(k, P::set1(T(0.25)))), k);
+
+    const reg z = P::mul(r, r);
+    const reg sr = K::template sin<P>(r, z), cr = K::template cos<P>(z);
+    const typename P::mask odd = P::cmp_gt(P::fnmadd(P::set1(T(2)), P::floor(P::mul(q, P::set1(T(0.5)))), q),
+        P::set1(T(0.5)));
+    s = P::select(odd, cr, sr);
+    c = P::select(odd, sr, cr);
+    s = P::select(P::cmp_gt(q, P::set1(T(1.5))), P::sub(P::zero(), s), s);
+    c = P::select(P::mask_and(P::cmp_gt(q, P::set1(T(0.5))), P::cmp_lt(q, P::set1(T(2.5)))), P::sub(P::zero(), c), c);
+
+    // The residual of larger arguments is not reduced to [-pi / 4, pi / 4] and the polynomials diverge
+    if (P::movemask(P::cmp_gt(abs_reg<P>(x), P::set1(K::reduction_limit()))))
+        sincos_large<P>(x, s, c);
+}
+
+/*!
+ * \brief Angle of the point (x, y) from the positive x axis, in [-pi, pi]
+ */
+template <typename P>
+MUSTINLINE typename P::reg atan2(typename P::reg y, typename P::reg x) {
+    typedef typename P::elt_type T;
+    typedef typename P::reg reg;
+    const reg ax = abs_reg<P>(x), ay = abs_reg<P>(y);
+    const reg hi = P::max(ax, ay), lo = P::min(ax, ay);
+    // Two infinite operands give 1 rather than inf / inf; NaN operands are dealt with at the end
+    reg t = P::select(P::cmp_gt(hi, P::zero()), P::div(lo, hi), P::zero());
+    t = P::select(P::cmp_ge(lo, P::set1(std::numeric_limits<T>::infinity())), P::set1(T(1)), t);
+
+    // atan(t) = pi / 4 + atan((t - 1) / (t + 1)) above tan(pi / 8)
+    const typename P::mask upper = P::cmp_gt(t, P::set1(T(0.414213562373095048802)));
+    const reg u = P::select(upper, P::div(P::sub(t, P::set1(T(1))), P::add(t, P::set1(T(1)))), t);
+    const T *c = trig_kernels<T>::angles();
+    reg a = trig_kernels<T>::template atan<P>(u, P::mul(u, u));
+    a = P::add(P::add(a, P::select(upper, P::set1(c[1]), P::zero())), P::select(upper, P::set1(c[0]), P::zero()));
+
+    // Octant and quadrant corrections, adding the small parts of the constants first
+    a = P::select(P::cmp_gt(ay, ax), P::add(P::sub(P::set1(c[2]), a), P::set1(c[3])), a);
+    a = P::select(P::cmp_lt(x, P::zero()), P::add(P::sub(P::set1(c[4]), a), P::set1(c[5])), a);
+    a = P::select(P::cmp_lt(y, P::zero()), P::sub(P::zero(), a), a);
+
+    // min and max resolve NaN operands differently on every backend, so NaN is restored explicitly
+    const typename P::mask ordered = P::mask_and(P::cmp_le(x, x), P::cmp_le(y, y));
+    return P::select(ordered, a, P::set1(std::numeric_limits<T>::quiet_NaN()));
+}
+
+/*!
+ * \brief Arc cosine of every element, in [0, pi]; NaN outside of [-1, 1], where the square root is NaN
+ */
+template <typename P>
+MUSTINLINE typename P::reg acos(typename P::reg x) {
+    const typename P::reg one = P::set1(typename P::elt_type(1));
+    return atan2<P>(P::sqrt(P::mul(P::sub(one, x), P::add(one, x))), x);
+}
+
+template <typename T>
+struct sincos_kernel {
+    const T *x;
+    T *s, *c;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        typename P::reg vs, vc;
+        sincos<P>(P::load(x + i), vs, vc);
+        P::store(s + i, vs);
+        P::store(c + i, vc);
+    }
+};
+
+template <typename T>
+struct atan2_kernel {
+    const T *y, *x;
+    T *out;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        P::store(out + i, atan2<P>(P::load(y + i), P::load(x + i)));
+    }
+};
+
+template <typename T>
+struct acos_kernel {
+    const T *x;
+    T *out;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        P::store(out + i, acos<P>(P::load(x + i)));
+    }
+};
+
+/*!
+ * \brief Cartesian to spherical (r, polar angle from +z, azimuth) or cylindrical (rho, azimuth, z) coordinates
+ */
+template <typename T, bool Spherical>
+struct from_cartesian_kernel {
+    vector3_soa<const T> in;
+    vector3_soa<T> out;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        typedef typename P::reg reg;
+        const reg x = P::load(in.x + i), y = P::load(in.y + i), z = P::load(in.z + i);
+        const reg rho2 = P::fmadd(y, y, P::mul(x, x));
+        const reg phi = atan2<P>(y, x);
+        if (Spherical) {
+            P::store(out.x + i, P::sqrt(P::fmadd(z, z, rho2)));
+            P::store(out.y + i, atan2<P>(P::sqrt(rho2), z));
+            // The azimuth of a point with a NaN height is NaN as well, like its other spherical coordinates
+            P::store(out.z + i, P::select(P::cmp_le(z, z), phi, z));
+        } else {
+            P::store(out.x + i, P::sqrt(rho2));
+            P::store(out.y + i, phi);
+            P::store(out.z + i, z);
+        }
+    }
+};
+
+/*!
+ * \brief Spherical or cylindrical coordinates to Cartesian ones
+ */
+template <typename T, bool Spherical>
+struct to_cartesian_kernel {
+    vector3_soa<const T> in;
+    vector3_soa<T> out;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        typedef typename P::reg reg;
+        const reg a = P::load(in.x + i), b = P::load(in.y + i), c = P::load(in.z + i);
+        reg sp, cp;
+        if (Spherical) {
+            reg st, ct;
+            sincos<P>(b, st, ct);
+            sincos<P>(c, sp, cp);
+            const reg rho = P::mul(a, st);
+            P::store(out.x + i, P::mul(rho, cp));
+            P::store(out.y + i, P::mul(rho, sp));
+            P::store(out.z + i, P::mul(a, ct));
+        } else {
+            sincos<P>(b, sp, cp);
+            P::store(out.x + i, P::mul(a, cp));
+            P::store(out.y + i, P::mul(a, sp));
+            P::store(out.z + i, c);
+        }
+    }
+};
+
+/*!
+ * \brief Applies a kernel to an array of vector class objects, converted to SoA form in blocks. The \e in and
+ * \e out members of the kernel are set to every block; other members are taken from \e proto.
+ */
+template <typename Kernel, typename V>
+void convert_vectors(const V *in, V *out, size_t n, const Kernel &proto = Kernel()) {
+    typedef typename V::elt_type T;
+    enum { block = 256 };
+    const ptrdiff_t blocks = static_cast<ptrdiff_t>((n + block - 1) / block);
+    VECTORS_OMP(parallel for schedule(static) if(blocks > 64))
+    for (ptrdiff_t b = 0; b < blocks; ++b) {
+        T a[3 * block], c[3 * block];
+        const size_t first = b * static_cast<size_t>(block), m = std::min<size_t>(block, n - first);
+        for (size_t j = 0; j < m; ++j) {
+            a[j] = in[first + j].x;
+            a[block + j] = in[first + j].y;
+            a[2 * block + j] = in[first + j].z;
+        }
+        Kernel k = proto;
+        k.in = vector3_soa<const T>(a, a + block, a + 2 * block, m);
+        k.out = vector3_soa<T>(c, c + block, c + 2 * block, m);
+        for (size_t j = 0; j + simd_pack<T>::width <= m; j += simd_pack<T>::width)
+            k.template apply<simd_pack<T> >(j);
+        for (size_t j = m - m % simd_pack<T>::width; j < m; ++j)
+            k.template apply<scalar_pack<T> >(j);
+        for (size_t j = 0; j < m; ++j)
+            out[first + j] = V(c[j], c[block + j], c[2 * block + j]);
+    }
+}
+
+} // namespace vectors_internal
+
+/*!
+ * \brief Sine and cosine of an array
+ * @param x Input angles
+ * @param s Output sines, may alias \e x
+ * @param c Output cosines
+ * @param n Number of elements
+ */
+template <typename T>
+void batch_sincos(const T *x, T *s, T *c, size_t n) {
+    VECTORS_PROFILE("batch_sincos", n);
+    vectors_internal::sincos_kernel<T> k = {x, s, c};
+    vectors_internal::pack_for<T>(n, k);
+}
+
+/*!
+ * \brief Element-wise atan2(y, x) of two arrays
+ * @param y Input ordinates
+ * @param x Input abscissas
+ * @param out Output angles in [-pi, pi], may alias the inputs
+ * @param n Number of elements
+ */
+template <typename T>
+void batch_atan2(const T *y, const T *x, T *out, size_t n) {
+    VECTORS_PROFILE("batch_atan2", n);
+    vectors_internal::atan2_kernel<T> k = {y, x, out};
+    vectors_internal::pack_for<T>(n, k);
+}
+
+/*!
+ * \brief Arc cosine of an array
+ * @param x Input values in [-1, 1]
+ * @param out Output angles in [0, pi], may alias \e x
+ * @param n Number of elements
+ */
+template <typename T>
+void batch_acos(const T *x, T *out, size_t n) {
+    VECTORS_PROFILE("batch_acos", n);
+    vectors_internal::acos_kernel<T> k = {x, out};
+    vectors_internal::pack_for<T>(n, k);
+}
+
+/*!
+ * \brief Converts Cartesian coordinates to spherical ones
+ * @param in Input points
+ * @param out Output coordinates: radius as x, polar angle from the z axis in [0, pi] as y, azimuth in
+ * [-pi, pi] as z; may coincide with \e in
+ */
+template <typename T>
+void cartesian_to_spherical(typename vector3_soa_in<T>::type in, vector3_soa<T> out) {
+    VECTORS_PROFILE("cartesian_to_spherical", in.size);
+    vectors_internal::from_cartesian_kernel<T, true> k = {in, out};
+    vectors_internal::pack_for<T>(in.size, k);
+}
+
+/*!
+ * \brief Converts spherical coordinates (radius, polar angle, azimuth) to Cartesian ones
+ * @param in Input coordinates, laid out as produced by cartesian_to_spherical()
+ * @param out Output points, may coincide with \e in
+ */
+template <typename T>
+void spherical_to_cartesian(typename vector3_soa_in<T>::type in, vector3_soa<T> out) {
+    VECTORS_PROFILE("spherical_to_cartesian", in.size);
+    vectors_internal::to_cartesian_kernel<T, true> k = {in, out};
+    vectors_internal::pack_for<T>(in.size, k);
+}
+
+/*!
+ * \brief Converts Cartesian coordinates to cylindrical ones
+ * @param in Input points
+ * @param out Output coordinates: distance from the z axis as x, azimuth in [-pi, pi] as y, z as z; may
+ * coincide with \e in
+ */
+template <typename T>
+void cartesian_to_cylindrical(typename vector3_soa_in<T>::type in, vector3_soa<T> out) {
+    VECTORS_PROFILE("cartesian_to_cylindrical", in.size);
+    vectors_internal::from_cartesian_kernel<T, false> k = {in, out};
+    vectors_internal::pack_for<T>(in.size, k);
+}
+
+/*!
+ * \brief Converts cylindrical coordinates (distance from the z axis, azimuth, z) to Cartesian ones
+ * @param in Input coordinates, laid out as produced by cartesian_to_cylindrical()
+ * @param out Output points, may coincide with \e in
+ */
+template <typename T>
+void cylindrical_to_cartesian(typename vector3_soa_in<T>::type in, vector3_soa<T> out) {
+    VECTORS_PROFILE("cylindrical_to_cartesian", in.size);
+    vectors_internal::to_cartesian_kernel<T, false> k = {in, out};
+    vectors_internal::pack_for<T>(in.size, k);
+}
+
+/*!
+ * \brief Converts an array of vector class objects from Cartesian to spherical coordinates, stored as
+ * (radius, polar angle, azimuth) in x, y, z
+ * @param in Input vectors
+ * @param out Output vectors, may coincide with \e in
+ * @param n Number of vectors
+ */
+template <typename V>
+void cartesian_to_spherical(const V *in, V *out, size_t n) {
+    VECTORS_PROFILE("cartesian_to_spherical", n);
+    vectors_internal::convert_vectors<vectors_internal::from_cartesian_kernel<typename V::elt_type, true> >(in, out, n);
+}
+
+/*!
+ * \brief Converts an array of vector class objects from spherical to Cartesian coordinates
+ * @param in Input vectors holding (radius, polar angle, azimuth)
+ * @param out Output vectors, may coincide with \e in
+ * @param n Number of vectors
+ */
+template <typename V>
+void spherical_to_cartesian(const V *in, V *out, size_t n) {
+    VECTORS_PROFILE("spherical_to_cartesian", n);
+    vectors_internal::convert_vectors<vectors_internal::to_cartesian_kernel<typename V::elt_type, true> >(in, out, n);
+}
+
+/*!
+ * \brief Converts an array of vector class objects from Cartesian to cylindrical coordinates, stored as
+ * (distance from the z axis, azimuth, z) in x, y, z
+ * @param in Input vectors
+ * @param out Output vectors, may coincide with \e in
+ * @param n Number of vectors
+ */
+template <typename V>
+void cartesian_to_cylindrical(const V *in, V *out, size_t n) {
+    VECTORS_PROFILE("cartesian_to_cylindrical", n);
+    vectors_internal::convert_vectors<vectors_internal::from_cartesian_kernel<typename V::elt_type, false> >(in, out,
+        n);
+}
+
+/*!
+ * \brief Converts an array of vector class objects from cylindrical to Cartesian coordinates
+ * @param in Input vectors holding (distance from the z axis, azimuth, z)
+ * @param out Output vectors, may coincide with \e in
+ * @param n Number of vectors
+ */
+template <typename V>
+void cylindrical_to_cartesian(const V *in, V *out, size_t n) {
+    VECTORS_PROFILE("cylindrical_to_cartesian", n);
+    vectors_internal::convert_vectors<vectors_internal::to_cartesian_kernel<typename V::elt_type, false> >(in, out,
+        n);
+}
+
+#endif /* VECTORSTRIG_H_ */
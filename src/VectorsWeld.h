@@ -0,0 +1,431 @@
+/* ****************************************************************************** *
+ * MIT License                                                                    *
+ *                                                                                *
+ * Copyright (c) 2018 Maxim Masterov                                              *
+ *                                                                                *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy   *
+ * of this software and associated documentation files (the "Software"), to deal  *
+ * in the Software without restriction, including without limitation the rights   *
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell      *
+ * copies of the Software, and to permit persons to whom the Software is          *
+ * furnished to do so, subject to the following conditions:                       *
+ *                                                                                *
+ * The above copyright notice and this permission notice shall be included in all *
+ * copies or substantial portions of the Software.                                *
+ *                                                                                *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    *
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         *
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  *
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  *
+ * SOFTWARE.                                                                      *
+ * ****************************************************************************** */
+
+#ifndef VECTORSWELD_H_
+#define VECTORSWELD_H_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "VectorsInternal.h"
+#include "VectorsPack.h"
+#include "VectorsProfiler.h"
+#include "Vector3_soa.h"
+#ifdef __SSE4_1__
+#include "Vector3i_simd.h"
+#endif
+
+/*
+ * Hashing of quantized coordinates and welding of (near-)duplicate points. Points are snapped to a lattice with
+ * twice the welding tolerance as cell size, so points closer than the tolerance lie in the same cell or in the
+ * neighbouring cells next to the half of the cell they lie in. Cells are found through an open-addressing hash
+ * table keyed by the lattice point.
+ */
+
+namespace vectors_internal {
+
+/*!
+ * \brief Hash of a lattice point, equal to vector3i_simd::hash()
+ */
+MUSTINLINE uint32_t lattice_hash(int32_t x, int32_t y, int32_t z) {
+    uint32_t h = (static_cast<uint32_t>(x) * 73856093u) ^ (static_cast<uint32_t>(y) * 19349663u) ^
+        (static_cast<uint32_t>(z) * 83492791u);
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    return h ^ (h >> 16);
+}
+
+/*!
+ * \brief Lattice coordinate of a scaled coordinate: rounded down, INT32_MIN outside of the int32_t range (as
+ * returned by the SSE/AVX conversion instructions)
+ */
+template <typename T>
+MUSTINLINE int32_t lattice_coordinate(T v) {
+    const T f = std::floor(v);
+    return f >= T(-2147483648.0) && f < T(2147483648.0) ? static_cast<int32_t>(f) : INT32_MIN;
+}
+
+/*!
+ * \brief Lattice cells of \e P::width points starting at \e i, their hashes and the halves of the cells the points
+ * lie in. Coordinates are scaled by \e inv to twice the lattice resolution, so the cell is the scaled coordinate
+ * divided by two and its lowest bit tells the half (bit k of \e side for axis k).
+ */
+template <typename P>
+struct lattice_cells {
+    typedef typename P::elt_type T;
+
+    static MUSTINLINE void apply(const vector3_soa<const T> &p, T inv, size_t i, int32_t *const *cell,
+            uint32_t *hash, int32_t *side) {
+        for (int l = 0; l < P::width; ++l) {
+            const int32_t x = lattice_coordinate(p.x[i + l] * inv);
+            const int32_t y = lattice_coordinate(p.y[i + l] * inv);
+            const int32_t z = lattice_coordinate(p.z[i + l] * inv);
+            cell[0][i + l] = x >> 1;
+            cell[1][i + l] = y >> 1;
+            cell[2][i + l] = z >> 1;
+            hash[i + l] = lattice_hash(x >> 1, y >> 1, z >> 1);
+            side[i + l] = (x & 1) | (y & 1) << 1 | (z & 1) << 2;
+        }
+    }
+};
+
+#ifdef __AVX2__
+/*!
+ * \brief lattice_hash() of eight lattice points
+ */
+MUSTINLINE __m256i lattice_hash(__m256i x, __m256i y, __m256i z) {
+    __m256i h = _mm256_xor_si256(_mm256_xor_si256(_mm256_mullo_epi32(x, _mm256_set1_epi32(73856093)),
+        _mm256_mullo_epi32(y, _mm256_set1_epi32(19349663))), _mm256_mullo_epi32(z, _mm256_set1_epi32(83492791)));
+    const __m256i m1 = _mm256_set1_epi32(static_cast<int>(0x85ebca6bu));
+    const __m256i m2 = _mm256_set1_epi32(static_cast<int>(0xc2b2ae35u));
+    h = _mm256_mullo_epi32(_mm256_xor_si256(h, _mm256_srli_epi32(h, 16)), m1);
+    h = _mm256_mullo_epi32(_mm256_xor_si256(h, _mm256_srli_epi32(h, 13)), m2);
+    return _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+}
+
+/*!
+ * \brief Stores cells, hashes and halves of eight points computed from coordinates at twice the resolution
+ */
+MUSTINLINE void store_lattice_cells(__m256i x, __m256i y, __m256i z, size_t i, int32_t *const *cell,
+        uint32_t *hash, int32_t *side, int count) {
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i bits = _mm256_or_si256(_mm256_and_si256(x, one), _mm256_or_si256(
+        _mm256_slli_epi32(_mm256_and_si256(y, one), 1), _mm256_slli_epi32(_mm256_and_si256(z, one), 2)));
+    x = _mm256_srai_epi32(x, 1);
+    y = _mm256_srai_epi32(y, 1);
+    z = _mm256_srai_epi32(z, 1);
+    const __m256i h = lattice_hash(x, y, z);
+    if (count == 8) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(cell[0] + i), x);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(cell[1] + i), y);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(cell[2] + i), z);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(hash + i), h);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(side + i), bits);
+    } else {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(cell[0] + i), _mm256_castsi256_si128(x));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(cell[1] + i), _mm256_castsi256_si128(y));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(cell[2] + i), _mm256_castsi256_si128(z));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(hash + i), _mm256_castsi256_si128(h));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(side + i), _mm256_castsi256_si128(bits));
+    }
+}
+
+template <>
+struct lattice_cells<simd_pack<float> > {
+    static MUSTINLINE void apply(const vector3_soa<const float> &p, float inv, size_t i, int32_t *const *cell,
+            uint32_t *hash, int32_t *side) {
+        typedef simd_pack<float> P;
+        const __m256 s = P::set1(inv);
+        store_lattice_cells(_mm256_cvttps_epi32(P::floor(P::mul(P::load(p.x + i), s))),
+            _mm256_cvttps_epi32(P::floor(P::mul(P::load(p.y + i), s))),
+            _mm256_cvttps_epi32(P::floor(P::mul(P::load(p.z + i), s))), i, cell, hash, side, 8);
+    }
+};
+
+template <>
+struct lattice_cells<simd_pack<double> > {
+    static MUSTINLINE void apply(const vector3_soa<const double> &p, double inv, size_t i, int32_t *const *cell,
+            uint32_t *hash, int32_t *side) {
+        typedef simd_pack<double> P;
+        const __m256d s = P::set1(inv);
+        store_lattice_cells(_mm256_castsi128_si256(_mm256_cvttpd_epi32(P::floor(P::mul(P::load(p.x + i), s)))),
+            _mm256_castsi128_si256(_mm256_cvttpd_epi32(P::floor(P::mul(P::load(p.y + i), s)))),
+            _mm256_castsi128_si256(_mm256_cvttpd_epi32(P::floor(P::mul(P::load(p.z + i), s)))), i, cell, hash,
+            side, 4);
+    }
+};
+#endif
+
+template <typename T>
+struct lattice_cells_kernel {
+    vector3_soa<const T> p;
+    T inv;
+    int32_t *cell[3];
+    uint32_t *hash;
+    int32_t *side;
+
+    template <typename P>
+    MUSTINLINE void apply(size_t i) const {
+        lattice_cells<P>::apply(p, inv, i, cell, hash, side);
+    }
+};
+
+/*!
+ * \class lattice_table
+ * \brief Occupied cells of a point set, numbered in the order of their first points, with the points of every
+ * cell listed in increasing order. Cells are found through an open-addressing hash table with linear probing;
+ * slots store the lattice coordinates, so a probe does not leave the table, and a bitmap of the home slots of
+ * the cells rejects most lookups of empty cells without touching it.
+ */
+class lattice_table {
+public:
+    /*!
+     * \brief Constructor
+     * @param cell Lattice coordinates of points
+     * @param hash Hashes of the lattice coordinates
+     * @param n Number of points
+     */
+    lattice_table(const int32_t *const *cell, const uint32_t *hash, size_t n) : point(n) {
+        // Points usually share cells, so the table starts small and grows with the number of cells
+        resize(64);
+        std::vector<uint32_t> index(n);
+        offset.push_back(0);
+        for (size_t i = 0; i < n; ++i) {
+            const int32_t x = cell[0][i], y = cell[1][i], z = cell[2][i];
+            size_t s = hash[i] & mask;
+            while (slot[s].cell >= 0 && !slot[s].is(x, y, z))
+                s = (s + 1) & mask;
+            if (slot[s].cell >= 0) {
+                index[i] = static_cast<uint32_t>(slot[s].cell);
+            } else {
+                const slot_entry e = {{x, y, z}, static_cast<int32_t>(cells.size())};
+                index[i] = static_cast<uint32_t>(cells.size());
+                slot[s] = e;
+                cells.push_back(e);
+                offset.push_back(0);
+                home[(hash[i] & mask) / 64] |= uint64_t(1) << (hash[i] & 63);
+                if (2 * cells.size() > slot.size())
+                    resize(2 * slot.size());
+            }
+            ++offset[index[i] + 1];
+        }
+        for (size_t c = 0; c < cells.size(); ++c)
+            offset[c + 1] += offset[c];
+        std::vector<uint32_t> fill(offset.begin(), offset.end() - 1);
+        for (size_t i = 0; i < n; ++i)
+            point[fill[index[i]]++] = static_cast<uint32_t>(i);
+    }
+
+    size_t cell_count() const { return cells.size(); }
+
+    /*!
+     * \brief Finds a cell
+     * @return Cell number, or -1 if no point lies in the cell
+     */
+    ptrdiff_t find(int32_t x, int32_t y, int32_t z) const {
+        const uint32_t h = lattice_hash(x, y, z);
+        if (!(home[(h & mask) / 64] >> (h & 63) & 1))
+            return -1;
+        for (size_t s = h & mask; slot[s].cell >= 0; s = (s + 1) & mask)
+            if (slot[s].is(x, y, z))
+                return slot[s].cell;
+        return -1;
+    }
+
+    /*!
+     * \brief Lattice coordinates of cell \e c
+     */
+    const int32_t *coordinates(size_t c) const { return cells[c].c; }
+
+    /*!
+     * \brief Points of cell c are points()[offsets()[c]] ... points()[offsets()[c + 1] - 1]
+     */
+    const uint32_t *offsets() const { return &offset[0]; }
+    const uint32_t *points() const { return point.empty() ? 0 : &point[0]; }
+
+private:
+    struct slot_entry {
+        int32_t c[3];
+        int32_t cell;
+
+        MUSTINLINE bool is(int32_t x, int32_t y, int32_t z) const { return c[0] == x && c[1] == y && c[2] == z; }
+    };
+
+    /*!
+     * \brief Rehashes the cells into \e capacity slots, a power of two not below 64
+     */
+    void resize(size_t capacity) {
+        const slot_entry empty = {{0, 0, 0}, -1};
+        mask = capacity - 1;
+        slot.assign(capacity, empty);
+        home.assign(capacity / 64, 0);
+        for (size_t c = 0; c < cells.size(); ++c) {
+            const uint32_t h = lattice_hash(cells[c].c[0], cells[c].c[1], cells[c].c[2]);
+            size_t s = h & mask;
+            while (slot[s].cell >= 0)
+                s = (s + 1) & mask;
+            slot[s] = cells[c];
+            home[(h & mask) / 64] |= uint64_t(1) << (h & 63);
+        }
+    }
+
+    size_t mask;                    //!< Number of slots minus one
+    std::vector<slot_entry> slot;   //!< Cells of slots, with negative cell numbers in empty slots
+    std::vector<uint64_t> home;     //!< Bitmap of slots where the probing of some cell starts
+    std::vector<slot_entry> cells;  //!< Lattice coordinates of cells
+    std::vector<uint32_t> offset;   //!< Start of the point list of every cell, plus the total length
+    std::vector<uint32_t> point;    //!< Concatenated point lists
+};
+
+} // namespace vectors_internal
+
+/*!
+ * \brief Hash of the lattice cell containing a point, for any of the floating point vector classes. Points in
+ * the same cell of size \e cell have equal hashes, and the hash equals vector3i_simd::floor(v / cell).hash().
+ * @param v Point
+ * @param cell Cell size
+ * @return 32-bit hash value
+ */
+template <typename V>
+MUSTINLINE uint32_t quantized_hash(const V &v, typename V::elt_type cell) {
+    typedef typename V::elt_type T;
+    const T inv = T(1) / cell;
+    return vectors_internal::lattice_hash(vectors_internal::lattice_coordinate(v.x * inv),
+        vectors_internal::lattice_coordinate(v.y * inv), vectors_internal::lattice_coordinate(v.z * inv));
+}
+
+#ifdef __SSE4_1__
+MUSTINLINE uint32_t quantized_hash(const vector3f_simd &v, float cell) {
+    return vector3i_simd::floor(v * (1.f / cell)).hash();
+}
+#endif
+
+#ifdef __AVX2__
+MUSTINLINE uint32_t quantized_hash(const vector3d_simd &v, double cell) {
+    return vector3i_simd::floor(v * (1. / cell)).hash();
+}
+#endif
+
+/*!
+ * \brief Welds points closer than the tolerance. Every point is mapped to the first point (in input order)
+ * within \e tolerance; chains of such points are merged, so welded points may end up farther apart than the
+ * tolerance. With zero tolerance only exact duplicates are merged, infinite coordinates included; points with
+ * NaN coordinates are never merged.
+ *
+ * Points are binned into cells twice as large as the tolerance, so the neighbours of a point lie in the 2x2x2
+ * block of cells on the side of the half-cell it lies in. Cells are computed and hashed with SIMD, cells are
+ * processed in parallel and the result does not depend on the number of threads. Coordinates divided by the
+ * tolerance should be below 2^30 in magnitude.
+ * @param points Input points
+ * @param tolerance Welding distance, non-negative
+ * @param remap Output array of points.size indices of welded points: point i becomes unique point remap[i]
+ * @param unique Optional output array of welded points, i.e. the first point of every group, in input order;
+ * should have room for points.size vectors
+ * @return Number of welded (unique) points
+ */
+template <typename T>
+size_t weld_points(typename vector3_soa_in<T>::type points, T tolerance, uint32_t *remap,
+        vector3_soa<T> unique = vector3_soa<T>()) {
+    VECTORS_PROFILE("weld_points", points.size);
+    const size_t n = points.size;
+    const bool exact = !(tolerance > T(0));
+    if (!n)
+        return 0;
+
+    // Exact duplicates share a cell of any size; pick one that keeps lattice coordinates small
+    T size = 2 * tolerance;
+    if (exact) {
+        T extent = 0;
+        for (size_t i = 0; i < n; ++i)
+            extent = std::max(extent, std::max(std::fabs(points.x[i]), std::max(std::fabs(points.y[i]),
+                std::fabs(points.z[i]))));
+        size = extent > T(0) && extent < std::numeric_limits<T>::infinity() ? extent / T(1 << 20) : T(1);
+    }
+
+    std::vector<int32_t> lattice(4 * n);
+    std::vector<uint32_t> hash(n);
+    int32_t *const cell[3] = {&lattice[0], &lattice[n], &lattice[2 * n]};
+    int32_t *const side = &lattice[3 * n];
+    vectors_internal::lattice_cells_kernel<T> k = {points, T(2) / size, {cell[0], cell[1], cell[2]}, &hash[0],
+        side};
+    vectors_internal::pack_for<T>(n, k);
+    const vectors_internal::lattice_table table(cell, &hash[0], n);
+    const uint32_t *offset = table.offsets();
+    const uint32_t *member = table.points();
+
+    // Coordinates and halves in the order of the point lists, so the points of a cell are read from contiguous
+    // memory
+    std::vector<T> sorted(3 * n);
+    std::vector<int32_t> half(n);
+    T *const sx = &sorted[0], *const sy = sx + n, *const sz = sy + n;
+    VECTORS_OMP(parallel for if(n > 16384))
+    for (ptrdiff_t a = 0; a < static_cast<ptrdiff_t>(n); ++a) {
+        sx[a] = points.x[member[a]];
+        sy[a] = points.y[member[a]];
+        sz[a] = points.z[member[a]];
+        half[a] = side[member[a]];
+    }
+
+    // Lowest index within the tolerance: points of a cell are sorted, so the first match in a cell is its best.
+    // Neighbouring cells are looked up once per cell, when the first point needs them.
+    std::vector<uint32_t> first(n);
+    const T tol2 = tolerance * tolerance;
+    VECTORS_OMP(parallel for schedule(dynamic, 256) if(n > 16384))
+    for (ptrdiff_t g = 0; g < static_cast<ptrdiff_t>(table.cell_count()); ++g) {
+        ptrdiff_t neighbor[27];
+        for (int q = 0; q < 27; ++q)
+            neighbor[q] = -2;
+        neighbor[13] = g;
+        for (uint32_t a = offset[g]; a < offset[g + 1]; ++a) {
+            const uint32_t i = member[a];
+            const T x = sx[a], y = sy[a], z = sz[a];
+            uint32_t best = i;
+            for (int corner = 0; corner < (exact ? 1 : 8); ++corner) {
+                // Offset towards the half of the cell the point lies in along the axes selected by corner
+                int q = 13;
+                for (int d = 0, step = 1; d < 3; ++d, step *= 3)
+                    if (corner >> d & 1)
+                        q += half[a] >> d & 1 ? step : -step;
+                if (neighbor[q] == -2) {
+                    const int32_t *c = table.coordinates(g);
+                    // Offsets wrap around at the ends of the int32_t range like the SIMD arithmetic does
+                    neighbor[q] = table.find(static_cast<int32_t>(c[0] + static_cast<uint32_t>(q % 3 - 1)),
+                        static_cast<int32_t>(c[1] + static_cast<uint32_t>(q / 3 % 3 - 1)),
+                        static_cast<int32_t>(c[2] + static_cast<uint32_t>(q / 9 - 1)));
+                }
+                if (neighbor[q] < 0)
+                    continue;
+                for (uint32_t m = offset[neighbor[q]]; m < offset[neighbor[q] + 1] && member[m] < best; ++m) {
+                    // Exact duplicates are compared directly: differences of infinite coordinates are NaN
+                    const T ex = sx[m] - x, ey = sy[m] - y, ez = sz[m] - z;
+                    if (exact ? sx[m] == x && sy[m] == y && sz[m] == z : ex * ex + ey * ey + ez * ez <= tol2) {
+                        best = member[m];
+                        break;
+                    }
+                }
+            }
+            first[i] = best;
+        }
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (first[i] != i) {
+            remap[i] = remap[first[i]];
+            continue;
+        }
+        if (unique.x) {
+            unique.x[count] = points.x[i];
+            unique.y[count] = points.y[i];
+            unique.z[count] = points.z[i];
+        }
+        remap[i] = static_cast<uint32_t>(count++);
+    }
+    return count;
+}
+
+#endif /* VECTORSWELD_H_ */